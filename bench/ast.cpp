@@ -0,0 +1,70 @@
+#include "whiley/ast.hpp"
+#include "whiley/parser.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+
+#include <sys/resource.h>
+
+/*
+ * Measures construction and teardown of a straight-line program of
+ * N statements 'x = x + 1;' (four nodes each, plus the enclosing block),
+ * once through ASTBuilder directly and once through the full parser.
+ */
+
+static long peakRSS () {
+  struct rusage usage;
+  getrusage (RUSAGE_SELF,&usage);
+  return usage.ru_maxrss;
+}
+
+template<class F>
+static double timeit (F&& f) {
+  auto start = std::chrono::steady_clock::now ();
+  f ();
+  auto stop = std::chrono::steady_clock::now ();
+  return std::chrono::duration<double,std::milli> (stop-start).count ();
+}
+
+int main (int argc, char** argv) {
+  std::size_t statements = argc > 1 ? std::strtoull (argv[1],nullptr,10) : 200000;
+  std::size_t nodes = statements * 4 + 1;
+
+  std::size_t arenaBytes = 0;
+  double build = timeit ([&]() {
+    Whiley::ASTBuilder builder;
+    auto x = builder.getInterner ().intern ("x");
+    Whiley::location_t loc;
+    builder.DeclareStmt (x,Whiley::Type::SI64,false,false,loc);
+    for (std::size_t i = 0; i < statements; ++i) {
+      builder.IdentifierExpr (x,loc);
+      builder.NumberExpr (1,loc);
+      builder.BinaryExpr (Whiley::BinOps::Add,loc);
+      builder.AssignStmt (x,loc);
+    }
+    builder.BlockStmt (statements,loc);
+    auto prgm = builder.get ();
+    arenaBytes = prgm.getArena ().bytesAllocated ();
+  });
+
+  std::stringstream str;
+  str << "si64 x;\n";
+  for (std::size_t i = 0; i < statements; ++i)
+    str << "x = x + 1;\n";
+  auto source = str.str ();
+
+  double parse = timeit ([&]() {
+    Whiley::WParser parser;
+    if (!parser.parse (std::span<const char> (source.data(),source.size())))
+      std::cerr << "parse failed" << std::endl;
+  });
+
+  std::cout << "phase,nodes,ms,ns_per_node\n";
+  std::cout << "build," << nodes << "," << build << "," << build * 1e6 / nodes << "\n";
+  std::cout << "parse," << nodes << "," << parse << "," << parse * 1e6 / nodes << "\n";
+  std::cout << "arena_bytes," << arenaBytes << "\n";
+  std::cout << "peak_rss_kb," << peakRSS () << "\n";
+}
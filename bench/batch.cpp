@@ -0,0 +1,86 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/compiler.hpp"
+#include "whiley/batch.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Running one program on a table of parameter rows as a batch, on one
+ * thread and then on doubling counts up to every core. Each row runs a
+ * short loop whose length depends on its parameters. Times are the best
+ * of three; output is CSV.
+ *
+ *   whiley_bench_batch [rows]
+ */
+
+namespace {
+  double best (const std::function<void()>& f) {
+    double res = 0;
+    for (int r = 0; r < 3; ++r) {
+      auto start = std::chrono::steady_clock::now ();
+      f ();
+      double ms = std::chrono::duration<double,std::milli> (std::chrono::steady_clock::now ()-start).count ();
+      res = r ? std::min (res,ms) : ms;
+    }
+    return res;
+  }
+
+  const std::string program =
+    "param ui32 seed;\n"
+    "param ui8 rounds;\n"
+    "output ui32 hash;\n"
+    "output ui8 steps;\n"
+    "hash = seed;\n"
+    "while (steps < rounds % (40 as ui8)) {\n"
+    "  hash = (hash ^ (hash << (13 as ui32))) * (16777619 as ui32);\n"
+    "  steps++;\n"
+    "}\n"
+    "assert hash != (0 as ui32);\n";
+}
+
+int main (int argc, char** argv) {
+  std::size_t rows = argc > 1 ? std::strtoul (argv[1],nullptr,10) : 1000000;
+  Whiley::WParser parser;
+  auto prgm = parser.parse (std::span<const char> (program.data (),program.size ())).get ();
+  Whiley::BufferMessageSystem discard;
+  if (!Whiley::TypeChecker {discard}.CheckProgram (prgm)) {
+    std::cerr << "ill-typed" << std::endl;
+    return 1;
+  }
+  auto cfa = Whiley::Compiler{}.Compile (prgm);
+  auto bc = Whiley::VM::assemble (cfa);
+  Whiley::VM::Batch batch (prgm,cfa,bc);
+
+  Whiley::RandomChoices random (1);
+  std::vector<std::vector<std::uint64_t>> in;
+  std::vector<const std::uint64_t*> columns;
+  for (auto& p : batch.parameters ()) {
+    auto& c = in.emplace_back (rows);
+    for (auto& v : c)
+      v = Whiley::normalize (p.type,random.value (p.type));
+    columns.push_back (c.data ());
+  }
+  std::vector<std::vector<std::uint64_t>> out (batch.outputs ().size (),std::vector<std::uint64_t> (rows));
+  std::vector<std::uint64_t*> targets;
+  for (auto& c : out)
+    targets.push_back (c.data ());
+  std::vector<Whiley::RunResult> results (rows);
+
+  std::size_t cores = std::max (1u,std::thread::hardware_concurrency ());
+  std::cout << "jobs,rows,ms,rows_per_s" << std::endl;
+  for (std::size_t jobs = 1;; jobs = std::min (2*jobs,cores)) {
+    batch.setJobs (jobs);
+    auto ms = best ([&] {batch.run (rows,columns,targets,results);});
+    std::cout << jobs << "," << rows << "," << ms << "," << (ms > 0 ? rows/ms*1000 : 0) << std::endl;
+    if (jobs == cores)
+      break;
+  }
+}
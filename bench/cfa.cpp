@@ -0,0 +1,58 @@
+#include "generate.hpp"
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/compiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Lowering a checked Program to its CFA over the synthetic shapes, sized
+ * scale times their default so the larger ones reach millions of edges.
+ * Times are the best of three; memory is the CFA's own arrays. CSV:
+ *
+ *   whiley_bench_cfa [scale] [shape...]
+ */
+
+int main (int argc, char** argv) {
+  std::size_t scale = argc > 1 ? std::strtoul (argv[1],nullptr,10) : 10;
+  std::vector<WhileyBench::Shape> shapes;
+  for (int i = 2; i < argc; ++i) {
+    auto s = WhileyBench::shapeFromName (argv[i]);
+    if (!s) {
+      std::cerr << "unknown shape " << argv[i] << std::endl;
+      return 1;
+    }
+    shapes.push_back (*s);
+  }
+  if (shapes.empty ())
+    shapes.assign (std::begin (WhileyBench::shapes),std::end (WhileyBench::shapes));
+
+  std::cout << "shape,n,locations,edges,expressions,bytes,bytes_per_edge,compile_ms,edges_per_s" << std::endl;
+  for (auto shape : shapes) {
+    auto n = WhileyBench::defaultSize (shape)*scale;
+    auto source = WhileyBench::generate (shape,n);
+    Whiley::WParser parser;
+    parser.useRecursiveDescent ();
+    auto prgm = parser.parse (std::span<const char> (source.data (),source.size ())).get ();
+    Whiley::BufferMessageSystem discard;
+    Whiley::TypeChecker {discard}.CheckProgram (prgm);
+
+    double best = 0;
+    Whiley::IR::CFA cfa;
+    for (int r = 0; r < 3; ++r) {
+      auto start = std::chrono::steady_clock::now ();
+      cfa = Whiley::Compiler{}.Compile (prgm);
+      double ms = std::chrono::duration<double,std::milli> (std::chrono::steady_clock::now ()-start).count ();
+      best = r ? std::min (best,ms) : ms;
+    }
+    std::cout << WhileyBench::shapeName (shape) << "," << n << "," << cfa.locations () << "," << cfa.edges () << ","
+	      << cfa.expressions () << "," << cfa.bytes () << "," << double (cfa.bytes ())/std::max<std::size_t> (cfa.edges (),1) << ","
+	      << best << "," << static_cast<std::uint64_t> (best > 0 ? cfa.edges ()*1e3/best : 0) << std::endl;
+  }
+}
@@ -0,0 +1,89 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/diagnostics.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/*
+ * Type checking time of a program with n type mismatches, per sink:
+ * formatting every message and writing it line by line (what
+ * STDMessageSystem does), formatting into a BufferMessageSystem, keeping
+ * records in a DiagnosticBuffer and writing them in blocks, and a
+ * DiagnosticBuffer stopping the checker after 100 messages.
+ * Output goes to /dev/null.
+ *
+ *   whiley_bench_diagnostics [n]
+ */
+
+namespace {
+  class StreamMessageSystem : public Whiley::MessageSystem {
+  public:
+    StreamMessageSystem (std::ostream& os) : os(os) {}
+    Whiley::MessageSystem& operator<< (const Whiley::Message& m) override {
+      os << m.to_string () << "\n";
+      return *this;
+    }
+  private:
+    std::ostream& os;
+  };
+
+  std::string program (std::size_t n) {
+    std::stringstream str;
+    str << "si64 x;\nui8 y;\n";
+    for (std::size_t i = 0; i < n; ++i)
+      str << "x = y;\n";
+    return str.str ();
+  }
+
+  double time (const std::function<void()>& f) {
+    double best = 0;
+    for (int r = 0; r < 3; ++r) {
+      auto start = std::chrono::steady_clock::now ();
+      f ();
+      double ms = std::chrono::duration<double,std::milli> (std::chrono::steady_clock::now ()-start).count ();
+      best = r ? std::min (best,ms) : ms;
+    }
+    return best;
+  }
+}
+
+int main (int argc, char** argv) {
+  std::size_t n = argc > 1 ? std::strtoul (argv[1],nullptr,10) : 200000;
+  auto source = program (n);
+  Whiley::WParser parser;
+  auto prgm = parser.parse (std::span<const char> (source.data (),source.size ())).get ();
+  std::ofstream null {"/dev/null"};
+
+  std::cout << "sink,messages,ms\n";
+  auto row = [&](const char* name, const std::function<void()>& f) {
+    std::cout << name << "," << n << "," << time (f) << std::endl;
+  };
+  row ("stream",[&]() {
+    StreamMessageSystem sink {null};
+    Whiley::TypeChecker {sink}.CheckProgram (prgm);
+  });
+  row ("buffer",[&]() {
+    Whiley::BufferMessageSystem sink;
+    Whiley::TypeChecker {sink}.CheckProgram (prgm);
+  });
+  row ("records",[&]() {
+    Whiley::DiagnosticBuffer sink;
+    Whiley::TypeChecker {sink}.CheckProgram (prgm);
+  });
+  row ("records+flush",[&]() {
+    Whiley::DiagnosticBuffer sink;
+    Whiley::TypeChecker {sink}.CheckProgram (prgm);
+    sink.flush (null);
+  });
+  row ("records+max100",[&]() {
+    Whiley::DiagnosticBuffer sink {100};
+    Whiley::TypeChecker {sink}.CheckProgram (prgm);
+    sink.flush (null);
+  });
+}
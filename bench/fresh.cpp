@@ -0,0 +1,35 @@
+#include "whiley/parser.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+
+/*
+ * Regression benchmark for temporary naming: N call expressions in one
+ * scope each need a fresh '£' symbol. Parse time must grow linearly in N.
+ */
+
+int main (int argc, char** argv) {
+  std::size_t calls = argc > 1 ? std::strtoull (argv[1],nullptr,10) : 50000;
+
+  std::stringstream str;
+  str << "si64 x;\n";
+  str << "fn id (si64 a) -> si64 { return a; }\n";
+  for (std::size_t i = 0; i < calls; ++i)
+    str << "x = id[x];\n";
+  auto source = str.str ();
+
+  auto start = std::chrono::steady_clock::now ();
+  Whiley::WParser parser;
+  if (!parser.parse (std::span<const char> (source.data(),source.size()))) {
+    std::cerr << "parse failed" << std::endl;
+    return 1;
+  }
+  auto stop = std::chrono::steady_clock::now ();
+  double ms = std::chrono::duration<double,std::milli> (stop-start).count ();
+
+  std::cout << "calls,ms,us_per_call\n";
+  std::cout << calls << "," << ms << "," << ms * 1e3 / calls << "\n";
+}
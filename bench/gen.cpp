@@ -0,0 +1,18 @@
+#include "generate.hpp"
+
+#include <iostream>
+#include <cstdlib>
+
+/* Writes a synthetic program to stdout: whiley_gen <shape> [n] */
+int main (int argc, char** argv) {
+  auto shape = argc > 1 ? WhileyBench::shapeFromName (argv[1]) : std::nullopt;
+  if (!shape) {
+    std::cerr << "usage: " << argv[0] << " <shape> [n]\nshapes:";
+    for (auto s : WhileyBench::shapes)
+      std::cerr << " " << WhileyBench::shapeName (s);
+    std::cerr << std::endl;
+    return 1;
+  }
+  auto n = argc > 2 ? std::strtoull (argv[2],nullptr,10) : WhileyBench::defaultSize (*shape);
+  std::cout << WhileyBench::generate (*shape,n);
+}
@@ -0,0 +1,119 @@
+#ifndef _WHILEY_BENCH_GENERATE__
+#define _WHILEY_BENCH_GENERATE__
+
+#include <cstddef>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+/*
+ * Synthetic, well-typed Whiley programs that stress one feature each.
+ * The size n counts the repeated unit of the shape (declarations,
+ * functions, nesting levels, statements, branches or calls).
+ */
+namespace WhileyBench {
+  enum class Shape {
+    Globals,
+    Functions,
+    Nesting,
+    StraightLine,
+    Choose,
+    Calls
+  };
+
+  inline constexpr Shape shapes[] = {Shape::Globals,Shape::Functions,Shape::Nesting,
+				     Shape::StraightLine,Shape::Choose,Shape::Calls};
+
+  inline const char* shapeName (Shape s) {
+    switch (s) {
+    case Shape::Globals: return "globals";
+    case Shape::Functions: return "functions";
+    case Shape::Nesting: return "nesting";
+    case Shape::StraightLine: return "straight";
+    case Shape::Choose: return "choose";
+    case Shape::Calls: return "calls";
+    }
+    return "";
+  }
+
+  inline std::optional<Shape> shapeFromName (std::string_view name) {
+    for (auto s : shapes)
+      if (name == shapeName (s))
+	return s;
+    return std::nullopt;
+  }
+
+  /* Size giving each shape a comparable amount of work at scale 1 */
+  inline std::size_t defaultSize (Shape s) {
+    switch (s) {
+    case Shape::Globals: return 20000;
+    case Shape::Functions: return 5000;
+    case Shape::Nesting: return 2000;
+    case Shape::StraightLine: return 100000;
+    case Shape::Choose: return 20000;
+    case Shape::Calls: return 20000;
+    }
+    return 0;
+  }
+
+  inline std::string generate (Shape shape, std::size_t n) {
+    std::stringstream str;
+    str << "si64 x;\n";
+    switch (shape) {
+    case Shape::Globals:
+      for (std::size_t i = 0; i < n; ++i)
+	str << "si64 g" << i << ";\n";
+      for (std::size_t i = 0; i < n; ++i)
+	str << "g" << i << " = x + " << i << ";\n";
+      break;
+    case Shape::Functions:
+      for (std::size_t i = 0; i < n; ++i) {
+	str << "fn f" << i << " (si64 a, si64 b) -> si64 {\n"
+	    << "  si64 r;\n"
+	    << "  r = a * " << i << " + b;\n"
+	    << "  if (r > b) { r = r - a; }\n"
+	    << "  return r;\n"
+	    << "}\n";
+      }
+      str << "x = f0[x, 1];\n";
+      break;
+    case Shape::Nesting:
+      for (std::size_t i = 0; i < n; ++i) {
+	if (i % 2)
+	  str << "while (x > " << i << ") {\n";
+	else
+	  str << "if (x < " << i << ") {\n";
+      }
+      str << "x = x - 1;\n";
+      for (std::size_t i = 0; i < n; ++i)
+	str << "}\n";
+      break;
+    case Shape::StraightLine:
+      for (std::size_t i = 0; i < n; ++i) {
+	switch (i % 4) {
+	case 0: str << "x = x + " << i << ";\n"; break;
+	case 1: str << "x = (x * 3) - (x / 2);\n"; break;
+	case 2: str << "assert x != " << i << ";\n"; break;
+	case 3: str << "x++;\n"; break;
+	}
+      }
+      break;
+    case Shape::Choose:
+      str << "choose {\n";
+      for (std::size_t i = 0; i < n; ++i)
+	str << "  :: { x = " << i << "; }\n";
+      str << "}\n";
+      break;
+    case Shape::Calls:
+      str << "fn add (si64 a, si64 b) -> si64 { return a + b; }\n"
+	  << "fn twice (si64 v) -> si64 { return add[v, v]; }\n";
+      for (std::size_t i = 0; i < n; ++i)
+	str << "x = add[twice[x], " << i << "];\n";
+      break;
+    }
+    return str.str ();
+  }
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "generate.hpp"
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/image.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/*
+ * Cost of getting a checked program back from its image instead of from
+ * source, per synthetic shape: parse and type check, serialise the image,
+ * open it and sweep every expression's type in place, and open and load a
+ * Program.
+ * Times are the best of three; output is CSV.
+ *
+ *   whiley_bench_image [scale] [shape...]
+ */
+
+namespace {
+  double best (const std::function<void()>& f) {
+    double res = 0;
+    for (int r = 0; r < 3; ++r) {
+      auto start = std::chrono::steady_clock::now ();
+      f ();
+      double ms = std::chrono::duration<double,std::milli> (std::chrono::steady_clock::now ()-start).count ();
+      res = r ? std::min (res,ms) : ms;
+    }
+    return res;
+  }
+}
+
+int main (int argc, char** argv) {
+  double scale = argc > 1 ? std::atof (argv[1]) : 1.0;
+  std::vector<WhileyBench::Shape> selected;
+  for (int i = 2; i < argc; ++i)
+    if (auto s = WhileyBench::shapeFromName (argv[i]))
+      selected.push_back (*s);
+  if (selected.empty ())
+    selected.assign (std::begin (WhileyBench::shapes),std::end (WhileyBench::shapes));
+
+  auto path = (std::filesystem::temp_directory_path () / "whiley_bench_image.wimg").string ();
+  Whiley::WParser parser;
+  std::cout << "shape,n,source_bytes,image_bytes,typed_exprs,frontend_ms,write_ms,open_ms,load_ms" << std::endl;
+  for (auto shape : selected) {
+    auto n = static_cast<std::size_t> (WhileyBench::defaultSize (shape) * scale);
+    auto source = WhileyBench::generate (shape,n);
+    std::span<const char> bytes {source.data (),source.size ()};
+
+    auto frontend = best ([&]() {
+      auto prgm = parser.parse (bytes).get ();
+      Whiley::TypeChecker{}.CheckProgram (prgm);
+    });
+    auto prgm = parser.parse (bytes).get ();
+    Whiley::TypeChecker{}.CheckProgram (prgm);
+    auto write = best ([&]() {
+      std::stringstream str;
+      Whiley::ProgramImage::write (prgm,str);
+    });
+    Whiley::ProgramImage::write (prgm,path);
+
+    std::size_t typed = 0;
+    auto open = best ([&]() {
+      auto image = Whiley::ProgramImage::open (path);
+      for (Whiley::expr_t e = 0; e < image.expressions (); ++e)
+	typed += image.type (e) != Whiley::Type::Untyped;
+    });
+    auto load = best ([&]() {
+      auto loaded = Whiley::ProgramImage::open (path).load ();
+    });
+
+    std::cout << WhileyBench::shapeName (shape) << "," << n << "," << source.size () << ","
+	      << std::filesystem::file_size (path) << "," << typed / 3 << "," << frontend << "," << write << ","
+	      << open << "," << load << std::endl;
+  }
+  std::filesystem::remove (path);
+}
@@ -0,0 +1,79 @@
+#include "generate.hpp"
+#include "whiley/incremental.hpp"
+#include "whiley/diagnostics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Editor loop latency of IncrementalProgram on a program of many small
+ * functions: the time of one update() after a typical edit, against
+ * parsing and checking the whole source. Each edit is made and undone
+ * repeatedly; times are the median and maximum. Output is CSV.
+ *
+ *   whiley_bench_incremental [lines] [repeats]
+ */
+
+namespace {
+  struct Edit {
+    const char* name;
+    std::size_t at;
+    std::size_t erase;
+    std::string insert;
+  };
+
+  double elapsed (std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli> (std::chrono::steady_clock::now ()-start).count ();
+  }
+}
+
+int main (int argc, char** argv) {
+  std::size_t lines = argc > 1 ? std::strtoul (argv[1],nullptr,10) : 50000;
+  int repeats = argc > 2 ? std::atoi (argv[2]) : 20;
+  // Six lines per function
+  auto n = std::max<std::size_t> (lines/6,2);
+  auto source = WhileyBench::generate (WhileyBench::Shape::Functions,n);
+
+  auto body = [&](std::size_t i) {
+    auto fn = source.find ("fn f" + std::to_string (i) + " ");
+    return source.find ("+ b;",fn) + 3;
+  };
+  std::vector<Edit> edits {
+    {"body_first",body (1),0," + 1"},
+    {"body_middle",body (n/2),0," + 1"},
+    {"body_last",body (n-1),0," + 1"},
+    {"blank_line",source.find ("fn f" + std::to_string (n/2) + " "),0,"\n"},
+    {"parameters",source.find ("si64 a")+2,2,"32"},
+    {"main",source.rfind ("1];"),1,"2"},
+  };
+
+  Whiley::DiagnosticBuffer discard;
+  Whiley::IncrementalProgram inc;
+  auto start = std::chrono::steady_clock::now ();
+  inc.update (source,discard);
+  auto full = elapsed (start);
+
+  std::cout << "edit,lines,bytes,full_ms,update_ms,max_ms,whole,reparsed,rechecked" << std::endl;
+  for (auto& e : edits) {
+    auto edited = source;
+    edited.replace (e.at,e.erase,e.insert);
+    std::vector<double> times;
+    Whiley::UpdateResult res;
+    for (int r = 0; r < repeats; ++r) {
+      start = std::chrono::steady_clock::now ();
+      res = inc.update (edited,discard);
+      times.push_back (elapsed (start));
+      start = std::chrono::steady_clock::now ();
+      inc.update (source,discard);
+      times.push_back (elapsed (start));
+    }
+    std::sort (times.begin (),times.end ());
+    std::cout << e.name << "," << std::count (source.begin (),source.end (),'\n') << "," << source.size () << ","
+	      << full << "," << times[times.size ()/2] << "," << times.back () << "," << res.full << ","
+	      << res.reparsed << "," << res.rechecked << std::endl;
+  }
+}
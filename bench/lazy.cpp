@@ -0,0 +1,76 @@
+#include "whiley/parser.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/*
+ * Cost of listing every function's signature with and without lazy
+ * bodies, for a fixed number of functions whose bodies grow: a full
+ * parse, a lazy parse that only reads signatures, and a lazy parse whose
+ * bodies are then all asked for.
+ * Times are the best of three; output is CSV.
+ *
+ *   whiley_bench_lazy [functions]
+ */
+
+namespace {
+  double best (const std::function<void()>& f) {
+    double res = 0;
+    for (int r = 0; r < 3; ++r) {
+      auto start = std::chrono::steady_clock::now ();
+      f ();
+      double ms = std::chrono::duration<double,std::milli> (std::chrono::steady_clock::now ()-start).count ();
+      res = r ? std::min (res,ms) : ms;
+    }
+    return res;
+  }
+
+  std::string program (std::size_t functions, std::size_t statements) {
+    std::stringstream str;
+    str << "si64 x;\n";
+    for (std::size_t i = 0; i < functions; ++i) {
+      str << "fn f" << i << " (si64 a, si64 b) -> si64 {\n  si64 r;\n  r = a;\n";
+      for (std::size_t s = 0; s < statements; ++s)
+	str << "  if (r > b) { r = r - a * " << s << "; } else { r = r + b; }\n";
+      str << "  return r;\n}\n";
+    }
+    str << "x = f0[x, 1];\n";
+    return str.str ();
+  }
+
+  std::size_t signatures (const Whiley::Program& prgm) {
+    std::size_t params = 0;
+    for (auto f : prgm.getFunctions ())
+      params += f.getFunction ()->getParams ().size () + (f.getFunction ()->returns () != Whiley::Type::Untyped);
+    return params;
+  }
+}
+
+int main (int argc, char** argv) {
+  std::size_t functions = argc > 1 ? std::strtoul (argv[1],nullptr,10) : 2000;
+  Whiley::WParser full;
+  full.useRecursiveDescent ();
+  Whiley::WParser lazy;
+  lazy.useLazyBodies ();
+
+  std::size_t seen = 0;
+  std::cout << "functions,body_lines,bytes,full_ms,signatures_ms,all_bodies_ms" << std::endl;
+  for (std::size_t statements : {1,4,16,64}) {
+    auto source = program (functions,statements);
+    std::span<const char> bytes {source.data (),source.size ()};
+    auto fullTime = best ([&]() {seen += signatures (full.parse (bytes).get ());});
+    auto signatureTime = best ([&]() {seen += signatures (lazy.parse (bytes).get ());});
+    auto bodiesTime = best ([&]() {
+      auto prgm = lazy.parse (bytes).get ();
+      for (auto f : prgm.getFunctions ())
+	seen += f.getFunction ()->getStmt () != nullptr;
+    });
+    std::cout << functions << "," << statements+3 << "," << source.size () << "," << fullTime << ","
+	      << signatureTime << "," << bodiesTime << std::endl;
+  }
+  return seen ? 0 : 1;
+}
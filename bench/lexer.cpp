@@ -0,0 +1,66 @@
+#include "generate.hpp"
+#include "scanner.h"
+#include "whiley/ast.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+/*
+ * Scanner throughput in tokens/second over the synthetic program shapes.
+ * The scanner is the one selected at configure time; build once with and
+ * once without WHILEY_HANDWRITTEN_LEXER to compare flex against the
+ * hand-written scanner.
+ */
+
+namespace {
+#ifdef WHILEY_HANDWRITTEN_LEXER
+  const char* scannerName = "handwritten";
+#else
+  const char* scannerName = "flex";
+#endif
+
+  std::size_t scan (const std::string& source) {
+    Whiley::Interner names;
+    Whiley::LineTable lines;
+    Whiley::BufferMessageSystem messages;
+    Whiley::Scanner scanner {std::span<const char> (source.data(),source.size()),names,lines,messages};
+    Whiley::location_t loc;
+    std::size_t tokens = 0;
+    for (;;) {
+      Whiley::Parser::semantic_type value;
+      auto tok = scanner.yylex (&value,&loc);
+      // Release the semantic value the way the parser would
+      switch (tok) {
+      case Whiley::Parser::token::IDENTIFIER: value.destroy<Whiley::Name> (); break;
+      case Whiley::Parser::token::NUMBER:
+      case Whiley::Parser::token::CHAR: value.destroy<std::int64_t> (); break;
+      case Whiley::Parser::token::TYPE: value.destroy<Whiley::Type> (); break;
+      default: break;
+      }
+      if (tok == Whiley::Parser::token::END)
+	return tokens;
+      ++tokens;
+    }
+  }
+}
+
+int main (int argc, char** argv) {
+  double scale = argc > 1 ? std::strtod (argv[1],nullptr) : 1.0;
+  std::cout << "scanner,shape,bytes,tokens,ms,mtokens_per_s,mb_per_s\n";
+  for (auto shape : WhileyBench::shapes) {
+    auto source = WhileyBench::generate (shape,std::max<std::size_t> (1,WhileyBench::defaultSize (shape) * scale));
+    double best = 0;
+    std::size_t tokens = 0;
+    for (int r = 0; r < 5; ++r) {
+      auto start = std::chrono::steady_clock::now ();
+      tokens = scan (source);
+      auto stop = std::chrono::steady_clock::now ();
+      double ms = std::chrono::duration<double,std::milli> (stop-start).count ();
+      best = r ? std::min (best,ms) : ms;
+    }
+    std::cout << scannerName << "," << WhileyBench::shapeName (shape) << "," << source.size () << ","
+	      << tokens << "," << best << "," << tokens / best / 1e3 << "," << source.size () / best / 1e3 << std::endl;
+  }
+}
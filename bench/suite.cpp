@@ -0,0 +1,120 @@
+#include "generate.hpp"
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/messaging.hpp"
+#include "whiley/config.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdlib>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Parse and type check throughput over the synthetic program shapes.
+ * Every case runs in a child process so peak RSS is per case; times are
+ * the best of several repetitions. Output is CSV, one row per case:
+ *
+ *   whiley_bench_suite [--rd] [scale] [shape...]
+ *
+ * --rd parses with the recursive-descent parser instead of the Bison one.
+ */
+
+namespace {
+  const std::size_t repetitions = 3;
+  bool recursiveDescent = false;
+
+  long peakRSS () {
+    struct rusage usage;
+    getrusage (RUSAGE_SELF,&usage);
+    return usage.ru_maxrss;
+  }
+
+  double ms (Whiley::Stats::clock::duration d) {
+    return std::chrono::duration<double,std::milli> (d).count ();
+  }
+
+  double perSecond (std::uint64_t n, double millis) {
+    return millis > 0 ? n * 1e3 / millis : 0;
+  }
+
+  void runCase (WhileyBench::Shape shape, std::size_t n) {
+    auto source = WhileyBench::generate (shape,n);
+    double lex = 0, parse = 0, check = 0;
+    std::uint64_t tokens = 0, nodes = 0, symbols = 0;
+    bool ok = true;
+    for (std::size_t r = 0; r < repetitions; ++r) {
+      Whiley::Stats stats;
+      Whiley::WParser parser;
+      parser.setStats (&stats);
+      parser.useRecursiveDescent (recursiveDescent);
+      auto res = parser.parse (std::span<const char> (source.data(),source.size()));
+      ok = ok && res;
+      auto prgm = res.get ();
+      Whiley::BufferMessageSystem messages;
+      Whiley::TypeChecker checker {messages};
+      checker.setStats (&stats);
+      ok = checker.CheckProgram (prgm) && ok;
+
+      auto best = [r](double& slot, double v) {slot = r ? std::min (slot,v) : v;};
+      best (lex,ms (stats.time ("lex")));
+      best (parse,ms (stats.time ("parse")));
+      best (check,ms (stats.time ("typecheck")));
+      tokens = stats.counter ("tokens");
+      nodes = stats.counter ("nodes");
+      symbols = stats.counter ("symbols");
+    }
+    std::cout << (recursiveDescent ? "rd" : "lalr") << "," << WhileyBench::shapeName (shape) << "," << n << "," << source.size () << ","
+	      << tokens << "," << nodes << "," << symbols << ","
+	      << lex << "," << parse << "," << check << ","
+	      << static_cast<std::uint64_t> (perSecond (tokens,lex)) << ","
+	      << static_cast<std::uint64_t> (perSecond (nodes,parse)) << ","
+	      << static_cast<std::uint64_t> (perSecond (nodes,check)) << ","
+	      << peakRSS () << "," << (ok ? "ok" : "failed") << std::endl;
+  }
+}
+
+int main (int argc, char** argv) {
+  int arg = 1;
+  if (arg < argc && std::string_view {argv[arg]} == "--rd") {
+    recursiveDescent = true;
+    ++arg;
+  }
+  double scale = arg < argc ? std::strtod (argv[arg++],nullptr) : 1.0;
+  std::vector<WhileyBench::Shape> selected;
+  for (int i = arg; i < argc; ++i) {
+    auto s = WhileyBench::shapeFromName (argv[i]);
+    if (!s) {
+      std::cerr << "unknown shape " << argv[i] << std::endl;
+      return 1;
+    }
+    selected.push_back (*s);
+  }
+  if (selected.empty ())
+    selected.assign (std::begin (WhileyBench::shapes),std::end (WhileyBench::shapes));
+
+  std::cout << "# whiley " << Whiley::Version::VERSION_MAJOR << "." << Whiley::Version::VERSION_MINOR << "\n";
+  std::cout << "parser,shape,n,bytes,tokens,nodes,symbols,lex_ms,parse_ms,typecheck_ms,"
+	       "lex_tokens_per_s,parse_nodes_per_s,typecheck_nodes_per_s,peak_rss_kb,status" << std::endl;
+  bool ok = true;
+  for (auto shape : selected) {
+    auto n = std::max<std::size_t> (1,WhileyBench::defaultSize (shape) * scale);
+    auto pid = fork ();
+    if (pid == 0) {
+      runCase (shape,n);
+      std::_Exit (0);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid (pid,&status,0) < 0 || !WIFEXITED (status) || WEXITSTATUS (status)) {
+      std::cout << (recursiveDescent ? "rd" : "lalr") << "," << WhileyBench::shapeName (shape) << "," << n << ",crashed" << std::endl;
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#ifndef _WHILEY_ARENA__
+#define _WHILEY_ARENA__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Whiley {
+  /**
+   * Bump allocator owning every node of a Program.
+   * Objects are never freed individually; destructors of non-trivial
+   * objects run in reverse construction order when the arena dies.
+   */
+  class Arena {
+  public:
+    Arena () = default;
+    Arena (const Arena&) = delete;
+    Arena& operator= (const Arena&) = delete;
+    Arena (Arena&& o) noexcept : chunks(std::move(o.chunks)),
+				 dtors(std::move(o.dtors)),
+				 cur(std::exchange(o.cur,nullptr)),
+				 end(std::exchange(o.end,nullptr)),
+				 allocated(std::exchange(o.allocated,0)),
+				 nextChunk(std::exchange(o.nextChunk,initialChunk)) {}
+    Arena& operator= (Arena&& o) noexcept {
+      if (this != &o) {
+	destroy ();
+	chunks = std::move(o.chunks);
+	dtors = std::move(o.dtors);
+	cur = std::exchange(o.cur,nullptr);
+	end = std::exchange(o.end,nullptr);
+	allocated = std::exchange(o.allocated,0);
+	nextChunk = std::exchange(o.nextChunk,initialChunk);
+      }
+      return *this;
+    }
+    ~Arena () {destroy ();}
+
+    template<class T,class... Args>
+    T* make (Args&&... args) {
+      void* mem = allocate (sizeof(T),alignof(T));
+      T* obj = ::new (mem) T(std::forward<Args>(args)...);
+      if constexpr (!std::is_trivially_destructible_v<T>) {
+	dtors.push_back ({obj,[](void* p) {static_cast<T*>(p)->~T();}});
+      }
+      return obj;
+    }
+
+    void* allocate (std::size_t size, std::size_t align) {
+      auto p = alignUp (cur,align);
+      if (!cur || p + size > end) {
+	grow (size + align);
+	p = alignUp (cur,align);
+      }
+      cur = p + size;
+      allocated += size;
+      return p;
+    }
+
+    /* Bytes handed out to objects (excluding chunk slack) */
+    std::size_t bytesAllocated () const {return allocated;}
+
+  private:
+    static constexpr std::size_t initialChunk = 4096;
+    static constexpr std::size_t maxChunk = 1 << 20;
+
+    static std::byte* alignUp (std::byte* p, std::size_t align) {
+      auto v = reinterpret_cast<std::uintptr_t> (p);
+      return reinterpret_cast<std::byte*> ((v + align - 1) & ~(align - 1));
+    }
+
+    void grow (std::size_t atLeast) {
+      auto size = std::max (nextChunk,atLeast);
+      chunks.emplace_back (new std::byte[size]);
+      cur = chunks.back().get();
+      end = cur + size;
+      nextChunk = std::min (nextChunk * 2,maxChunk);
+    }
+
+    void destroy () {
+      for (auto it = dtors.rbegin (); it != dtors.rend (); ++it)
+	it->fn (it->obj);
+      dtors.clear ();
+      chunks.clear ();
+      cur = end = nullptr;
+      allocated = 0;
+    }
+
+    struct Dtor {
+      void* obj;
+      void (*fn) (void*);
+    };
+
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    std::vector<Dtor> dtors;
+    std::byte* cur{nullptr};
+    std::byte* end{nullptr};
+    std::size_t allocated{0};
+    std::size_t nextChunk{initialChunk};
+  };
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include <variant>
 #include <vector>
@@ -15,8 +16,13 @@
 #include <utility>
 #include <generator>
 #include <algorithm>
+#include <array>
+#include <tuple>
+#include <type_traits>
 
 #include "whiley/symbol.hpp"
+#include "whiley/arena.hpp"
+#include "whiley/location.hpp"
 
   namespace Whiley {
     template<class... Ts> struct overloaded : Ts... { 
@@ -37,7 +43,7 @@
     class DeclareStatement;
     class IfStatement;
     class WhileStatement;
-    class SequenceStatement;
+    class BlockStatement;
     class ChooseStatement;
     class SkipStatement;
     class AssertStatement;
@@ -144,7 +150,7 @@
       virtual void visitWhileStatement (const WhileStatement& ) = 0;
       virtual void visitChooseStatement (const ChooseStatement& ) = 0;
       
-      virtual void visitSequenceStatement (const SequenceStatement& ) = 0;
+      virtual void visitBlockStatement (const BlockStatement& ) = 0;
       virtual void visitReturnStatement (const ReturnStatement& ) = 0;
       virtual void visitCallStatement (const CallStatement& ) = 0;
       virtual void visitAllocStatement (const AllocStatement& ) = 0;
@@ -189,53 +195,19 @@
       Whiley::Function_ptr func;
     };
     
-    struct fileloc_t {
-      std::size_t line{1};
-      std::size_t col{1};
-      operator std::string () const {
-	std::stringstream str;
-	str << line << ":" << col;
-	return str.str();
-      }
-    };
-
-    inline std::ostream& operator<< (std::ostream& os, const fileloc_t& loc) {
-      return os << loc.line <<":"<<loc.col;
-    }
-    
-    struct location_t {
-      fileloc_t begin;
-      fileloc_t end;
-
-      void step () {begin = end; end = fileloc_t{};}
-      void movecol (std::size_t s) {end.col+=s;}
-      void newline () {
-	end.line++;
-	end.col = 1;
-	begin = end;
-      }
-    };
-
-    inline std::ostream& operator<< (std::ostream& os, const location_t& loc) {
-      return os << loc.begin << " - " << loc.end;
-    }
-    
-
-    
-    
     class Node {
     public:
       Node (const location_t& loc = location_t{}) : location (loc) {}
       virtual ~Node () {}
-      auto& getFileLocation () const {return location.begin;}
       auto& getLocation () const {return location;}
+      void setLocation (const location_t& loc) {location = loc;}
     
     private:
       location_t location;
     };
 
     
-    using Node_ptr = std::shared_ptr<Node>;
+    using Node_ptr = Node*;
     
     using expr_t = std::size_t;
     
@@ -255,7 +227,6 @@
     };
     
 
-    using Expression_ptr = std::shared_ptr<Expression>;
     
     class Identifier : public Expression {
     public:
@@ -372,7 +343,6 @@
       
     };
     
-    using Statement_ptr = std::shared_ptr<Statement>;
 
     class SkipStatement  : public Statement{
     public:
@@ -382,47 +352,48 @@
     
     class AssignStatement  : public Statement{
     public:
-      AssignStatement (std::string assignName, Expression_ptr&& expr, const location_t& loc) : Statement(loc),
-											       assignName(std::move(assignName)),
+      AssignStatement (Name assignName, Expression_ptr&& expr, const location_t& loc) : Statement(loc),
+											       assignName(assignName),
 											       expr(std::move(expr)) {}
       
       void accept (StatementVisitor& v) const override {v.visitAssignStatement(*this);}
-      auto& getAssignName () const {return assignName;}
+      auto getAssignName () const {return assignName;}
       auto& getExpression () const {return *expr;}
       
       private:
-      std::string assignName;
+      Name assignName;
       Expression_ptr expr;
 
     };
 
     class IncrementDecrementStatement  : public Statement{
     public:
-      IncrementDecrementStatement (std::string assignName, bool decrement,const location_t& loc) : Statement(loc),
-												   assignName(std::move(assignName)),
+      IncrementDecrementStatement (Name assignName, bool decrement,const location_t& loc) : Statement(loc),
+												   assignName(assignName),
 												   decrement(decrement)
 										     {}
       
       void accept (StatementVisitor& v) const override {v.visitIncrementDecrementStatement(*this);}
-      auto& getIncrementee () const {return assignName;}
+      auto getIncrementee () const {return assignName;}
+      bool isDecrement () const {return decrement;}
       
       private:
-      std::string assignName;
+      Name assignName;
       bool decrement{false};
     };
 
     class AllocStatement  : public Statement{
     public:
-      AllocStatement (std::string assignName, Expression_ptr&& expr, const location_t& loc) : Statement(loc),
-											       assignName(std::move(assignName)),
+      AllocStatement (Name assignName, Expression_ptr&& expr, const location_t& loc) : Statement(loc),
+											       assignName(assignName),
 											       expr(std::move(expr)) {}
       
       void accept (StatementVisitor& v) const override {v.visitAllocStatement(*this);}
-      auto& getAssignName () const {return assignName;}
+      auto getAssignName () const {return assignName;}
       auto& getExpression () const {return *expr;}
       
       private:
-      std::string assignName;
+      Name assignName;
       Expression_ptr expr;
     };
 
@@ -525,24 +496,19 @@
       
     };
 
-    class SequenceStatement  : public Statement{
+    class BlockStatement  : public Statement{
     public:
-      SequenceStatement (Statement_ptr first,Statement_ptr second, const location_t& loc) : Statement(loc),
-											    first(std::move(first)) ,
-											    second(std::move(second)) {}
+      BlockStatement (std::vector<Statement_ptr>&& stmts, const location_t& loc) : Statement(loc),
+										   statements(std::move(stmts)) {}
       
       void accept (StatementVisitor& v) const {
-	v.visitSequenceStatement (*this);
+	v.visitBlockStatement (*this);
       }
       
-      auto& getFirst () const {return *first;}
-      auto& getSecond () const {return *second;}
+      const auto& getStatements () const {return statements;}
       
     private:
-
-      Statement_ptr first;
-      Statement_ptr second;
-      
+      std::vector<Statement_ptr> statements;
     };
 
     class ReturnStatement : public Statement {
@@ -561,7 +527,7 @@
 
     class CallStatement : public Statement {
     public:
-      CallStatement (std::string assignname, std::string funcname, std::vector<Expression_ptr> params ,const location_t& loc) : Statement(loc),
+      CallStatement (Name assignname, Name funcname, std::vector<Expression_ptr> params ,const location_t& loc) : Statement(loc),
 
 																assign_name(assignname),
 																func_name(funcname),
@@ -573,12 +539,12 @@
       }
 
 
-      auto& assignname ()const {return assign_name;}
-      auto& funcname ()const {return func_name;}
+      auto assignname ()const {return assign_name;}
+      auto funcname ()const {return func_name;}
       auto& parameters () const {return params;}
     private:
-      std::string assign_name;
-      std::string func_name;
+      Name assign_name;
+      Name func_name;
       
       std::vector<Expression_ptr> params;
     };
@@ -608,8 +574,13 @@
     
     class Program {
     public:
-      Program (Whiley::Frame&& frame,  Statement_ptr&& stmt) : 	stmt(std::move(stmt)),									       frame(std::move(frame))
+      Program (Whiley::Frame&& frame,  Statement_ptr&& stmt, Arena&& arena, LineTable&& lines = LineTable{}) : arena(std::move(arena)),
+														stmt(std::move(stmt)),
+														frame(std::move(frame)),
+														lines(std::move(lines))
       {}
+      Program (Program&&) = default;
+      Program& operator= (Program&&) = default;
       
       auto& getStmt () const {return *stmt;}
       
@@ -636,10 +607,18 @@
       }
 
       auto getFrame () const {return frame;}
+      auto& getArena () const {return arena;}
+      /* Resolves node locations to line/column */
+      auto& getLineTable () const {return lines;}
       
     private:
+      friend class ASTBuilder;
+      /* Owns every node reachable from stmt and the function bodies in frame,
+	 except for bodies parsed lazily, which their BodySource owns */
+      Arena arena;
       Statement_ptr stmt;
       Whiley::Frame frame;
+      LineTable lines;
       
     };
 
@@ -650,194 +629,339 @@
       return os << prgm.getStmt ();
     }
     
+    /* Node classes counted per kind by ASTBuilder, in reporting order */
+    using NodeKinds = std::tuple<Identifier,NumberExpression,UndefExpression,BinaryExpression,DerefExpression,CastExpression,
+				 AssignStatement,AllocStatement,FreeStatement,AssertStatement,AssumeStatement,MemAssignStatement,
+				 IfStatement,WhileStatement,BlockStatement,ChooseStatement,SkipStatement,ReturnStatement,
+				 CallStatement,IncrementDecrementStatement>;
+    inline constexpr const char* nodeKindNames[] = {"Identifier","NumberExpression","UndefExpression","BinaryExpression","DerefExpression","CastExpression",
+						   "AssignStatement","AllocStatement","FreeStatement","AssertStatement","AssumeStatement","MemAssignStatement",
+						   "IfStatement","WhileStatement","BlockStatement","ChooseStatement","SkipStatement","ReturnStatement",
+						   "CallStatement","IncrementDecrementStatement"};
+    inline constexpr std::size_t nodeKindCount = std::tuple_size_v<NodeKinds>;
+
+    template<class T, class Kinds = NodeKinds> struct NodeKindIndex;
+    template<class T, class... Ts>
+    struct NodeKindIndex<T,std::tuple<T,Ts...>> : std::integral_constant<std::size_t,0> {};
+    template<class T, class U, class... Ts>
+    struct NodeKindIndex<T,std::tuple<U,Ts...>> : std::integral_constant<std::size_t,1+NodeKindIndex<T,std::tuple<Ts...>>::value> {};
+    
+    /**
+     * Builds a Program bottom-up. The make* functions create nodes from
+     * their operands; the capitalised methods are the actions of parser.y,
+     * which keep operands on side stacks and forward to make*.
+     * Calls inside expressions are hoisted: each becomes a CallStatement
+     * that withCalls places in front of the statement using its result.
+     */
     class ASTBuilder {
     public:
+      ASTBuilder () = default;
+      /* Resumes on prgm to rebuild some of its functions in place: FunctionBegin and
+	 FunctionEnd then replace the function of that name, which must exist */
+      explicit ASTBuilder (Program&& prgm) : arena(std::move(prgm.arena)),
+					     lines(std::move(prgm.lines)),
+					     frame(prgm.frame),
+					     replacing(true) {}
+      /* Resumes on arena and lines to build the deferred body of the function whose frame
+	 is func, seeing what a full parse would have seen there; see release */
+      ASTBuilder (Frame func, Arena&& arena, LineTable&& lines) : arena(std::move(arena)),
+								 lines(std::move(lines)),
+								 frame(func),
+								 visible(func.owner ().id ()) {}
+
+      /* Hoisted calls assign to fresh variables named by this and a number */
+      static constexpr std::string_view hoistedPrefix {"£"};
+
+      Expression_ptr makeNumber (std::int64_t val, const location_t& l) {
+	return node<NumberExpression> (val,l);
+      }
 
-      
+      Expression_ptr makeUndef (Whiley::Type type, const location_t& l) {
+	return node<UndefExpression> (type,l);
+      }
+
+      /* Constants are substituted; unknown names become 0 */
+      Expression_ptr makeIdentifier (Name name, const location_t& l) {
+        auto lookup = frame.resolve(name,visible);
+	if (lookup) {
+	  if (std::holds_alternative<Expression_ptr>(lookup.value().getUserData())) {
+	    return std::get<Expression_ptr>(lookup.value().getUserData());
+	  }
+	  else {
+	    return node<Identifier> (lookup.value(), l);
+	  }
+        }
+	return makeNumber (0,l);
+      }
+
+      Expression_ptr makeDeref (Expression_ptr mem, Type t, const location_t& l) {
+	return node<DerefExpression> (std::move(mem),t,l);
+      }
+
+      Expression_ptr makeCast (Expression_ptr expr, Type type, const location_t& l) {
+	return node<CastExpression> (std::move(expr),type,l);
+      }
+
+      /* The call is queued for hoisting; the expression reads its result from a fresh variable.
+	 nullptr if funcname is not a function, which the parser reports */
+      Expression_ptr makeCall (Name funcname, std::vector<Expression_ptr>&& exprs, const location_t& loc) {
+	auto lookup = frame.resolve(funcname,visible);
+	if (lookup && std::holds_alternative<Function_ptr>(lookup.value().getUserData())) {
+	  auto func = std::get<Function_ptr>(lookup.value().getUserData());
+	  auto symb = frame.createFresh (freshPrefix);
+	  symb.setUserData (VarDecl {func->returns(),false,false});
+	  auto result = node<Identifier> (symb, loc);
+	  callSequence.push_back (node<CallStatement> (symb.getName(),funcname,std::move(exprs),loc));
+	  return result;
+	}
+	return nullptr;
+      }
+
+      Expression_ptr makeBinary (BinOps op, Expression_ptr left, Expression_ptr right, const location_t& l) {
+	return node<BinaryExpression> (std::move(left),std::move(right),op,l);
+      }
+
+      Statement_ptr makeAssign (Name name, Expression_ptr expr, const location_t& l) {
+	return node<AssignStatement> (name,std::move(expr),l);
+      }
+
+      Statement_ptr makeAlloc (Name name, Expression_ptr expr, const location_t& l) {
+	return node<AllocStatement> (name,std::move(expr),l);
+      }
+
+      Statement_ptr makeFree (Expression_ptr expr, const location_t& l) {
+	return node<FreeStatement> (std::move(expr),l);
+      }
+
+      Statement_ptr makeAssert (Expression_ptr expr, const location_t& l) {
+	return node<AssertStatement> (std::move(expr),l);
+      }
+
+      Statement_ptr makeAssume (Expression_ptr expr, const location_t& l) {
+	return node<AssumeStatement> (std::move(expr),l);
+      }
+
+      Statement_ptr makeReturn (Expression_ptr expr, const location_t& l) {
+	return node<ReturnStatement> (std::move(expr),l);
+      }
+
+      Statement_ptr makeSkip (const location_t& l) {
+	return node<SkipStatement> (l);
+      }
+
+      Statement_ptr makeMemAssign (Expression_ptr mem, Expression_ptr val, const location_t& l) {
+	return node<MemAssignStatement> (std::move(mem),std::move(val),l);
+      }
+
+      Statement_ptr makeIncrement (Name name, const location_t& l) {
+	return node<IncrementDecrementStatement> (name,false,l);
+      }
+
+      Statement_ptr makeDecrement (Name name, const location_t& l) {
+	return node<IncrementDecrementStatement> (name,true,l);
+      }
+
+      Statement_ptr makeCallStmt (Name ass, Name funcname, std::vector<Expression_ptr>&& exprs, const location_t& loc) {
+	return node<CallStatement> (ass,funcname,std::move(exprs),loc);
+      }
+
+      /* condCalls are the hoisted calls of the condition (takeCalls right after it), or null */
+      Statement_ptr makeIf (Expression_ptr cond, Statement_ptr condCalls, Statement_ptr ifb, Statement_ptr elseb, const location_t& l) {
+	Statement_ptr if_ = node<IfStatement> (std::move(cond),
+					       std::move(ifb),
+					       std::move(elseb),
+					       l);
+	if (condCalls) {
+	  if_ = makeBlock ({condCalls,if_},l);
+	}
+	return if_;
+      }
+
+      Statement_ptr makeWhile (Expression_ptr cond, Statement_ptr condCalls, Statement_ptr body, const location_t& l) {
+	if (!condCalls)
+	  return node<WhileStatement> (cond,body,l);
+	// Calls in the condition are re-evaluated before every test
+	body = makeBlock ({body,condCalls},body->getLocation());
+	return makeBlock ({condCalls,node<WhileStatement> (cond,body,l)},l);
+      }
+
+      Statement_ptr makeChoose (std::vector<Statement_ptr>&& branches, const location_t& l) {
+	return node<ChooseStatement> (std::move(branches),l);
+      }
+
+      /* Single statements stay unwrapped and nested blocks are spliced, so blocks never nest directly */
+      Statement_ptr makeBlock (std::vector<Statement_ptr>&& stmts, const location_t& l) {
+	if (stmts.size () == 1)
+	  return stmts.front ();
+	std::vector<Statement_ptr> flat;
+	flat.reserve (stmts.size ());
+	for (auto s : stmts) {
+	  if (auto block = dynamic_cast<BlockStatement*> (s))
+	    flat.insert (flat.end (),block->getStatements ().begin (),block->getStatements ().end ());
+	  else
+	    flat.push_back (s);
+	}
+	return node<BlockStatement> (std::move(flat),l);
+      }
+
+      /* The calls hoisted since the last statement as one statement, or null */
+      Statement_ptr takeCalls () {
+	if (callSequence.empty ())
+	  return nullptr;
+	auto l = callSequence.front ()->getLocation ();
+	auto res = makeBlock (std::move(callSequence),l);
+	callSequence.clear ();
+	return res;
+      }
+
+      /* stmt preceded by the calls its expressions hoisted */
+      Statement_ptr withCalls (Statement_ptr stmt) {
+	if (callSequence.empty ())
+	  return stmt;
+	callSequence.push_back (stmt);
+	return takeCalls ();
+      }
+
+      void Constant (Name name, Expression_ptr value) {
+	auto symb = frame.createSymbol (name);
+	symb.setUserData (value);
+      }
+
+      void DeclareStmt (Name name,  Type type,bool parameter,bool out, const location_t&) {
+	auto symb = frame.createSymbol (name);
+	symb.setUserData (VarDecl {type,parameter,out});
+      }
+
+      void ParamDeclare (Name name,  Type type,const location_t&) {
+	auto symb = frame.createSymbol (name);
+	symb.setUserData (ParamDecl {type});
+	params.push_back(symb);
+      }
+
+      void FunctionBegin (Name name) {
+	funcname = name;
+	frame = replacing ? frame.renew (name) : frame.create (name);
+	params.clear();
+      }
+
+      void FunctionEnd (Type ty, Statement_ptr body) {
+	define (std::make_shared<Whiley::Function> (frame,std::move(body),std::move(params),ty));
+      }
+
+      /* As above, with the body at loc left to source */
+      void FunctionEnd (Type ty, std::shared_ptr<BodySource> source, const location_t& loc) {
+	define (std::make_shared<Whiley::Function> (frame,std::move(source),loc,std::move(params),ty));
+      }
+
+      Program get (Statement_ptr main) {
+	return Program (std::move(frame),std::move(main),std::move(arena),std::move(lines));
+      }
+
+      /* Hands back what a builder for a deferred body resumed on */
+      void release (Arena& to, LineTable& toLines) {
+	to = std::move(arena);
+	toLines = std::move(lines);
+      }
+
+      /* Grammar actions of parser.y */
       
       void NumberExpr (std::int64_t val, const location_t& l) {
-	exprStack.insert (std::make_shared<NumberExpression> (val,l));
+	exprStack.insert (makeNumber (val,l));
       }
 
       
       void UndefExpr (Whiley::Type type, const location_t& l) {
-	exprStack.insert (std::make_shared<UndefExpression> (type,l));
+	exprStack.insert (makeUndef (type,l));
       }
 
-      void Constant (const std::string name) {
-	auto left = exprStack.pop ();  
-	auto symb = frame.createSymbol (name);
-	symb.setUserData (left);
+      void Constant (Name name) {
+	Constant (name,exprStack.pop ());
       }
       
-      void IdentifierExpr (const std::string name, const location_t& l) {
-        auto lookup = frame.resolve(name);
-	if (lookup) {
-	  if (std::holds_alternative<Expression_ptr>(lookup.value().getUserData())) {
-	    auto expr = std::get<Expression_ptr>(lookup.value().getUserData());
-	    exprStack.insert(std::move(expr));
-	    
-	  }
-	  else {
-	    exprStack.insert(std::make_shared<Identifier>(lookup.value(), l));
-	  }
-        } else {
-	  NumberExpr (0,l);
-	}          
+      void IdentifierExpr (Name name, const location_t& l) {
+	exprStack.insert (makeIdentifier (name,l));
       }
 
       void DerefExpr (Type t, const location_t& l) {
 	auto left = exprStack.pop ();  
-	exprStack.insert (std::make_shared<DerefExpression> (std::move(left),t,l));
+	exprStack.insert (makeDeref (std::move(left),t,l));
       }
 
       void CastExpr (Type type, const location_t& l) {
 	auto left = exprStack.pop ();  
-	exprStack.insert (std::make_shared<CastExpression> (std::move(left),type,l));
+	exprStack.insert (makeCast (std::move(left),type,l));
       }
 
-      void CallExpr (std::string funcname, std::size_t nbExprs, const location_t& loc) {
-	std::vector<Expression_ptr> exprs;
-	for (std::size_t i = 0; i< nbExprs; ++i) {
-	  exprs.push_back (std::move(exprStack.pop ()));
-	}
-	std::reverse(exprs.begin(),exprs.end());
-	auto lookup = frame.resolve(funcname);
-	if (std::holds_alternative<Function_ptr>(lookup.value().getUserData())) {
-	  auto func = std::get<Function_ptr>(lookup.value().getUserData());
-	  auto symb = frame.createFresh ("£");
-	  symb.setUserData (VarDecl {func->returns(),false,false});
-	  IdentifierExpr (symb.getName(),loc);
-	  addCallSeq (std::make_shared<CallStatement> (symb.getName(),funcname,exprs,loc));
-	}
-	else {
-	  NumberExpr(0,loc);
-	}
+      /* False if funcname is not a function */
+      bool CallExpr (Name funcname, std::size_t nbExprs, const location_t& loc) {
+	auto call = makeCall (funcname,popExprs (nbExprs),loc);
+	if (!call)
+	  return false;
+	exprStack.insert (std::move(call));
+	return true;
       }
       
       void BinaryExpr (BinOps op, const location_t& l) {
 	auto right = exprStack.pop ();
 	auto left = exprStack.pop ();  
-	exprStack.insert (std::make_shared<BinaryExpression> (std::move(left),std::move(right),op,l));
+	exprStack.insert (makeBinary (op,std::move(left),std::move(right),l));
       }
 
-      void AssignStmt (std::string name, const location_t& l) {
-	
-	auto expr = exprStack.pop ();
-	
-	pushStack (std::make_shared<AssignStatement> (name,std::move(expr),l));
+      void AssignStmt (Name name, const location_t& l) {
+	pushStack (makeAssign (name,exprStack.pop (),l));
       }
 
-      void AllocStmt (std::string name, const location_t& l) {
-	
-	auto expr = exprStack.pop ();
-	
-	pushStack (std::make_shared<AllocStatement> (name,std::move(expr),l));
+      void AllocStmt (Name name, const location_t& l) {
+	pushStack (makeAlloc (name,exprStack.pop (),l));
       }
 
       void FreeStmt (const location_t& l) {
-	
-	auto expr = exprStack.pop ();
-	
-	pushStack (std::make_shared<FreeStatement> (std::move(expr),l));
+	pushStack (makeFree (exprStack.pop (),l));
       }
       
       void AssertStmt (const location_t& l) {
-
-	auto expr = exprStack.pop ();
-	  
-	pushStack (std::make_shared<AssertStatement> (std::move(expr),l));
-	
+	pushStack (makeAssert (exprStack.pop (),l));
       }
 
       void AssumeStmt (const location_t& l) {
-
-	auto expr = exprStack.pop ();
-	  
-	pushStack (std::make_shared<AssumeStatement> (std::move(expr),l));
-	
-      }
-      
-      void DeclareStmt (std::string name,  Type type,bool parameter,bool out, const location_t&) {
-	auto symb = frame.createSymbol (name);
-	symb.setUserData (VarDecl {type,parameter,out});
-      }
-
-      void ParamDeclare (std::string name,  Type type,const location_t&) {
-	auto symb = frame.createSymbol (name);
-	symb.setUserData (ParamDecl {type});
-	params.push_back(symb);
+	pushStack (makeAssume (exprStack.pop (),l));
       }
       
       void IfStmt (const location_t& l)  {
 	auto expr = exprStack.pop ();
 	auto elseb = stmtStack.pop ();
 	auto ifb = stmtStack.pop ();
-
-	if (hasWhile()) {
-	  pushStack (std::make_shared<SequenceStatement>(whileSeq(),
-							 std::make_shared<IfStatement> (std::move(expr),
-											std::move(ifb),
-											std::move(elseb),
-											l),
-							 l)
-		     );
-		     
-	}
-	else {
-	  pushStack (std::make_shared<IfStatement> (std::move(expr),
-						    std::move(ifb),
-						    std::move(elseb),
-						    l)
-		     );
-	}
+	pushStack (makeIf (std::move(expr),whileSeq (),std::move(ifb),std::move(elseb),l));
       }
 
       void ChooseStmt (std::size_t bufs, const location_t& l)  {
+	// Branches come off the stack last first and are kept in that order
 	std::vector<Statement_ptr> statements;
 	for (std::size_t i = 0; i< bufs; ++i) {
 	  statements.push_back (std::move(stmtStack.pop ()));
 	}
-	pushStack (std::make_shared<ChooseStatement> (std::move(statements),l));
+	pushStack (makeChoose (std::move(statements),l));
       }
       
        void SkipStmt (const location_t& l) {
-	
-	 pushStack (std::make_shared<SkipStatement> (l));
+	 pushStack (makeSkip (l));
       }
 
       void MemAssignStmt (const location_t& l) {
 	auto assign_val = exprStack.pop ();
 	auto mem = exprStack.pop ();
-	
-	pushStack (std::make_shared<MemAssignStatement> (std::move(mem),
-								std::move(assign_val),
-								l)
-			  );
+	pushStack (makeMemAssign (std::move(mem),std::move(assign_val),l));
       }
       
-      
       void WhileStmt (const location_t& l) {
 	auto expr = exprStack.pop ();
 	auto body = stmtStack.pop ();
-	Statement_ptr while_ = std::make_shared<WhileStatement> (expr,body,l);
-	if (hasWhile()) {
-	  auto whileSequence = whileSeq ();
-	  body = std::make_shared<SequenceStatement> (std::move(body),whileSequence,body->getLocation());
-	  auto temp = std::make_shared<WhileStatement> (expr,body,  l  );
-	  
-	  while_ = std::make_shared<SequenceStatement> (whileSequence,temp,l);
-	}
-	 
-	pushStack (while_);
-	
-        }
+	pushStack (makeWhile (expr,whileSeq (),body,l));
+      }
       
       void WhileCond () {
-	if (callSequence) {
-	  whileSequence.insert(std::move(callSequence));
-	  callSequence = nullptr;
-	}
+	// Always push (possibly null) so every If/While pops exactly its own entry
+	whileSequence.insert(takeCalls ());
       }
 
       void IfCond () {
@@ -845,104 +969,90 @@
       }
 
       
-      void SequenceStmt ( const location_t& l) {
-	auto second = stmtStack.pop ();
-	auto first = stmtStack.pop ();
-	
-	pushStack (std::make_shared<SequenceStatement> (std::move(first),
-							       std::move(second),
-							       l)
-			  );
+      void BlockStmt (std::size_t nbStmts, const location_t& l) {
+	std::vector<Statement_ptr> stmts (nbStmts);
+	for (std::size_t i = nbStmts; i > 0; --i) {
+	  stmts[i-1] = stmtStack.pop ();
+	}
 	
+	stmtStack.insert (makeBlock (std::move(stmts),l));
       }
 
-      void Increment (const std::string name, location_t& l) {
-	pushStack (std::make_shared<IncrementDecrementStatement> (name,false,l));
-      }
-
-      void FunctionBegin (const std::string name) {
-	funcname = name;
-	frame = frame.create (name);
-	params.clear();
+      void Increment (Name name, const location_t& l) {
+	pushStack (makeIncrement (name,l));
       }
       
       void FunctionEnd (Type ty) {
-	auto oldframe = frame;
-	frame = frame.close();
-	auto symbol = frame.createSymbol (funcname);
-	
-	symbol.setUserData (std::make_shared<Whiley::Function> (oldframe,stmtStack.pop(),std::move(params),ty));
+	FunctionEnd (ty,stmtStack.pop());
       }
 
       void ReturnStmt (const location_t& l) {
-	auto expr = exprStack.pop ();
-	
-	pushStack(std::make_shared<ReturnStatement> (std::move(expr),l));
-	
+	pushStack (makeReturn (exprStack.pop (),l));
       }
       
-      void CallStmt (std::string ass, std::string funcname, std::size_t nbExprs, const location_t& loc) {
-	std::vector<Expression_ptr> exprs;
-	for (std::size_t i = 0; i< nbExprs; ++i) {
-	  exprs.push_back (std::move(exprStack.pop ()));
-	}
-	std::reverse(exprs.begin(),exprs.end());
-	pushStack(std::make_shared<CallStatement> (ass,funcname,std::move(exprs),loc));
+      void CallStmt (Name ass, Name funcname, std::size_t nbExprs, const location_t& loc) {
+	pushStack (makeCallStmt (ass,funcname,popExprs (nbExprs),loc));
       }
 
+      Interner& getInterner () const {return frame.getInterner ();}
+      /* Filled by the scanner while parsing; moves into the Program */
+      LineTable& getLineTable () {return lines;}
+      /* Nodes created so far, indexed like NodeKinds */
+      const auto& getNodeCounts () const {return nodeCounts;}
+
       auto get () {
 	if (!stmtStack.size())
-	  SkipStmt ({0,0,0,0});
-	return Program (std::move(frame),stmtStack.pop ());
-	
+	  SkipStmt ({});
+	return get (stmtStack.pop ());
       }
 
       
       
     private:
-
-      void addCallSeq (Statement_ptr ptr) {
-	if (callSequence) {
-	  callSequence = std::make_shared<SequenceStatement> (callSequence,ptr,ptr->getLocation());
-	}
-	else
-	  callSequence = ptr;
+      /* Closes the frame of the function being built and binds its name to func */
+      void define (Function_ptr func) {
+	frame = frame.close();
+	auto symbol = replacing ? frame.resolve (funcname).value () : frame.createSymbol (funcname);
+	symbol.setUserData (std::move(func));
       }
 
-      Statement_ptr getCall () {
-	auto res = callSequence;
-	callSequence = nullptr;
-	return res;
-	
+      template<class T,class... Args>
+      T* node (Args&&... args) {
+	++nodeCounts[NodeKindIndex<T>::value];
+	return arena.make<T> (std::forward<Args>(args)...);
       }
 
-      void pushStack (Statement_ptr ptr) {
-	Statement_ptr f = ptr;
-	if (callSequence) {
-	  f = std::make_shared<SequenceStatement> (callSequence,ptr,ptr->getLocation());
-	  callSequence = nullptr;
+      std::vector<Expression_ptr> popExprs (std::size_t n) {
+	std::vector<Expression_ptr> exprs (n);
+	for (std::size_t i = n; i > 0; --i) {
+	  exprs[i-1] = exprStack.pop ();
 	}
+	return exprs;
+      }
 
-	stmtStack.insert (std::move(f));
-	
+      void pushStack (Statement_ptr ptr) {
+	stmtStack.insert (withCalls (ptr));
       }
 
       Statement_ptr whileSeq () {
 	return whileSequence.pop();
       }
-
-      bool hasWhile () {
-	return whileSequence.size() > 0;
-      }
       
+      Arena arena;
+      LineTable lines;
+      std::array<std::size_t,nodeKindCount> nodeCounts{};
       Stack<Expression_ptr> exprStack;
       Stack<Statement_ptr> stmtStack;
-      Statement_ptr callSequence;
+      std::vector<Statement_ptr> callSequence;
       Stack<Statement_ptr> whileSequence;
       
       Whiley::Frame frame{""};
-      std::string funcname;
+      Name freshPrefix{frame.intern (hoistedPrefix)};
+      Name funcname;
       std::vector<Symbol> params;
+      bool replacing{false};
+      /* Symbols of enclosing frames made from this id on are not there yet in a full parse */
+      std::uint32_t visible{~std::uint32_t{0}};
     };
     
     
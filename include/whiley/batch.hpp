@@ -0,0 +1,71 @@
+#ifndef _WHILEY_BATCH__
+#define _WHILEY_BATCH__
+
+#include "whiley/ast.hpp"
+#include "whiley/vm.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace Whiley {
+  class ThreadPool;
+
+  namespace VM {
+    /**
+     * Runs one program on many rows of parameters across threads. A
+     * column holds one value per row, in the form of runtime.hpp, for a
+     * param or output variable; columns come in the order the program
+     * declares the variables. Every other global starts each row at 0.
+     * A row's outputs are what its run leaves in them, however it stops.
+     * Each thread keeps a Machine for all its rows, so once they have
+     * grown to the program, rows do not allocate.
+     */
+    class Batch {
+    public:
+      struct Column {
+	Symbol symbol;
+	Type type;
+	IR::reg_t reg;
+      };
+
+      /* cfa is prgm compiled, bc the cfa assembled */
+      Batch (const Program& prgm, const IR::CFA& cfa, const Bytecode& bc);
+      ~Batch ();
+
+      const std::vector<Column>& parameters () const {return params;}
+      const std::vector<Column>& outputs () const {return outs;}
+
+      /**
+       * Runs rows [0,rows): run r starts from in[i][r] for parameters ()[i],
+       * stores outputs ()[j] in out[j][r] and how it stopped in results[r].
+       * Throws std::runtime_error unless there is a column for every param
+       * and output and room for every row's result.
+       */
+      void run (std::size_t rows, std::span<const std::uint64_t* const> in, std::span<std::uint64_t* const> out,
+		std::span<RunResult> results);
+
+      /* Threads to run on, all cores by default */
+      void setJobs (std::size_t jobs);
+      /* Row r resolves ? and choose by RandomChoices seeded with seed+r, whichever thread runs it */
+      void setSeed (std::uint64_t s) {seed = s;}
+      void setStepLimit (std::uint64_t steps) {stepLimit = steps;}
+      void setDepthLimit (std::uint32_t depth) {depthLimit = depth;}
+      void setDispatch (Dispatch d) {dispatch = d;}
+
+    private:
+      const Bytecode& bc;
+      std::vector<Column> params;
+      std::vector<Column> outs;
+      std::vector<Machine> machines;
+      std::unique_ptr<ThreadPool> pool;
+      std::uint64_t seed{0};
+      std::uint64_t stepLimit{~std::uint64_t{0}};
+      std::uint32_t depthLimit{1000};
+      Dispatch dispatch{Dispatch::Threaded};
+    };
+  }
+}
+
+#endif
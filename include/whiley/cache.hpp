@@ -0,0 +1,101 @@
+#ifndef _WHILEY_CACHE__
+#define _WHILEY_CACHE__
+
+#include "whiley/image.hpp"
+#include "whiley/options.hpp"
+#include "whiley/parser.hpp"
+#include "whiley/messaging.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+namespace Whiley {
+  /* 128-bit digest of everything a checked program depends on */
+  struct CacheKey {
+    std::uint64_t high{0};
+    std::uint64_t low{0};
+
+    std::string hex () const;
+    bool operator== (const CacheKey&) const = default;
+  };
+
+  struct CacheCounters {
+    std::uint64_t hits{0};
+    std::uint64_t misses{0};
+    std::uint64_t stores{0};
+    std::uint64_t evictions{0};
+    /* Current content */
+    std::uint64_t entries{0};
+    std::uint64_t bytes{0};
+  };
+
+  /**
+   * On-disk cache of type checked programs, stored as ProgramImages and
+   * addressed by a hash of the source bytes, the enabled TypeFlags and the
+   * library and image versions. Only programs that parsed and checked
+   * cleanly are stored.
+   * When the entries outgrow maxBytes the least recently used are removed.
+   * Use is recorded in the files' modification times, so recency carries
+   * over between processes sharing the directory. One cache may be used
+   * from many threads.
+   */
+  class CompilationCache {
+  public:
+    static constexpr std::uint64_t defaultMaxBytes = std::uint64_t{256} << 20;
+
+    /* Creates directory if needed and indexes the entries already in it */
+    explicit CompilationCache (const std::filesystem::path& directory, std::uint64_t maxBytes = defaultMaxBytes);
+
+    static CacheKey key (std::span<const char> source, const TypeFlags& flags);
+
+    /* The cached image or program for key; counts a hit or a miss */
+    std::optional<ProgramImage> find (const CacheKey& key);
+    std::optional<Program> load (const CacheKey& key);
+    void store (const CacheKey& key, const Program& prgm);
+
+    /* The checked program of source, from the cache or else parsed and checked with
+       parser, reporting to messages; nothing if it does not parse or check */
+    std::optional<Program> compile (const WParser& parser, std::span<const char> source, MessageSystem& messages);
+
+    CacheCounters counters () const;
+    void resetCounters ();
+    std::uint64_t maxBytes () const {return limit;}
+    const std::filesystem::path& directory () const {return dir;}
+
+  private:
+    struct Entry {
+      std::string name;
+      std::uint64_t bytes;
+    };
+
+    std::filesystem::path path (const std::string& name) const;
+    void touch (const std::string& name, std::uint64_t bytes);
+    /* Removes the file and its entry */
+    void forget (const std::string& name);
+    void unindex (const std::string& name);
+    void evict ();
+
+    std::filesystem::path dir;
+    std::uint64_t limit;
+
+    mutable std::mutex mutex;
+    /* Least recently used first */
+    std::list<Entry> lru;
+    std::unordered_map<std::string,std::list<Entry>::iterator> index;
+    std::uint64_t total{0};
+
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::atomic<std::uint64_t> stores{0};
+    std::atomic<std::uint64_t> evictions{0};
+  };
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef _WHILEY_CFA__
+#define _WHILEY_CFA__
+
+#include "whiley/ast.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <ranges>
+#include <span>
+#include <vector>
+
+namespace Whiley {
+  class Compiler;
+
+  namespace IR {
+    using expr_t = std::uint32_t;
+    using loc_t = std::uint32_t;
+    using edge_t = std::uint32_t;
+    using reg_t = std::uint32_t;
+    using func_t = std::uint32_t;
+
+    inline constexpr std::uint32_t none = ~std::uint32_t{0};
+
+    enum class ExprKind : std::uint8_t {
+      Register,
+      Constant,
+      Binary,
+      Not,
+      Load,
+      Cast
+    };
+
+    enum class EdgeKind : std::uint8_t {
+      Skip,
+      Assign,
+      Havoc,
+      Assume,
+      Store,
+      Alloc,
+      Free,
+      Call,
+      Return
+    };
+
+    enum class LocationKind : std::uint8_t {
+      Plain,
+      Initial,
+      Final,
+      Error,
+      Entry,
+      Exit
+    };
+
+    /**
+     * Control-flow automaton of a whole program. Locations, edges,
+     * expressions and registers are dense ids into parallel arrays; the
+     * edges leaving a location are contiguous (CSR), as are the ids of the
+     * edges entering one.
+     *
+     * Expressions are hash-consed: building one that exists returns its id,
+     * so equal ids mean equal expressions. Their columns:
+     *   Register  lhs = register
+     *   Constant  value
+     *   Binary    op, lhs, rhs
+     *   Not       lhs; negating a comparison gives the opposite comparison
+     *   Load      lhs = address, type = load type
+     *   Cast      lhs = operand, type = target
+     *
+     * Edge columns (a,b,c):
+     *   Skip
+     *   Assign  a = register, b = expr
+     *   Havoc   a = register, set to any value of its type
+     *   Assume  b = expr, which must be non-zero to take the edge
+     *   Store   b = address expr, c = value expr, stored at the value's width
+     *   Alloc   a = register, b = size expr
+     *   Free    b = expr
+     *   Call    a = register (none if the result is dropped), b = function,
+     *           c = offset into arguments() with the argument count at arguments()[c]
+     *   Return  b = expr; the target is the function's exit
+     *
+     * Registers [0,programRegisters ()) hold the globals and the temporaries
+     * of the main statement. Every function owns a contiguous range, its
+     * parameters first, that is private to each of its activations.
+     */
+    class CFA {
+    public:
+      struct Function {
+	Symbol symbol;
+	Type returns;
+	loc_t entry;
+	loc_t exit;
+	reg_t firstRegister;
+	std::uint32_t registers;
+	std::uint32_t params;
+      };
+
+      /* Building. Edges may be added in any order; finish sorts them */
+      reg_t makeRegister (Type t, std::optional<Symbol> symbol = std::nullopt);
+      loc_t makeLocation (LocationKind k, func_t owner, const location_t& source);
+      func_t makeFunction (Symbol symbol, Type returns, const location_t& source);
+      void addEdge (EdgeKind k, loc_t from, loc_t to, std::uint32_t a = none, std::uint32_t b = none, std::uint32_t c = none);
+      std::uint32_t addArguments (std::span<const expr_t> args);
+
+      expr_t reg (reg_t r);
+      expr_t constant (std::int64_t value, Type t);
+      expr_t binary (BinOps op, Type t, expr_t l, expr_t r);
+      expr_t negate (expr_t e);
+      expr_t load (Type t, expr_t address);
+      expr_t cast (Type t, expr_t e);
+
+      /* Lays the edges out by source and indexes them by target; needed before
+	 successors and predecessors, and again after adding edges. Renumbers edges */
+      void finish ();
+
+      std::size_t locations () const {return lkind.size();}
+      std::size_t edges () const {return ekind.size();}
+      std::size_t expressions () const {return xkind.size();}
+      std::size_t registers () const {return rtype.size();}
+
+      LocationKind locationKind (loc_t l) const {return lkind[l];}
+      /* The function l belongs to, none for the main statement */
+      func_t owner (loc_t l) const {return lowner[l];}
+      const location_t& sourceLocation (loc_t l) const {return lsource[l];}
+      auto successors (loc_t l) const {return std::views::iota (succ[l],succ[l+1]);}
+      std::span<const edge_t> predecessors (loc_t l) const {
+	return {predEdges.data()+pred[l],predEdges.data()+pred[l+1]};
+      }
+
+      EdgeKind edgeKind (edge_t e) const {return ekind[e];}
+      loc_t source (edge_t e) const {return esource[e];}
+      loc_t target (edge_t e) const {return etarget[e];}
+      std::uint32_t a (edge_t e) const {return ea[e];}
+      std::uint32_t b (edge_t e) const {return eb[e];}
+      std::uint32_t c (edge_t e) const {return ec[e];}
+
+      ExprKind exprKind (expr_t x) const {return xkind[x];}
+      BinOps op (expr_t x) const {return xop[x];}
+      Type type (expr_t x) const {return xtype[x];}
+      std::uint32_t lhs (expr_t x) const {return xlhs[x];}
+      std::uint32_t rhs (expr_t x) const {return xrhs[x];}
+      std::int64_t value (expr_t x) const {return xvalue[x];}
+
+      Type registerType (reg_t r) const {return rtype[r];}
+      /* The variable behind r, nothing for temporaries */
+      const std::optional<Symbol>& registerSymbol (reg_t r) const {return rsymbol[r];}
+      std::uint32_t programRegisters () const {return mainRegisters;}
+
+      const auto& functions () const {return funcs;}
+      const auto& arguments () const {return argumentList;}
+      loc_t initial () const {return init;}
+      loc_t final () const {return fin;}
+
+      /* Heap bytes held by the arrays */
+      std::size_t bytes () const;
+
+    private:
+      friend class Whiley::Compiler;
+
+      expr_t intern (ExprKind k, BinOps op, Type t, std::uint32_t l, std::uint32_t r, std::int64_t v);
+      std::size_t hash (ExprKind k, BinOps op, Type t, std::uint32_t l, std::uint32_t r, std::int64_t v) const;
+      void rehash ();
+
+      std::vector<LocationKind> lkind;
+      std::vector<func_t> lowner;
+      std::vector<location_t> lsource;
+
+      std::vector<EdgeKind> ekind;
+      std::vector<loc_t> esource;
+      std::vector<loc_t> etarget;
+      std::vector<std::uint32_t> ea;
+      std::vector<std::uint32_t> eb;
+      std::vector<std::uint32_t> ec;
+      std::vector<edge_t> succ;
+      std::vector<std::uint32_t> pred;
+      std::vector<edge_t> predEdges;
+
+      std::vector<ExprKind> xkind;
+      std::vector<BinOps> xop;
+      std::vector<Type> xtype;
+      std::vector<std::uint32_t> xlhs;
+      std::vector<std::uint32_t> xrhs;
+      std::vector<std::int64_t> xvalue;
+      /* Open addressing over expression ids, none when empty */
+      std::vector<expr_t> slots;
+
+      std::vector<Type> rtype;
+      std::vector<std::optional<Symbol>> rsymbol;
+      std::uint32_t mainRegisters{0};
+
+      std::vector<Function> funcs;
+      std::vector<std::uint32_t> argumentList;
+      loc_t init{none};
+      loc_t fin{none};
+      /* Keeps the symbol table behind the symbols alive */
+      std::optional<Frame> frame;
+    };
+
+    std::ostream& operator<< (std::ostream&, const CFA&);
+  }
+}
+
+#endif
@@ -2,29 +2,55 @@
 #define _WHILEY_COMPILER__
 
 #include "whiley/ast.hpp"
+#include "whiley/cfa.hpp"
+
+#include <memory>
 
 namespace Whiley {
-  class Compiler : private NodeVisitor {
+  /**
+   * Lowers a type checked Program to its control-flow automaton. The main
+   * statement runs from initial () to final (); every function gets an
+   * entry and an exit location, and a body falling off its end blocks.
+   * An assertion branches to an Error location of its own when it fails,
+   * and every ? in an expression becomes a Havoc of a fresh register
+   * right before the statement that reads it.
+   * Throws std::runtime_error on what the checker would have rejected.
+   */
+  class Compiler : private StatementVisitor,
+		   private ExpressionVisitor {
   public:
-    FMTeach::IR::CFA Compile (const FMTeach::Whiley::Program&);
+    Compiler ();
+    ~Compiler ();
+    IR::CFA Compile (const Program& prgm);
+
     void visitIdentifier (const Identifier&) override ;
-    void visitNumberExpression (const NumberExpression& ) override ; 
+    void visitNumberExpression (const NumberExpression& ) override ;
     void visitDerefExpression (const DerefExpression& ) override ;
-    void visitBinaryExpression (const BinaryExpression& ) override ;  
-    void visitAssignStatement (const AssignStatement& ) override ; 
-    void visitAssertStatement (const AssertStatement& ) override ; 
-    void visitAssumeStatement (const AssumeStatement& ) override ; 
-    void visitNonDetAssignStatement (const NonDetAssignStatement& ) override ; 
-    
-    void visitIfStatement (const IfStatement& ) override ; 
-    void visitSkipStatement (const SkipStatement& ) override ; 
-    void visitWhileStatement (const WhileStatement& ) override ; 
-    void visitSequenceStatement (const SequenceStatement& ) override ; 
+    void visitUndefExpression (const UndefExpression& ) override ;
+    void visitCastExpression (const CastExpression& ) override ;
+    void visitBinaryExpression (const BinaryExpression& ) override ;
+
+    void visitAssignStatement (const AssignStatement& ) override ;
+    void visitAllocStatement (const AllocStatement& ) override ;
+    void visitFreeStatement (const FreeStatement& ) override ;
+    void visitAssertStatement (const AssertStatement& ) override ;
+    void visitAssumeStatement (const AssumeStatement& ) override ;
+    void visitIfStatement (const IfStatement& ) override ;
+    void visitSkipStatement (const SkipStatement& ) override ;
+    void visitWhileStatement (const WhileStatement& ) override ;
+    void visitChooseStatement (const ChooseStatement& ) override ;
+    void visitBlockStatement (const BlockStatement& ) override ;
     void visitMemAssignStatement (const MemAssignStatement&) override;
-    
+    void visitReturnStatement (const ReturnStatement&) override;
+    void visitCallStatement (const CallStatement&) override;
+    void visitIncrementDecrementStatement (const IncrementDecrementStatement&) override;
+
   private:
+    IR::expr_t expression (const Expression& e);
+    void statement (const Statement& s, IR::loc_t from, IR::loc_t to);
+
     struct Internal;
-    Internal* _internal = nullptr;
+    std::unique_ptr<Internal> _internal;
   };
 }
 
@@ -0,0 +1,106 @@
+#ifndef _WHILEY_DIAGNOSTICS__
+#define _WHILEY_DIAGNOSTICS__
+
+#include "whiley/messaging.hpp"
+#include "whiley/location.hpp"
+#include "whiley/symbol.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+
+namespace Whiley {
+  enum class DiagnosticKind : std::uint8_t {
+    Text,
+    TypeMismatch,
+    VariableNotDeclared,
+    NotAFunction,
+    NotAVariable,
+    MissingReturn,
+    InconsistentNumberofParameters,
+    ReturnStatementNotInFunction
+  };
+
+  /**
+   * Unformatted form of a Message: what went wrong, where and with which
+   * types or names. format writes the text the Message's to_string would
+   * give. lines, name and symbol point into the checked Program, which
+   * must outlive the record for it to be formatted.
+   */
+  struct Diagnostic {
+    using Formatter = void (*) (std::ostream&, const Diagnostic&);
+
+    DiagnosticKind kind{DiagnosticKind::Text};
+    Type first{Type::Untyped};
+    Type second{Type::Untyped};
+    std::uint32_t offset{0};
+    const LineTable* lines{nullptr};
+    Name name;
+    std::optional<Symbol> symbol;
+    Formatter format{nullptr};
+  };
+
+  /**
+   * MessageSystem keeping messages as Diagnostic records and formatting
+   * them only when flushed. Messages without a record (syntax errors) are
+   * kept as text. Any number of threads may add messages at once without
+   * locking; records get their order from a shared counter and are never
+   * moved. Flushing and reading may run alongside adding and see every
+   * message completed so far.
+   * Past maxMessages further messages are dropped and full() turns true,
+   * which makes the TypeChecker stop.
+   */
+  class DiagnosticBuffer : public MessageSystem {
+  public:
+    static constexpr std::size_t unlimited = std::numeric_limits<std::size_t>::max ();
+
+    explicit DiagnosticBuffer (std::size_t maxMessages = unlimited) : limit(maxMessages) {}
+    DiagnosticBuffer (const DiagnosticBuffer&) = delete;
+    DiagnosticBuffer& operator= (const DiagnosticBuffer&) = delete;
+    ~DiagnosticBuffer ();
+
+    MessageSystem& operator<< (const Message& m) override;
+    bool full () const override {return claimed.load (std::memory_order_relaxed) >= limit;}
+
+    /* Messages kept, and dropped past the limit */
+    std::size_t size () const {return std::min (claimed.load (std::memory_order_acquire),limit);}
+    std::size_t dropped () const;
+    /* Record of message i, or null for text messages and messages still being added */
+    const Diagnostic* get (std::size_t i) const;
+    std::string format (std::size_t i) const;
+
+    /* Writes the messages not flushed yet, one per line, in blocks of about blockSize bytes.
+       Stops at the first message still being added; only one thread may flush at a time */
+    void flush (std::ostream& os, std::size_t blockSize = 1 << 16);
+    /* Passes the messages not flushed yet on, records still unformatted, until to is full */
+    void flush (MessageSystem& to);
+
+  private:
+    struct Slot {
+      Diagnostic diagnostic;
+      std::unique_ptr<std::string> text;
+      std::atomic<bool> ready{false};
+    };
+
+    /* Segment k holds firstSegment << k slots, so 48 segments outlast any index */
+    static constexpr std::size_t firstSegment = 256;
+    static constexpr std::size_t segments = 48;
+
+    Slot* slot (std::size_t i) const;
+    Slot& claim (std::size_t i);
+    bool write (std::ostream& os, std::size_t i) const;
+
+    std::array<std::atomic<Slot*>,segments> segment{};
+    std::atomic<std::size_t> claimed{0};
+    std::size_t limit;
+    std::size_t flushed{0};
+  };
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef _WHILEY_FLAT__
+#define _WHILEY_FLAT__
+
+#include "whiley/ast.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <ostream>
+#include <optional>
+
+namespace Whiley {
+  using stmt_t = std::size_t;
+
+  enum class ExprKind : std::uint8_t {
+    Identifier,
+    Number,
+    Undef,
+    Binary,
+    Deref,
+    Cast
+  };
+
+  enum class StmtKind : std::uint8_t {
+    Skip,
+    Assign,
+    Alloc,
+    Free,
+    Assert,
+    Assume,
+    MemAssign,
+    If,
+    While,
+    Block,
+    Choose,
+    Return,
+    Call,
+    IncrementDecrement
+  };
+
+  /**
+   * Struct-of-arrays form of a Program. Expressions and statements are
+   * stored in post-order, so every operand index is smaller than the index
+   * of its user and a single forward sweep visits children before parents.
+   *
+   * Expression columns:
+   *   Identifier  value = index into symbols()
+   *   Number      value = literal
+   *   Undef       target = type
+   *   Binary      op, lhs, rhs
+   *   Deref       lhs = address, target = load type
+   *   Cast        lhs = operand, target = type
+   *
+   * Statement columns (a,b,c):
+   *   Assign/Alloc        a = index into names(), b = expr
+   *   Free/Assert/Assume  b = expr
+   *   Return              b = expr
+   *   MemAssign           b = address expr, c = value expr
+   *   If                  b = condition, a = then, c = else
+   *   While               b = condition, a = body
+   *   Block/Choose        a = offset into children(), c = count
+   *   Call                a = assign name (none if absent), b = callee name, c = offset into arguments()
+   *                       with the argument count at arguments()[c]
+   *   IncrementDecrement  a = index into names(), b = 1 for a decrement, else 0
+   */
+  class FlatProgram {
+  public:
+    static constexpr std::uint32_t none = ~std::uint32_t{0};
+
+    struct FlatFunction {
+      Symbol symbol;
+      stmt_t body;
+    };
+
+    std::size_t expressions () const {return ekind.size();}
+    std::size_t statements () const {return skind.size();}
+
+    ExprKind kind (expr_t e) const {return ekind[e];}
+    BinOps op (expr_t e) const {return eop[e];}
+    Type type (expr_t e) const {return etype[e];}
+    Type target (expr_t e) const {return etarget[e];}
+    expr_t lhs (expr_t e) const {return elhs[e];}
+    expr_t rhs (expr_t e) const {return erhs[e];}
+    std::int64_t value (expr_t e) const {return evalue[e];}
+    const location_t& exprLocation (expr_t e) const {return eloc[e];}
+
+    StmtKind stmtKind (stmt_t s) const {return skind[s];}
+    std::uint32_t a (stmt_t s) const {return sa[s];}
+    std::uint32_t b (stmt_t s) const {return sb[s];}
+    std::uint32_t c (stmt_t s) const {return sc[s];}
+    const location_t& stmtLocation (stmt_t s) const {return sloc[s];}
+
+    const auto& symbols () const {return symbolTable;}
+    const auto& names () const {return nameTable;}
+    const auto& children () const {return childList;}
+    const auto& arguments () const {return argumentList;}
+    const auto& functions () const {return funcs;}
+    stmt_t main () const {return mainStmt;}
+
+    /* Linear sweeps in storage (post-)order */
+    template<class F>
+    void forEachExpression (F&& f) const {
+      for (expr_t e = 0; e < ekind.size(); ++e)
+	f (e,ekind[e]);
+    }
+
+    template<class F>
+    void forEachStatement (F&& f) const {
+      for (stmt_t s = 0; s < skind.size(); ++s)
+	f (s,skind[s]);
+    }
+
+  private:
+    friend class Flattener;
+    friend FlatProgram flatten (const Program& prgm);
+
+    std::vector<ExprKind> ekind;
+    std::vector<BinOps> eop;
+    std::vector<Type> etype;
+    std::vector<Type> etarget;
+    std::vector<std::uint32_t> elhs;
+    std::vector<std::uint32_t> erhs;
+    std::vector<std::int64_t> evalue;
+    std::vector<location_t> eloc;
+
+    std::vector<StmtKind> skind;
+    std::vector<std::uint32_t> sa;
+    std::vector<std::uint32_t> sb;
+    std::vector<std::uint32_t> sc;
+    std::vector<location_t> sloc;
+
+    std::vector<Symbol> symbolTable;
+    std::vector<Name> nameTable;
+    std::vector<std::uint32_t> childList;
+    std::vector<std::uint32_t> argumentList;
+    std::vector<FlatFunction> funcs;
+    stmt_t mainStmt{0};
+    /* Keeps the symbol table behind symbolTable alive */
+    std::optional<Frame> frame;
+  };
+
+  FlatProgram flatten (const Program& prgm);
+
+  std::ostream& operator<< (std::ostream&, const FlatProgram&);
+}
+
+#endif
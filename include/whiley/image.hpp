@@ -0,0 +1,164 @@
+#ifndef _WHILEY_IMAGE__
+#define _WHILEY_IMAGE__
+
+#include "whiley/ast.hpp"
+#include "whiley/flat.hpp"
+#include "whiley/source.hpp"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace Whiley {
+  /**
+   * Versioned binary image of a parsed and type checked Program: the whole
+   * symbol table, every function body and main, with the types the
+   * TypeChecker set on expressions. Nodes refer to each other by index,
+   * never by pointer, so an opened image is used in place: open() maps the
+   * file and the accessors below read straight from the mapping. load()
+   * turns an image back into a Program without parsing or checking.
+   *
+   * Expressions and statements are stored children first and keep the
+   * column conventions of FlatProgram, except that an Identifier's value
+   * is the id of its symbol in symbols() and names are indices into
+   * string(). Block/Choose children and call arguments live in lists().
+   * Records have no implicit padding, so equal Programs give equal bytes.
+   */
+  class ProgramImage {
+  public:
+    static constexpr std::uint32_t version = 2;
+    static constexpr std::uint32_t none = ~std::uint32_t{0};
+
+    enum class SymbolKind : std::uint8_t {
+      None,
+      Variable,
+      Parameter,
+      Function,
+      Constant
+    };
+
+    struct ExprRecord {
+      std::int64_t value;
+      std::uint32_t lhs;
+      std::uint32_t rhs;
+      location_t location;
+      ExprKind kind;
+      std::uint8_t op;
+      std::uint8_t type;
+      std::uint8_t target;
+      std::uint32_t reserved;
+    };
+
+    struct StmtRecord {
+      std::uint32_t a;
+      std::uint32_t b;
+      std::uint32_t c;
+      location_t location;
+      StmtKind kind;
+      std::uint8_t reserved[3];
+    };
+
+    /* Symbol i of the table; value is the function index or the constant's expression */
+    struct SymbolRecord {
+      std::uint32_t name;
+      std::uint32_t scope;
+      std::uint32_t value;
+      SymbolKind kind;
+      std::uint8_t type;
+      std::uint8_t parameter;
+      std::uint8_t output;
+    };
+
+    /* Scope 0 is the global one; every other scope is a function's and owned by its symbol name__ */
+    struct ScopeRecord {
+      std::uint32_t owner;
+      std::uint32_t parent;
+    };
+
+    /* params is an offset into lists(), holding the parameter count and then their symbols */
+    struct FunctionRecord {
+      std::uint32_t symbol;
+      std::uint32_t scope;
+      std::uint32_t body;
+      std::uint32_t params;
+      std::uint8_t returns;
+      std::uint8_t reserved[3];
+    };
+
+    ProgramImage (ProgramImage&&) = default;
+    ProgramImage& operator= (ProgramImage&&) = default;
+
+    static void write (const Program& prgm, std::ostream& os);
+    /* Writes to a temporary next to filename and renames it, so readers never see half an image */
+    static void write (const Program& prgm, const std::string& filename);
+
+    /* Throws std::runtime_error unless the bytes are an intact image of this version */
+    static ProgramImage open (const std::string& filename);
+    static ProgramImage read (std::istream& is);
+
+    std::size_t expressions () const {return exprs.size ();}
+    std::size_t statements () const {return stmts.size ();}
+
+    ExprKind kind (expr_t e) const {return exprs[e].kind;}
+    BinOps op (expr_t e) const {return static_cast<BinOps> (exprs[e].op);}
+    Type type (expr_t e) const {return static_cast<Type> (exprs[e].type);}
+    Type target (expr_t e) const {return static_cast<Type> (exprs[e].target);}
+    expr_t lhs (expr_t e) const {return exprs[e].lhs;}
+    expr_t rhs (expr_t e) const {return exprs[e].rhs;}
+    std::int64_t value (expr_t e) const {return exprs[e].value;}
+    const location_t& exprLocation (expr_t e) const {return exprs[e].location;}
+
+    StmtKind stmtKind (stmt_t s) const {return stmts[s].kind;}
+    std::uint32_t a (stmt_t s) const {return stmts[s].a;}
+    std::uint32_t b (stmt_t s) const {return stmts[s].b;}
+    std::uint32_t c (stmt_t s) const {return stmts[s].c;}
+    const location_t& stmtLocation (stmt_t s) const {return stmts[s].location;}
+
+    std::string_view string (std::uint32_t i) const {
+      return {chars.data ()+stringOffsets[i],stringOffsets[i+1]-stringOffsets[i]};
+    }
+    std::size_t strings () const {return stringOffsets.size ()-1;}
+
+    auto symbols () const {return syms;}
+    auto scopes () const {return scopeRecords;}
+    auto functions () const {return funcs;}
+    auto lists () const {return listItems;}
+    auto lineStarts () const {return lines;}
+    stmt_t main () const {return mainStmt;}
+
+    /* Size of the image and whether it is read from a mapping */
+    std::size_t bytes () const {return buffer.length ();}
+    bool isMapped () const {return buffer.isMapped ();}
+
+    /* A Program equal to the one written, with its own symbol table and arena */
+    Program load () const;
+
+  private:
+    class Writer;
+
+    ProgramImage (SourceBuffer&& b);
+
+    SourceBuffer buffer;
+    std::span<const char> chars;
+    std::span<const std::uint32_t> stringOffsets;
+    std::span<const SymbolRecord> syms;
+    std::span<const ScopeRecord> scopeRecords;
+    std::span<const ExprRecord> exprs;
+    std::span<const StmtRecord> stmts;
+    std::span<const std::uint32_t> listItems;
+    std::span<const FunctionRecord> funcs;
+    std::span<const std::uint32_t> lines;
+    stmt_t mainStmt{0};
+  };
+
+  static_assert (std::is_trivially_copyable_v<ProgramImage::ExprRecord> && sizeof (ProgramImage::ExprRecord) == 32);
+  static_assert (std::is_trivially_copyable_v<ProgramImage::StmtRecord> && sizeof (ProgramImage::StmtRecord) == 24);
+  static_assert (std::is_trivially_copyable_v<ProgramImage::SymbolRecord> && sizeof (ProgramImage::SymbolRecord) == 16);
+  static_assert (std::is_trivially_copyable_v<ProgramImage::FunctionRecord> && sizeof (ProgramImage::FunctionRecord) == 20);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _WHILEY_INCREMENTAL__
+#define _WHILEY_INCREMENTAL__
+
+#include "whiley/ast.hpp"
+#include "whiley/messaging.hpp"
+#include "whiley/options.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Whiley {
+  struct UpdateResult {
+    operator bool () const {return ok;}
+
+    /* The source parsed, and every function and main last checked cleanly */
+    bool ok{false};
+    /* The whole source was parsed and checked again */
+    bool full{false};
+    std::size_t reparsed{0};
+    /* Functions checked again, main included */
+    std::size_t rechecked{0};
+  };
+
+  /**
+   * A checked Program kept up to date with a source being edited. update()
+   * compares the new source with the previous one; when the change lies
+   * within a single function, only that function is parsed again, into a
+   * fresh scope of the same Program, and the locations of everything after
+   * it are moved. The function is checked again, and so are its callers if
+   * its parameters changed; callers are parsed again if its return type
+   * changed, since the variables receiving hoisted calls carry it.
+   * Any other change (declarations, main, a function's name, several
+   * functions) parses and checks the whole source, as does an update once
+   * replaced functions have left as many dead nodes as live ones.
+   * The result always equals parsing and checking the new source afresh;
+   * messages are only reported for what was checked again.
+   */
+  class IncrementalProgram {
+  public:
+    explicit IncrementalProgram (const TypeFlags& flags = TypeFlags::All ()) : flags(flags) {}
+
+    UpdateResult update (std::span<const char> source, MessageSystem& messages = STDMessageSystem::get());
+
+    /* Whether the last update parsed; program () throws otherwise */
+    bool parsed () const {return prgm.has_value ();}
+    const Program& program () const;
+    std::string_view source () const {return text;}
+
+  private:
+    struct Unit {
+      Name name;
+      location_t loc;
+      /* Functions called, by name */
+      std::vector<Name> callees;
+      bool checked;
+    };
+
+    UpdateResult reparseAll (MessageSystem& messages);
+    bool checkFunction (Unit& unit, MessageSystem& messages);
+    UpdateResult result () const;
+
+    TypeFlags flags;
+    std::string text;
+    std::optional<Program> prgm;
+    /* Functions in source order */
+    std::vector<Unit> units;
+    std::vector<Name> mainCallees;
+    bool mainChecked{false};
+    /* Arena size right after the last full parse */
+    std::size_t liveBytes{0};
+  };
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef _WHILEY_INTERN__
+#define _WHILEY_INTERN__
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <optional>
+#include <ostream>
+#include <cstdint>
+#include <functional>
+
+namespace Whiley {
+  class Interner;
+
+  /**
+   * Handle to an identifier interned in an Interner.
+   * Two names from the same Interner are equal iff their spelling is equal,
+   * so comparison and hashing never touch the characters.
+   */
+  class Name {
+  public:
+    Name () = default;
+    std::string_view view () const {return entry ? std::string_view{entry->text} : std::string_view{};}
+    std::string str () const {return std::string{view()};}
+    std::uint32_t id () const {return entry ? entry->id : 0;}
+    explicit operator bool () const {return entry != nullptr;}
+    bool operator== (const Name& o) const {return entry == o.entry;}
+
+  private:
+    friend class Interner;
+    struct Entry {
+      std::string text;
+      std::uint32_t id;
+    };
+    Name (const Entry* e) : entry(e) {}
+    const Entry* entry{nullptr};
+  };
+
+  inline std::ostream& operator<< (std::ostream& os, const Name& n) {
+    return os << n.view ();
+  }
+
+  class Interner {
+  public:
+    Interner () = default;
+    Interner (const Interner&) = delete;
+    Interner& operator= (const Interner&) = delete;
+
+    Name intern (std::string_view s) {
+      auto it = table.find (s);
+      if (it != table.end())
+	return Name{it->second};
+      auto& entry = entries.emplace_back (Name::Entry{std::string{s},static_cast<std::uint32_t> (entries.size()+1)});
+      table.emplace (std::string_view{entry.text},&entry);
+      return Name{&entry};
+    }
+
+    /* Lookup without inserting; a name that was never interned cannot be bound anywhere */
+    std::optional<Name> lookup (std::string_view s) const {
+      auto it = table.find (s);
+      if (it != table.end())
+	return Name{it->second};
+      return std::nullopt;
+    }
+
+    std::size_t size () const {return entries.size();}
+
+  private:
+    std::deque<Name::Entry> entries;
+    std::unordered_map<std::string_view,const Name::Entry*> table;
+  };
+
+}
+
+template<>
+struct std::hash<Whiley::Name> {
+  std::size_t operator() (const Whiley::Name& n) const noexcept {
+    return n.id ();
+  }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _WHILEY_INTERPRETER__
+#define _WHILEY_INTERPRETER__
+
+#include "whiley/ast.hpp"
+#include "whiley/runtime.hpp"
+
+#include <memory>
+
+namespace Whiley {
+  /**
+   * Runs a type checked Program by walking its AST. It is the reference
+   * for the semantics in runtime.hpp and far slower than the bytecode VM
+   * (vm.hpp), which has to agree with it.
+   */
+  class Interpreter : private StatementVisitor,
+		      private ExpressionVisitor {
+  public:
+    explicit Interpreter (const Program& prgm);
+    ~Interpreter ();
+
+    /* Runs the main statement from the current values of the globals */
+    RunResult run (Nondeterminism& choices);
+    /* Globals, all 0 until set; a run leaves them as it stopped */
+    std::uint64_t get (const Symbol& s) const;
+    void set (const Symbol& s, std::uint64_t v);
+    void reset ();
+    /* A run stops after this many loop iterations and calls */
+    void setStepLimit (std::uint64_t steps);
+    /* Calls nested deeper than this overflow the stack */
+    void setDepthLimit (std::uint32_t depth);
+
+    void visitIdentifier (const Identifier&) override ;
+    void visitNumberExpression (const NumberExpression& ) override ;
+    void visitDerefExpression (const DerefExpression& ) override ;
+    void visitUndefExpression (const UndefExpression& ) override ;
+    void visitCastExpression (const CastExpression& ) override ;
+    void visitBinaryExpression (const BinaryExpression& ) override ;
+
+    void visitAssignStatement (const AssignStatement& ) override ;
+    void visitAllocStatement (const AllocStatement& ) override ;
+    void visitFreeStatement (const FreeStatement& ) override ;
+    void visitAssertStatement (const AssertStatement& ) override ;
+    void visitAssumeStatement (const AssumeStatement& ) override ;
+    void visitIfStatement (const IfStatement& ) override ;
+    void visitSkipStatement (const SkipStatement& ) override ;
+    void visitWhileStatement (const WhileStatement& ) override ;
+    void visitChooseStatement (const ChooseStatement& ) override ;
+    void visitBlockStatement (const BlockStatement& ) override ;
+    void visitMemAssignStatement (const MemAssignStatement&) override;
+    void visitReturnStatement (const ReturnStatement&) override;
+    void visitCallStatement (const CallStatement&) override;
+    void visitIncrementDecrementStatement (const IncrementDecrementStatement&) override;
+
+  private:
+    std::uint64_t expression (const Expression& e);
+    void statement (const Statement& s);
+
+    struct Internal;
+    std::unique_ptr<Internal> _internal;
+  };
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef _WHILEY_KERNELS__
+#define _WHILEY_KERNELS__
+
+#include "whiley/ast.hpp"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace Whiley {
+  /**
+   * The arithmetic of every type, instantiated per Type so that width,
+   * signedness and wrapping are compile-time constants. Values are 64
+   * bits wide, sign- or zero-extended from the width of their type.
+   * Everything that computes with values, at run time or folding
+   * constants, goes through these, so both agree by construction.
+   */
+  namespace Kernels {
+    /* The C++ integer a value of t is held in; pointers and untyped values are plain 64 bits */
+    template<Type t> struct Repr {using type = std::uint64_t;};
+    template<> struct Repr<Type::UI8> {using type = std::uint8_t;};
+    template<> struct Repr<Type::SI8> {using type = std::int8_t;};
+    template<> struct Repr<Type::UI16> {using type = std::uint16_t;};
+    template<> struct Repr<Type::SI16> {using type = std::int16_t;};
+    template<> struct Repr<Type::UI32> {using type = std::uint32_t;};
+    template<> struct Repr<Type::SI32> {using type = std::int32_t;};
+    template<> struct Repr<Type::SI64> {using type = std::int64_t;};
+
+    template<Type t> using repr_t = typename Repr<t>::type;
+    template<Type t> constexpr bool is_signed = std::is_signed_v<repr_t<t>>;
+    /* Bytes in memory */
+    template<Type t> constexpr std::size_t width = sizeof (repr_t<t>);
+
+    /* v cut to the width of t and extended back */
+    template<Type t>
+    constexpr std::uint64_t wrap (std::uint64_t v) {
+      if constexpr (is_signed<t>)
+	return static_cast<std::uint64_t> (static_cast<std::int64_t> (static_cast<repr_t<t>> (v)));
+      else
+	return static_cast<repr_t<t>> (v);
+    }
+
+    template<Type t>
+    constexpr bool less (std::uint64_t a, std::uint64_t b) {
+      if constexpr (is_signed<t>)
+	return static_cast<std::int64_t> (a) < static_cast<std::int64_t> (b);
+      else
+	return a < b;
+    }
+
+    /* a op b; comparisons give 1 or 0. Nothing on division by zero */
+    template<BinOps op, Type t>
+    constexpr std::optional<std::uint64_t> apply (std::uint64_t a, std::uint64_t b) {
+      auto sa = static_cast<std::int64_t> (a), sb = static_cast<std::int64_t> (b);
+      if constexpr (op == BinOps::Add)
+	return wrap<t> (a+b);
+      else if constexpr (op == BinOps::Sub)
+	return wrap<t> (a-b);
+      else if constexpr (op == BinOps::Mul)
+	return wrap<t> (a*b);
+      else if constexpr (op == BinOps::Div) {
+	if (!b)
+	  return std::nullopt;
+	// The most negative value over -1 wraps rather than trapping
+	if constexpr (is_signed<t>)
+	  return wrap<t> (sb == -1 ? 0-a : static_cast<std::uint64_t> (sa/sb));
+	else
+	  return a/b;
+      }
+      else if constexpr (op == BinOps::Mod) {
+	if (!b)
+	  return std::nullopt;
+	if constexpr (is_signed<t>)
+	  return sb == -1 ? 0 : static_cast<std::uint64_t> (sa%sb);
+	else
+	  return a%b;
+      }
+      else if constexpr (op == BinOps::Xor)
+	return a^b;
+      else if constexpr (op == BinOps::Or)
+	return a|b;
+      else if constexpr (op == BinOps::And)
+	return a&b;
+      // The shift is unsigned; shifting every bit out gives 0
+      else if constexpr (op == BinOps::LShl)
+	return b < 64 ? wrap<t> (a << b) : 0;
+      else if constexpr (op == BinOps::LEq)
+	return !less<t> (b,a);
+      else if constexpr (op == BinOps::GEq)
+	return !less<t> (a,b);
+      else if constexpr (op == BinOps::Lt)
+	return less<t> (a,b);
+      else if constexpr (op == BinOps::Gt)
+	return less<t> (b,a);
+      else if constexpr (op == BinOps::Eq)
+	return a == b;
+      else
+	return a != b;
+    }
+
+    using Kernel = std::optional<std::uint64_t> (*) (std::uint64_t, std::uint64_t);
+    using Wrapper = std::uint64_t (*) (std::uint64_t);
+
+    constexpr std::size_t types = std::to_underlying (Type::Pointer)+1;
+    constexpr std::size_t operators = std::to_underlying (BinOps::LShl)+1;
+
+    /* The kernels of every operator at t, by BinOps */
+    template<Type t>
+    inline constexpr auto row = []<std::size_t... ops> (std::index_sequence<ops...>) {
+      return std::array<Kernel,operators> {&apply<static_cast<BinOps> (ops),t>...};
+    } (std::make_index_sequence<operators> ());
+
+    namespace detail {
+      template<std::size_t... ts>
+      constexpr auto kernels (std::index_sequence<ts...>) {
+	return std::array<std::array<Kernel,operators>,types> {row<static_cast<Type> (ts)>...};
+      }
+
+      template<std::size_t... ts>
+      constexpr auto wrappers (std::index_sequence<ts...>) {
+	return std::array<Wrapper,types> {&wrap<static_cast<Type> (ts)>...};
+      }
+
+      inline constexpr auto kernelTable = kernels (std::make_index_sequence<types> ());
+      inline constexpr auto wrapperTable = wrappers (std::make_index_sequence<types> ());
+    }
+
+    /* For when op and t are only known at run time: one lookup, no switch */
+    inline Kernel kernel (BinOps op, Type t) {
+      return detail::kernelTable[std::to_underlying (t)][std::to_underlying (op)];
+    }
+
+    inline Wrapper wrapper (Type t) {
+      return detail::wrapperTable[std::to_underlying (t)];
+    }
+  }
+}
+
+#endif
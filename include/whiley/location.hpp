@@ -0,0 +1,70 @@
+#ifndef _WHILEY_LOCATION__
+#define _WHILEY_LOCATION__
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace Whiley {
+  /* Human readable position, 1-based */
+  struct fileloc_t {
+    std::size_t line{1};
+    std::size_t col{1};
+  };
+
+  inline std::ostream& operator<< (std::ostream& os, const fileloc_t& loc) {
+    return os << loc.line <<":"<<loc.col;
+  }
+
+  /* Byte range [begin,end) into the source; see LineTable for line/column */
+  struct location_t {
+    std::uint32_t begin{0};
+    std::uint32_t end{0};
+
+    void step () {begin = end;}
+    void advance (std::uint32_t n) {end += n;}
+  };
+
+  inline std::ostream& operator<< (std::ostream& os, const location_t& loc) {
+    return os << loc.begin << "-" << loc.end;
+  }
+
+  /**
+   * Start offsets of every line of one source, recorded by the scanner as
+   * it passes newlines. Offsets are only turned into line/column when a
+   * diagnostic or dump asks for them.
+   */
+  class LineTable {
+  public:
+    LineTable () : starts{0} {}
+
+    void addLine (std::uint32_t start) {starts.push_back (start);}
+    std::size_t lines () const {return starts.size ();}
+    const std::vector<std::uint32_t>& lineStarts () const {return starts;}
+
+    /* Follows the source having its bytes [begin,end) replaced by text */
+    void edit (std::uint32_t begin, std::uint32_t end, std::string_view text) {
+      auto first = std::upper_bound (starts.begin (),starts.end (),begin);
+      auto last = std::upper_bound (first,starts.end (),end);
+      auto delta = static_cast<std::uint32_t> (text.size ()) - (end-begin);
+      for (auto it = last; it != starts.end (); ++it)
+	*it += delta;
+      std::vector<std::uint32_t> added;
+      for (auto nl = text.find ('\n'); nl != std::string_view::npos; nl = text.find ('\n',nl+1))
+	added.push_back (begin + static_cast<std::uint32_t> (nl) + 1);
+      starts.insert (starts.erase (first,last),added.begin (),added.end ());
+    }
+
+    fileloc_t lookup (std::uint32_t offset) const {
+      auto line = std::upper_bound (starts.begin (),starts.end (),offset) - starts.begin ();
+      return {static_cast<std::size_t> (line),offset - starts[line-1] + 1};
+    }
+
+  private:
+    std::vector<std::uint32_t> starts;
+  };
+}
+
+#endif
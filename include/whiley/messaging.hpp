@@ -3,13 +3,20 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <iostream>
+#include <mutex>
 
 
 namespace Whiley {
+  struct Diagnostic;
+  
   class Message {
   public:
     ~Message () {}
     virtual std::string to_string () const = 0;
+    /* Fills the compact record of this message if it has one (diagnostics.hpp) */
+    virtual bool describe (Diagnostic&) const {return false;}
     
   };
 
@@ -25,12 +32,17 @@ namespace Whiley {
   public:
     ~MessageSystem () {}
     virtual MessageSystem& operator<< (const Message&) = 0;
+    /* True once further messages are dropped; producers may stop early */
+    virtual bool full () const {return false;}
   };
 
+  /* Shared by default, so writes are serialised to keep concurrent messages whole */
   class STDMessageSystem : public MessageSystem{
   public:
     MessageSystem& operator<< (const Message& m) override {
-      std::cout << m.to_string () << "\n";
+      auto text = m.to_string ();
+      std::lock_guard lock {mutex};
+      std::cout << text << "\n";
       return *this;
     }
 
@@ -41,7 +53,30 @@ namespace Whiley {
     
   private:
     STDMessageSystem () {}
+    std::mutex mutex;
+  };
+
+  /* Formats and keeps messages until flushed; one per task keeps output deterministic */
+  class BufferMessageSystem : public MessageSystem {
+  public:
+    MessageSystem& operator<< (const Message& m) override {
+      messages.push_back (m.to_string ());
+      return *this;
+    }
+
+    void flush (MessageSystem& to) {
+      for (auto& m : messages) {
+	if (to.full ())
+	  break;
+	to << StringMessage {std::move(m)};
+      }
+      messages.clear ();
+    }
+
+    auto size () const {return messages.size ();}
     
+  private:
+    std::vector<std::string> messages;
   };
 
   
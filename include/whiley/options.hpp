@@ -29,6 +29,11 @@ namespace Whiley {
     void reset (E e)  {
       flags.reset (std::to_underlying(e));
     }
+
+    /* One bit per enumerator, for hashing and comparison */
+    unsigned long long bits () const {
+      return flags.to_ullong ();
+    }
     
     
   private:
@@ -1,7 +1,13 @@
+#ifndef _WHILEY_PARSER__
+#define _WHILEY_PARSER__
+
 #include "whiley/ast.hpp"
+#include "whiley/messaging.hpp"
 #include "whiley/options.hpp"
+#include "whiley/stats.hpp"
 
 #include <utility>
+#include <span>
 
 namespace Whiley {
   struct ParseResult {
@@ -14,20 +20,50 @@ namespace Whiley {
   };
   
   
+  /**
+   * Parses are independent of each other and parse() does not modify the
+   * WParser, so one configured WParser may be used from many threads at
+   * once as long as its MessageSystem (and Stats) are thread-safe, or each
+   * parse is given its own MessageSystem.
+   */
   class WParser {
   public:
-    WParser () : flags(TypeFlags::All()) {    }
-    ParseResult parse( const std::string& filename );
-    ParseResult parse( std::istream& iss );
+    /* Syntax errors are reported to messaging */
+    WParser (MessageSystem& messaging = STDMessageSystem::get()) : flags(TypeFlags::All()),messaging(messaging) {    }
+    ParseResult parse( const std::string& filename ) const {return parse (filename,messaging);}
+    ParseResult parse( std::istream& iss ) const {return parse (iss,messaging);}
+    ParseResult parse( std::span<const char> source ) const {return parse (source,messaging);}
+
+    /* As above, but reporting this parse's errors to messages */
+    ParseResult parse( const std::string& filename, MessageSystem& messages ) const;
+    ParseResult parse( std::istream& iss, MessageSystem& messages ) const;
+    ParseResult parse( std::span<const char> source, MessageSystem& messages ) const;
 
     
     template<Type t>
     void disable() {flags.reset (t);}
-    
+    const TypeFlags& getFlags () const {return flags;}
+
+    /* Collect phase times and counters of following parses into stats (null disables) */
+    void setStats (Stats* s) {stats = s;}
+
+    /* Parse with the hand-written recursive-descent parser instead of the Bison one; both build the same Program */
+    void useRecursiveDescent (bool b = true) {recursiveDescent = b;}
+
+    /* Leave function bodies unparsed, only matching their braces: parse() builds the
+       declarations, function signatures and main, and each body is parsed when first
+       asked for (Function::getStmt), throwing if it does not parse. Bodies come out as
+       in a full parse. Implies the recursive-descent parser. */
+    void useLazyBodies (bool b = true) {lazyBodies = b;}
 	
   private:
     TypeFlags flags;
+    MessageSystem& messaging;
+    Stats* stats{nullptr};
+    bool recursiveDescent{false};
+    bool lazyBodies{false};
     
   };
 }
 
+#endif
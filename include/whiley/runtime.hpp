@@ -0,0 +1,180 @@
+#ifndef _WHILEY_RUNTIME__
+#define _WHILEY_RUNTIME__
+
+#include "whiley/ast.hpp"
+#include "whiley/kernels.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+namespace Whiley {
+  /**
+   * Values at run time are 64 bits wide, holding a value of type t
+   * sign- or zero-extended from its width. Every operation leaves its
+   * result in that form, so integers wrap at their own width. These
+   * look up the kernels for a type only known at run time.
+   */
+  inline std::uint64_t normalize (Type t, std::uint64_t v) {
+    return Kernels::wrapper (t) (v);
+  }
+
+  /* a op b for operands of type t; comparisons give 1 or 0. Nothing on division by zero */
+  inline std::optional<std::uint64_t> evaluate (BinOps op, Type t, std::uint64_t a, std::uint64_t b) {
+    return Kernels::kernel (op,t) (a,b);
+  }
+
+  /* Bytes a value of type t takes in memory */
+  inline std::size_t storeSize (Type t) {
+    return isInteger (t) ? bytesize (t) : 8;
+  }
+
+  /**
+   * Memory of one run. A pointer is the block number plus one in its
+   * upper 32 bits and an offset into the block in the lower, so null is 0
+   * and pointer arithmetic stays within 32-bit offsets. Blocks are never
+   * reused within a run; clear keeps the storage for the next one.
+   */
+  class Heap {
+  public:
+    /* A zeroed block of size bytes, or 0 if the heap limit is reached */
+    std::uint64_t allocate (std::uint64_t size);
+    /* False unless p is the start of a live block */
+    bool release (std::uint64_t p);
+    /* False unless [p,p+storeSize (t)) lies in a live block */
+    bool load (std::uint64_t p, Type t, std::uint64_t& v) const {
+      if (!read (p,storeSize (t),v))
+	return false;
+      v = normalize (t,v);
+      return true;
+    }
+
+    bool store (std::uint64_t p, Type t, std::uint64_t v) {
+      return write (p,storeSize (t),v);
+    }
+
+    /* The same for a type known at compile time */
+    template<Type t>
+    bool load (std::uint64_t p, std::uint64_t& v) const {
+      if (!read (p,Kernels::width<t>,v))
+	return false;
+      v = Kernels::wrap<t> (v);
+      return true;
+    }
+
+    template<Type t>
+    bool store (std::uint64_t p, std::uint64_t v) {
+      return write (p,Kernels::width<t>,v);
+    }
+
+    void clear ();
+    void setLimit (std::uint64_t bytes) {limit = bytes;}
+
+  private:
+    struct Block {
+      std::uint64_t offset;
+      std::uint32_t size;
+      bool live;
+    };
+
+    bool read (std::uint64_t p, std::size_t n, std::uint64_t& v) const {
+      auto mem = at (p,n);
+      if (!mem)
+	return false;
+      // Little endian whatever the host
+      std::uint64_t res = 0;
+      if constexpr (std::endian::native == std::endian::little)
+	std::memcpy (&res,mem,n);
+      else
+	for (std::size_t i = n; i > 0; --i)
+	  res = (res << 8) | std::to_integer<std::uint64_t> (mem[i-1]);
+      v = res;
+      return true;
+    }
+
+    bool write (std::uint64_t p, std::size_t n, std::uint64_t v) {
+      auto mem = const_cast<std::byte*> (at (p,n));
+      if (!mem)
+	return false;
+      if constexpr (std::endian::native == std::endian::little)
+	std::memcpy (mem,&v,n);
+      else
+	for (std::size_t i = 0; i < n; ++i, v >>= 8)
+	  mem[i] = static_cast<std::byte> (v);
+      return true;
+    }
+
+    const std::byte* at (std::uint64_t p, std::size_t n) const {
+      // Null has block number 0, which wraps to a block that never exists
+      auto b = (p >> 32)-1;
+      auto offset = p & 0xFFFFFFFFu;
+      if (b >= blocks.size () || !blocks[b].live || offset+n > blocks[b].size)
+	return nullptr;
+      return bytes.data ()+blocks[b].offset+offset;
+    }
+
+    std::vector<Block> blocks;
+    std::vector<std::byte> bytes;
+    std::uint64_t limit{std::uint64_t{1} << 30};
+  };
+
+  /**
+   * Resolves what a program leaves open: the value of every ? and ??T,
+   * and which branch of a choose is taken.
+   */
+  class Nondeterminism {
+  public:
+    virtual ~Nondeterminism () {}
+    /* Any value; it is normalized to t */
+    virtual std::uint64_t value (Type t) = 0;
+    /* One of 0..n-1; only asked when there is a choice, n > 1 */
+    virtual std::size_t choose (std::size_t n) = 0;
+  };
+
+  /* Uniform choices from a seeded SplitMix64 stream */
+  class RandomChoices : public Nondeterminism {
+  public:
+    explicit RandomChoices (std::uint64_t seed = 0) : state(seed) {}
+    std::uint64_t value (Type) override {return next ();}
+    std::size_t choose (std::size_t n) override {
+      // Scales the upper 32 bits rather than dividing when n fits in them
+      return n <= ~std::uint32_t{0} ? static_cast<std::size_t> (((next () >> 32)*n) >> 32) : next () % n;
+    }
+    void reseed (std::uint64_t seed) {state = seed;}
+
+  private:
+    std::uint64_t next () {
+      auto z = (state += 0x9E3779B97F4A7C15ull);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      return z ^ (z >> 31);
+    }
+    std::uint64_t state;
+  };
+
+  enum class Outcome : std::uint8_t {
+    Finished,
+    AssertionFailed,
+    /* An assume did not hold, a choose had no branch or a function ran off its end */
+    Blocked,
+    DivisionByZero,
+    /* Load, store or free through a pointer not into a live block */
+    InvalidAccess,
+    OutOfMemory,
+    StackOverflow,
+    OutOfSteps
+  };
+
+  std::ostream& operator<< (std::ostream& os, Outcome o);
+
+  struct RunResult {
+    Outcome outcome{Outcome::Finished};
+    /* The statement that stopped the run, unless it finished */
+    location_t where{};
+  };
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _WHILEY_SOURCE__
+#define _WHILEY_SOURCE__
+
+#include <span>
+#include <string>
+#include <vector>
+#include <istream>
+#include <cstddef>
+
+namespace Whiley {
+  /**
+   * Owner of the raw bytes of a Whiley program.
+   * Regular files are memory mapped read-only; anything that cannot be
+   * mapped (pipes, terminals, std::istream) is read once into an owned buffer.
+   */
+  class SourceBuffer {
+  public:
+    SourceBuffer () = default;
+    SourceBuffer (const SourceBuffer&) = delete;
+    SourceBuffer (SourceBuffer&&) noexcept;
+    SourceBuffer& operator= (const SourceBuffer&) = delete;
+    SourceBuffer& operator= (SourceBuffer&&) noexcept;
+    ~SourceBuffer ();
+
+    static SourceBuffer fromFile (const std::string& filename);
+    static SourceBuffer fromStream (std::istream& is);
+
+    std::span<const char> view () const {return {data,size};}
+    std::size_t length () const {return size;}
+    bool isMapped () const {return mapped;}
+
+  private:
+    void release ();
+
+    const char* data{nullptr};
+    std::size_t size{0};
+    bool mapped{false};
+    std::vector<char> owned;
+  };
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _WHILEY_STATS__
+#define _WHILEY_STATS__
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace Whiley {
+  /**
+   * Opt-in phase timings and counters. Components take a Stats* that is
+   * null unless instrumentation was requested, so the disabled path costs
+   * one branch per phase. Nodes and tokens are always counted, by a plain
+   * increment of a per-parse count, and only published with stats.
+   * Recording is thread safe; parallel phases appear on their own trace lanes.
+   */
+  class Stats {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    /* Times a phase from construction to destruction; does nothing without stats */
+    class Timer {
+    public:
+      Timer (Stats* stats, std::string_view phase, std::string_view detail = {}) : stats(stats) {
+	if (stats) {
+	  this->phase = phase;
+	  this->detail = detail;
+	  begin = clock::now ();
+	}
+      }
+      Timer (const Timer&) = delete;
+      Timer& operator= (const Timer&) = delete;
+      ~Timer () {
+	if (stats)
+	  stats->record (phase,begin,clock::now (),detail);
+      }
+    private:
+      Stats* stats;
+      std::string_view phase;
+      std::string_view detail;
+      clock::time_point begin;
+    };
+
+    Stats () : origin(clock::now ()) {}
+
+    /* A timed interval; shows up in the phase totals and on the timeline */
+    void record (std::string_view phase, clock::time_point begin, clock::time_point end, std::string_view detail = {});
+    /* Time spent interleaved with other phases; totals only */
+    void addTime (std::string_view phase, clock::duration d);
+    void add (std::string_view counter, std::uint64_t n);
+    void max (std::string_view counter, std::uint64_t n);
+
+    std::uint64_t counter (std::string_view counter) const;
+    clock::duration time (std::string_view phase) const;
+
+    /* {"phases": {name: {"ms": .., "count": ..}}, "counters": {name: n}} */
+    void writeJSON (std::ostream& os) const;
+    /* Chrome trace-event format, loadable in chrome://tracing or Perfetto */
+    void writeTrace (std::ostream& os) const;
+    void clear ();
+
+  private:
+    struct Phase {
+      std::string name;
+      clock::duration total{0};
+      std::uint64_t count{0};
+    };
+    struct Event {
+      std::string name;
+      std::string detail;
+      clock::time_point begin;
+      clock::time_point end;
+      std::size_t lane;
+    };
+
+    Phase& phase (std::string_view name);
+    std::uint64_t& slot (std::string_view name);
+    std::size_t lane ();
+
+    mutable std::mutex mutex;
+    clock::time_point origin;
+    std::vector<Phase> phases;
+    std::vector<std::pair<std::string,std::uint64_t>> counters;
+    std::vector<Event> events;
+    std::vector<std::thread::id> lanes;
+  };
+}
+
+#endif
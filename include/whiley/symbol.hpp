@@ -2,11 +2,19 @@
 #define _WHILEY_SYMBOL__
 
 
+#include <atomic>
+#include <exception>
 #include <memory>
+#include <mutex>
 #include <variant>
 #include <generator>
 #include <vector>
 #include <optional>
+#include <string>
+#include <cstdint>
+
+#include "whiley/intern.hpp"
+#include "whiley/location.hpp"
 
 namespace Whiley {
 
@@ -38,72 +46,127 @@ namespace Whiley {
   };
   
   
+  /* AST nodes are owned by the Arena of their Program; these never own */
   class Statement;
-  using Statement_ptr = std::shared_ptr<Statement>;
+  using Statement_ptr = Statement*;
 
   class Expression;
-  using Expression_ptr = std::shared_ptr<Expression>;
+  using Expression_ptr = Expression*;
   
   class Function;
   using Function_ptr = std::shared_ptr<Function>;
 
   using UserData = std::variant<std::monostate,VarDecl,Function_ptr,ParamDecl,Expression_ptr>;
   
+  struct SymbolTable;
+  
+  /**
+   * Dense handle into the SymbolTable shared by all frames of a compilation.
+   * A Symbol stays valid as long as some Frame of that compilation is alive.
+   */
   class Symbol {
-  private:
-    struct Internal;
-    std::shared_ptr<Internal> internal;
   public:
-    std::string getName() const;
+    Name getName() const;
     std::string getFullName() const;
     void setUserData (UserData);
     const UserData& getUserData () const ;
     Symbol& operator=(const Symbol&) =  default;
-  public:
-    Symbol (const Symbol& s) : internal(s.internal) {}
-    Symbol (Symbol parent,std::string);
-    Symbol (std::string s);
-    std::size_t hash () const;
+    Symbol (const Symbol& s) = default;
+    std::size_t hash () const {return ident;}
+    std::uint32_t id () const {return ident;}
+  private:
+    friend class Frame;
+    friend class ProgramImage;
+    Symbol (SymbolTable* t, std::uint32_t id) : table(t),ident(id) {}
+    SymbolTable* table;
+    std::uint32_t ident;
   };
   
   class Frame {
   public:
     Frame (std::string s);
     Frame (const Frame&f )=default;
-    Frame open(std::string s);
+    Frame& operator= (const Frame&) = default;
+    Frame open(Name s);
+    Frame open(const std::string& s);
     Frame close ();
-    Frame create(std::string s);
+    Frame create(Name s);
+    Frame create(const std::string& s);
+    /* As create, for a child s that exists: it is replaced by an empty scope and
+       whatever was declared in the old one can no longer be resolved */
+    Frame renew(Name s);
 
+    std::optional<Symbol> resolve(Name s) const;
     std::optional<Symbol> resolve(const std::string& s) const;
+    /* As resolve, seeing in enclosing frames only the symbols created before the one with id before */
+    std::optional<Symbol> resolve(Name s, std::uint32_t before) const;
     
-    /*Symbol resolve(const std::string& s) const;
-    bool resolve(const std::string& s, Symbol&) const;
-    */
-    
-    Symbol createSymbol (std::string s);
-    Symbol createFresh (std::string s);
-    std::generator<Symbol> getLocalSymbols() const ; 
+    Symbol createSymbol (Name s);
+    Symbol createSymbol (const std::string& s);
+    /* Unused name prefix<n>; n counts up per scope and prefix */
+    Symbol createFresh (Name prefix);
+    Symbol createFresh (const std::string& s);
+    std::generator<Symbol> getLocalSymbols() const ;
+    /* The symbol this frame belongs to: name__ for a function's, the root itself for the root */
+    Symbol owner () const;
+
+    /* Interner shared by every frame of this compilation */
+    Interner& getInterner () const;
+    Name intern (std::string_view s) const {return getInterner().intern (s);}
+
+    /* Size of the whole table: symbols in all scopes, deepest scope nesting */
+    std::size_t symbolCount () const;
+    std::size_t maxDepth () const;
   private:
-    struct Internal;
-    std::shared_ptr<Internal> _internal;
-    
-    Frame (std::shared_ptr<Internal>&& s) : _internal(std::move(s)) {}
-    Frame (const std::shared_ptr<Internal>& s) : _internal(s) {}
+    friend class Function;
+    friend class ProgramImage;
+    Frame (std::shared_ptr<SymbolTable> t, std::uint32_t scope) : table(std::move(t)),scope(scope) {}
     
+    std::shared_ptr<SymbolTable> table;
+    std::uint32_t scope;
    };
 
+  /**
+   * Parses the function bodies a lazy parse left unparsed (WParser::useLazyBodies)
+   * when they are first asked for. One is shared by all functions of a Program.
+   */
+  class BodySource {
+  public:
+    virtual ~BodySource () {}
+    /* The body of the function whose frame is func; loc spans the text between its braces */
+    virtual Statement_ptr parse (Frame func, const location_t& loc) = 0;
+  private:
+    friend class Function;
+    /* Bodies add symbols to the table they share, so they are parsed one at a time */
+    std::mutex mutex;
+  };
+
   class Function {
   public:
     Function (Whiley::Frame f, Statement_ptr&& stmt, std::vector<Symbol>&& params,Type retType);
+    /* With its body, at loc, left to source */
+    Function (Whiley::Frame f, std::shared_ptr<BodySource> source, const location_t& loc, std::vector<Symbol>&& params,Type retType);
     ~Function();
     auto returns() const {return returnType;}
-    auto& getStmt() const {return stmt;}
-    auto getFrame() const {return frame;}
+    /* Parses a deferred body on first use, safely from any number of threads at once;
+       throws, then and every time after, if it does not parse. Meanwhile other threads may go on reading the symbols
+       they know of, but looking names up by their spelling is not safe. */
+    Statement_ptr getStmt() const;
+    /* False while the body is deferred */
+    bool isParsed () const {return stmt.load (std::memory_order_acquire) != nullptr;}
+    /* Parses a deferred body first, as its declarations belong to the frame */
+    Whiley::Frame getFrame() const;
     auto& getParams() const {return parameters;} 
   private:
-    Whiley::Frame frame;
+    /* Non-owning: the table owns this Function through the symbol's user data */
+    SymbolTable* table;
+    std::uint32_t scope;
     Type returnType;
-    Statement_ptr stmt;
+    mutable std::atomic<Statement_ptr> stmt;
+    std::shared_ptr<BodySource> source;
+    location_t body;
+    /* What parsing the body threw, thrown again on every later try */
+    mutable std::exception_ptr failure;
     std::vector<Symbol> parameters;
   };
   
@@ -0,0 +1,51 @@
+#ifndef _WHILEY_THREADPOOL__
+#define _WHILEY_THREADPOOL__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Whiley {
+  /**
+   * Fixed set of worker threads running index-parallel loops.
+   * The calling thread takes part in every loop, so a pool of size n
+   * spawns n-1 workers and a pool of size 1 runs everything inline.
+   */
+  class ThreadPool {
+  public:
+    explicit ThreadPool (std::size_t threads = std::thread::hardware_concurrency ());
+    ThreadPool (const ThreadPool&) = delete;
+    ThreadPool& operator= (const ThreadPool&) = delete;
+    ~ThreadPool ();
+
+    std::size_t size () const {return workers.size ()+1;}
+
+    /* Runs body(0) ... body(n-1) across the pool and returns when all are done.
+       The first exception thrown by a task is rethrown here. */
+    void parallelFor (std::size_t n, const std::function<void(std::size_t)>& body);
+
+  private:
+    void run ();
+    void drain (const std::function<void(std::size_t)>& body, std::size_t n);
+
+    std::vector<std::jthread> workers;
+    std::mutex submit;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(std::size_t)>* job{nullptr};
+    std::size_t jobSize{0};
+    std::atomic<std::size_t> next{0};
+    std::size_t finished{0};
+    std::uint64_t generation{0};
+    bool stopping{false};
+    std::exception_ptr error;
+  };
+}
+
+#endif
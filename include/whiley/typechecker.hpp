@@ -1,16 +1,27 @@
-#ifndef _WHILEY_COMPILER__
-#define _WHILEY_COMPILER__
+#ifndef _WHILEY_TYPECHECKER__
+#define _WHILEY_TYPECHECKER__
 
 #include "whiley/ast.hpp"
 #include "whiley/messaging.hpp"
+#include "whiley/stats.hpp"
 
 namespace Whiley {
+  class ThreadPool;
+  
   class TypeChecker : private StatementVisitor,
 		      private ExpressionVisitor {
   public:
     TypeChecker (MessageSystem& messaging = STDMessageSystem::get());
     ~TypeChecker ();
+    /* Stops early, failing, once messaging is full () */
     bool CheckProgram (Program& prgm);
+    /* Check only the function func of prgm, or only its main statement */
+    bool CheckFunction (Program& prgm, const Symbol& func);
+    bool CheckMain (Program& prgm);
+    /* Check function bodies on jobs threads; diagnostics keep the serial order */
+    void setJobs (std::size_t jobs);
+    /* Record the checking time per function and overall into stats (null disables) */
+    void setStats (Stats* s) {stats = s;}
     
     void visitIdentifier (const Identifier&) override ;
     void visitNumberExpression (const NumberExpression& ) override ; 
@@ -28,19 +39,25 @@ namespace Whiley {
     void visitSkipStatement (const SkipStatement& ) override ; 
     void visitWhileStatement (const WhileStatement& ) override ; 
     void visitChooseStatement (const ChooseStatement& ) override ; 
-    void visitSequenceStatement (const SequenceStatement& ) override ; 
+    void visitBlockStatement (const BlockStatement& ) override ; 
     void visitMemAssignStatement (const MemAssignStatement&) override;
     void visitReturnStatement (const ReturnStatement&) override;
     void visitCallStatement (const CallStatement&) override;
     void visitIncrementDecrementStatement (const IncrementDecrementStatement& ass) override;
   private:
+    bool CheckAll (Program& prgm);
     [[nodiscard]] Type CheckExpression (Expression&);
     bool CheckStatement (Statement& s);
+    bool CheckFunction (const Symbol& s, const Function_ptr& func);
+    template<class M>
+    void report (M&& msg);
     
     
     struct Internal;
     std::unique_ptr<Internal> _internal;
     MessageSystem& messaging;
+    std::unique_ptr<ThreadPool> pool;
+    Stats* stats{nullptr};
   };
 }
 
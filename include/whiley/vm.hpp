@@ -0,0 +1,205 @@
+#ifndef _WHILEY_VM__
+#define _WHILEY_VM__
+
+#include "whiley/cfa.hpp"
+#include "whiley/runtime.hpp"
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace Whiley {
+  namespace VM {
+    /**
+     * Register machine instructions. Operands a, b and c are slots of the
+     * current frame unless noted; the type is the one the result is
+     * normalized to (for comparisons, the operands').
+     *
+     *   Mov        a := b
+     *   Add .. GEq a := b op c; Div and Mod trap on zero
+     *   Not        a := b == 0
+     *   Cast       a := b normalized to the type
+     *   Load       a := the value of the type at pointer b
+     *   Store      stores c at pointer b, at the width of the type
+     *   Update     stores the value at pointer b combined with c by the BinOps a
+     *   Alloc      a := a new block of b bytes
+     *   Free       frees the block at b
+     *   Havoc      a := any value of the type
+     *   GetGlobal  a := global b
+     *   SetGlobal  global a := b
+     *   Jump       to instruction a
+     *   JumpIf     to instruction a if b is non-zero
+     *   JumpIfNot  to instruction a if b is zero
+     *   JumpEq .. JumpGEq  to instruction a if b op c
+     *   IncJumpLt, IncJumpLEq, IncJumpNEq  b := b+1, then to instruction a if b op c
+     *   Assume     blocks unless b is non-zero
+     *   Choose     to one of the c instructions listed at operands()[b]
+     *   Call       a := function b applied to the arguments that the instructions
+     *              before it wrote just past the frame, where the callee's frame
+     *              starts; a is none when the result is dropped
+     *   Return     returns b
+     *   Halt, Fail, Block  stop: finished, assertion failed, blocked
+     *
+     * Globals are the first slots of the main statement's frame, so there
+     * it reads and writes them as any other slot. Constants, folded where
+     * their operands are constant too, have slots of their own that are
+     * filled in as the frame is entered.
+     */
+    enum class Op : std::uint8_t {
+      Mov,
+      Add,
+      Sub,
+      Mul,
+      Div,
+      Mod,
+      Xor,
+      Or,
+      And,
+      Shl,
+      Eq,
+      NEq,
+      Lt,
+      LEq,
+      Gt,
+      GEq,
+      Not,
+      Cast,
+      Load,
+      Store,
+      Update,
+      Alloc,
+      Free,
+      Havoc,
+      GetGlobal,
+      SetGlobal,
+      Jump,
+      JumpIf,
+      JumpIfNot,
+      JumpEq,
+      JumpNEq,
+      JumpLt,
+      JumpLEq,
+      JumpGt,
+      JumpGEq,
+      IncJumpLt,
+      IncJumpLEq,
+      IncJumpNEq,
+      Assume,
+      Choose,
+      Call,
+      Return,
+      Halt,
+      Fail,
+      Block
+    };
+
+    struct Instr {
+      Op op;
+      std::uint8_t t;
+      /* The code run for op at the type, chosen as it is assembled */
+      std::uint16_t handler;
+      std::uint32_t a;
+      std::uint32_t b;
+      std::uint32_t c;
+
+      Type type () const {return static_cast<Type> (t);}
+    };
+
+    static_assert (sizeof (Instr) == 16);
+
+    /* Code of a whole program: the main statement starts at instruction 0 */
+    struct Bytecode {
+      /* A frame is laid out as parameters, locals, constants and temporaries */
+      struct Function {
+	std::uint32_t entry;
+	std::uint32_t frameSize;
+	std::uint32_t params;
+	std::uint32_t locals;
+	/* The locals that some path reads before it writes them, which are zeroed on
+	   entry: their count, then their slots, at operands()[zeroed]; none for the
+	   main statement, whose frame reset() zeroes */
+	std::uint32_t zeroed;
+	/* The values of the constant slots, from constants[firstConstant] */
+	std::uint32_t firstConstant;
+	std::uint32_t constants;
+      };
+
+      std::vector<Instr> code;
+      /* Where each instruction comes from */
+      std::vector<location_t> sources;
+      /* Argument lists and jump tables */
+      std::vector<std::uint32_t> operands;
+      std::vector<std::uint64_t> constants;
+      std::vector<Function> functions;
+      /* Its locals are the CFA registers of the main statement, globals first */
+      Function main{};
+      /* Their types */
+      std::vector<Type> globals;
+    };
+
+    /* Lays out the CFA as straight-line code, falling through wherever it can */
+    Bytecode assemble (const IR::CFA& cfa);
+
+    std::ostream& operator<< (std::ostream& os, const Bytecode& bc);
+
+    /* How the Machine gets from one instruction to the next */
+    enum class Dispatch : std::uint8_t {
+      /* A switch in a loop */
+      Switch,
+      /* A computed goto at the end of every instruction, where the compiler has them */
+      Threaded
+    };
+
+    /**
+     * Runs Bytecode with the semantics of the Interpreter. Frames live on
+     * one register stack that grows to the deepest call and is kept for
+     * the next run, so calls do not allocate; it grows together with the
+     * return records, so a call only checks those. Each depth has a frame
+     * of the largest size at a fixed place, whose constants are only
+     * copied in when another function ran there last; arguments are
+     * written straight into it, so a recursive call does little more than
+     * push its return record. The Machine runs about ten times as fast as
+     * the Interpreter, less where the heap dominates (see bench/vm.cpp).
+     */
+    class Machine {
+    public:
+      explicit Machine (const Bytecode& bc);
+
+      RunResult run (Nondeterminism& choices);
+      /* Registers of the main statement, by CFA register; they keep their values between runs */
+      std::uint64_t get (IR::reg_t r) const {return stack[r];}
+      void set (IR::reg_t r, std::uint64_t v) {stack[r] = normalize (bc.globals[r],v);}
+      void reset ();
+      /* A run stops after this many jumps and calls */
+      void setStepLimit (std::uint64_t steps) {stepLimit = steps;}
+      void setDepthLimit (std::uint32_t depth) {depthLimit = depth;}
+      /* Threaded dispatch falls back to the switch where it is not built in */
+      void setDispatch (Dispatch d) {dispatch = d;}
+      static bool threadedDispatch ();
+
+    private:
+      struct Frame {
+	std::uint64_t* regs;
+	const Instr* ret;
+	std::uint32_t dest;
+	/* The function whose constants the frame above holds */
+	std::uint32_t constants{~std::uint32_t{0}};
+      };
+
+      template<bool threaded>
+      RunResult execute (Nondeterminism& choices);
+
+      const Bytecode& bc;
+      std::vector<std::uint64_t> stack;
+      std::vector<Frame> frames;
+      /* Of any function's frame */
+      std::uint32_t largest{0};
+      Heap memory;
+      std::uint64_t stepLimit{~std::uint64_t{0}};
+      std::uint32_t depthLimit{1000};
+      Dispatch dispatch{Dispatch::Threaded};
+    };
+  }
+}
+
+#endif
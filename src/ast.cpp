@@ -149,7 +149,7 @@
       }
 
       void visitCallStatement (const CallStatement& r) override {
-	if (r.assignname () != "") {
+	if (r.assignname ()) {
 	  os << r.assignname() << " = ";
 	}
 	os << r.funcname () <<  "(";
@@ -182,13 +182,12 @@
 
       void visitIncrementDecrementStatement (const IncrementDecrementStatement& ass)  {
 
-	os << ass.getIncrementee () << "++;\n"; 
+	os << ass.getIncrementee () << (ass.isDecrement () ? "--;\n" : "++;\n");
 	  }
       
-      void visitSequenceStatement (const SequenceStatement& seg) override {
-	seg.getFirst ().accept(*this);
-	seg.getSecond ().accept(*this);
-	
+      void visitBlockStatement (const BlockStatement& block) override {
+	for (auto s : block.getStatements ())
+	  s->accept(*this);
       }
 
       template<class N>
@@ -0,0 +1,78 @@
+#include "whiley/batch.hpp"
+#include "whiley/threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace Whiley {
+  namespace VM {
+    namespace {
+      /* Rows a thread takes at a time: enough to make taking them cheap, few enough to share out the tail */
+      constexpr std::size_t blockRows = 256;
+    }
+
+    Batch::Batch (const Program& prgm, const IR::CFA& cfa, const Bytecode& bc) : bc(bc) {
+      std::unordered_map<std::uint32_t,IR::reg_t> registers;
+      for (IR::reg_t r = 0; r < cfa.programRegisters (); ++r)
+	if (auto& s = cfa.registerSymbol (r))
+	  registers.emplace (s->id (),r);
+      for (auto decl : prgm.getVars ()) {
+	if (!decl.isParamter () && !decl.isOutput ())
+	  continue;
+	auto it = registers.find (decl.getSymbol ().id ());
+	if (it == registers.end ())
+	  throw std::runtime_error ("No register for " + decl.getSymbol ().getFullName ());
+	(decl.isParamter () ? params : outs).push_back ({decl.getSymbol (),decl.getType (),it->second});
+      }
+      setJobs (std::thread::hardware_concurrency ());
+    }
+
+    Batch::~Batch () {}
+
+    void Batch::setJobs (std::size_t jobs) {
+      jobs = std::max<std::size_t> (jobs,1);
+      pool = jobs > 1 ? std::make_unique<ThreadPool> (jobs) : nullptr;
+      machines.clear ();
+      machines.reserve (jobs);
+      for (std::size_t i = 0; i < jobs; ++i)
+	machines.emplace_back (bc);
+    }
+
+    void Batch::run (std::size_t rows, std::span<const std::uint64_t* const> in, std::span<std::uint64_t* const> out,
+		     std::span<RunResult> results) {
+      if (in.size () != params.size () || out.size () != outs.size ())
+	throw std::runtime_error ("A batch needs one column for each param and each output");
+      if (results.size () < rows)
+	throw std::runtime_error ("No room for the result of every row");
+      for (auto& m : machines) {
+	m.setStepLimit (stepLimit);
+	m.setDepthLimit (depthLimit);
+	m.setDispatch (dispatch);
+      }
+
+      // Threads take blocks of rows as they finish the last, each with its own machine
+      std::atomic<std::size_t> next {0};
+      auto work = [&](std::size_t k) {
+	auto& m = machines[k];
+	RandomChoices choices;
+	for (std::size_t first; (first = next.fetch_add (blockRows,std::memory_order_relaxed)) < rows;)
+	  for (auto row = first, end = std::min (rows,first+blockRows); row < end; ++row) {
+	    m.reset ();
+	    for (std::size_t i = 0; i < params.size (); ++i)
+	      m.set (params[i].reg,in[i][row]);
+	    choices.reseed (seed+row);
+	    results[row] = m.run (choices);
+	    for (std::size_t j = 0; j < outs.size (); ++j)
+	      out[j][row] = m.get (outs[j].reg);
+	  }
+      };
+      if (pool)
+	pool->parallelFor (machines.size (),work);
+      else
+	work (0);
+    }
+  }
+}
@@ -0,0 +1,240 @@
+#include "whiley/cache.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/config.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace Whiley {
+  namespace {
+    const std::string_view extension = ".wimg";
+
+    std::uint64_t fmix (std::uint64_t k) {
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccdull;
+      k ^= k >> 33;
+      k *= 0xc4ceb9fe1a85ec53ull;
+      k ^= k >> 33;
+      return k;
+    }
+
+    /* MurmurHash3 x64 128; not cryptographic, but 128 bits make accidental collisions negligible */
+    CacheKey murmur (std::span<const char> data, std::uint64_t seed) {
+      const std::uint64_t c1 = 0x87c37b91114253d5ull;
+      const std::uint64_t c2 = 0x4cf5ad432745937full;
+      auto p = reinterpret_cast<const unsigned char*> (data.data ());
+      auto n = data.size ();
+      std::uint64_t h1 = seed, h2 = seed;
+
+      for (std::size_t i = 0; i + 16 <= n; i += 16) {
+	std::uint64_t k1, k2;
+	std::memcpy (&k1,p+i,8);
+	std::memcpy (&k2,p+i+8,8);
+	h1 ^= std::rotl (k1*c1,31)*c2;
+	h1 = (std::rotl (h1,27)+h2)*5+0x52dce729;
+	h2 ^= std::rotl (k2*c2,33)*c1;
+	h2 = (std::rotl (h2,31)+h1)*5+0x38495ab5;
+      }
+
+      std::uint64_t k1 = 0, k2 = 0;
+      auto tail = n & ~std::size_t{15};
+      for (std::size_t i = tail; i < n; ++i) {
+	if (i - tail < 8)
+	  k1 |= std::uint64_t{p[i]} << 8*(i-tail);
+	else
+	  k2 |= std::uint64_t{p[i]} << 8*(i-tail-8);
+      }
+      if (n - tail > 8)
+	h2 ^= std::rotl (k2*c2,33)*c1;
+      if (n - tail > 0)
+	h1 ^= std::rotl (k1*c1,31)*c2;
+
+      h1 ^= n;
+      h2 ^= n;
+      h1 += h2;
+      h2 += h1;
+      h1 = fmix (h1);
+      h2 = fmix (h2);
+      h1 += h2;
+      h2 += h1;
+      return {h1,h2};
+    }
+  }
+
+  std::string CacheKey::hex () const {
+    static const char digits[] = "0123456789abcdef";
+    std::string res (32,'0');
+    for (std::size_t i = 0; i < 16; ++i) {
+      res[15-i] = digits[(high >> 4*i) & 15];
+      res[31-i] = digits[(low >> 4*i) & 15];
+    }
+    return res;
+  }
+
+  CompilationCache::CompilationCache (const std::filesystem::path& directory, std::uint64_t maxBytes) : dir(directory),
+													  limit(maxBytes) {
+    std::filesystem::create_directories (dir);
+    struct Found {
+      std::filesystem::file_time_type used;
+      Entry entry;
+    };
+    std::vector<Found> found;
+    for (auto& f : std::filesystem::directory_iterator (dir)) {
+      std::error_code ec;
+      if (f.path ().extension () != extension || !f.is_regular_file (ec))
+	continue;
+      auto size = f.file_size (ec);
+      auto used = f.last_write_time (ec);
+      if (!ec)
+	found.push_back ({used,{f.path ().filename ().string (),size}});
+    }
+    std::sort (found.begin (),found.end (),[](auto& a, auto& b) {return a.used < b.used;});
+    for (auto& f : found)
+      touch (f.entry.name,f.entry.bytes);
+    evict ();
+  }
+
+  CacheKey CompilationCache::key (std::span<const char> source, const TypeFlags& flags) {
+    // Anything that changes the stored program goes into the seed
+    auto salt = std::string{"whiley "} + Version::VERSION_MAJOR + "." + Version::VERSION_MINOR
+      + " image " + std::to_string (ProgramImage::version) + " flags " + std::to_string (flags.bits ());
+    return murmur (source,murmur (salt,0).low);
+  }
+
+  std::filesystem::path CompilationCache::path (const std::string& name) const {
+    return dir / name;
+  }
+
+  std::optional<ProgramImage> CompilationCache::find (const CacheKey& key) {
+    auto name = key.hex () + std::string{extension};
+    auto file = path (name);
+    bool present = false;
+    // A store renames complete images into place, so an image there after a failed open may be new: try it once more
+    for (int attempt = 0; attempt < 2; ++attempt) {
+      try {
+	auto image = ProgramImage::open (file.string ());
+	++hits;
+	touch (name,image.bytes ());
+	std::error_code ec;
+	std::filesystem::last_write_time (file,std::filesystem::file_time_type::clock::now (),ec);
+	return image;
+      }
+      catch (std::runtime_error&) {
+	std::error_code ec;
+	present = std::filesystem::exists (file,ec);
+	if (!present)
+	  break;
+      }
+    }
+    ++misses;
+    // Only an image that is there and unreadable is removed; an absent one may be stored meanwhile
+    if (present)
+      forget (name);
+    else
+      unindex (name);
+    return std::nullopt;
+  }
+
+  std::optional<Program> CompilationCache::load (const CacheKey& key) {
+    auto image = find (key);
+    if (!image)
+      return std::nullopt;
+    try {
+      return image->load ();
+    }
+    catch (std::runtime_error&) {
+      // An image that opens but does not load was a miss after all
+      --hits;
+      ++misses;
+      forget (key.hex () + std::string{extension});
+      return std::nullopt;
+    }
+  }
+
+  void CompilationCache::store (const CacheKey& key, const Program& prgm) {
+    auto name = key.hex () + std::string{extension};
+    auto file = path (name);
+    ProgramImage::write (prgm,file.string ());
+    ++stores;
+    touch (name,std::filesystem::file_size (file));
+    evict ();
+  }
+
+  std::optional<Program> CompilationCache::compile (const WParser& parser, std::span<const char> source, MessageSystem& messages) {
+    auto k = key (source,parser.getFlags ());
+    if (auto prgm = load (k))
+      return prgm;
+    auto parsed = parser.parse (source,messages);
+    if (!parsed)
+      return std::nullopt;
+    auto prgm = parsed.get ();
+    if (!TypeChecker {messages}.CheckProgram (prgm))
+      return std::nullopt;
+    try {
+      store (k,prgm);
+    }
+    catch (std::exception&) {
+      // A cache that cannot be written only costs time
+    }
+    return prgm;
+  }
+
+  CacheCounters CompilationCache::counters () const {
+    std::lock_guard lock {mutex};
+    return {hits.load (),misses.load (),stores.load (),evictions.load (),lru.size (),total};
+  }
+
+  void CompilationCache::resetCounters () {
+    hits = 0;
+    misses = 0;
+    stores = 0;
+    evictions = 0;
+  }
+
+  void CompilationCache::touch (const std::string& name, std::uint64_t bytes) {
+    std::lock_guard lock {mutex};
+    auto it = index.find (name);
+    if (it != index.end ()) {
+      total -= it->second->bytes;
+      it->second->bytes = bytes;
+      lru.splice (lru.end (),lru,it->second);
+    }
+    else
+      index.emplace (name,lru.insert (lru.end (),Entry {name,bytes}));
+    total += bytes;
+  }
+
+  void CompilationCache::forget (const std::string& name) {
+    std::error_code ec;
+    std::filesystem::remove (path (name),ec);
+    unindex (name);
+  }
+
+  void CompilationCache::unindex (const std::string& name) {
+    std::lock_guard lock {mutex};
+    auto it = index.find (name);
+    if (it != index.end ()) {
+      total -= it->second->bytes;
+      lru.erase (it->second);
+      index.erase (it);
+    }
+  }
+
+  void CompilationCache::evict () {
+    std::lock_guard lock {mutex};
+    while (total > limit && !lru.empty ()) {
+      // Removing a mapped image is safe; whoever has it open keeps reading the old pages
+      auto& victim = lru.front ();
+      std::error_code ec;
+      std::filesystem::remove (path (victim.name),ec);
+      total -= victim.bytes;
+      index.erase (victim.name);
+      lru.pop_front ();
+      ++evictions;
+    }
+  }
+}
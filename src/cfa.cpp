@@ -0,0 +1,288 @@
+#include "whiley/cfa.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+namespace Whiley {
+  namespace IR {
+    namespace {
+      std::uint32_t narrow (std::size_t v) {
+	if (v >= none)
+	  throw std::runtime_error ("Program too large for the CFA");
+	return static_cast<std::uint32_t> (v);
+      }
+
+      template<class T>
+      void permute (std::vector<T>& column, const std::vector<edge_t>& order) {
+	std::vector<T> res;
+	res.reserve (order.size ());
+	for (auto e : order)
+	  res.push_back (column[e]);
+	column = std::move(res);
+      }
+
+      template<class T>
+      std::size_t capacityBytes (const std::vector<T>& v) {
+	return v.capacity () * sizeof(T);
+      }
+    }
+
+    reg_t CFA::makeRegister (Type t, std::optional<Symbol> symbol) {
+      auto r = narrow (rtype.size ());
+      rtype.push_back (t);
+      rsymbol.push_back (std::move(symbol));
+      return r;
+    }
+
+    loc_t CFA::makeLocation (LocationKind k, func_t owner, const location_t& source) {
+      auto l = narrow (lkind.size ());
+      lkind.push_back (k);
+      lowner.push_back (owner);
+      lsource.push_back (source);
+      return l;
+    }
+
+    func_t CFA::makeFunction (Symbol symbol, Type returns, const location_t& source) {
+      auto f = narrow (funcs.size ());
+      auto entry = makeLocation (LocationKind::Entry,f,source);
+      auto exit = makeLocation (LocationKind::Exit,f,source);
+      funcs.push_back ({symbol,returns,entry,exit,0,0,0});
+      return f;
+    }
+
+    void CFA::addEdge (EdgeKind k, loc_t from, loc_t to, std::uint32_t a, std::uint32_t b, std::uint32_t c) {
+      narrow (ekind.size ());
+      ekind.push_back (k);
+      esource.push_back (from);
+      etarget.push_back (to);
+      ea.push_back (a);
+      eb.push_back (b);
+      ec.push_back (c);
+    }
+
+    std::uint32_t CFA::addArguments (std::span<const expr_t> args) {
+      auto offset = narrow (argumentList.size ());
+      argumentList.push_back (narrow (args.size ()));
+      argumentList.insert (argumentList.end (),args.begin (),args.end ());
+      return offset;
+    }
+
+    expr_t CFA::reg (reg_t r) {
+      return intern (ExprKind::Register,BinOps::Add,rtype[r],r,none,0);
+    }
+
+    expr_t CFA::constant (std::int64_t value, Type t) {
+      return intern (ExprKind::Constant,BinOps::Add,t,none,none,value);
+    }
+
+    expr_t CFA::binary (BinOps op, Type t, expr_t l, expr_t r) {
+      return intern (ExprKind::Binary,op,t,l,r,0);
+    }
+
+    expr_t CFA::negate (expr_t e) {
+      if (xkind[e] == ExprKind::Not)
+	return xlhs[e];
+      if (xkind[e] == ExprKind::Binary) {
+	auto flipped = [](BinOps op) -> std::optional<BinOps> {
+	  switch (op) {
+	  case BinOps::LEq: return BinOps::Gt;
+	  case BinOps::GEq: return BinOps::Lt;
+	  case BinOps::Lt: return BinOps::GEq;
+	  case BinOps::Gt: return BinOps::LEq;
+	  case BinOps::Eq: return BinOps::NEq;
+	  case BinOps::NEq: return BinOps::Eq;
+	  default: return std::nullopt;
+	  }
+	} (xop[e]);
+	if (flipped)
+	  return binary (*flipped,xtype[e],xlhs[e],xrhs[e]);
+      }
+      return intern (ExprKind::Not,BinOps::Add,xtype[e],e,none,0);
+    }
+
+    expr_t CFA::load (Type t, expr_t address) {
+      return intern (ExprKind::Load,BinOps::Add,t,address,none,0);
+    }
+
+    expr_t CFA::cast (Type t, expr_t e) {
+      return intern (ExprKind::Cast,BinOps::Add,t,e,none,0);
+    }
+
+    std::size_t CFA::hash (ExprKind k, BinOps op, Type t, std::uint32_t l, std::uint32_t r, std::int64_t v) const {
+      auto h = (static_cast<std::uint64_t> (k) << 16) | (static_cast<std::uint64_t> (op) << 8) | static_cast<std::uint64_t> (t);
+      for (std::uint64_t w : {std::uint64_t{l},std::uint64_t{r},static_cast<std::uint64_t> (v)}) {
+	h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+	h ^= h >> 29;
+      }
+      return h;
+    }
+
+    expr_t CFA::intern (ExprKind k, BinOps op, Type t, std::uint32_t l, std::uint32_t r, std::int64_t v) {
+      if (2*(xkind.size ()+1) > slots.size ())
+	rehash ();
+      auto mask = slots.size ()-1;
+      for (auto i = hash (k,op,t,l,r,v) & mask; ; i = (i+1) & mask) {
+	auto x = slots[i];
+	if (x == none) {
+	  x = narrow (xkind.size ());
+	  xkind.push_back (k);
+	  xop.push_back (op);
+	  xtype.push_back (t);
+	  xlhs.push_back (l);
+	  xrhs.push_back (r);
+	  xvalue.push_back (v);
+	  slots[i] = x;
+	  return x;
+	}
+	if (xkind[x] == k && xop[x] == op && xtype[x] == t && xlhs[x] == l && xrhs[x] == r && xvalue[x] == v)
+	  return x;
+      }
+    }
+
+    void CFA::rehash () {
+      slots.assign (std::max<std::size_t> (64,2*slots.size ()),none);
+      auto mask = slots.size ()-1;
+      for (expr_t x = 0; x < xkind.size (); ++x) {
+	auto i = hash (xkind[x],xop[x],xtype[x],xlhs[x],xrhs[x],xvalue[x]) & mask;
+	while (slots[i] != none)
+	  i = (i+1) & mask;
+	slots[i] = x;
+      }
+    }
+
+    void CFA::finish () {
+      // Counting sort by source; stable, so edges of a location keep their order
+      auto n = lkind.size ();
+      succ.assign (n+1,0);
+      for (auto s : esource)
+	++succ[s+1];
+      for (std::size_t l = 0; l < n; ++l)
+	succ[l+1] += succ[l];
+      std::vector<edge_t> order (ekind.size ());
+      {
+	std::vector<edge_t> next (succ.begin (),succ.end ()-1);
+	for (edge_t e = 0; e < ekind.size (); ++e)
+	  order[next[esource[e]]++] = e;
+      }
+      permute (ekind,order);
+      permute (esource,order);
+      permute (etarget,order);
+      permute (ea,order);
+      permute (eb,order);
+      permute (ec,order);
+
+      pred.assign (n+1,0);
+      for (auto t : etarget)
+	++pred[t+1];
+      for (std::size_t l = 0; l < n; ++l)
+	pred[l+1] += pred[l];
+      predEdges.resize (ekind.size ());
+      std::vector<std::uint32_t> next (pred.begin (),pred.end ()-1);
+      for (edge_t e = 0; e < ekind.size (); ++e)
+	predEdges[next[etarget[e]]++] = e;
+    }
+
+    std::size_t CFA::bytes () const {
+      return capacityBytes (lkind) + capacityBytes (lowner) + capacityBytes (lsource)
+	+ capacityBytes (ekind) + capacityBytes (esource) + capacityBytes (etarget)
+	+ capacityBytes (ea) + capacityBytes (eb) + capacityBytes (ec)
+	+ capacityBytes (succ) + capacityBytes (pred) + capacityBytes (predEdges)
+	+ capacityBytes (xkind) + capacityBytes (xop) + capacityBytes (xtype)
+	+ capacityBytes (xlhs) + capacityBytes (xrhs) + capacityBytes (xvalue) + capacityBytes (slots)
+	+ capacityBytes (rtype) + capacityBytes (rsymbol) + capacityBytes (funcs) + capacityBytes (argumentList);
+    }
+
+    static std::ostream& operator<< (std::ostream& os, BinOps op) {
+      static const char* names[] = {"add","sub","div","mul","leq","geq","lt","gt","eq","neq","mod","xor","or","and","lshl"};
+      return os << names[std::to_underlying (op)];
+    }
+
+    std::ostream& operator<< (std::ostream& os, const CFA& cfa) {
+      for (reg_t r = 0; r < cfa.registers (); ++r) {
+	os << "r" << r << " : " << cfa.registerType (r);
+	if (auto& s = cfa.registerSymbol (r))
+	  os << " " << s->getFullName ();
+	os << "\n";
+      }
+      for (expr_t x = 0; x < cfa.expressions (); ++x) {
+	os << "e" << x << " : " << cfa.type (x) << " = ";
+	switch (cfa.exprKind (x)) {
+	case ExprKind::Register:
+	  os << "r" << cfa.lhs (x);
+	  break;
+	case ExprKind::Constant:
+	  os << cfa.value (x);
+	  break;
+	case ExprKind::Binary:
+	  os << cfa.op (x) << " e" << cfa.lhs (x) << " e" << cfa.rhs (x);
+	  break;
+	case ExprKind::Not:
+	  os << "not e" << cfa.lhs (x);
+	  break;
+	case ExprKind::Load:
+	  os << "load e" << cfa.lhs (x);
+	  break;
+	case ExprKind::Cast:
+	  os << "cast e" << cfa.lhs (x);
+	  break;
+	}
+	os << "\n";
+      }
+      for (func_t f = 0; f < cfa.functions ().size (); ++f) {
+	auto& func = cfa.functions ()[f];
+	os << "f" << f << " " << func.symbol.getName () << " -> " << func.returns << " entry l" << func.entry << " exit l" << func.exit
+	   << " registers r" << func.firstRegister << "+" << func.registers << " params " << func.params << "\n";
+      }
+
+      static const char* kinds[] = {"","initial","final","error","entry","exit"};
+      for (loc_t l = 0; l < cfa.locations (); ++l) {
+	os << "l" << l;
+	if (cfa.locationKind (l) != LocationKind::Plain)
+	  os << " " << kinds[std::to_underlying (cfa.locationKind (l))];
+	if (cfa.owner (l) != none)
+	  os << " in f" << cfa.owner (l);
+	os << " @" << cfa.sourceLocation (l) << "\n";
+	for (auto e : cfa.successors (l)) {
+	  os << "  -> l" << cfa.target (e) << " ";
+	  switch (cfa.edgeKind (e)) {
+	  case EdgeKind::Skip:
+	    os << "skip";
+	    break;
+	  case EdgeKind::Assign:
+	    os << "r" << cfa.a (e) << " := e" << cfa.b (e);
+	    break;
+	  case EdgeKind::Havoc:
+	    os << "r" << cfa.a (e) << " := ?";
+	    break;
+	  case EdgeKind::Assume:
+	    os << "assume e" << cfa.b (e);
+	    break;
+	  case EdgeKind::Store:
+	    os << "store e" << cfa.b (e) << " e" << cfa.c (e);
+	    break;
+	  case EdgeKind::Alloc:
+	    os << "r" << cfa.a (e) << " := alloc e" << cfa.b (e);
+	    break;
+	  case EdgeKind::Free:
+	    os << "free e" << cfa.b (e);
+	    break;
+	  case EdgeKind::Call: {
+	    if (cfa.a (e) != none)
+	      os << "r" << cfa.a (e) << " := ";
+	    os << "call f" << cfa.b (e);
+	    auto args = cfa.arguments ().begin ()+cfa.c (e);
+	    for (std::uint32_t i = 1; i <= *args; ++i)
+	      os << " e" << args[i];
+	    break;
+	  }
+	  case EdgeKind::Return:
+	    os << "return e" << cfa.b (e);
+	    break;
+	  }
+	  os << "\n";
+	}
+      }
+      return os;
+    }
+  }
+}
@@ -1,213 +1,290 @@
 #include "whiley/compiler.hpp"
-#include <unordered_map>
-
-namespace FMTeach {
-  namespace Whiley {
-    struct Compiler::Internal {
-      FMTeach::IR::CFA cfa;
-      FMTeach::IR::Location_ptr start;
-      FMTeach::IR::Location_ptr end;
-      FMTeach::IR::Expr_ptr expr;
-      std::unordered_map<std::string,FMTeach::IR::Register_ptr> vars;
-    };
-
-    FMTeach::IR::CFA Compiler::Compile (const FMTeach::Whiley::Program& prgm) {
-      Internal mystore;
-      _internal = &mystore;
-
-      for (auto& var : prgm.getVars ()) {
-	mystore.vars.emplace (var,mystore.cfa.makeRegister (var));
-      }
 
-      mystore.start = mystore.cfa.makeLocation ("Init",true);
+#include <optional>
+#include <stdexcept>
+#include <variant>
+#include <vector>
 
-      prgm.getStmt ().accept(*this);
-      
-      return mystore.cfa;
-    }
-      
-    
-    void Compiler::visitIdentifier (const Identifier& ids) {
-      _internal->expr = _internal->vars.at(ids.getName ());
-    }
-    
-    void Compiler::visitNumberExpression (const NumberExpression& num) {
-      _internal->expr = std::make_shared<FMTeach::IR::Constant> (num.getValue ());
-    }
+namespace Whiley {
+  struct Compiler::Internal {
+    Internal (Frame f) : frame(f) {}
 
-    void Compiler::visitDerefExpression (const DerefExpression& num) {
-      num.getMem ().accept (*this);
-      _internal->expr = std::make_shared<FMTeach::IR::DerefExpr> (_internal->expr);
-    }
-    
-    
-    void Compiler::visitBinaryExpression (const BinaryExpression& be) {
-      be.getLeft ().accept (*this);
-      auto le = _internal->expr;
-      be.getRight ().accept (*this);
-      auto right = _internal->expr;
-      switch (be.getOp ()) {
-	case BinOps::Add:
-	  _internal->expr = std::make_shared<FMTeach::IR::AddExpr> (std::move(le),std::move(right));
-	  break;
-      case BinOps::Sub:
-	_internal->expr = std::make_shared<FMTeach::IR::SubExpr> (std::move(le),std::move(right));
-	break;
-      case BinOps::Mul:
-	_internal->expr = std::make_shared<FMTeach::IR::MulExpr> (std::move(le),std::move(right));
-	break;
-      case BinOps::Div:
-	_internal->expr = std::make_shared<FMTeach::IR::DivExpr> (std::move(le),std::move(right));
-	break;
-      case BinOps::LEq:
-	_internal->expr = std::make_shared<FMTeach::IR::LEqExpr> (std::move(le),std::move(right));
-	break;
-      case BinOps::GEq:
-	_internal->expr = std::make_shared<FMTeach::IR::GEqExpr> (std::move(le),std::move(right));
-	break;
-      case BinOps::Lt:
-	_internal->expr = std::make_shared<FMTeach::IR::LtExpr> (std::move(le),std::move(right));
-	break;
-      case BinOps::Gt:
-	_internal->expr = std::make_shared<FMTeach::IR::GtExpr> (std::move(le),std::move(right));
-	break;
-      case BinOps::Eq:
-	_internal->expr = std::make_shared<FMTeach::IR::EqExpr> (std::move(le),std::move(right));
-	break;
-      case BinOps::NEq:
-	_internal->expr = std::make_shared<FMTeach::IR::NEqExpr> (std::move(le),std::move(right));
-	break;
-	
-	
-      };
-    }
-    
-    void Compiler::visitAssignStatement (const AssignStatement& ass) {
-      auto reg = _internal->vars.at (ass.getAssignName ());
-      ass.getExpression ().accept(*this);
-      _internal->start->setName (static_cast<std::string> (ass.getFileLocation ()));
-      auto end = _internal->cfa.makeLocation ("",false);
-      _internal->start->addEdge (std::make_shared<FMTeach::IR::Assign> (reg,_internal->expr),end);
-      _internal->end = end;
+    /* The register of the variable s, made on first use */
+    IR::reg_t variable (const Symbol& s) {
+      if (s.id () >= registerOf.size ())
+	registerOf.resize (s.id ()+1,IR::none);
+      auto& r = registerOf[s.id ()];
+      if (r == IR::none) {
+	auto type = std::visit (overloaded {
+	    [](const VarDecl& d) -> std::optional<Type> {return d.type;},
+	    [](const ParamDecl& d) -> std::optional<Type> {return d.type;},
+	    [](auto&) -> std::optional<Type> {return std::nullopt;}
+	  },s.getUserData ());
+	if (!type)
+	  throw std::runtime_error ("'" + s.getFullName () + "' is not a variable");
+	r = cfa.makeRegister (*type,s);
+      }
+      return r;
     }
 
-    void Compiler::visitAssertStatement (const AssertStatement& ass) {
-      
-      ass.getExpression ().accept(*this);
-      auto expr = _internal->expr;
-      auto nexpr = std::make_shared<FMTeach::IR::NegationExpr> (expr);
-      auto assert_violated = _internal->cfa.makeLocation ("AssertViolation",false,true);
-      _internal->start->setName (static_cast<std::string> (ass.getFileLocation ()));
-      _internal->start->addEdge (std::make_shared<FMTeach::IR::Assume> (nexpr),assert_violated);
-      
-      // continuation
-      auto nloc = _internal->cfa.makeLocation ("",false);
-      _internal->start->addEdge (std::make_shared<FMTeach::IR::Assume> (expr),nloc);
-      _internal->end = nloc;
+    IR::reg_t variable (Name name) {
+      auto s = frame.resolve (name);
+      if (!s)
+	throw std::runtime_error ("'" + name.str () + "' not declared");
+      return variable (*s);
     }
 
-    void Compiler::visitAssumeStatement (const AssumeStatement& ass) {
-      
-      ass.getExpression ().accept(*this);
-      auto expr = _internal->expr;
-      
-      // continuation
-      auto nloc = _internal->cfa.makeLocation ("",false);
-      _internal->start->setName (static_cast<std::string> (ass.getFileLocation ()));
-      _internal->start->addEdge (std::make_shared<FMTeach::IR::Assume> (expr),nloc);
-      _internal->end = nloc;
+    IR::func_t function (Name name) {
+      auto s = frame.resolve (name);
+      if (!s || s->id () >= functionOf.size () || functionOf[s->id ()] == IR::none)
+	throw std::runtime_error ("'" + name.str () + "' is not a function");
+      return functionOf[s->id ()];
     }
-    
-    void Compiler::visitNonDetAssignStatement (const NonDetAssignStatement& ass) {
-      auto reg = _internal->vars.at (ass.getAssignName ());
-      auto end = _internal->cfa.makeLocation ("",false);
-      _internal->start->setName (static_cast<std::string> (ass.getFileLocation ()));
-      _internal->start->addEdge (std::make_shared<FMTeach::IR::NonDetAssign> (reg),end);
-      _internal->end = end;
+
+    IR::loc_t fresh (const Node& n) {
+      return cfa.makeLocation (IR::LocationKind::Plain,func,n.getLocation ());
     }
-    
-    void Compiler::visitIfStatement (const IfStatement& ifs ) {
-      ifs.getCondition ().accept(*this);
-      auto posExpr = _internal->expr;
-      auto negExpr = std::make_shared<FMTeach::IR::NegationExpr> (_internal->expr);
-      auto my_start = _internal->start;
-      _internal->start->setName (static_cast<std::string> (ifs.getFileLocation ()));
-      auto my_end = _internal->cfa.makeLocation ("",false);
-      
-      //IfBody
-      {
-	auto nloc = _internal->cfa.makeLocation ("",false);
-	my_start->addEdge (std::make_shared<FMTeach::IR::Assume> (posExpr),nloc);
-	_internal->start = nloc;
-	ifs.getIfBody ().accept(*this);
-	_internal->end->addEdge (std::make_shared<FMTeach::IR::Skip> (),my_end);
-	
-      }
 
-      //else body
-      {
-	auto nloc = _internal->cfa.makeLocation ("",false);
-	my_start->addEdge (std::make_shared<FMTeach::IR::Assume> (negExpr),nloc);
-	_internal->start = nloc;
-	ifs.getElseBody ().accept(*this);
-	_internal->end->addEdge (std::make_shared<FMTeach::IR::Skip> (),my_end);
-	
+    /* Emits the havocs the statement's expressions asked for; its own edge starts at the result */
+    IR::loc_t settle (const Node& n) {
+      auto at = from;
+      for (auto r : havocs) {
+	auto next = fresh (n);
+	cfa.addEdge (IR::EdgeKind::Havoc,at,next,r);
+	at = next;
       }
+      havocs.clear ();
+      return at;
+    }
 
-      
-      // Construct start edge for
+    IR::CFA cfa;
+    Frame frame;
+    IR::func_t func{IR::none};
+    /* Where the statement being lowered starts and where it continues */
+    IR::loc_t from{IR::none};
+    IR::loc_t to{IR::none};
+    IR::expr_t expr{0};
+    std::vector<IR::reg_t> havocs;
+    /* Indexed by symbol id */
+    std::vector<IR::reg_t> registerOf;
+    std::vector<IR::func_t> functionOf;
+  };
 
+  Compiler::Compiler () {}
+  Compiler::~Compiler () {}
 
-      _internal->end = my_end;
+  IR::CFA Compiler::Compile (const Program& prgm) {
+    auto root = prgm.getFrame ();
+    _internal = std::make_unique<Internal> (root);
+    auto& in = *_internal;
+    auto& cfa = in.cfa;
+    cfa.frame = root;
+
+    std::vector<std::pair<Symbol,Function_ptr>> funcs;
+    for (auto f : prgm.getFunctions ()) {
+      // Deferred bodies declare their locals when parsed
+      f.getFunction ()->getStmt ();
+      funcs.emplace_back (f.getSymbol (),f.getFunction ());
     }
-    void Compiler::visitSkipStatement (const SkipStatement& ass) {
-      auto end = _internal->cfa.makeLocation ("",false);
-      _internal->start->setName (static_cast<std::string> (ass.getFileLocation ()));
-      _internal->start->addEdge (std::make_shared<FMTeach::IR::Skip> (),end);
-      _internal->end = end;
-      
+    for (auto v : prgm.getVars ())
+      in.variable (v.getSymbol ());
+    for (auto& [symb,func] : funcs) {
+      if (symb.id () >= in.functionOf.size ())
+	in.functionOf.resize (symb.id ()+1,IR::none);
+      in.functionOf[symb.id ()] = cfa.makeFunction (symb,func->returns (),func->getStmt ()->getLocation ());
     }
 
-    void Compiler::visitWhileStatement (const WhileStatement& whiles) {
-      whiles.getCondition ().accept(*this);
-      auto posExpr = _internal->expr;
-      auto negExpr = std::make_shared<FMTeach::IR::NegationExpr> (_internal->expr);
-      _internal->start->setName (static_cast<std::string> (whiles.getFileLocation ()));
-      auto my_start = _internal->start;
-      auto my_end = _internal->cfa.makeLocation ("",false);
-      auto body =  _internal->cfa.makeLocation ("",false);
-      
-      _internal->start->addEdge (std::make_shared<FMTeach::IR::Assume> (negExpr),my_end);
-      _internal->start->addEdge (std::make_shared<FMTeach::IR::Assume> (posExpr),body);
-      _internal->start = body;
-      whiles.getBody ().accept(*this);
-      _internal->end->addEdge (std::make_shared<FMTeach::IR::Skip> (),my_start);
-      
-      _internal->end = my_end;
+    auto& main = prgm.getStmt ();
+    cfa.init = cfa.makeLocation (IR::LocationKind::Initial,IR::none,main.getLocation ());
+    cfa.fin = cfa.makeLocation (IR::LocationKind::Final,IR::none,main.getLocation ());
+    statement (main,cfa.init,cfa.fin);
+    cfa.mainRegisters = cfa.registers ();
+
+    for (auto& [symb,func] : funcs) {
+      auto f = in.functionOf[symb.id ()];
+      in.func = f;
+      in.frame = root.open (symb.getName ());
+      auto first = cfa.registers ();
+      for (auto& p : func->getParams ())
+	in.variable (p);
+      for (auto s : in.frame.getLocalSymbols ())
+	if (std::holds_alternative<VarDecl> (s.getUserData ()))
+	  in.variable (s);
+      auto body = func->getStmt ();
+      statement (*body,cfa.funcs[f].entry,in.fresh (*body));
+      cfa.funcs[f].firstRegister = first;
+      cfa.funcs[f].registers = cfa.registers ()-first;
+      cfa.funcs[f].params = func->getParams ().size ();
     }
 
-    
-    void Compiler::visitMemAssignStatement (const MemAssignStatement& assign) {
-        assign.getMemLoc ().accept (*this);
-	auto mem = _internal->expr;
-	assign.getExpression ().accept (*this);
-	auto assigne = _internal->expr;
-	auto my_end = _internal->cfa.makeLocation ("",false);
-	_internal->start->setName (static_cast<std::string> (assign.getFileLocation ()));
-      
-	_internal->start->addEdge (std::make_shared<FMTeach::IR::Store> (assigne,mem),my_end);
-	_internal->end = my_end;
-	
-      }
-      
-    
-    void Compiler::visitSequenceStatement (const SequenceStatement&  s) {
-      s.getFirst().accept (*this);
-      _internal->start = _internal->end;
-      s.getSecond().accept (*this);
-      
+    cfa.finish ();
+    auto res = std::move(cfa);
+    _internal = nullptr;
+    return res;
+  }
+
+  IR::expr_t Compiler::expression (const Expression& e) {
+    e.accept (*this);
+    return _internal->expr;
+  }
+
+  void Compiler::statement (const Statement& s, IR::loc_t from, IR::loc_t to) {
+    _internal->from = from;
+    _internal->to = to;
+    s.accept (*this);
+  }
+
+  void Compiler::visitIdentifier (const Identifier& id) {
+    _internal->expr = _internal->cfa.reg (_internal->variable (id.getSymbol ()));
+  }
+
+  void Compiler::visitNumberExpression (const NumberExpression& num) {
+    _internal->expr = _internal->cfa.constant (num.getValue (),num.getType ());
+  }
+
+  void Compiler::visitUndefExpression (const UndefExpression& undef) {
+    // Each ? is a value of its own, so it cannot be shared like other expressions
+    auto r = _internal->cfa.makeRegister (undef.getUndefType ());
+    _internal->havocs.push_back (r);
+    _internal->expr = _internal->cfa.reg (r);
+  }
+
+  void Compiler::visitDerefExpression (const DerefExpression& deref) {
+    auto mem = expression (deref.getMem ());
+    _internal->expr = _internal->cfa.load (deref.getLoadType (),mem);
+  }
+
+  void Compiler::visitCastExpression (const CastExpression& cast) {
+    auto e = expression (cast.getExpression ());
+    _internal->expr = _internal->cfa.cast (cast.getType (),e);
+  }
+
+  void Compiler::visitBinaryExpression (const BinaryExpression& be) {
+    auto l = expression (be.getLeft ());
+    auto r = expression (be.getRight ());
+    _internal->expr = _internal->cfa.binary (be.getOp (),be.getType (),l,r);
+  }
+
+  void Compiler::visitSkipStatement (const SkipStatement& s) {
+    _internal->cfa.addEdge (IR::EdgeKind::Skip,_internal->settle (s),_internal->to);
+  }
+
+  void Compiler::visitAssignStatement (const AssignStatement& ass) {
+    auto r = _internal->variable (ass.getAssignName ());
+    auto e = expression (ass.getExpression ());
+    _internal->cfa.addEdge (IR::EdgeKind::Assign,_internal->settle (ass),_internal->to,r,e);
+  }
+
+  void Compiler::visitIncrementDecrementStatement (const IncrementDecrementStatement& inc) {
+    auto& cfa = _internal->cfa;
+    auto r = _internal->variable (inc.getIncrementee ());
+    auto t = cfa.registerType (r);
+    auto e = cfa.binary (inc.isDecrement () ? BinOps::Sub : BinOps::Add,t,cfa.reg (r),cfa.constant (1,t));
+    cfa.addEdge (IR::EdgeKind::Assign,_internal->settle (inc),_internal->to,r,e);
+  }
+
+  void Compiler::visitAllocStatement (const AllocStatement& alloc) {
+    auto r = _internal->variable (alloc.getAssignName ());
+    auto size = expression (alloc.getExpression ());
+    _internal->cfa.addEdge (IR::EdgeKind::Alloc,_internal->settle (alloc),_internal->to,r,size);
+  }
+
+  void Compiler::visitFreeStatement (const FreeStatement& free) {
+    auto e = expression (free.getExpression ());
+    _internal->cfa.addEdge (IR::EdgeKind::Free,_internal->settle (free),_internal->to,IR::none,e);
+  }
+
+  void Compiler::visitAssertStatement (const AssertStatement& ass) {
+    auto& cfa = _internal->cfa;
+    auto e = expression (ass.getExpression ());
+    auto at = _internal->settle (ass);
+    auto violated = cfa.makeLocation (IR::LocationKind::Error,_internal->func,ass.getLocation ());
+    cfa.addEdge (IR::EdgeKind::Assume,at,violated,IR::none,cfa.negate (e));
+    cfa.addEdge (IR::EdgeKind::Assume,at,_internal->to,IR::none,e);
+  }
+
+  void Compiler::visitAssumeStatement (const AssumeStatement& ass) {
+    auto e = expression (ass.getExpression ());
+    _internal->cfa.addEdge (IR::EdgeKind::Assume,_internal->settle (ass),_internal->to,IR::none,e);
+  }
+
+  void Compiler::visitMemAssignStatement (const MemAssignStatement& assign) {
+    auto mem = expression (assign.getMemLoc ());
+    auto e = expression (assign.getExpression ());
+    _internal->cfa.addEdge (IR::EdgeKind::Store,_internal->settle (assign),_internal->to,IR::none,mem,e);
+  }
+
+  void Compiler::visitReturnStatement (const ReturnStatement& ret) {
+    if (_internal->func == IR::none)
+      throw std::runtime_error ("Return statement not inside a function");
+    auto e = expression (ret.getExpr ());
+    auto exit = _internal->cfa.funcs[_internal->func].exit;
+    _internal->cfa.addEdge (IR::EdgeKind::Return,_internal->settle (ret),exit,IR::none,e);
+  }
+
+  void Compiler::visitCallStatement (const CallStatement& call) {
+    auto callee = _internal->function (call.funcname ());
+    auto& params = std::get<Function_ptr> (_internal->frame.resolve (call.funcname ())->getUserData ())->getParams ();
+    if (params.size () != call.parameters ().size ())
+      throw std::runtime_error ("Inconsistent number of parameters (formal vs actual) calling '" + call.funcname ().str () + "'");
+    std::vector<IR::expr_t> args;
+    args.reserve (params.size ());
+    for (auto& p : call.parameters ())
+      args.push_back (expression (*p));
+    auto r = call.assignname () ? _internal->variable (call.assignname ()) : IR::none;
+    auto& cfa = _internal->cfa;
+    cfa.addEdge (IR::EdgeKind::Call,_internal->settle (call),_internal->to,r,callee,cfa.addArguments (args));
+  }
+
+  void Compiler::visitIfStatement (const IfStatement& ifs) {
+    auto& cfa = _internal->cfa;
+    auto to = _internal->to;
+    auto cond = expression (ifs.getCondition ());
+    auto at = _internal->settle (ifs);
+    auto then = _internal->fresh (ifs.getIfBody ());
+    auto otherwise = _internal->fresh (ifs.getElseBody ());
+    cfa.addEdge (IR::EdgeKind::Assume,at,then,IR::none,cond);
+    cfa.addEdge (IR::EdgeKind::Assume,at,otherwise,IR::none,cfa.negate (cond));
+    statement (ifs.getIfBody (),then,to);
+    statement (ifs.getElseBody (),otherwise,to);
+  }
+
+  void Compiler::visitWhileStatement (const WhileStatement& whiles) {
+    // The statement's start is the loop head: nothing else leaves it
+    auto& cfa = _internal->cfa;
+    auto head = _internal->from;
+    auto to = _internal->to;
+    auto cond = expression (whiles.getCondition ());
+    auto at = _internal->settle (whiles);
+    auto body = _internal->fresh (whiles.getBody ());
+    cfa.addEdge (IR::EdgeKind::Assume,at,body,IR::none,cond);
+    cfa.addEdge (IR::EdgeKind::Assume,at,to,IR::none,cfa.negate (cond));
+    statement (whiles.getBody (),body,head);
+  }
+
+  void Compiler::visitChooseStatement (const ChooseStatement& choose) {
+    // Branches start apart, so a loop opening one cannot jump into another
+    auto from = _internal->from;
+    auto to = _internal->to;
+    for (auto& b : choose.getStatements ()) {
+      auto start = _internal->fresh (*b);
+      _internal->cfa.addEdge (IR::EdgeKind::Skip,from,start);
+      statement (*b,start,to);
+    }
+  }
+
+  void Compiler::visitBlockStatement (const BlockStatement& block) {
+    auto& stmts = block.getStatements ();
+    auto at = _internal->from;
+    auto to = _internal->to;
+    if (stmts.empty ()) {
+      _internal->cfa.addEdge (IR::EdgeKind::Skip,at,to);
+      return;
+    }
+    for (std::size_t i = 0; i < stmts.size (); ++i) {
+      auto next = i+1 < stmts.size () ? _internal->fresh (*stmts[i+1]) : to;
+      statement (*stmts[i],at,next);
+      at = next;
     }
-      
-    
   }
 }
@@ -0,0 +1,128 @@
+#include "whiley/diagnostics.hpp"
+
+#include <bit>
+#include <sstream>
+
+namespace Whiley {
+  namespace {
+    struct Position {
+      std::size_t segment;
+      std::size_t offset;
+    };
+
+    /* Forwards a record without formatting it */
+    class RecordMessage : public Message {
+    public:
+      RecordMessage (const Diagnostic& d) : d(d) {}
+      std::string to_string () const override {
+	std::stringstream str;
+	d.format (str,d);
+	return str.str ();
+      }
+      bool describe (Diagnostic& to) const override {
+	to = d;
+	return true;
+      }
+    private:
+      const Diagnostic& d;
+    };
+
+    /* Segment k starts at index firstSegment * (2^k - 1) */
+    template<std::size_t firstSegment>
+    Position position (std::size_t i) {
+      std::size_t k = std::bit_width (i / firstSegment + 1) - 1;
+      return {k,i - firstSegment * ((std::size_t{1} << k) - 1)};
+    }
+  }
+
+  DiagnosticBuffer::~DiagnosticBuffer () {
+    for (auto& s : segment)
+      delete[] s.load (std::memory_order_relaxed);
+  }
+
+  DiagnosticBuffer::Slot* DiagnosticBuffer::slot (std::size_t i) const {
+    auto [k,offset] = position<firstSegment> (i);
+    auto seg = segment[k].load (std::memory_order_acquire);
+    return seg ? seg + offset : nullptr;
+  }
+
+  DiagnosticBuffer::Slot& DiagnosticBuffer::claim (std::size_t i) {
+    auto [k,offset] = position<firstSegment> (i);
+    auto seg = segment[k].load (std::memory_order_acquire);
+    if (!seg) {
+      // Whoever installs the segment first wins; the others discard theirs
+      auto fresh = new Slot[firstSegment << k];
+      if (segment[k].compare_exchange_strong (seg,fresh,std::memory_order_acq_rel))
+	seg = fresh;
+      else
+	delete[] fresh;
+    }
+    return seg[offset];
+  }
+
+  MessageSystem& DiagnosticBuffer::operator<< (const Message& m) {
+    auto i = claimed.fetch_add (1,std::memory_order_relaxed);
+    if (i >= limit)
+      return *this;
+    auto& s = claim (i);
+    if (!m.describe (s.diagnostic))
+      s.text = std::make_unique<std::string> (m.to_string ());
+    s.ready.store (true,std::memory_order_release);
+    return *this;
+  }
+
+  std::size_t DiagnosticBuffer::dropped () const {
+    auto n = claimed.load (std::memory_order_relaxed);
+    return n > limit ? n - limit : 0;
+  }
+
+  const Diagnostic* DiagnosticBuffer::get (std::size_t i) const {
+    auto s = i < size () ? slot (i) : nullptr;
+    if (!s || !s->ready.load (std::memory_order_acquire) || s->text)
+      return nullptr;
+    return &s->diagnostic;
+  }
+
+  bool DiagnosticBuffer::write (std::ostream& os, std::size_t i) const {
+    auto s = slot (i);
+    if (!s || !s->ready.load (std::memory_order_acquire))
+      return false;
+    if (s->text)
+      os << *s->text;
+    else
+      s->diagnostic.format (os,s->diagnostic);
+    return true;
+  }
+
+  std::string DiagnosticBuffer::format (std::size_t i) const {
+    std::stringstream str;
+    if (i < size ())
+      write (str,i);
+    return str.str ();
+  }
+
+  void DiagnosticBuffer::flush (std::ostream& os, std::size_t blockSize) {
+    std::stringstream block;
+    for (auto n = size (); flushed < n && write (block,flushed); ++flushed) {
+      block << "\n";
+      if (static_cast<std::size_t> (block.tellp ()) >= blockSize) {
+	os << block.view ();
+	block.str ({});
+      }
+    }
+    os << block.view ();
+    os.flush ();
+  }
+
+  void DiagnosticBuffer::flush (MessageSystem& to) {
+    for (auto n = size (); flushed < n && !to.full (); ++flushed) {
+      auto s = slot (flushed);
+      if (!s || !s->ready.load (std::memory_order_acquire))
+	break;
+      if (s->text)
+	to << StringMessage {*s->text};
+      else
+	to << RecordMessage {s->diagnostic};
+    }
+  }
+}
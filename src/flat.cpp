@@ -0,0 +1,302 @@
+#include "whiley/flat.hpp"
+
+#include <unordered_map>
+#include <stdexcept>
+#include <limits>
+
+namespace Whiley {
+  class Flattener : private ExpressionVisitor,
+		    private StatementVisitor {
+  public:
+    Flattener (FlatProgram& f) : flat(f) {}
+
+    expr_t expression (const Expression& e) {
+      auto it = exprIndex.find (&e);
+      if (it != exprIndex.end ())
+	return it->second;
+      e.accept (*this);
+      exprIndex.emplace (&e,result);
+      return result;
+    }
+
+    stmt_t statement (const Statement& s) {
+      s.accept (*this);
+      return result;
+    }
+
+  private:
+    static std::uint32_t narrow (std::size_t v) {
+      if (v >= FlatProgram::none)
+	throw std::runtime_error ("Program too large for flat representation");
+      return static_cast<std::uint32_t> (v);
+    }
+
+    std::uint32_t name (Name n) {
+      auto [it,inserted] = nameIndex.emplace (n,flat.nameTable.size());
+      if (inserted)
+	flat.nameTable.push_back (n);
+      return it->second;
+    }
+
+    std::uint32_t symbol (const Symbol& s) {
+      auto [it,inserted] = symbolIndex.emplace (s.hash(),flat.symbolTable.size());
+      if (inserted)
+	flat.symbolTable.push_back (s);
+      return it->second;
+    }
+
+    expr_t pushExpr (ExprKind k, const Expression& e, std::uint32_t lhs = FlatProgram::none, std::uint32_t rhs = FlatProgram::none) {
+      flat.ekind.push_back (k);
+      flat.eop.push_back (BinOps::Add);
+      flat.etype.push_back (e.getType ());
+      flat.etarget.push_back (Type::Untyped);
+      flat.elhs.push_back (lhs);
+      flat.erhs.push_back (rhs);
+      flat.evalue.push_back (0);
+      flat.eloc.push_back (e.getLocation ());
+      return narrow (flat.ekind.size()-1);
+    }
+
+    stmt_t pushStmt (StmtKind k, const Statement& s, std::uint32_t a = FlatProgram::none, std::uint32_t b = FlatProgram::none, std::uint32_t c = FlatProgram::none) {
+      flat.skind.push_back (k);
+      flat.sa.push_back (a);
+      flat.sb.push_back (b);
+      flat.sc.push_back (c);
+      flat.sloc.push_back (s.getLocation ());
+      return narrow (flat.skind.size()-1);
+    }
+
+    std::uint32_t list (const std::vector<std::uint32_t>& items) {
+      auto offset = narrow (flat.childList.size());
+      flat.childList.insert (flat.childList.end(),items.begin(),items.end());
+      return offset;
+    }
+
+    void visitIdentifier (const Identifier& id) override {
+      result = pushExpr (ExprKind::Identifier,id);
+      flat.evalue[result] = symbol (id.getSymbol ());
+    }
+
+    void visitNumberExpression (const NumberExpression& n) override {
+      result = pushExpr (ExprKind::Number,n);
+      flat.evalue[result] = n.getValue ();
+    }
+
+    void visitUndefExpression (const UndefExpression& u) override {
+      result = pushExpr (ExprKind::Undef,u);
+      flat.etarget[result] = u.getUndefType ();
+    }
+
+    void visitBinaryExpression (const BinaryExpression& b) override {
+      auto l = expression (b.getLeft ());
+      auto r = expression (b.getRight ());
+      result = pushExpr (ExprKind::Binary,b,l,r);
+      flat.eop[result] = b.getOp ();
+    }
+
+    void visitDerefExpression (const DerefExpression& d) override {
+      auto m = expression (d.getMem ());
+      result = pushExpr (ExprKind::Deref,d,m);
+      flat.etarget[result] = d.getLoadType ();
+    }
+
+    void visitCastExpression (const CastExpression& c) override {
+      auto m = expression (c.getExpression ());
+      result = pushExpr (ExprKind::Cast,c,m);
+      flat.etarget[result] = c.getType ();
+    }
+
+    void visitSkipStatement (const SkipStatement& s) override {
+      result = pushStmt (StmtKind::Skip,s);
+    }
+
+    void visitAssignStatement (const AssignStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Assign,s,name (s.getAssignName ()),e);
+    }
+
+    void visitAllocStatement (const AllocStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Alloc,s,name (s.getAssignName ()),e);
+    }
+
+    void visitFreeStatement (const FreeStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Free,s,FlatProgram::none,e);
+    }
+
+    void visitAssertStatement (const AssertStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Assert,s,FlatProgram::none,e);
+    }
+
+    void visitAssumeStatement (const AssumeStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Assume,s,FlatProgram::none,e);
+    }
+
+    void visitReturnStatement (const ReturnStatement& s) override {
+      auto e = expression (s.getExpr ());
+      result = pushStmt (StmtKind::Return,s,FlatProgram::none,e);
+    }
+
+    void visitMemAssignStatement (const MemAssignStatement& s) override {
+      auto m = expression (s.getMemLoc ());
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::MemAssign,s,FlatProgram::none,m,e);
+    }
+
+    void visitIfStatement (const IfStatement& s) override {
+      auto cond = expression (s.getCondition ());
+      auto ifb = statement (s.getIfBody ());
+      auto elseb = statement (s.getElseBody ());
+      result = pushStmt (StmtKind::If,s,ifb,cond,elseb);
+    }
+
+    void visitWhileStatement (const WhileStatement& s) override {
+      auto cond = expression (s.getCondition ());
+      auto body = statement (s.getBody ());
+      result = pushStmt (StmtKind::While,s,body,cond);
+    }
+
+    void visitBlockStatement (const BlockStatement& block) override {
+      std::vector<std::uint32_t> items;
+      for (auto s : block.getStatements ())
+	items.push_back (statement (*s));
+      auto offset = list (items);
+      result = pushStmt (StmtKind::Block,block,offset,FlatProgram::none,narrow (items.size()));
+    }
+
+    void visitChooseStatement (const ChooseStatement& s) override {
+      std::vector<std::uint32_t> items;
+      for (auto& b : s.getStatements ())
+	items.push_back (statement (*b));
+      auto offset = list (items);
+      result = pushStmt (StmtKind::Choose,s,offset,FlatProgram::none,narrow (items.size()));
+    }
+
+    void visitCallStatement (const CallStatement& s) override {
+      std::vector<std::uint32_t> args;
+      for (auto& p : s.parameters ())
+	args.push_back (expression (*p));
+      auto offset = narrow (flat.argumentList.size());
+      flat.argumentList.push_back (narrow (args.size()));
+      flat.argumentList.insert (flat.argumentList.end(),args.begin(),args.end());
+      auto assign = s.assignname () ? name (s.assignname ()) : FlatProgram::none;
+      result = pushStmt (StmtKind::Call,s,assign,name (s.funcname ()),offset);
+    }
+
+    void visitIncrementDecrementStatement (const IncrementDecrementStatement& s) override {
+      result = pushStmt (StmtKind::IncrementDecrement,s,name (s.getIncrementee ()),s.isDecrement ());
+    }
+
+    FlatProgram& flat;
+    std::size_t result{0};
+    std::unordered_map<const Expression*,expr_t> exprIndex;
+    std::unordered_map<std::size_t,std::uint32_t> symbolIndex;
+    std::unordered_map<Name,std::uint32_t> nameIndex;
+  };
+
+  FlatProgram flatten (const Program& prgm) {
+    FlatProgram flat;
+    flat.frame = prgm.getFrame ();
+    Flattener flattener {flat};
+    for (auto f : prgm.getFunctions ()) {
+      auto func = f.getFunction ();
+      flat.funcs.push_back ({f.getSymbol (),flattener.statement (*func->getStmt ())});
+    }
+    flat.mainStmt = flattener.statement (prgm.getStmt ());
+    return flat;
+  }
+
+  static std::ostream& operator<< (std::ostream& os, BinOps op) {
+    static const char* names[] = {"add","sub","div","mul","leq","geq","lt","gt","eq","neq","mod","xor","or","and","lshl"};
+    return os << names[std::to_underlying (op)];
+  }
+
+  std::ostream& operator<< (std::ostream& os, const FlatProgram& flat) {
+    flat.forEachExpression ([&](expr_t e, ExprKind k) {
+      os << "e" << e << " : " << flat.type (e) << " = ";
+      switch (k) {
+      case ExprKind::Identifier:
+	os << flat.symbols ()[flat.value (e)].getName ();
+	break;
+      case ExprKind::Number:
+	os << flat.value (e);
+	break;
+      case ExprKind::Undef:
+	os << "?" << flat.target (e);
+	break;
+      case ExprKind::Binary:
+	os << flat.op (e) << " e" << flat.lhs (e) << " e" << flat.rhs (e);
+	break;
+      case ExprKind::Deref:
+	os << "load " << flat.target (e) << " e" << flat.lhs (e);
+	break;
+      case ExprKind::Cast:
+	os << "cast " << flat.target (e) << " e" << flat.lhs (e);
+	break;
+      }
+      os << "\n";
+    });
+
+    flat.forEachStatement ([&](stmt_t s, StmtKind k) {
+      os << "s" << s << " ";
+      switch (k) {
+      case StmtKind::Skip:
+	os << "skip";
+	break;
+      case StmtKind::Assign:
+	os << "assign " << flat.names ()[flat.a (s)] << " e" << flat.b (s);
+	break;
+      case StmtKind::Alloc:
+	os << "alloc " << flat.names ()[flat.a (s)] << " e" << flat.b (s);
+	break;
+      case StmtKind::Free:
+	os << "free e" << flat.b (s);
+	break;
+      case StmtKind::Assert:
+	os << "assert e" << flat.b (s);
+	break;
+      case StmtKind::Assume:
+	os << "assume e" << flat.b (s);
+	break;
+      case StmtKind::Return:
+	os << "return e" << flat.b (s);
+	break;
+      case StmtKind::MemAssign:
+	os << "store e" << flat.b (s) << " e" << flat.c (s);
+	break;
+      case StmtKind::If:
+	os << "if e" << flat.b (s) << " s" << flat.a (s) << " s" << flat.c (s);
+	break;
+      case StmtKind::While:
+	os << "while e" << flat.b (s) << " s" << flat.a (s);
+	break;
+      case StmtKind::Block:
+      case StmtKind::Choose:
+	os << (k == StmtKind::Block ? "block" : "choose");
+	for (std::uint32_t i = 0; i < flat.c (s); ++i)
+	  os << " s" << flat.children ()[flat.a (s)+i];
+	break;
+      case StmtKind::Call: {
+	if (flat.a (s) != FlatProgram::none)
+	  os << flat.names ()[flat.a (s)] << " = ";
+	os << "call " << flat.names ()[flat.b (s)];
+	auto count = flat.arguments ()[flat.c (s)];
+	for (std::uint32_t i = 1; i <= count; ++i)
+	  os << " e" << flat.arguments ()[flat.c (s)+i];
+	break;
+      }
+      case StmtKind::IncrementDecrement:
+	os << (flat.b (s) ? "decr " : "incr ") << flat.names ()[flat.a (s)];
+	break;
+      }
+      os << "\n";
+    });
+
+    for (auto& f : flat.functions ())
+      os << "fn " << f.symbol.getName () << " s" << f.body << "\n";
+    return os << "main s" << flat.main () << "\n";
+  }
+}
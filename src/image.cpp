@@ -0,0 +1,585 @@
+#include "whiley/image.hpp"
+#include "symboltable.h"
+
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace Whiley {
+  namespace {
+    constexpr char magic[8] = {'W','H','L','Y','I','M','G','\0'};
+    constexpr std::uint32_t byteOrder = 0x01020304;
+
+    enum Section {
+      Chars,
+      StringOffsets,
+      Symbols,
+      Scopes,
+      Expressions,
+      Statements,
+      Lists,
+      Functions,
+      Lines,
+      SectionCount
+    };
+
+    struct SectionEntry {
+      std::uint64_t offset;
+      std::uint64_t count;
+    };
+
+    struct Header {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t byteOrder;
+      std::uint64_t size;
+      std::uint32_t main;
+      std::uint32_t sections;
+      SectionEntry section[SectionCount];
+    };
+
+    [[noreturn]] void corrupt () {
+      throw std::runtime_error ("Corrupt program image");
+    }
+
+    std::uint32_t narrow (std::size_t v) {
+      if (v >= ProgramImage::none)
+	throw std::runtime_error ("Program too large for an image");
+      return static_cast<std::uint32_t> (v);
+    }
+
+    Type checkType (std::uint8_t t) {
+      if (t > static_cast<std::uint8_t> (Type::Pointer))
+	corrupt ();
+      return static_cast<Type> (t);
+    }
+
+    std::uint32_t checkIndex (std::uint32_t i, std::size_t limit) {
+      if (i >= limit)
+	corrupt ();
+      return i;
+    }
+  }
+
+  /* Collects the records of one Program; shared nodes are written once */
+  class ProgramImage::Writer : private ExpressionVisitor,
+			       private StatementVisitor {
+  public:
+    std::uint32_t expression (const Expression& e) {
+      auto it = exprIndex.find (&e);
+      if (it != exprIndex.end ())
+	return it->second;
+      e.accept (*this);
+      exprIndex.emplace (&e,result);
+      return result;
+    }
+
+    std::uint32_t statement (const Statement& s) {
+      auto it = stmtIndex.find (&s);
+      if (it != stmtIndex.end ())
+	return it->second;
+      s.accept (*this);
+      stmtIndex.emplace (&s,result);
+      return result;
+    }
+
+    std::uint32_t string (std::string_view s) {
+      auto [it,inserted] = stringIndex.emplace (std::string{s},narrow (stringOffsets.size ()-1));
+      if (inserted) {
+	chars.insert (chars.end (),s.begin (),s.end ());
+	stringOffsets.push_back (narrow (chars.size ()));
+      }
+      return it->second;
+    }
+
+    std::uint32_t list (const std::vector<std::uint32_t>& items) {
+      auto offset = narrow (lists.size ());
+      lists.insert (lists.end (),items.begin (),items.end ());
+      return offset;
+    }
+
+    std::vector<char> chars;
+    std::vector<std::uint32_t> stringOffsets{0};
+    std::vector<SymbolRecord> symbols;
+    std::vector<ScopeRecord> scopes;
+    std::vector<ExprRecord> exprs;
+    std::vector<StmtRecord> stmts;
+    std::vector<std::uint32_t> lists;
+    std::vector<FunctionRecord> functions;
+
+  private:
+    std::uint32_t pushExpr (ExprKind k, const Expression& e, std::uint32_t lhs = none, std::uint32_t rhs = none) {
+      exprs.push_back ({0,lhs,rhs,e.getLocation (),k,0,static_cast<std::uint8_t> (e.getType ()),0,0});
+      return narrow (exprs.size ()-1);
+    }
+
+    std::uint32_t pushStmt (StmtKind k, const Statement& s, std::uint32_t a = none, std::uint32_t b = none, std::uint32_t c = none) {
+      stmts.push_back ({a,b,c,s.getLocation (),k,{}});
+      return narrow (stmts.size ()-1);
+    }
+
+    std::uint32_t name (Name n) {
+      return n ? string (n.view ()) : none;
+    }
+
+    void visitIdentifier (const Identifier& id) override {
+      result = pushExpr (ExprKind::Identifier,id);
+      exprs[result].value = id.getSymbol ().id ();
+    }
+
+    void visitNumberExpression (const NumberExpression& n) override {
+      result = pushExpr (ExprKind::Number,n);
+      exprs[result].value = n.getValue ();
+    }
+
+    void visitUndefExpression (const UndefExpression& u) override {
+      result = pushExpr (ExprKind::Undef,u);
+      exprs[result].target = static_cast<std::uint8_t> (u.getUndefType ());
+    }
+
+    void visitBinaryExpression (const BinaryExpression& b) override {
+      auto l = expression (b.getLeft ());
+      auto r = expression (b.getRight ());
+      result = pushExpr (ExprKind::Binary,b,l,r);
+      exprs[result].op = static_cast<std::uint8_t> (b.getOp ());
+    }
+
+    void visitDerefExpression (const DerefExpression& d) override {
+      auto m = expression (d.getMem ());
+      result = pushExpr (ExprKind::Deref,d,m);
+      exprs[result].target = static_cast<std::uint8_t> (d.getLoadType ());
+    }
+
+    void visitCastExpression (const CastExpression& c) override {
+      auto m = expression (c.getExpression ());
+      result = pushExpr (ExprKind::Cast,c,m);
+      exprs[result].target = static_cast<std::uint8_t> (c.getType ());
+    }
+
+    void visitSkipStatement (const SkipStatement& s) override {
+      result = pushStmt (StmtKind::Skip,s);
+    }
+
+    void visitAssignStatement (const AssignStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Assign,s,name (s.getAssignName ()),e);
+    }
+
+    void visitAllocStatement (const AllocStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Alloc,s,name (s.getAssignName ()),e);
+    }
+
+    void visitFreeStatement (const FreeStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Free,s,none,e);
+    }
+
+    void visitAssertStatement (const AssertStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Assert,s,none,e);
+    }
+
+    void visitAssumeStatement (const AssumeStatement& s) override {
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::Assume,s,none,e);
+    }
+
+    void visitReturnStatement (const ReturnStatement& s) override {
+      auto e = expression (s.getExpr ());
+      result = pushStmt (StmtKind::Return,s,none,e);
+    }
+
+    void visitMemAssignStatement (const MemAssignStatement& s) override {
+      auto m = expression (s.getMemLoc ());
+      auto e = expression (s.getExpression ());
+      result = pushStmt (StmtKind::MemAssign,s,none,m,e);
+    }
+
+    void visitIfStatement (const IfStatement& s) override {
+      auto cond = expression (s.getCondition ());
+      auto ifb = statement (s.getIfBody ());
+      auto elseb = statement (s.getElseBody ());
+      result = pushStmt (StmtKind::If,s,ifb,cond,elseb);
+    }
+
+    void visitWhileStatement (const WhileStatement& s) override {
+      auto cond = expression (s.getCondition ());
+      auto body = statement (s.getBody ());
+      result = pushStmt (StmtKind::While,s,body,cond);
+    }
+
+    void visitBlockStatement (const BlockStatement& block) override {
+      std::vector<std::uint32_t> items;
+      for (auto s : block.getStatements ())
+	items.push_back (statement (*s));
+      result = pushStmt (StmtKind::Block,block,list (items),none,narrow (items.size ()));
+    }
+
+    void visitChooseStatement (const ChooseStatement& s) override {
+      std::vector<std::uint32_t> items;
+      for (auto b : s.getStatements ())
+	items.push_back (statement (*b));
+      result = pushStmt (StmtKind::Choose,s,list (items),none,narrow (items.size ()));
+    }
+
+    void visitCallStatement (const CallStatement& s) override {
+      std::vector<std::uint32_t> args {0};
+      for (auto p : s.parameters ())
+	args.push_back (expression (*p));
+      args[0] = narrow (args.size ()-1);
+      result = pushStmt (StmtKind::Call,s,name (s.assignname ()),name (s.funcname ()),list (args));
+    }
+
+    void visitIncrementDecrementStatement (const IncrementDecrementStatement& s) override {
+      result = pushStmt (StmtKind::IncrementDecrement,s,name (s.getIncrementee ()),s.isDecrement ());
+    }
+
+    std::uint32_t result{0};
+    std::unordered_map<const Expression*,std::uint32_t> exprIndex;
+    std::unordered_map<const Statement*,std::uint32_t> stmtIndex;
+    std::unordered_map<std::string,std::uint32_t> stringIndex;
+  };
+
+  void ProgramImage::write (const Program& prgm, std::ostream& os) {
+    auto frame = prgm.getFrame ();
+    auto& table = *frame.table;
+    Writer w;
+    for (auto& scope : table.scopes)
+      w.scopes.push_back ({scope.owner,scope.parent});
+    for (std::size_t id = 0; id < table.names.size (); ++id) {
+      SymbolRecord rec {w.string (table.names[id].view ()),table.scopeOf[id],none,SymbolKind::None,0,0,0};
+      std::visit (overloaded {
+	  [&](const VarDecl& v) {
+	    rec.kind = SymbolKind::Variable;
+	    rec.type = static_cast<std::uint8_t> (v.type);
+	    rec.parameter = v.parameter;
+	    rec.output = v.output;
+	  },
+	  [&](const ParamDecl& p) {
+	    rec.kind = SymbolKind::Parameter;
+	    rec.type = static_cast<std::uint8_t> (p.type);
+	  },
+	  [&](const Expression_ptr& e) {
+	    rec.kind = SymbolKind::Constant;
+	    rec.value = w.expression (*e);
+	  },
+	  [&](const Function_ptr& f) {
+	    std::vector<std::uint32_t> params {narrow (f->getParams ().size ())};
+	    for (auto& p : f->getParams ())
+	      params.push_back (p.id ());
+	    rec.kind = SymbolKind::Function;
+	    rec.value = narrow (w.functions.size ());
+	    w.functions.push_back ({narrow (id),f->getFrame ().scope,w.statement (*f->getStmt ()),w.list (params),
+				    static_cast<std::uint8_t> (f->returns ()),{}});
+	  },
+	  [](const std::monostate&) {}
+	},
+	table.data[id]);
+      w.symbols.push_back (rec);
+    }
+    auto main = w.statement (prgm.getStmt ());
+    auto& lines = prgm.getLineTable ().lineStarts ();
+
+    Header header {};
+    std::memcpy (header.magic,magic,sizeof (magic));
+    header.version = version;
+    header.byteOrder = byteOrder;
+    header.main = main;
+    header.sections = SectionCount;
+    std::pair<const void*,std::size_t> data[SectionCount] = {
+      {w.chars.data (),w.chars.size ()},
+      {w.stringOffsets.data (),w.stringOffsets.size ()*sizeof (std::uint32_t)},
+      {w.symbols.data (),w.symbols.size ()*sizeof (SymbolRecord)},
+      {w.scopes.data (),w.scopes.size ()*sizeof (ScopeRecord)},
+      {w.exprs.data (),w.exprs.size ()*sizeof (ExprRecord)},
+      {w.stmts.data (),w.stmts.size ()*sizeof (StmtRecord)},
+      {w.lists.data (),w.lists.size ()*sizeof (std::uint32_t)},
+      {w.functions.data (),w.functions.size ()*sizeof (FunctionRecord)},
+      {lines.data (),lines.size ()*sizeof (std::uint32_t)}
+    };
+    std::size_t counts[SectionCount] = {w.chars.size (),w.stringOffsets.size (),w.symbols.size (),w.scopes.size (),
+					w.exprs.size (),w.stmts.size (),w.lists.size (),w.functions.size (),lines.size ()};
+    // Every section starts 8-byte aligned, so records can be read in place
+    std::uint64_t offset = sizeof (Header);
+    for (std::size_t i = 0; i < SectionCount; ++i) {
+      header.section[i] = {offset,counts[i]};
+      offset = (offset + data[i].second + 7) & ~std::uint64_t{7};
+    }
+    header.size = offset;
+
+    static const char padding[8] = {};
+    os.write (reinterpret_cast<const char*> (&header),sizeof (header));
+    for (std::size_t i = 0; i < SectionCount; ++i) {
+      os.write (static_cast<const char*> (data[i].first),data[i].second);
+      os.write (padding,(8 - data[i].second % 8) % 8);
+    }
+    if (!os)
+      throw std::runtime_error ("Cannot write program image");
+  }
+
+  void ProgramImage::write (const Program& prgm, const std::string& filename) {
+    // Unique per writer, so concurrent writers of one file never share a temporary
+    static std::atomic<std::uint64_t> counter {0};
+    auto tmp = filename + "." + std::to_string (::getpid ()) + "." + std::to_string (counter++) + ".tmp";
+    {
+      std::ofstream os {tmp,std::ios::binary | std::ios::trunc};
+      if (!os)
+	throw std::runtime_error ("Cannot open file " + tmp);
+      write (prgm,os);
+      os.close ();
+      if (!os)
+	throw std::runtime_error ("Cannot write file " + tmp);
+    }
+    if (std::rename (tmp.c_str (),filename.c_str ()) != 0) {
+      std::remove (tmp.c_str ());
+      throw std::runtime_error ("Cannot write file " + filename);
+    }
+  }
+
+  ProgramImage ProgramImage::open (const std::string& filename) {
+    return ProgramImage {SourceBuffer::fromFile (filename)};
+  }
+
+  ProgramImage ProgramImage::read (std::istream& is) {
+    return ProgramImage {SourceBuffer::fromStream (is)};
+  }
+
+  ProgramImage::ProgramImage (SourceBuffer&& b) : buffer(std::move(b)) {
+    auto bytes = buffer.view ();
+    Header header;
+    if (bytes.size () < sizeof (header))
+      corrupt ();
+    std::memcpy (&header,bytes.data (),sizeof (header));
+    if (std::memcmp (header.magic,magic,sizeof (magic)) != 0)
+      throw std::runtime_error ("Not a program image");
+    if (header.version != version || header.byteOrder != byteOrder)
+      throw std::runtime_error ("Program image of another version or byte order");
+    if (header.size != bytes.size () || header.sections != SectionCount || reinterpret_cast<std::uintptr_t> (bytes.data ()) % 8)
+      corrupt ();
+
+    auto section = [&]<class T>(Section s, std::span<const T>& to) {
+      auto [offset,count] = header.section[s];
+      if (offset % alignof (T) || offset > bytes.size () || count > (bytes.size ()-offset) / sizeof (T))
+	corrupt ();
+      to = {reinterpret_cast<const T*> (bytes.data ()+offset),count};
+    };
+    section (Chars,chars);
+    section (StringOffsets,stringOffsets);
+    section (Symbols,syms);
+    section (Scopes,scopeRecords);
+    section (Expressions,exprs);
+    section (Statements,stmts);
+    section (Lists,listItems);
+    section (Functions,funcs);
+    section (Lines,lines);
+    mainStmt = header.main;
+
+    // Enough to make the accessors safe to call on any index below their counts
+    if (stringOffsets.empty () || stringOffsets.back () > chars.size () || syms.empty () || scopeRecords.empty () || lines.empty ())
+      corrupt ();
+    for (std::size_t i = 1; i < stringOffsets.size (); ++i)
+      if (stringOffsets[i] < stringOffsets[i-1])
+	corrupt ();
+    checkIndex (mainStmt,stmts.size ());
+  }
+
+  Program ProgramImage::load () const {
+    auto table = std::make_shared<SymbolTable> (std::string{string (checkIndex (syms[0].name,strings ()))});
+    std::vector<Name> names;
+    names.reserve (strings ());
+    for (std::uint32_t i = 0; i < strings (); ++i)
+      names.push_back (table->interner.intern (string (i)));
+
+    // Creating symbols and scopes in id order gives every symbol its original id
+    std::size_t nextScope = 1;
+    // Scopes renewed by an incremental update reuse an older owner and precede their members
+    auto renewed = [&](std::uint32_t id) {
+      while (nextScope < scopeRecords.size () && scopeRecords[nextScope].owner < id) {
+	auto& rec = scopeRecords[nextScope];
+	auto key = names[checkIndex (syms[rec.owner].name,names.size ())].view ();
+	if (!key.ends_with ("__"))
+	  corrupt ();
+	key.remove_suffix (2);
+	if (table->renewScope (checkIndex (rec.parent,table->scopes.size ()),table->interner.intern (key)) != nextScope++)
+	  corrupt ();
+      }
+    };
+    for (std::uint32_t id = 1; id < syms.size (); ++id) {
+      renewed (id);
+      auto name = names[checkIndex (syms[id].name,names.size ())];
+      auto scope = checkIndex (syms[id].scope,table->scopes.size ());
+      if (nextScope < scopeRecords.size () && scopeRecords[nextScope].owner == id) {
+	auto key = name.view ();
+	if (!key.ends_with ("__") || scopeRecords[nextScope].parent != scope)
+	  corrupt ();
+	key.remove_suffix (2);
+	if (table->makeScope (scope,table->interner.intern (key)) != nextScope++)
+	  corrupt ();
+      }
+      else
+	table->makeSymbol (scope,name);
+    }
+    renewed (static_cast<std::uint32_t> (syms.size ()));
+    if (nextScope != scopeRecords.size ())
+      corrupt ();
+    auto symbol = [&](std::uint32_t id) {return Symbol {table.get (),checkIndex (id,syms.size ())};};
+    auto name = [&](std::uint32_t i) {return i == none ? Name{} : names[checkIndex (i,names.size ())];};
+
+    Arena arena;
+    std::vector<Expression_ptr> e (exprs.size ());
+    for (std::size_t i = 0; i < exprs.size (); ++i) {
+      auto& r = exprs[i];
+      auto sub = [&](std::uint32_t j) {return e[checkIndex (j,i)];};
+      switch (r.kind) {
+      case ExprKind::Identifier:
+	if (r.value < 0 || static_cast<std::uint64_t> (r.value) >= syms.size ())
+	  corrupt ();
+	e[i] = arena.make<Identifier> (symbol (static_cast<std::uint32_t> (r.value)),r.location);
+	break;
+      case ExprKind::Number:
+	e[i] = arena.make<NumberExpression> (r.value,r.location);
+	break;
+      case ExprKind::Undef:
+	e[i] = arena.make<UndefExpression> (checkType (r.target),r.location);
+	break;
+      case ExprKind::Binary:
+	if (r.op > static_cast<std::uint8_t> (BinOps::LShl))
+	  corrupt ();
+	e[i] = arena.make<BinaryExpression> (sub (r.lhs),sub (r.rhs),static_cast<BinOps> (r.op),r.location);
+	break;
+      case ExprKind::Deref:
+	e[i] = arena.make<DerefExpression> (sub (r.lhs),checkType (r.target),r.location);
+	break;
+      case ExprKind::Cast:
+	e[i] = arena.make<CastExpression> (sub (r.lhs),checkType (r.target),r.location);
+	break;
+      default:
+	corrupt ();
+      }
+      e[i]->setType (checkType (r.type));
+    }
+
+    std::vector<Statement_ptr> s (stmts.size ());
+    for (std::size_t i = 0; i < stmts.size (); ++i) {
+      auto& r = stmts[i];
+      auto expr = [&](std::uint32_t j) {return e[checkIndex (j,e.size ())];};
+      auto sub = [&](std::uint32_t j) {return s[checkIndex (j,i)];};
+      auto children = [&]() {
+	if (r.a > listItems.size () || r.c > listItems.size ()-r.a)
+	  corrupt ();
+	std::vector<Statement_ptr> items;
+	for (auto j : listItems.subspan (r.a,r.c))
+	  items.push_back (sub (j));
+	return items;
+      };
+      switch (r.kind) {
+      case StmtKind::Skip:
+	s[i] = arena.make<SkipStatement> (r.location);
+	break;
+      case StmtKind::Assign:
+	s[i] = arena.make<AssignStatement> (name (r.a),expr (r.b),r.location);
+	break;
+      case StmtKind::Alloc:
+	s[i] = arena.make<AllocStatement> (name (r.a),expr (r.b),r.location);
+	break;
+      case StmtKind::Free:
+	s[i] = arena.make<FreeStatement> (expr (r.b),r.location);
+	break;
+      case StmtKind::Assert:
+	s[i] = arena.make<AssertStatement> (expr (r.b),r.location);
+	break;
+      case StmtKind::Assume:
+	s[i] = arena.make<AssumeStatement> (expr (r.b),r.location);
+	break;
+      case StmtKind::Return:
+	s[i] = arena.make<ReturnStatement> (expr (r.b),r.location);
+	break;
+      case StmtKind::MemAssign:
+	s[i] = arena.make<MemAssignStatement> (expr (r.b),expr (r.c),r.location);
+	break;
+      case StmtKind::If:
+	s[i] = arena.make<IfStatement> (expr (r.b),sub (r.a),sub (r.c),r.location);
+	break;
+      case StmtKind::While:
+	s[i] = arena.make<WhileStatement> (expr (r.b),sub (r.a),r.location);
+	break;
+      case StmtKind::Block:
+	s[i] = arena.make<BlockStatement> (children (),r.location);
+	break;
+      case StmtKind::Choose:
+	s[i] = arena.make<ChooseStatement> (children (),r.location);
+	break;
+      case StmtKind::Call: {
+	auto count = listItems[checkIndex (r.c,listItems.size ())];
+	if (count > listItems.size ()-r.c-1)
+	  corrupt ();
+	std::vector<Expression_ptr> args;
+	for (auto j : listItems.subspan (r.c+1,count))
+	  args.push_back (expr (j));
+	s[i] = arena.make<CallStatement> (name (r.a),name (r.b),std::move(args),r.location);
+	break;
+      }
+      case StmtKind::IncrementDecrement:
+	if (r.b > 1)
+	  corrupt ();
+	s[i] = arena.make<IncrementDecrementStatement> (name (r.a),r.b == 1,r.location);
+	break;
+      default:
+	corrupt ();
+      }
+    }
+
+    // Each function has a scope of its own, a child of the one it is declared in, or printing its Frame would not end
+    std::vector<bool> claimed (table->scopes.size ());
+    for (std::uint32_t id = 0; id < syms.size (); ++id) {
+      auto& r = syms[id];
+      switch (r.kind) {
+      case SymbolKind::None:
+	break;
+      case SymbolKind::Variable:
+	symbol (id).setUserData (VarDecl {checkType (r.type),r.parameter != 0,r.output != 0});
+	break;
+      case SymbolKind::Parameter:
+	symbol (id).setUserData (ParamDecl {checkType (r.type)});
+	break;
+      case SymbolKind::Constant:
+	symbol (id).setUserData (e[checkIndex (r.value,e.size ())]);
+	break;
+      case SymbolKind::Function: {
+	auto& f = funcs[checkIndex (r.value,funcs.size ())];
+	auto count = listItems[checkIndex (f.params,listItems.size ())];
+	if (f.symbol != id || count > listItems.size ()-f.params-1)
+	  corrupt ();
+	std::vector<Symbol> params;
+	for (auto p : listItems.subspan (f.params+1,count))
+	  params.push_back (symbol (p));
+	auto scope = checkIndex (f.scope,table->scopes.size ());
+	auto owner = table->scopes[scope].owner;
+	auto key = table->names[owner].view ();
+	if (!scope || claimed[scope] || table->scopes[scope].parent != r.scope || table->scopeOf[owner] != r.scope
+	    || !key.ends_with ("__") || key.substr (0,key.size ()-2) != table->names[id].view ())
+	  corrupt ();
+	claimed[scope] = true;
+	Frame frame {table,scope};
+	symbol (id).setUserData (std::make_shared<Function> (frame,Statement_ptr {s[checkIndex (f.body,s.size ())]},std::move(params),checkType (f.returns)));
+	break;
+      }
+      default:
+	corrupt ();
+      }
+    }
+
+    LineTable lineTable;
+    for (std::size_t i = 1; i < lines.size (); ++i)
+      lineTable.addLine (lines[i]);
+    return Program {Frame {table,0},Statement_ptr {s[mainStmt]},std::move(arena),std::move(lineTable)};
+  }
+}
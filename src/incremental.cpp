@@ -0,0 +1,417 @@
+#include "whiley/incremental.hpp"
+#include "whiley/typechecker.hpp"
+#include "scanner.h"
+#include "rdparser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace Whiley {
+  namespace {
+    /* Visits every node under a statement; hoisted calls and constants are shared, so some more than once */
+    class Walker : protected NodeVisitor {
+    public:
+      void walk (const Statement& s) {s.accept (*this);}
+      void walk (const Expression& e) {
+	if (enter (e))
+	  e.accept (*this);
+      }
+
+    protected:
+      virtual void node (const Node&) {}
+      virtual bool enter (const Expression&) {return true;}
+
+      void visitIdentifier (const Identifier& e) override {node (e);}
+      void visitNumberExpression (const NumberExpression& e) override {node (e);}
+      void visitUndefExpression (const UndefExpression& e) override {node (e);}
+      void visitBinaryExpression (const BinaryExpression& e) override {node (e); walk (e.getLeft ()); walk (e.getRight ());}
+      void visitDerefExpression (const DerefExpression& e) override {node (e); walk (e.getMem ());}
+      void visitCastExpression (const CastExpression& e) override {node (e); walk (e.getExpression ());}
+
+      void visitAssertStatement (const AssertStatement& s) override {node (s); walk (s.getExpression ());}
+      void visitAssumeStatement (const AssumeStatement& s) override {node (s); walk (s.getExpression ());}
+      void visitAssignStatement (const AssignStatement& s) override {node (s); walk (s.getExpression ());}
+      void visitAllocStatement (const AllocStatement& s) override {node (s); walk (s.getExpression ());}
+      void visitFreeStatement (const FreeStatement& s) override {node (s); walk (s.getExpression ());}
+      void visitReturnStatement (const ReturnStatement& s) override {node (s); walk (s.getExpr ());}
+      void visitSkipStatement (const SkipStatement& s) override {node (s);}
+      void visitIncrementDecrementStatement (const IncrementDecrementStatement& s) override {node (s);}
+      void visitMemAssignStatement (const MemAssignStatement& s) override {node (s); walk (s.getMemLoc ()); walk (s.getExpression ());}
+
+      void visitIfStatement (const IfStatement& s) override {
+	node (s);
+	walk (s.getCondition ());
+	walk (s.getIfBody ());
+	walk (s.getElseBody ());
+      }
+
+      void visitWhileStatement (const WhileStatement& s) override {
+	node (s);
+	walk (s.getCondition ());
+	walk (s.getBody ());
+      }
+
+      void visitChooseStatement (const ChooseStatement& s) override {
+	node (s);
+	for (auto b : s.getStatements ())
+	  walk (*b);
+      }
+
+      void visitBlockStatement (const BlockStatement& s) override {
+	node (s);
+	for (auto b : s.getStatements ())
+	  walk (*b);
+      }
+
+      void visitCallStatement (const CallStatement& s) override {
+	node (s);
+	for (auto p : s.parameters ())
+	  walk (*p);
+      }
+    };
+
+    /* Moves every location at or after from by delta (modulo 2^32, so it may be negative) */
+    class Shifter : public Walker {
+    public:
+      Shifter (std::uint32_t from, std::uint32_t delta) : from(from),delta(delta) {}
+
+      /* A constant, shifted once however often it is substituted */
+      void constant (const Expression& e) {constants.emplace (&e,false);}
+
+    protected:
+      void node (const Node& n) override {
+	auto loc = n.getLocation ();
+	if (loc.begin >= from)
+	  loc.begin += delta;
+	if (loc.end >= from)
+	  loc.end += delta;
+	// Visitors only hand out const nodes; the Program is not in use while it is updated
+	const_cast<Node&> (n).setLocation (loc);
+      }
+
+      bool enter (const Expression& e) override {
+	if (constants.empty ())
+	  return true;
+	auto it = constants.find (&e);
+	return it == constants.end () || !std::exchange (it->second,true);
+      }
+
+      void visitCallStatement (const CallStatement& s) override {
+	// Calls hoisted out of a loop condition are both in front of the loop and at the end of its body
+	if (calls.insert (&s).second)
+	  Walker::visitCallStatement (s);
+      }
+
+    private:
+      std::uint32_t from;
+      std::uint32_t delta;
+      std::unordered_map<const Expression*,bool> constants;
+      std::unordered_set<const CallStatement*> calls;
+    };
+
+    /* Clears the types the TypeChecker set, as in a fresh parse */
+    class Untyper : public Walker {
+    protected:
+      bool enter (const Expression& e) override {
+	const_cast<Expression&> (e).setType (Type::Untyped);
+	return true;
+      }
+    };
+
+    /* Functions called under a statement, and whether everything a reparsed function
+       refers to was declared before it, as it would be in a parse of the whole source */
+    class References : public Walker {
+    public:
+      /* Without a root, only calls are collected */
+      References (std::optional<Frame> root = std::nullopt, std::uint32_t limit = 0) : root(std::move(root)),
+											  limit(limit) {}
+
+      std::vector<Name> callees;
+      bool visible{true};
+
+    protected:
+      bool enter (const Expression&) override {return root.has_value ();}
+
+      void visitIdentifier (const Identifier& e) override {
+	auto symb = e.getSymbol ();
+	if (symb.id () > limit && isRoot (symb.getName (),symb.id ()))
+	  visible = false;
+      }
+
+      void visitCallStatement (const CallStatement& s) override {
+	if (std::find (callees.begin (),callees.end (),s.funcname ()) == callees.end ())
+	  callees.push_back (s.funcname ());
+	// Only hoisted calls are resolved while parsing; call statements are resolved when checked
+	if (root && s.assignname ().view ().starts_with (ASTBuilder::hoistedPrefix)) {
+	  auto callee = root->resolve (s.funcname ());
+	  if (callee && callee->id () > limit)
+	    visible = false;
+	}
+	Walker::visitCallStatement (s);
+      }
+
+    private:
+      bool isRoot (Name name, std::uint32_t id) const {
+	auto found = root->resolve (name);
+	return found && found->id () == id;
+      }
+
+      std::optional<Frame> root;
+      std::uint32_t limit;
+    };
+
+    constexpr std::size_t block = 4096;
+
+    std::size_t commonPrefix (std::string_view a, std::string_view b) {
+      auto n = std::min (a.size (),b.size ());
+      std::size_t i = 0;
+      // Whole blocks through memcmp, which is vectorised, the rest byte by byte
+      while (i + block <= n && !std::memcmp (a.data ()+i,b.data ()+i,block))
+	i += block;
+      while (i < n && a[i] == b[i])
+	++i;
+      return i;
+    }
+
+    std::size_t commonSuffix (std::string_view a, std::string_view b, std::size_t limit) {
+      std::size_t i = 0;
+      while (i + block <= limit && !std::memcmp (a.data ()+a.size ()-i-block,b.data ()+b.size ()-i-block,block))
+	i += block;
+      while (i < limit && a[a.size ()-1-i] == b[b.size ()-1-i])
+	++i;
+      return i;
+    }
+
+    bool blank (std::string_view s) {
+      return s.find_first_not_of (" \t\n") == std::string_view::npos;
+    }
+
+    std::vector<Type> parameterTypes (const Function& f) {
+      std::vector<Type> res;
+      for (auto& p : f.getParams ())
+	res.push_back (std::holds_alternative<ParamDecl> (p.getUserData ()) ? std::get<ParamDecl> (p.getUserData ()).type : Type::Untyped);
+      return res;
+    }
+
+    /* Values of the constants declared in a function */
+    std::vector<Expression_ptr> constants (const Function& f) {
+      std::vector<Expression_ptr> res;
+      auto frame = f.getFrame ();
+      for (auto s : frame.getLocalSymbols ())
+	if (std::holds_alternative<Expression_ptr> (s.getUserData ()))
+	  res.push_back (std::get<Expression_ptr> (s.getUserData ()));
+      return res;
+    }
+
+    bool calls (const std::vector<Name>& callees, Name name) {
+      return std::find (callees.begin (),callees.end (),name) != callees.end ();
+    }
+
+    /* What a reparse changed about a function */
+    enum class Change {
+      Failed,
+      Body,
+      Parameters,
+      Returns
+    };
+  }
+
+  const Program& IncrementalProgram::program () const {
+    if (!prgm)
+      throw std::runtime_error ("Source did not parse");
+    return *prgm;
+  }
+
+  UpdateResult IncrementalProgram::result () const {
+    UpdateResult res;
+    res.ok = prgm && mainChecked && std::all_of (units.begin (),units.end (),[](auto& u) {return u.checked;});
+    return res;
+  }
+
+  bool IncrementalProgram::checkFunction (Unit& unit, MessageSystem& messages) {
+    unit.checked = TypeChecker {messages}.CheckFunction (*prgm,prgm->getFrame ().resolve (unit.name).value ());
+    return unit.checked;
+  }
+
+  UpdateResult IncrementalProgram::reparseAll (MessageSystem& messages) {
+    prgm.reset ();
+    units.clear ();
+    mainCallees.clear ();
+    mainChecked = false;
+
+    ASTBuilder builder;
+    Scanner scanner {std::span<const char> {text},builder.getInterner (),builder.getLineTable (),messages,flags};
+    RDParser parser {scanner,builder,messages};
+    UpdateResult res;
+    res.full = true;
+    if (parser.parse ())
+      return res;
+    prgm.emplace (builder.get (parser.getMain ()));
+    liveBytes = prgm->getArena ().bytesAllocated ();
+
+    auto root = prgm->getFrame ();
+    for (auto& f : parser.getFunctions ()) {
+      References refs;
+      refs.walk (*std::get<Function_ptr> (root.resolve (f.name).value ().getUserData ())->getStmt ());
+      units.push_back ({f.name,f.loc,std::move(refs.callees),false});
+    }
+    References refs;
+    refs.walk (prgm->getStmt ());
+    mainCallees = std::move(refs.callees);
+
+    // In the order of TypeChecker::CheckProgram, so messages come out the same
+    for (auto& u : units)
+      checkFunction (u,messages);
+    mainChecked = TypeChecker {messages}.CheckMain (*prgm);
+    res.ok = result ().ok;
+    res.reparsed = units.size ();
+    res.rechecked = units.size ()+1;
+    return res;
+  }
+
+  namespace {
+    Change reparse (ASTBuilder& builder, const Frame& root, std::string_view text, const TypeFlags& flags,
+		    Name name, location_t& loc, std::vector<Name>& callees) {
+      auto symbol = root.resolve (name).value ();
+      // Keeps the old function alive to compare signatures
+      auto before = std::get<Function_ptr> (symbol.getUserData ());
+      // Anything declared after the function's scope owner was not there when a full parse reached it
+      auto limit = root.resolve (name.str ()+"__").value ().id ();
+
+      BufferMessageSystem discard;
+      LineTable lines;
+      Scanner scanner {std::span<const char> {text.data ()+loc.begin,loc.end-loc.begin},builder.getInterner (),lines,discard,flags};
+      RDParser parser {scanner,builder,discard,loc.begin};
+      if (parser.parseFunction () || !(parser.getFunctions ().front ().name == name))
+	return Change::Failed;
+
+      auto after = std::get<Function_ptr> (symbol.getUserData ());
+      References refs {root,limit};
+      for (auto c : constants (*after))
+	refs.walk (*c);
+      refs.walk (*after->getStmt ());
+      if (!refs.visible)
+	return Change::Failed;
+
+      loc = parser.getFunctions ().front ().loc;
+      callees = std::move(refs.callees);
+      if (after->returns () != before->returns ())
+	return Change::Returns;
+      if (parameterTypes (*after) != parameterTypes (*before))
+	return Change::Parameters;
+      return Change::Body;
+    }
+  }
+
+  UpdateResult IncrementalProgram::update (std::span<const char> source, MessageSystem& messages) {
+    std::string_view next {source.data (),source.size ()};
+    // Replaced functions stay in the arena until a full parse starts a new one
+    if (!prgm || prgm->getArena ().bytesAllocated () > 2*liveBytes) {
+      text.assign (next);
+      return reparseAll (messages);
+    }
+
+    // The edit replaced [begin,oldEnd) of the old text
+    auto begin = commonPrefix (text,next);
+    if (begin == text.size () && begin == next.size ())
+      return result ();
+    auto suffix = commonSuffix (text,next,std::min (text.size (),next.size ())-begin);
+    auto oldEnd = static_cast<std::uint32_t> (text.size ()-suffix);
+    auto replacement = next.substr (begin,next.size ()-suffix-begin);
+    auto delta = static_cast<std::uint32_t> (next.size ()) - static_cast<std::uint32_t> (text.size ());
+
+    // Either blanks between two functions or a change within one function
+    auto moved = std::partition_point (units.begin (),units.end (),[&](auto& u) {return u.loc.begin < oldEnd;}) - units.begin ();
+    auto changed = std::partition_point (units.begin (),units.end (),[&](auto& u) {return u.loc.end < oldEnd;}) - units.begin ();
+    bool between = moved > 0 && static_cast<std::size_t> (moved) < units.size () && units[moved-1].loc.end <= begin && blank (replacement);
+    bool within = !between && static_cast<std::size_t> (changed) < units.size () && units[changed].loc.begin <= begin;
+    if (!between && !within) {
+      text.assign (next);
+      return reparseAll (messages);
+    }
+    if (within)
+      moved = changed+1;
+
+    auto root = prgm->getFrame ();
+    auto main = &prgm->getStmt ();
+    ASTBuilder builder {std::move(*prgm)};
+    prgm.reset ();
+    text.assign (next);
+    builder.getLineTable ().edit (begin,oldEnd,replacement);
+
+    // Move everything after the edit
+    Shifter shifter {oldEnd,delta};
+    for (auto k = static_cast<std::size_t> (moved); k < units.size (); ++k) {
+      auto func = std::get<Function_ptr> (root.resolve (units[k].name).value ().getUserData ());
+      auto local = constants (*func);
+      for (auto c : local)
+	shifter.constant (*c);
+      for (auto c : local)
+	shifter.walk (*c);
+      shifter.walk (*func->getStmt ());
+      units[k].loc.begin += delta;
+      units[k].loc.end += delta;
+    }
+    shifter.walk (*main);
+
+    UpdateResult res;
+    std::vector<bool> recheck (units.size ());
+    bool recheckMain = false;
+    bool ok = true;
+    if (within) {
+      auto i = static_cast<std::size_t> (changed);
+      auto& unit = units[i];
+      unit.loc.end += delta;
+      try {
+	auto change = reparse (builder,root,text,flags,unit.name,unit.loc,unit.callees);
+	ok = change != Change::Failed;
+	recheck[i] = true;
+	++res.reparsed;
+	for (std::size_t k = 0; ok && change != Change::Body && k < units.size (); ++k) {
+	  if (k == i || !calls (units[k].callees,unit.name))
+	    continue;
+	  // Callers keep the old return type in the variables receiving hoisted calls
+	  if (change == Change::Returns) {
+	    ok = reparse (builder,root,text,flags,units[k].name,units[k].loc,units[k].callees) == Change::Body;
+	    ++res.reparsed;
+	  }
+	  // A check stopped by the changed call would leave the types of the last one behind
+	  else
+	    Untyper {}.walk (*std::get<Function_ptr> (root.resolve (units[k].name).value ().getUserData ())->getStmt ());
+	  recheck[k] = true;
+	}
+	if (change != Change::Body && calls (mainCallees,unit.name)) {
+	  // Main is only parsed with the whole source
+	  ok = ok && change == Change::Parameters;
+	  if (ok)
+	    Untyper {}.walk (*main);
+	  recheckMain = true;
+	}
+      }
+      catch (std::exception&) {
+	// Whatever the function could not be rebuilt from, a full parse reports
+	ok = false;
+      }
+    }
+    if (!ok)
+      return reparseAll (messages);
+
+    prgm.emplace (builder.get (main));
+    for (std::size_t k = 0; k < units.size (); ++k) {
+      if (recheck[k]) {
+	checkFunction (units[k],messages);
+	++res.rechecked;
+      }
+    }
+    if (recheckMain) {
+      mainChecked = TypeChecker {messages}.CheckMain (*prgm);
+      ++res.rechecked;
+    }
+    res.ok = result ().ok;
+    return res;
+  }
+}
@@ -0,0 +1,290 @@
+#include "whiley/interpreter.hpp"
+
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace Whiley {
+  namespace {
+    /* Unwinds a run that cannot go on */
+    struct Stop {
+      Outcome outcome;
+    };
+
+    Type symbolType (const Symbol& s) {
+      return std::visit (overloaded {
+	  [](const VarDecl& d) {return d.type;},
+	  [](const ParamDecl& d) {return d.type;},
+	  [](auto&) {return Type::Untyped;}
+	},s.getUserData ());
+    }
+  }
+
+  struct Interpreter::Internal {
+    Internal (const Program& p) : prgm(p),frame(p.getFrame ()),values(p.getFrame ().symbolCount ()+1,0) {}
+
+    Symbol resolve (Name n) const {
+      auto s = frame.resolve (n);
+      if (!s)
+	throw std::runtime_error ("'" + n.str () + "' not declared");
+      return *s;
+    }
+
+    std::uint64_t& variable (const Symbol& s) {
+      if (s.id () >= values.size ())
+	values.resize (s.id ()+1,0);
+      return values[s.id ()];
+    }
+
+    void step () {
+      if (++steps > stepLimit)
+	throw Stop {Outcome::OutOfSteps};
+    }
+
+    /* The variables of a function that each call gets afresh: its parameters first */
+    struct Locals {
+      Frame frame;
+      std::vector<std::uint32_t> ids;
+    };
+
+    const Locals& locals (const Function_ptr& func) {
+      auto it = calls.find (func.get ());
+      if (it == calls.end ()) {
+	Locals l {func->getFrame (),{}};
+	for (auto& p : func->getParams ())
+	  l.ids.push_back (p.id ());
+	for (auto s : l.frame.getLocalSymbols ())
+	  if (std::holds_alternative<VarDecl> (s.getUserData ()))
+	    l.ids.push_back (s.id ());
+	for (auto id : l.ids)
+	  if (id >= values.size ())
+	    values.resize (id+1,0);
+	it = calls.emplace (func.get (),std::move(l)).first;
+      }
+      return it->second;
+    }
+
+    const Program& prgm;
+    Frame frame;
+    /* Indexed by symbol id */
+    std::vector<std::uint64_t> values;
+    Heap heap;
+    Nondeterminism* choices{nullptr};
+    std::uint64_t value{0};
+    bool returning{false};
+    location_t at{};
+    std::uint64_t steps{0};
+    std::uint64_t stepLimit{std::numeric_limits<std::uint64_t>::max ()};
+    std::uint32_t depth{0};
+    std::uint32_t depthLimit{1000};
+    /* Values of the callers' locals, restored on return */
+    std::vector<std::uint64_t> saved;
+    std::unordered_map<const Function*,Locals> calls;
+  };
+
+  Interpreter::Interpreter (const Program& prgm) : _internal(std::make_unique<Internal> (prgm)) {}
+  Interpreter::~Interpreter () {}
+
+  RunResult Interpreter::run (Nondeterminism& choices) {
+    auto& in = *_internal;
+    in.frame = in.prgm.getFrame ();
+    in.choices = &choices;
+    in.heap.clear ();
+    in.saved.clear ();
+    in.returning = false;
+    in.steps = 0;
+    in.depth = 0;
+    try {
+      statement (in.prgm.getStmt ());
+    }
+    catch (Stop& s) {
+      return {s.outcome,in.at};
+    }
+    return {};
+  }
+
+  std::uint64_t Interpreter::get (const Symbol& s) const {
+    return s.id () < _internal->values.size () ? _internal->values[s.id ()] : 0;
+  }
+
+  void Interpreter::set (const Symbol& s, std::uint64_t v) {
+    _internal->variable (s) = normalize (symbolType (s),v);
+  }
+
+  void Interpreter::reset () {
+    std::fill (_internal->values.begin (),_internal->values.end (),0);
+  }
+
+  void Interpreter::setStepLimit (std::uint64_t steps) {
+    _internal->stepLimit = steps;
+  }
+
+  void Interpreter::setDepthLimit (std::uint32_t depth) {
+    _internal->depthLimit = depth;
+  }
+
+  std::uint64_t Interpreter::expression (const Expression& e) {
+    e.accept (*this);
+    return _internal->value;
+  }
+
+  void Interpreter::statement (const Statement& s) {
+    _internal->at = s.getLocation ();
+    s.accept (*this);
+  }
+
+  void Interpreter::visitIdentifier (const Identifier& id) {
+    _internal->value = _internal->variable (id.getSymbol ());
+  }
+
+  void Interpreter::visitNumberExpression (const NumberExpression& num) {
+    _internal->value = normalize (num.getType (),num.getValue ());
+  }
+
+  void Interpreter::visitUndefExpression (const UndefExpression& undef) {
+    _internal->value = normalize (undef.getUndefType (),_internal->choices->value (undef.getUndefType ()));
+  }
+
+  void Interpreter::visitDerefExpression (const DerefExpression& deref) {
+    auto p = expression (deref.getMem ());
+    if (!_internal->heap.load (p,deref.getLoadType (),_internal->value))
+      throw Stop {Outcome::InvalidAccess};
+  }
+
+  void Interpreter::visitCastExpression (const CastExpression& cast) {
+    _internal->value = normalize (cast.getType (),expression (cast.getExpression ()));
+  }
+
+  void Interpreter::visitBinaryExpression (const BinaryExpression& be) {
+    auto l = expression (be.getLeft ());
+    auto r = expression (be.getRight ());
+    auto res = evaluate (be.getOp (),be.getType (),l,r);
+    if (!res)
+      throw Stop {Outcome::DivisionByZero};
+    _internal->value = *res;
+  }
+
+  void Interpreter::visitSkipStatement (const SkipStatement&) {
+  }
+
+  void Interpreter::visitAssignStatement (const AssignStatement& ass) {
+    auto v = expression (ass.getExpression ());
+    _internal->variable (_internal->resolve (ass.getAssignName ())) = v;
+  }
+
+  void Interpreter::visitIncrementDecrementStatement (const IncrementDecrementStatement& inc) {
+    auto s = _internal->resolve (inc.getIncrementee ());
+    auto& v = _internal->variable (s);
+    v = normalize (symbolType (s),inc.isDecrement () ? v-1 : v+1);
+  }
+
+  void Interpreter::visitAllocStatement (const AllocStatement& alloc) {
+    auto size = expression (alloc.getExpression ());
+    auto p = _internal->heap.allocate (size);
+    if (!p)
+      throw Stop {Outcome::OutOfMemory};
+    _internal->variable (_internal->resolve (alloc.getAssignName ())) = p;
+  }
+
+  void Interpreter::visitFreeStatement (const FreeStatement& free) {
+    if (!_internal->heap.release (expression (free.getExpression ())))
+      throw Stop {Outcome::InvalidAccess};
+  }
+
+  void Interpreter::visitAssertStatement (const AssertStatement& ass) {
+    if (!expression (ass.getExpression ()))
+      throw Stop {Outcome::AssertionFailed};
+  }
+
+  void Interpreter::visitAssumeStatement (const AssumeStatement& ass) {
+    if (!expression (ass.getExpression ()))
+      throw Stop {Outcome::Blocked};
+  }
+
+  void Interpreter::visitMemAssignStatement (const MemAssignStatement& assign) {
+    auto p = expression (assign.getMemLoc ());
+    auto v = expression (assign.getExpression ());
+    if (!_internal->heap.store (p,assign.getExpression ().getType (),v))
+      throw Stop {Outcome::InvalidAccess};
+  }
+
+  void Interpreter::visitReturnStatement (const ReturnStatement& ret) {
+    _internal->value = expression (ret.getExpr ());
+    _internal->returning = true;
+  }
+
+  void Interpreter::visitCallStatement (const CallStatement& call) {
+    auto& in = *_internal;
+    auto callee = in.resolve (call.funcname ());
+    auto func = std::get<Function_ptr> (callee.getUserData ());
+    auto& locals = in.locals (func);
+    auto base = in.saved.size ();
+    for (auto& p : call.parameters ())
+      in.saved.push_back (expression (*p));
+    if (in.depth == in.depthLimit)
+      throw Stop {Outcome::StackOverflow};
+    in.step ();
+
+    // Swap the arguments in for the callee's locals, keeping what the caller had
+    for (std::size_t i = 0; i < locals.ids.size (); ++i) {
+      auto& slot = in.values[locals.ids[i]];
+      if (i < call.parameters ().size ())
+	std::swap (slot,in.saved[base+i]);
+      else {
+	in.saved.push_back (slot);
+	slot = 0;
+      }
+    }
+    auto caller = in.frame;
+    auto at = in.at;
+    in.frame = locals.frame;
+    ++in.depth;
+    statement (*func->getStmt ());
+    if (!in.returning)
+      throw Stop {Outcome::Blocked};
+    --in.depth;
+    in.returning = false;
+    in.frame = caller;
+    in.at = at;
+
+    for (std::size_t i = 0; i < locals.ids.size (); ++i)
+      in.values[locals.ids[i]] = in.saved[base+i];
+    in.saved.resize (base);
+    if (call.assignname ())
+      in.variable (in.resolve (call.assignname ())) = in.value;
+  }
+
+  void Interpreter::visitIfStatement (const IfStatement& ifs) {
+    if (expression (ifs.getCondition ()))
+      statement (ifs.getIfBody ());
+    else
+      statement (ifs.getElseBody ());
+  }
+
+  void Interpreter::visitWhileStatement (const WhileStatement& whiles) {
+    while (expression (whiles.getCondition ())) {
+      _internal->step ();
+      statement (whiles.getBody ());
+      if (_internal->returning)
+	return;
+      _internal->at = whiles.getLocation ();
+    }
+  }
+
+  void Interpreter::visitChooseStatement (const ChooseStatement& choose) {
+    auto& branches = choose.getStatements ();
+    if (branches.empty ())
+      throw Stop {Outcome::Blocked};
+    statement (*branches[branches.size () > 1 ? _internal->choices->choose (branches.size ()) : 0]);
+  }
+
+  void Interpreter::visitBlockStatement (const BlockStatement& block) {
+    for (auto s : block.getStatements ()) {
+      statement (*s);
+      if (_internal->returning)
+	return;
+    }
+  }
+}
@@ -0,0 +1,417 @@
+#include "scanner.h"
+#include "whiley/ast.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+#if defined(WHILEY_LEXER_NO_SIMD)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define WHILEY_LEXER_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define WHILEY_LEXER_SSE2
+#endif
+
+/*
+ * Hand-written replacement for the flex scanner in lexer.l, accepting the
+ * same tokens with the same longest-match behaviour. Whitespace and
+ * identifier/number runs are scanned a vector at a time where the target
+ * supports it; keywords are found with a perfect hash computed at compile
+ * time.
+ */
+
+namespace Whiley {
+  namespace {
+    using token = Whiley::Parser::token;
+
+    struct Keyword {
+      std::string_view text;
+      token::token_kind_type kind;
+      /* For kind == TYPE; subject to TypeFlags */
+      Type type;
+    };
+
+    constexpr Keyword keywords[] = {
+      {"param",token::PARAM,Type::Untyped},
+      {"output",token::OUTPUT,Type::Untyped},
+      {"var",token::TYPE,Type::SI8},
+      {"si8",token::TYPE,Type::SI8},
+      {"ui8",token::TYPE,Type::UI8},
+      {"si16",token::TYPE,Type::SI16},
+      {"ui16",token::TYPE,Type::UI16},
+      {"si32",token::TYPE,Type::SI32},
+      {"ui32",token::TYPE,Type::UI32},
+      {"si64",token::TYPE,Type::SI64},
+      {"ui64",token::TYPE,Type::UI64},
+      {"ptr",token::TYPE,Type::Pointer},
+      {"while",token::WHILE,Type::Untyped},
+      {"if",token::IF,Type::Untyped},
+      {"else",token::ELSE,Type::Untyped},
+      {"skip",token::SKIP,Type::Untyped},
+      {"assert",token::ASSERT,Type::Untyped},
+      {"assume",token::ASSUME,Type::Untyped},
+      {"as",token::AS,Type::Untyped},
+      {"choose",token::CHOOSE,Type::Untyped},
+      {"return",token::RETURN,Type::Untyped},
+      {"alloc",token::ALLOC,Type::Untyped},
+      {"free",token::FREE,Type::Untyped},
+      {"for",token::FOR,Type::Untyped},
+      {"const",token::CONSTANT,Type::Untyped},
+      // Only a keyword when followed by a space, as "fn " in lexer.l
+      {"fn",token::FUNCTION,Type::Untyped}
+    };
+
+    constexpr std::size_t minKeyword = 2;
+    constexpr std::size_t maxKeyword = 6;
+    constexpr std::size_t hashSize = 64;
+
+    constexpr std::size_t keywordHash (std::string_view s, std::uint32_t a, std::uint32_t b) {
+      return (static_cast<unsigned char> (s.front ()) * a +
+	      static_cast<unsigned char> (s.back ()) * b +
+	      static_cast<unsigned char> (s[1]) + s.size ()) & (hashSize-1);
+    }
+
+    struct HashParams {
+      std::uint32_t a{0};
+      std::uint32_t b{0};
+    };
+
+    /* Smallest multipliers for which no two keywords share a slot */
+    constexpr HashParams findHash () {
+      for (std::uint32_t a = 1; a < 256; ++a) {
+	for (std::uint32_t b = 1; b < 256; ++b) {
+	  std::array<bool,hashSize> used {};
+	  bool ok = true;
+	  for (auto& k : keywords) {
+	    auto h = keywordHash (k.text,a,b);
+	    if (used[h]) {
+	      ok = false;
+	      break;
+	    }
+	    used[h] = true;
+	  }
+	  if (ok)
+	    return {a,b};
+	}
+      }
+      return {};
+    }
+
+    constexpr HashParams hashParams = findHash ();
+    static_assert (hashParams.a, "no perfect hash for the keyword set");
+
+    /* Slot -> index into keywords, -1 when empty */
+    constexpr auto keywordTable = []() {
+      std::array<std::int8_t,hashSize> table;
+      table.fill (-1);
+      for (std::size_t i = 0; i < std::size (keywords); ++i)
+	table[keywordHash (keywords[i].text,hashParams.a,hashParams.b)] = static_cast<std::int8_t> (i);
+      return table;
+    }();
+
+    const Keyword* findKeyword (std::string_view s) {
+      if (s.size () < minKeyword || s.size () > maxKeyword)
+	return nullptr;
+      auto i = keywordTable[keywordHash (s,hashParams.a,hashParams.b)];
+      if (i < 0 || keywords[i].text != s)
+	return nullptr;
+      return &keywords[i];
+    }
+
+    enum CharClass : std::uint8_t {
+      Other = 0,
+      Ident = 1,
+      Digit = 2
+    };
+
+    constexpr auto charClasses = []() {
+      std::array<std::uint8_t,256> classes {};
+      for (int c = 'a'; c <= 'z'; ++c)
+	classes[c] = Ident;
+      for (int c = 'A'; c <= 'Z'; ++c)
+	classes[c] = Ident;
+      for (int c = '0'; c <= '9'; ++c)
+	classes[c] = Ident | Digit;
+      classes['_'] = Ident;
+      return classes;
+    }();
+
+    bool isIdent (char c) {return charClasses[static_cast<unsigned char> (c)] & Ident;}
+    bool isDigit (char c) {return charClasses[static_cast<unsigned char> (c)] & Digit;}
+    bool isHex (char c) {return isDigit (c) || ((c|0x20) >= 'a' && (c|0x20) <= 'f');}
+
+#if defined(WHILEY_LEXER_AVX2)
+    constexpr std::size_t vectorBytes = 32;
+    using vec = __m256i;
+    vec load (const char* p) {return _mm256_loadu_si256 (reinterpret_cast<const vec*> (p));}
+    vec splat (char c) {return _mm256_set1_epi8 (c);}
+    vec eq (vec a, vec b) {return _mm256_cmpeq_epi8 (a,b);}
+    vec any (vec a, vec b) {return _mm256_or_si256 (a,b);}
+    vec add (vec a, vec b) {return _mm256_add_epi8 (a,b);}
+    vec less (vec a, vec b) {return _mm256_cmpgt_epi8 (b,a);}
+    std::uint32_t bits (vec a) {return static_cast<std::uint32_t> (_mm256_movemask_epi8 (a));}
+#elif defined(WHILEY_LEXER_SSE2)
+    constexpr std::size_t vectorBytes = 16;
+    using vec = __m128i;
+    vec load (const char* p) {return _mm_loadu_si128 (reinterpret_cast<const vec*> (p));}
+    vec splat (char c) {return _mm_set1_epi8 (c);}
+    vec eq (vec a, vec b) {return _mm_cmpeq_epi8 (a,b);}
+    vec any (vec a, vec b) {return _mm_or_si128 (a,b);}
+    vec add (vec a, vec b) {return _mm_add_epi8 (a,b);}
+    vec less (vec a, vec b) {return _mm_cmplt_epi8 (a,b);}
+    std::uint32_t bits (vec a) {return static_cast<std::uint32_t> (_mm_movemask_epi8 (a));}
+#endif
+
+#if defined(WHILEY_LEXER_AVX2) || defined(WHILEY_LEXER_SSE2)
+    constexpr std::uint32_t fullMask = vectorBytes == 32 ? ~std::uint32_t{0} : (std::uint32_t{1} << vectorBytes) - 1;
+
+    /* Lanes holding lo..hi: shift the range down to start at -128 and compare signed */
+    vec inRange (vec v, char lo, char hi) {
+      auto shifted = add (v,splat (static_cast<char> (-128 - lo)));
+      return less (shifted,splat (static_cast<char> (-128 + (hi - lo + 1))));
+    }
+
+    std::uint32_t identMask (vec v) {
+      auto alpha = inRange (any (v,splat (0x20)),'a','z');
+      auto digit = inRange (v,'0','9');
+      return bits (any (any (alpha,digit),eq (v,splat ('_'))));
+    }
+#endif
+
+    /* Most runs are a few bytes long; vectors only pay off once a run outlasts this */
+    constexpr std::ptrdiff_t scalarPrefix = 8;
+
+    /* End of the run of identifier characters starting at p */
+    const char* scanIdent (const char* p, const char* end) {
+#if defined(WHILEY_LEXER_AVX2) || defined(WHILEY_LEXER_SSE2)
+      for (auto stop = p + std::min (scalarPrefix,end-p); p < stop; ++p)
+	if (!isIdent (*p))
+	  return p;
+      while (end - p >= static_cast<std::ptrdiff_t> (vectorBytes)) {
+	auto stop = ~identMask (load (p)) & fullMask;
+	if (stop)
+	  return p + std::countr_zero (stop);
+	p += vectorBytes;
+      }
+#endif
+      while (p < end && isIdent (*p))
+	++p;
+      return p;
+    }
+
+    /* End of the run of spaces, tabs and newlines starting at p; newlines go to lines */
+    const char* scanSpace (const char* p, const char* end, const char* base, LineTable& lines) {
+#if defined(WHILEY_LEXER_AVX2) || defined(WHILEY_LEXER_SSE2)
+      for (auto stop = p + std::min (scalarPrefix,end-p); p < stop; ++p) {
+	if (*p == '\n')
+	  lines.addLine (static_cast<std::uint32_t> (p - base + 1));
+	else if (*p != ' ' && *p != '\t')
+	  return p;
+      }
+      while (end - p >= static_cast<std::ptrdiff_t> (vectorBytes)) {
+	auto v = load (p);
+	auto newlines = bits (eq (v,splat ('\n')));
+	auto blank = bits (any (eq (v,splat (' ')),eq (v,splat ('\t')))) | newlines;
+	auto stop = ~blank & fullMask;
+	auto run = stop ? std::countr_zero (stop) : static_cast<int> (vectorBytes);
+	if (run < 32)
+	  newlines &= (std::uint32_t{1} << run) - 1;
+	for (; newlines; newlines &= newlines - 1)
+	  lines.addLine (static_cast<std::uint32_t> (p - base + std::countr_zero (newlines) + 1));
+	if (stop)
+	  return p + run;
+	p += vectorBytes;
+      }
+#endif
+      for (; p < end; ++p) {
+	if (*p == '\n')
+	  lines.addLine (static_cast<std::uint32_t> (p - base + 1));
+	else if (*p != ' ' && *p != '\t')
+	  break;
+      }
+      return p;
+    }
+
+    std::int64_t toNumber (std::string_view digits, int base) {
+      std::int64_t value = 0;
+      auto [ptr,ec] = std::from_chars (digits.data (),digits.data () + digits.size (),value,base);
+      if (ec == std::errc::result_out_of_range)
+	throw std::out_of_range ("Number literal out of range");
+      return value;
+    }
+  }
+
+  int Scanner::yylex (Whiley::Parser::semantic_type * const lval, Whiley::Parser::location_type *location) {
+    yylval = lval;
+    loc = location;
+    const char* base = source.data ();
+    const char* end = base + source.size ();
+    const char* p = base + pos;
+
+    while (true) {
+      p = scanSpace (p,end,base,lines);
+      const char* start = p;
+      auto finish = [&](const char* stop, int tok) {
+	loc->begin = static_cast<std::uint32_t> (start - base);
+	loc->end = static_cast<std::uint32_t> (stop - base);
+	pos = stop - base;
+	return tok;
+      };
+      auto next = [&](std::size_t i) {return p + i < end ? p[i] : '\0';};
+
+      if (p == end)
+	return finish (p,token::END);
+
+      char c = *p;
+      if (isIdent (c) && !isDigit (c)) {
+	auto stop = scanIdent (p+1,end);
+	std::string_view text {p,static_cast<std::size_t> (stop-p)};
+	if (auto kw = findKeyword (text)) {
+	  if (kw->kind == token::TYPE) {
+	    finish (stop,0);
+	    return type_res (kw->type,text);
+	  }
+	  if (kw->kind != token::FUNCTION)
+	    return finish (stop,kw->kind);
+	  if (stop < end && *stop == ' ')
+	    return finish (stop+1,token::FUNCTION);
+	}
+	yylval->emplace<Whiley::Name> (names.intern (text));
+	return finish (stop,token::IDENTIFIER);
+      }
+
+      if (isDigit (c)) {
+	if (c == '0' && (next (1) == 'x' || next (1) == 'X') && isHex (next (2))) {
+	  auto stop = p+2;
+	  while (stop < end && isHex (*stop))
+	    ++stop;
+	  yylval->emplace<std::int64_t> (toNumber ({p+2,static_cast<std::size_t> (stop-p-2)},16));
+	  return finish (stop,token::NUMBER);
+	}
+	if (c == '0' && (next (1) == 'b' || next (1) == 'B') && (next (2) == '0' || next (2) == '1')) {
+	  auto stop = p+2;
+	  while (stop < end && (*stop == '0' || *stop == '1'))
+	    ++stop;
+	  yylval->emplace<std::int64_t> (toNumber ({p+2,static_cast<std::size_t> (stop-p-2)},2));
+	  return finish (stop,token::NUMBER);
+	}
+	auto stop = p+1;
+	while (stop < end && isDigit (*stop))
+	  ++stop;
+	yylval->emplace<std::int64_t> (toNumber ({p,static_cast<std::size_t> (stop-p)},10));
+	return finish (stop,token::NUMBER);
+      }
+
+      switch (c) {
+      case '+': return next (1) == '+' ? finish (p+2,token::INCREMENT) : finish (p+1,token::PLUS);
+      case '-':
+	if (next (1) == '>')
+	  return finish (p+2,token::ARROW);
+	if (next (1) >= '1' && next (1) <= '9') {
+	  auto stop = p+2;
+	  while (stop < end && isDigit (*stop))
+	    ++stop;
+	  yylval->emplace<std::int64_t> (toNumber ({p,static_cast<std::size_t> (stop-p)},10));
+	  return finish (stop,token::NUMBER);
+	}
+	return finish (p+1,token::MINUS);
+      case '/': return finish (p+1,token::DIV);
+      case '*': return finish (p+1,token::MUL);
+      case '%': return finish (p+1,token::MOD);
+      case '#': return finish (p+1,token::DEREF);
+      case '$': return finish (p+1,token::DEREFEXPR);
+      case '<':
+	if (next (1) == '=')
+	  return finish (p+2,token::LEQ);
+	if (next (1) == '<')
+	  return finish (p+2,token::LSHL);
+	return finish (p+1,token::LT);
+      case '>': return next (1) == '=' ? finish (p+2,token::GEQ) : finish (p+1,token::GT);
+      case '=': return next (1) == '=' ? finish (p+2,token::EQ) : finish (p+1,token::ASS);
+      case '!':
+	if (next (1) == '=')
+	  return finish (p+2,token::NEQ);
+	break;
+      case ';': return finish (p+1,token::SEMI);
+      case '(': return finish (p+1,token::LPARAN);
+      case ')': return finish (p+1,token::RPARAN);
+      case '{': return finish (p+1,token::LBRACE);
+      case '}': return finish (p+1,token::RBRACE);
+      case '[': return finish (p+1,token::LBRACK);
+      case ']': return finish (p+1,token::RBRACK);
+      case '?': return next (1) == '?' ? finish (p+2,token::NONDETTYPE) : finish (p+1,token::NONDET);
+      case '^': return finish (p+1,token::XOR);
+      case '|': return finish (p+1,token::BITOR);
+      case '&': return finish (p+1,token::BITAND);
+      case ',': return finish (p+1,token::COMMA);
+      case ':':
+	if (next (1) == ':')
+	  return finish (p+2,token::SELECTOR);
+	break;
+      case '\'': {
+	auto lit = next (1);
+	if (isIdent (lit) && lit != '_' && next (2) == '\'') {
+	  yylval->emplace<std::int64_t> (lit);
+	  return finish (p+3,token::CHAR);
+	}
+	// A lone quote is blank in lexer.l
+	++p;
+	continue;
+      }
+      default:
+	break;
+      }
+      unexpected (std::string_view (&c,1));
+      ++p;
+    }
+  }
+
+  bool Scanner::skipBlock (Whiley::Parser::location_type *location) {
+    // No token but the braces themselves holds a brace, so counting them is enough
+    const char* base = source.data ();
+    const char* end = base + source.size ();
+    const char* p = base + pos;
+    std::size_t depth = 1;
+    auto closes = [&](const char* at) {
+      if (*at == '{') {
+	++depth;
+	return false;
+      }
+      if (--depth)
+	return false;
+      location->begin = static_cast<std::uint32_t> (at - base);
+      location->end = location->begin + 1;
+      pos = location->end;
+      return true;
+    };
+#if defined(WHILEY_LEXER_AVX2) || defined(WHILEY_LEXER_SSE2)
+    while (end - p >= static_cast<std::ptrdiff_t> (vectorBytes)) {
+      auto v = load (p);
+      auto newlines = bits (eq (v,splat ('\n')));
+      auto braces = bits (any (eq (v,splat ('{')),eq (v,splat ('}'))));
+      for (auto hits = newlines | braces; hits; hits &= hits - 1) {
+	auto at = p + std::countr_zero (hits);
+	if (*at == '\n')
+	  lines.addLine (static_cast<std::uint32_t> (at - base + 1));
+	else if (closes (at))
+	  return true;
+      }
+      p += vectorBytes;
+    }
+#endif
+    for (; p < end; ++p) {
+      if (*p == '\n')
+	lines.addLine (static_cast<std::uint32_t> (p - base + 1));
+      else if ((*p == '{' || *p == '}') && closes (p))
+	return true;
+    }
+    pos = source.size ();
+    location->begin = location->end = static_cast<std::uint32_t> (pos);
+    return false;
+  }
+}
@@ -34,7 +34,7 @@
    #include <fstream>
    #include "scanner.h"
 #undef yylex
-#define yylex scanner.yylex
+#define yylex scanner.lex
   
 }
 
@@ -91,18 +91,19 @@
 
 
 %token END 0 "end of file"
-%token <std::string>    IDENTIFIER
+%token <Whiley::Name>    IDENTIFIER
 %token <std::int64_t>   NUMBER
 %token <std::int64_t>   CHAR
 
 %token <Type>    TYPE
 %type<std::size_t> stmt_list;
+%type<std::size_t> stmtlist;
 %type<std::size_t> expr_list; 
 %locations
 
 %%
 
-prgm : decllist functionlist stmtlist  {}
+prgm : decllist functionlist stmtlist  {builder.BlockStmt ($3,@3);}
 decllist :  decllist decl | /*empty*/
 decl : TYPE IDENTIFIER SEMI { builder.DeclareStmt ($2,$1,false,false,@$);}
      | PARAM TYPE IDENTIFIER SEMI { builder.DeclareStmt ($3,$2,true,false,@$);}
@@ -114,27 +115,27 @@ param : TYPE IDENTIFIER { builder.ParamDeclare ($2,$1,@$);}
 
 
 functionlist : functionlist function |  /* empty */  
-function : FUNCTION IDENTIFIER {builder.FunctionBegin ($2);} LPARAN paramlist  RPARAN ARROW TYPE LBRACE decllist stmtlist RBRACE  {builder.FunctionEnd ($8);} 
+function : FUNCTION IDENTIFIER {builder.FunctionBegin ($2);} LPARAN paramlist  RPARAN ARROW TYPE LBRACE decllist stmtlist RBRACE  {builder.BlockStmt ($11,@11); builder.FunctionEnd ($8);} 
 
 
-stmtlist : stmtlist stmt {builder.SequenceStmt (@$);} | stmt
+stmtlist : stmtlist stmt {$$ = $1+1;} | stmt {$$ = 1;}
 
 stmt : simpstmt  | selectivestmt | iterativestmt
 
-stmt_list : SELECTOR LBRACE stmtlist RBRACE  {$$ =1;}
-| stmt_list SELECTOR LBRACE stmtlist RBRACE {$$ = $1+1;}
+stmt_list : SELECTOR LBRACE stmtlist RBRACE  {builder.BlockStmt ($3,@3); $$ =1;}
+| stmt_list SELECTOR LBRACE stmtlist RBRACE {builder.BlockStmt ($4,@4); $$ = $1+1;}
 
 expr_list :  expr {$$ =1;} | /*empty */ {$$ = 0;}
 | expr_list COMMA expr {$$ = $1+1;}
 
 
-selectivestmt : IF LPARAN expr {builder.IfCond();}  RPARAN  LBRACE stmtlist RBRACE if_else
+selectivestmt : IF LPARAN expr {builder.IfCond();}  RPARAN  LBRACE stmtlist RBRACE {builder.BlockStmt ($7,@7);} if_else
               | CHOOSE LBRACE stmt_list RBRACE {builder.ChooseStmt ($3,@$);}
 
-if_else       : ELSE LBRACE stmtlist RBRACE {builder.IfStmt (@$);} | /*empty*/ {builder.SkipStmt(@$);builder.IfStmt (@$);}
+if_else       : ELSE LBRACE stmtlist RBRACE {builder.BlockStmt ($3,@3); builder.IfStmt (@$);} | /*empty*/ {builder.SkipStmt(@$);builder.IfStmt (@$);}
 
-iterativestmt : WHILE LPARAN expr  RPARAN {builder.WhileCond ();} LBRACE stmtlist RBRACE {builder.WhileStmt (@$);}
-| FOR LPARAN IDENTIFIER ASS expr  SEMI {builder.AssignStmt ($3,@$);} expr {builder.WhileCond();} SEMI INCREMENT IDENTIFIER  RPARAN LBRACE stmtlist RBRACE {builder.Increment ($12,@$); builder.SequenceStmt (@4); builder.WhileStmt (@$);  builder.SequenceStmt (@$);} 
+iterativestmt : WHILE LPARAN expr  RPARAN {builder.WhileCond ();} LBRACE stmtlist RBRACE {builder.BlockStmt ($7,@7); builder.WhileStmt (@$);}
+| FOR LPARAN IDENTIFIER ASS expr  SEMI {builder.AssignStmt ($3,@$);} expr {builder.WhileCond();} SEMI INCREMENT IDENTIFIER  RPARAN LBRACE stmtlist RBRACE {builder.Increment ($12,@$); builder.BlockStmt ($15+1,@15); builder.WhileStmt (@$);  builder.BlockStmt (2,@$);} 
 
 
 simpstmt : IDENTIFIER ASS expr SEMI { builder.AssignStmt ($1,@$);}
@@ -146,7 +147,7 @@ simpstmt : IDENTIFIER ASS expr SEMI { builder.AssignStmt ($1,@$);}
 | ASSUME  expr SEMI {builder.AssumeStmt (@$);}
 | RETURN expr SEMI {builder.ReturnStmt (@$);}
 | IDENTIFIER ASS IDENTIFIER LPARAN expr_list RPARAN SEMI {builder.CallStmt ($1,$3,$5,@$);};
-| IDENTIFIER LPARAN expr_list RPARAN SEMI {builder.CallStmt ("",$1,$3,@$);};
+| IDENTIFIER LPARAN expr_list RPARAN SEMI {builder.CallStmt (Whiley::Name{},$1,$3,@$);};
 
 | IDENTIFIER INCREMENT SEMI {builder.Increment ($1,@$);}
 
@@ -180,7 +181,7 @@ arith_factor : NUMBER {builder.NumberExpr ($1,@$);}
              | NONDETTYPE TYPE {builder.UndefExpr ($2,@$);}
              | DEREFEXPR expr  AS TYPE DEREFEXPR{builder.DerefExpr ($4,@$); }
              | LPARAN expr AS TYPE RPARAN {builder.CastExpr ($4,@$);}
-             | IDENTIFIER LBRACK expr_list RBRACK {builder.CallExpr ($1,$3,@$);}
+             | IDENTIFIER LBRACK expr_list RBRACK {if (!builder.CallExpr ($1,$3,@$)) throw syntax_error (@$,"not a function");}
 
 %%
 
@@ -188,6 +189,7 @@ arith_factor : NUMBER {builder.NumberExpr ($1,@$);}
 void  Whiley::Parser::error( const location_type& l, const std::string &err_message )
 {
   std::stringstream str;
-  str << "Error: " << err_message << " at " << l << "\n";
+  auto& lines = builder.getLineTable ();
+  str << "Error: " << err_message << " at " << lines.lookup (l.begin) << " - " << lines.lookup (l.end) << "\n";
   messager << StringMessage (str.str());
 }
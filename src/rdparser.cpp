@@ -0,0 +1,508 @@
+#include "rdparser.h"
+#include "scanner.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace Whiley {
+  namespace {
+    using token = Parser::token;
+
+    /* Comparisons bind loosest and do not associate */
+    constexpr int comparison = 1;
+
+    /* Operator and binding power of a binary operator token; power 0 if it is none */
+    std::pair<BinOps,int> binary (token::token_kind_type kind) {
+      switch (kind) {
+      case token::LEQ: return {BinOps::LEq,comparison};
+      case token::GEQ: return {BinOps::GEq,comparison};
+      case token::LT: return {BinOps::Lt,comparison};
+      case token::GT: return {BinOps::Gt,comparison};
+      case token::EQ: return {BinOps::Eq,comparison};
+      case token::NEQ: return {BinOps::NEq,comparison};
+      case token::PLUS: return {BinOps::Add,2};
+      case token::MINUS: return {BinOps::Sub,2};
+      case token::MUL: return {BinOps::Mul,3};
+      case token::DIV: return {BinOps::Div,3};
+      case token::MOD: return {BinOps::Mod,3};
+      case token::XOR: return {BinOps::Xor,3};
+      case token::BITOR: return {BinOps::Or,3};
+      case token::BITAND: return {BinOps::And,3};
+      case token::LSHL: return {BinOps::LShl,3};
+      default: return {BinOps::Add,0};
+      }
+    }
+  }
+
+  int RDParser::parse () {
+    try {
+      declarations ();
+      while (peek ().kind == token::FUNCTION)
+	function ();
+      location_t loc;
+      auto stmts = statements (loc);
+      expect (token::END);
+      main = builder.makeBlock (std::move(stmts),loc);
+      return 0;
+    }
+    catch (SyntaxError& err) {
+      return report (err);
+    }
+  }
+
+  int RDParser::parseFunction () {
+    try {
+      function ();
+      expect (token::END);
+      return 0;
+    }
+    catch (SyntaxError& err) {
+      return report (err);
+    }
+  }
+
+  int RDParser::parseBody () {
+    try {
+      main = body ();
+      expect (token::END);
+      return 0;
+    }
+    catch (SyntaxError& err) {
+      return report (err);
+    }
+  }
+
+  int RDParser::report (const SyntaxError& err) {
+    std::stringstream str;
+    auto& lines = builder.getLineTable ();
+    str << "Error: " << err.what << " at " << lines.lookup (err.loc.begin) << " - " << lines.lookup (err.loc.end) << "\n";
+    messager << StringMessage (str.str());
+    return 1;
+  }
+
+  const RDParser::Token& RDParser::peek (std::size_t ahead) {
+    while (buffered <= ahead) {
+      auto& tok = lookahead[(head+buffered) % lookahead.size()];
+      Parser::semantic_type value;
+      tok.kind = static_cast<kind_t> (scanner.lex (&value,&scanned));
+      tok.loc = {scanned.begin+origin,scanned.end+origin};
+      // Take the semantic value and release it the way the Bison parser would
+      switch (tok.kind) {
+      case token::IDENTIFIER:
+	tok.name = value.as<Name> ();
+	value.destroy<Name> ();
+	break;
+      case token::NUMBER:
+      case token::CHAR:
+	tok.number = value.as<std::int64_t> ();
+	value.destroy<std::int64_t> ();
+	break;
+      case token::TYPE:
+	tok.type = value.as<Type> ();
+	value.destroy<Type> ();
+	break;
+      default:
+	break;
+      }
+      ++buffered;
+    }
+    return lookahead[(head+ahead) % lookahead.size()];
+  }
+
+  RDParser::Token RDParser::next () {
+    auto tok = peek ();
+    head = (head+1) % lookahead.size();
+    --buffered;
+    lastEnd = tok.loc.end;
+    return tok;
+  }
+
+  RDParser::Token RDParser::expect (kind_t kind) {
+    if (peek ().kind != kind)
+      fail ();
+    return next ();
+  }
+
+  bool RDParser::accept (kind_t kind) {
+    if (peek ().kind != kind)
+      return false;
+    next ();
+    return true;
+  }
+
+  void RDParser::fail () {
+    throw SyntaxError {peek ().loc};
+  }
+
+  bool RDParser::startsStatement (kind_t kind) {
+    switch (kind) {
+    case token::IDENTIFIER:
+    case token::FREE:
+    case token::SKIP:
+    case token::DEREF:
+    case token::ASSERT:
+    case token::ASSUME:
+    case token::RETURN:
+    case token::IF:
+    case token::CHOOSE:
+    case token::WHILE:
+    case token::FOR:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  bool RDParser::startsExpression (kind_t kind) {
+    switch (kind) {
+    case token::NUMBER:
+    case token::CHAR:
+    case token::IDENTIFIER:
+    case token::LPARAN:
+    case token::NONDET:
+    case token::NONDETTYPE:
+    case token::DEREFEXPR:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  void RDParser::declarations () {
+    for (;;) {
+      auto first = peek ();
+      switch (first.kind) {
+      case token::TYPE: {
+	next ();
+	auto name = expect (token::IDENTIFIER);
+	expect (token::SEMI);
+	builder.DeclareStmt (name.name,first.type,false,false,from (first.loc));
+	break;
+      }
+      case token::PARAM:
+      case token::OUTPUT: {
+	next ();
+	auto type = expect (token::TYPE);
+	auto name = expect (token::IDENTIFIER);
+	expect (token::SEMI);
+	builder.DeclareStmt (name.name,type.type,first.kind == token::PARAM,first.kind == token::OUTPUT,from (first.loc));
+	break;
+      }
+      case token::CONSTANT: {
+	next ();
+	auto name = expect (token::IDENTIFIER);
+	expect (token::ASS);
+	auto value = expression ();
+	expect (token::SEMI);
+	builder.Constant (name.name,value.expr);
+	break;
+      }
+      default:
+	return;
+      }
+    }
+  }
+
+  void RDParser::function () {
+    auto first = expect (token::FUNCTION);
+    auto name = expect (token::IDENTIFIER);
+    builder.FunctionBegin (name.name);
+    expect (token::LPARAN);
+    auto param = [this] () {
+      auto type = expect (token::TYPE);
+      auto name = expect (token::IDENTIFIER);
+      builder.ParamDeclare (name.name,type.type,from (type.loc));
+    };
+    // As in parser.y the first parameter may be empty
+    if (peek ().kind == token::TYPE)
+      param ();
+    while (accept (token::COMMA))
+      param ();
+    expect (token::RPARAN);
+    expect (token::ARROW);
+    auto ret = expect (token::TYPE);
+    auto open = expect (token::LBRACE);
+    if (bodies) {
+      // Nothing was read past the brace, so the scanner stands right behind it
+      if (!scanner.skipBlock (&scanned))
+	fail ();
+      lastEnd = scanned.end+origin;
+      builder.FunctionEnd (ret.type,bodies,{open.loc.end,scanned.begin+origin});
+    }
+    else {
+      auto stmt = body ();
+      expect (token::RBRACE);
+      builder.FunctionEnd (ret.type,stmt);
+    }
+    functions.push_back ({name.name,from (first.loc)});
+  }
+
+  /* decllist stmtlist */
+  Statement_ptr RDParser::body () {
+    declarations ();
+    location_t loc;
+    auto stmts = statements (loc);
+    return builder.makeBlock (std::move(stmts),loc);
+  }
+
+  std::vector<Statement_ptr> RDParser::statements (location_t& loc) {
+    if (!startsStatement (peek ().kind))
+      fail ();
+    std::vector<Statement_ptr> stmts;
+    loc.begin = peek ().loc.begin;
+    while (startsStatement (peek ().kind))
+      stmts.push_back (statement ());
+    loc.end = lastEnd;
+    return stmts;
+  }
+
+  Statement_ptr RDParser::block () {
+    expect (token::LBRACE);
+    location_t loc;
+    auto stmts = statements (loc);
+    expect (token::RBRACE);
+    return builder.makeBlock (std::move(stmts),loc);
+  }
+
+  Statement_ptr RDParser::statement () {
+    switch (peek ().kind) {
+    case token::IF:
+      return ifStatement ();
+    case token::CHOOSE:
+      return chooseStatement ();
+    case token::WHILE:
+      return whileStatement ();
+    case token::FOR:
+      return forStatement ();
+    default:
+      return simpleStatement ();
+    }
+  }
+
+  Statement_ptr RDParser::simpleStatement () {
+    auto first = next ();
+    Statement_ptr stmt;
+    switch (first.kind) {
+    case token::IDENTIFIER:
+      if (accept (token::ASS)) {
+	if (accept (token::ALLOC)) {
+	  auto size = expression ();
+	  expect (token::SEMI);
+	  stmt = builder.makeAlloc (first.name,size.expr,from (first.loc));
+	}
+	else if (peek ().kind == token::IDENTIFIER && peek (1).kind == token::LPARAN) {
+	  auto callee = next ();
+	  next ();
+	  auto args = arguments (token::RPARAN);
+	  expect (token::SEMI);
+	  stmt = builder.makeCallStmt (first.name,callee.name,std::move(args),from (first.loc));
+	}
+	else {
+	  auto value = expression ();
+	  expect (token::SEMI);
+	  stmt = builder.makeAssign (first.name,value.expr,from (first.loc));
+	}
+      }
+      else if (accept (token::LPARAN)) {
+	auto args = arguments (token::RPARAN);
+	expect (token::SEMI);
+	stmt = builder.makeCallStmt (Name{},first.name,std::move(args),from (first.loc));
+      }
+      else if (accept (token::INCREMENT)) {
+	expect (token::SEMI);
+	stmt = builder.makeIncrement (first.name,from (first.loc));
+      }
+      else
+	fail ();
+      break;
+    case token::FREE: {
+      auto mem = expression ();
+      expect (token::SEMI);
+      stmt = builder.makeFree (mem.expr,from (first.loc));
+      break;
+    }
+    case token::SKIP:
+      expect (token::SEMI);
+      stmt = builder.makeSkip (from (first.loc));
+      break;
+    case token::DEREF: {
+      auto mem = expression ();
+      expect (token::ASS);
+      auto value = expression ();
+      expect (token::SEMI);
+      stmt = builder.makeMemAssign (mem.expr,value.expr,from (first.loc));
+      break;
+    }
+    case token::ASSERT:
+    case token::ASSUME:
+    case token::RETURN: {
+      auto expr = expression ();
+      expect (token::SEMI);
+      auto loc = from (first.loc);
+      if (first.kind == token::ASSERT)
+	stmt = builder.makeAssert (expr.expr,loc);
+      else if (first.kind == token::ASSUME)
+	stmt = builder.makeAssume (expr.expr,loc);
+      else
+	stmt = builder.makeReturn (expr.expr,loc);
+      break;
+    }
+    default:
+      std::unreachable ();
+    }
+    return builder.withCalls (stmt);
+  }
+
+  Statement_ptr RDParser::ifStatement () {
+    next ();
+    expect (token::LPARAN);
+    auto cond = expression ();
+    auto condCalls = builder.takeCalls ();
+    expect (token::RPARAN);
+    auto ifb = block ();
+    // The IfStatement is located at its else part, empty if there is none
+    Statement_ptr elseb;
+    location_t loc {lastEnd,lastEnd};
+    if (peek ().kind == token::ELSE) {
+      auto else_ = next ();
+      elseb = block ();
+      loc = from (else_.loc);
+    }
+    else
+      elseb = builder.withCalls (builder.makeSkip (loc));
+    return builder.withCalls (builder.makeIf (cond.expr,condCalls,ifb,elseb,loc));
+  }
+
+  Statement_ptr RDParser::chooseStatement () {
+    auto first = next ();
+    expect (token::LBRACE);
+    std::vector<Statement_ptr> branches;
+    do {
+      expect (token::SELECTOR);
+      branches.push_back (block ());
+    } while (peek ().kind == token::SELECTOR);
+    expect (token::RBRACE);
+    // parser.y hands the branches over last first
+    std::reverse (branches.begin (),branches.end ());
+    return builder.withCalls (builder.makeChoose (std::move(branches),from (first.loc)));
+  }
+
+  Statement_ptr RDParser::whileStatement () {
+    auto first = next ();
+    expect (token::LPARAN);
+    auto cond = expression ();
+    expect (token::RPARAN);
+    auto condCalls = builder.takeCalls ();
+    auto body = block ();
+    return builder.withCalls (builder.makeWhile (cond.expr,condCalls,body,from (first.loc)));
+  }
+
+  Statement_ptr RDParser::forStatement () {
+    auto first = next ();
+    expect (token::LPARAN);
+    auto var = expect (token::IDENTIFIER);
+    expect (token::ASS);
+    auto init = expression ();
+    expect (token::SEMI);
+    auto assign = builder.withCalls (builder.makeAssign (var.name,init.expr,{lastEnd,lastEnd}));
+    auto cond = expression ();
+    auto condCalls = builder.takeCalls ();
+    expect (token::SEMI);
+    expect (token::INCREMENT);
+    auto incremented = expect (token::IDENTIFIER);
+    expect (token::RPARAN);
+    expect (token::LBRACE);
+    location_t bodyLoc;
+    auto stmts = statements (bodyLoc);
+    expect (token::RBRACE);
+    auto loc = from (first.loc);
+    stmts.push_back (builder.withCalls (builder.makeIncrement (incremented.name,loc)));
+    auto body = builder.makeBlock (std::move(stmts),bodyLoc);
+    auto loop = builder.withCalls (builder.makeWhile (cond.expr,condCalls,body,loc));
+    return builder.makeBlock ({assign,loop},loc);
+  }
+
+  std::vector<Expression_ptr> RDParser::arguments (kind_t close) {
+    // As in parser.y the first argument may be empty
+    std::vector<Expression_ptr> args;
+    if (startsExpression (peek ().kind))
+      args.push_back (expression ().expr);
+    while (accept (token::COMMA))
+      args.push_back (expression ().expr);
+    expect (close);
+    return args;
+  }
+
+  RDParser::Parsed RDParser::expression (int minPower) {
+    auto left = factor ();
+    for (;;) {
+      auto [op,power] = binary (peek ().kind);
+      if (power <= minPower)
+	return left;
+      next ();
+      // Parsing the right operand one level tighter makes operators left associative
+      auto right = expression (power);
+      location_t loc {left.loc.begin,right.loc.end};
+      left = {builder.makeBinary (op,left.expr,right.expr,loc),loc};
+      if (power == comparison)
+	return left;
+    }
+  }
+
+  RDParser::Parsed RDParser::factor () {
+    if (!startsExpression (peek ().kind))
+      fail ();
+    auto first = next ();
+    Expression_ptr expr;
+    switch (first.kind) {
+    case token::NUMBER:
+      expr = builder.makeNumber (first.number,first.loc);
+      break;
+    case token::CHAR:
+      expr = builder.makeCast (builder.makeNumber (first.number,first.loc),Type::SI8,first.loc);
+      break;
+    case token::IDENTIFIER:
+      if (accept (token::LBRACK)) {
+	auto args = arguments (token::RBRACK);
+	expr = builder.makeCall (first.name,std::move(args),from (first.loc));
+	if (!expr)
+	  throw SyntaxError {from (first.loc),"not a function"};
+      }
+      else
+	expr = builder.makeIdentifier (first.name,first.loc);
+      break;
+    case token::LPARAN: {
+      auto inner = expression ();
+      if (accept (token::AS)) {
+	auto type = expect (token::TYPE);
+	expect (token::RPARAN);
+	expr = builder.makeCast (inner.expr,type.type,from (first.loc));
+      }
+      else {
+	expect (token::RPARAN);
+	expr = inner.expr;
+      }
+      break;
+    }
+    case token::NONDET:
+      expr = builder.makeUndef (Type::SI8,first.loc);
+      break;
+    case token::NONDETTYPE: {
+      auto type = expect (token::TYPE);
+      expr = builder.makeUndef (type.type,from (first.loc));
+      break;
+    }
+    case token::DEREFEXPR: {
+      auto mem = expression ();
+      expect (token::AS);
+      auto type = expect (token::TYPE);
+      expect (token::DEREFEXPR);
+      expr = builder.makeDeref (mem.expr,type.type,from (first.loc));
+      break;
+    }
+    default:
+      std::unreachable ();
+    }
+    return {expr,from (first.loc)};
+  }
+}
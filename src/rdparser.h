@@ -0,0 +1,121 @@
+#ifndef __RDPARSER_HPP__
+#define __RDPARSER_HPP__
+
+#include "parser.hh"
+#include "whiley/ast.hpp"
+#include "whiley/messaging.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Whiley {
+  class Scanner;
+
+  /**
+   * Hand-written alternative to the Bison parser of parser.y. It accepts the
+   * same language over the same Scanner tokens and builds the same Program,
+   * locations included, but creates nodes directly through the ASTBuilder's
+   * make* functions instead of going through its side stacks.
+   * Expressions are parsed by precedence climbing.
+   */
+  class RDParser {
+  public:
+    /* origin is the offset of the scanned text in its file and is added to every location */
+    RDParser (Scanner& scanner, ASTBuilder& builder, MessageSystem& messager, std::uint32_t origin = 0) : scanner(scanner),
+													  builder(builder),
+													  messager(messager),
+													  origin(origin) {}
+
+    /* Returns 0 on success like Parser::parse; on a syntax error the program is left unfinished */
+    int parse ();
+    /* As parse, for text holding exactly one function definition */
+    int parseFunction ();
+    /* As parse, for the text between the braces of a function body; the builder
+       must be building that function */
+    int parseBody ();
+    /* The main statement of the last successful parse, or the body for parseBody */
+    Statement_ptr getMain () const {return main;}
+
+    /* Leave function bodies to source, only matching their braces */
+    void deferBodies (std::shared_ptr<BodySource> source) {bodies = std::move(source);}
+
+    /* A parsed function and its extent, from fn to the closing brace */
+    struct FunctionSpan {
+      Name name;
+      location_t loc;
+    };
+    const std::vector<FunctionSpan>& getFunctions () const {return functions;}
+
+  private:
+    using token = Parser::token;
+    using kind_t = Parser::token::token_kind_type;
+
+    struct Token {
+      kind_t kind;
+      location_t loc;
+      Name name;
+      std::int64_t number{0};
+      Type type{Type::Untyped};
+    };
+
+    /* An expression with the location its grammar symbol spans (parentheses included) */
+    struct Parsed {
+      Expression_ptr expr;
+      location_t loc;
+    };
+
+    struct SyntaxError {
+      location_t loc;
+      const char* what{"syntax error"};
+    };
+
+    const Token& peek (std::size_t ahead = 0);
+    Token next ();
+    Token expect (kind_t kind);
+    bool accept (kind_t kind);
+    [[noreturn]] void fail ();
+    int report (const SyntaxError& err);
+    /* From the start of first to the end of the last consumed token */
+    location_t from (const location_t& first) const {return {first.begin,lastEnd};}
+
+    void declarations ();
+    void function ();
+    Statement_ptr body ();
+    std::vector<Statement_ptr> statements (location_t& loc);
+    Statement_ptr statement ();
+    Statement_ptr simpleStatement ();
+    Statement_ptr ifStatement ();
+    Statement_ptr chooseStatement ();
+    Statement_ptr whileStatement ();
+    Statement_ptr forStatement ();
+    Statement_ptr block ();
+    std::vector<Expression_ptr> arguments (kind_t close);
+
+    Parsed expression (int minPower = 0);
+    Parsed factor ();
+
+    static bool startsStatement (kind_t kind);
+    static bool startsExpression (kind_t kind);
+
+    Scanner& scanner;
+    ASTBuilder& builder;
+    MessageSystem& messager;
+    /* Tokens read ahead; statements need two to tell calls from assignments */
+    std::array<Token,4> lookahead;
+    std::size_t head{0};
+    std::size_t buffered{0};
+    /* The flex scanner advances one location across calls, like Bison's yylloc */
+    location_t scanned;
+    /* End of the last consumed token; also where Bison places empty rules */
+    std::uint32_t lastEnd{0};
+    std::uint32_t origin;
+    Statement_ptr main{nullptr};
+    std::vector<FunctionSpan> functions;
+    std::shared_ptr<BodySource> bodies;
+  };
+}
+
+#endif
@@ -0,0 +1,32 @@
+#include "whiley/runtime.hpp"
+
+#include <algorithm>
+
+namespace Whiley {
+  std::uint64_t Heap::allocate (std::uint64_t size) {
+    if (size > limit || bytes.size ()+size > limit || size > ~std::uint32_t{0} || blocks.size () >= ~std::uint32_t{0})
+      return 0;
+    blocks.push_back ({bytes.size (),static_cast<std::uint32_t> (size),true});
+    bytes.resize (bytes.size ()+size,std::byte{0});
+    return std::uint64_t{blocks.size ()} << 32;
+  }
+
+  bool Heap::release (std::uint64_t p) {
+    auto b = (p >> 32)-1;
+    if (!(p >> 32) || b >= blocks.size () || !blocks[b].live || static_cast<std::uint32_t> (p))
+      return false;
+    blocks[b].live = false;
+    return true;
+  }
+
+  void Heap::clear () {
+    blocks.clear ();
+    bytes.clear ();
+  }
+
+  std::ostream& operator<< (std::ostream& os, Outcome o) {
+    static const char* names[] = {"finished","assertion failed","blocked","division by zero","invalid access",
+				  "out of memory","stack overflow","out of steps"};
+    return os << names[std::to_underlying (o)];
+  }
+}
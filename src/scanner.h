@@ -1,24 +1,139 @@
 #ifndef __SCANNER_HPP__
 #define __SCANNER_HPP__
 
-#if ! defined(yyFlexLexerOnce)
+#include "whiley/config.hpp"
+
+#if !defined(WHILEY_HANDWRITTEN_LEXER) && ! defined(yyFlexLexerOnce)
 #include <FlexLexer.h>
 #endif
 
 #include "parser.hh"
 #include "whiley/options.hpp"
+#include "whiley/messaging.hpp"
+#include "whiley/stats.hpp"
+
+#include <span>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <istream>
+#include <iterator>
 
   namespace Whiley {
+#ifdef WHILEY_HANDWRITTEN_LEXER
+    /* Hand-written scanner over a contiguous buffer (src/lexer.cpp) */
+    class Scanner {
+    public:
+      
+      Scanner(std::istream *in, Whiley::Interner& names, Whiley::LineTable& lines, Whiley::MessageSystem& messages, Whiley::TypeFlags flags = Whiley::TypeFlags::All ()) : names(names),
+																	   lines(lines),
+																	   messages(messages),
+																	   owned(std::istreambuf_iterator<char> (*in),std::istreambuf_iterator<char> ()),
+																	   source(owned),
+																	   enabled(std::move(flags)) {
+	checkSize ();
+    };
+
+      Scanner(std::span<const char> src, Whiley::Interner& names, Whiley::LineTable& lines, Whiley::MessageSystem& messages, Whiley::TypeFlags flags = Whiley::TypeFlags::All ()) : names(names),
+																		   lines(lines),
+																		   messages(messages),
+																		   source(src),
+																		   enabled(std::move(flags)) {
+	checkSize ();
+    };
+      
+      int yylex( Whiley::Parser::semantic_type * const lval, 
+		 Whiley::Parser::location_type *location );   
+#else
     class Scanner : public yyFlexLexer{
     public:
       
-      Scanner(std::istream *in, Whiley::TypeFlags flags = Whiley::TypeFlags::All ()) : yyFlexLexer(in),enabled(std::move(flags)) {
+      Scanner(std::istream *in, Whiley::Interner& names, Whiley::LineTable& lines, Whiley::MessageSystem& messages, Whiley::TypeFlags flags = Whiley::TypeFlags::All ()) : yyFlexLexer(in),
+																	   names(names),
+																	   lines(lines),
+																	   messages(messages),
+																	   enabled(std::move(flags)) {
+    };
+
+      /* Scan directly over in-memory source, bypassing std::istream */
+      Scanner(std::span<const char> src, Whiley::Interner& names, Whiley::LineTable& lines, Whiley::MessageSystem& messages, Whiley::TypeFlags flags = Whiley::TypeFlags::All ()) : yyFlexLexer(nullptr),
+																		   names(names),
+																		   lines(lines),
+																		   messages(messages),
+															   source(src),
+															   fromMemory(true),
+															   enabled(std::move(flags)) {
     };
       
       using FlexLexer::yylex;
       
       virtual int yylex( Whiley::Parser::semantic_type * const lval, 
 			 Whiley::Parser::location_type *location );   
+#endif
+
+      /* Parser entry point; lexing is only timed when stats are collected */
+      int lex (Whiley::Parser::semantic_type * const lval, Whiley::Parser::location_type *location) {
+	++tokens;
+	if (!timed)
+	  return yylex (lval,location);
+	auto begin = Stats::clock::now ();
+	auto tok = yylex (lval,location);
+	lexTime += Stats::clock::now () - begin;
+	return tok;
+      }
+
+      void setTimed (bool t) {timed = t;}
+
+      /* Skips the rest of a block whose opening brace was the last token, up to and
+	 including the brace closing it, to which location is set as by lex; false if
+	 the source ends first. Newlines on the way still go to lines. */
+      bool skipBlock (Whiley::Parser::location_type *location);
+
+      void unexpected (std::string_view text) {
+	messages << Whiley::StringMessage {"Unexpected text" + std::string {text}};
+      }
+      std::size_t tokenCount () const {return tokens;}
+      Stats::clock::duration lexingTime () const {return lexTime;}
+      
+#ifdef WHILEY_HANDWRITTEN_LEXER
+    private:
+      void checkSize () {
+	// Locations are 32-bit offsets
+	if (source.size () > std::numeric_limits<std::uint32_t>::max ())
+	  throw std::runtime_error ("Source larger than 4 GiB");
+      }
+
+      Whiley::Parser::token::token_kind_type type_res (Type t, std::string_view text) {
+	if (enabled.isSet(t))  {
+	  yylval->emplace<Type> (t); return Whiley::Parser::token::TYPE;
+	}
+	else
+	  yylval->emplace<Whiley::Name> (names.intern (text)); return Whiley::Parser::token::IDENTIFIER;
+      }
+#else
+    protected:
+      int LexerInput (char* buf, int max_size) override {
+	std::size_t n;
+	if (!fromMemory) {
+	  auto read = yyFlexLexer::LexerInput (buf,max_size);
+	  if (read <= 0)
+	    return read;
+	  n = read;
+	}
+	else {
+	  n = std::min<std::size_t> (max_size,source.size());
+	  std::memcpy (buf,source.data(),n);
+	  source = source.subspan (n);
+	}
+	// Locations are 32-bit offsets
+	consumed += n;
+	if (consumed > std::numeric_limits<std::uint32_t>::max ())
+	  throw std::runtime_error ("Source larger than 4 GiB");
+	return static_cast<int> (n);
+      }
       
     private:
       Whiley::Parser::token::token_kind_type type_res (Type t) {
@@ -26,13 +141,33 @@
 	  yylval->emplace<Type> (t); return Whiley::Parser::token::TYPE;
 	}
 	else
-	  yylval->emplace<std::string> (yytext); return Whiley::Parser::token::IDENTIFIER;
+	  yylval->emplace<Whiley::Name> (names.intern (std::string_view (yytext,yyleng))); return Whiley::Parser::token::IDENTIFIER;
       }
+#endif
       /* yyval ptr */
       Whiley::Parser::semantic_type *yylval = nullptr;
       /* location ptr */
       Whiley::Parser::location_type *loc    = nullptr;
+      /* identifier interner of the compilation being scanned */
+      Whiley::Interner& names;
+      /* line starts of the source being scanned */
+      Whiley::LineTable& lines;
+      /* diagnostics of the parse this scanner belongs to */
+      Whiley::MessageSystem& messages;
+#ifdef WHILEY_HANDWRITTEN_LEXER
+      /* Source read from a stream; empty when scanning caller memory */
+      std::string owned;
+      std::span<const char> source;
+      std::size_t pos{0};
+#else
+      std::span<const char> source;
+      bool fromMemory{false};
+      std::size_t consumed{0};
+#endif
       Whiley::TypeFlags enabled;
+      std::size_t tokens{0};
+      bool timed{false};
+      Stats::clock::duration lexTime{0};
     };
 
   }
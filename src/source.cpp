@@ -0,0 +1,87 @@
+#include "whiley/source.hpp"
+
+#include <stdexcept>
+#include <utility>
+#include <iterator>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Whiley {
+  SourceBuffer::SourceBuffer (SourceBuffer&& o) noexcept : data(std::exchange(o.data,nullptr)),
+							   size(std::exchange(o.size,0)),
+							   mapped(std::exchange(o.mapped,false)),
+							   owned(std::move(o.owned)) {}
+
+  SourceBuffer& SourceBuffer::operator= (SourceBuffer&& o) noexcept {
+    if (this != &o) {
+      release ();
+      data = std::exchange(o.data,nullptr);
+      size = std::exchange(o.size,0);
+      mapped = std::exchange(o.mapped,false);
+      owned = std::move(o.owned);
+    }
+    return *this;
+  }
+
+  SourceBuffer::~SourceBuffer () {
+    release ();
+  }
+
+  void SourceBuffer::release () {
+    if (mapped)
+      ::munmap (const_cast<char*>(data),size);
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    owned.clear();
+  }
+
+  SourceBuffer SourceBuffer::fromFile (const std::string& filename) {
+    int fd = ::open (filename.c_str(),O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::runtime_error ("Cannot open file " + filename);
+
+    SourceBuffer buffer;
+    struct stat st;
+    if (::fstat (fd,&st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void* addr = ::mmap (nullptr,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+      if (addr != MAP_FAILED) {
+	::madvise (addr,st.st_size,MADV_SEQUENTIAL);
+	buffer.data = static_cast<const char*> (addr);
+	buffer.size = st.st_size;
+	buffer.mapped = true;
+	::close (fd);
+	return buffer;
+      }
+    }
+
+    // Pipes, character devices and files mmap refuses: read everything once
+    char chunk[1 << 16];
+    ssize_t r;
+    while ((r = ::read (fd,chunk,sizeof(chunk))) != 0) {
+      if (r < 0) {
+	if (errno == EINTR)
+	  continue;
+	::close (fd);
+	throw std::runtime_error ("Cannot read file " + filename);
+      }
+      buffer.owned.insert (buffer.owned.end(),chunk,chunk+r);
+    }
+    ::close (fd);
+    buffer.data = buffer.owned.data();
+    buffer.size = buffer.owned.size();
+    return buffer;
+  }
+
+  SourceBuffer SourceBuffer::fromStream (std::istream& is) {
+    SourceBuffer buffer;
+    buffer.owned.assign (std::istreambuf_iterator<char>(is),std::istreambuf_iterator<char>());
+    buffer.data = buffer.owned.data();
+    buffer.size = buffer.owned.size();
+    return buffer;
+  }
+}
@@ -0,0 +1,154 @@
+#include "whiley/stats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace Whiley {
+  namespace {
+    void quote (std::ostream& os, std::string_view s) {
+      os << '"';
+      for (char c : s) {
+	if (c == '"' || c == '\\')
+	  os << '\\' << c;
+	else if (static_cast<unsigned char> (c) < 0x20)
+	  os << "\\u" << std::hex << std::setw (4) << std::setfill ('0') << int(c) << std::dec << std::setfill (' ');
+	else
+	  os << c;
+      }
+      os << '"';
+    }
+
+    double micros (Stats::clock::duration d) {
+      return std::chrono::duration<double,std::micro> (d).count ();
+    }
+  }
+
+  // Callers hold the mutex for the helpers below
+  Stats::Phase& Stats::phase (std::string_view name) {
+    auto it = std::find_if (phases.begin (),phases.end (),[&](auto& p) {return p.name == name;});
+    if (it == phases.end ())
+      return phases.emplace_back (Phase {std::string{name}});
+    return *it;
+  }
+
+  std::uint64_t& Stats::slot (std::string_view name) {
+    auto it = std::find_if (counters.begin (),counters.end (),[&](auto& c) {return c.first == name;});
+    if (it == counters.end ())
+      return counters.emplace_back (std::string{name},0).second;
+    return it->second;
+  }
+
+  std::size_t Stats::lane () {
+    auto id = std::this_thread::get_id ();
+    auto it = std::find (lanes.begin (),lanes.end (),id);
+    if (it == lanes.end ()) {
+      lanes.push_back (id);
+      return lanes.size ()-1;
+    }
+    return it - lanes.begin ();
+  }
+
+  void Stats::record (std::string_view name, clock::time_point begin, clock::time_point end, std::string_view detail) {
+    std::lock_guard lock {mutex};
+    auto& p = phase (name);
+    p.total += end - begin;
+    ++p.count;
+    events.push_back ({std::string{name},std::string{detail},begin,end,lane ()});
+  }
+
+  void Stats::addTime (std::string_view name, clock::duration d) {
+    std::lock_guard lock {mutex};
+    auto& p = phase (name);
+    p.total += d;
+    ++p.count;
+  }
+
+  void Stats::add (std::string_view name, std::uint64_t n) {
+    std::lock_guard lock {mutex};
+    slot (name) += n;
+  }
+
+  void Stats::max (std::string_view name, std::uint64_t n) {
+    std::lock_guard lock {mutex};
+    auto& c = slot (name);
+    c = std::max (c,n);
+  }
+
+  std::uint64_t Stats::counter (std::string_view name) const {
+    std::lock_guard lock {mutex};
+    for (auto& [n,v] : counters)
+      if (n == name)
+	return v;
+    return 0;
+  }
+
+  Stats::clock::duration Stats::time (std::string_view name) const {
+    std::lock_guard lock {mutex};
+    for (auto& p : phases)
+      if (p.name == name)
+	return p.total;
+    return clock::duration{0};
+  }
+
+  void Stats::writeJSON (std::ostream& os) const {
+    std::lock_guard lock {mutex};
+    os << "{\n  \"phases\": {";
+    for (std::size_t i = 0; i < phases.size (); ++i) {
+      os << (i ? ",\n    " : "\n    ");
+      quote (os,phases[i].name);
+      os << ": {\"ms\": " << micros (phases[i].total) / 1000 << ", \"count\": " << phases[i].count << "}";
+    }
+    os << "\n  },\n  \"counters\": {";
+    for (std::size_t i = 0; i < counters.size (); ++i) {
+      os << (i ? ",\n    " : "\n    ");
+      quote (os,counters[i].first);
+      os << ": " << counters[i].second;
+    }
+    os << "\n  }\n}\n";
+  }
+
+  void Stats::writeTrace (std::ostream& os) const {
+    std::lock_guard lock {mutex};
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (auto& e : events) {
+      os << (first ? "\n" : ",\n");
+      first = false;
+      os << "  {\"name\": ";
+      quote (os,e.name);
+      os << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.lane
+	 << ", \"ts\": " << micros (e.begin - origin)
+	 << ", \"dur\": " << micros (e.end - e.begin);
+      if (!e.detail.empty ()) {
+	os << ", \"args\": {\"name\": ";
+	quote (os,e.detail);
+	os << "}";
+      }
+      os << "}";
+    }
+    // Final counter values as one sample at the end of the timeline
+    if (!counters.empty ()) {
+      auto last = origin;
+      for (auto& e : events)
+	last = std::max (last,e.end);
+      for (auto& [name,value] : counters) {
+	os << (first ? "\n" : ",\n");
+	first = false;
+	os << "  {\"name\": ";
+	quote (os,name);
+	os << ", \"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"ts\": " << micros (last - origin)
+	   << ", \"args\": {\"value\": " << value << "}}";
+      }
+    }
+    os << "\n]}\n";
+  }
+
+  void Stats::clear () {
+    std::lock_guard lock {mutex};
+    origin = clock::now ();
+    phases.clear ();
+    counters.clear ();
+    events.clear ();
+    lanes.clear ();
+  }
+}
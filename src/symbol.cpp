@@ -1,162 +1,167 @@
 #include "whiley/symbol.hpp"
 
 #include <optional>
-#include <unordered_map>
 #include <string>
 #include <stdexcept>
 #include <sstream>
 #include <iostream>
 #include <utility>
+#include <deque>
+#include <bit>
+#include <algorithm>
+#include <unordered_map>
 #include "whiley/ast.hpp"
+#include "symboltable.h"
 
 namespace Whiley {
-
-  struct Symbol::Internal {
-    Internal (std::string name, std::shared_ptr<Internal> par) : name(name),parent(par) {}
-    std::ostream& output (std::ostream& os) const {
-      if (parent ) {
-	return parent->output (os) << "#" << name;
-	
-      }
-      else
-	return os << name;
-    }
-    
-    
-    bool isRoot () const {
-      return parent == nullptr;
-    }
-    
-    std::string name;
-    std::shared_ptr<Internal> parent;
-    UserData data;
-  };
-
-  Symbol::Symbol(Symbol parent,std::string name) : internal(std::make_shared<Internal>(name,parent.internal)){
-  }
-  
-  Symbol::Symbol (std::string s) : internal(std::make_shared<Internal> (s,nullptr)) {}
-  
-  std::string Symbol::getName() const {return internal->name; }
+  Name Symbol::getName() const {return table->names[ident]; }
   std::string Symbol::getFullName() const {
     std::stringstream str;
-    internal->output(str);
+    table->output(str,ident);
     return str.str();
   }
 
 
   void Symbol::setUserData (UserData data) {
-    internal->data = std::move(data);
+    table->data[ident] = std::move(data);
   }
   const UserData& Symbol::getUserData () const  {
-    return internal->data;
-  }
-  
-  
-  std::size_t Symbol::hash () const {
-    return reinterpret_cast<std::size_t> (internal.get());
-  }
-  
-  struct Frame::Internal : public std::enable_shared_from_this<Internal> {
-    Internal (Symbol s, std::shared_ptr<Internal> inter) : symb(s),parent(inter) {}
-
-    Symbol makeSymbol (std::string name) {
-      if (!symbols.count(name)) {
-	Symbol b (symb,name);
-	symbols.emplace (std::make_pair(name,b));
-	return b;
-      }
-      else
-	throw std::runtime_error ("Symbol already exists");
-    }
+    return table->data[ident];
+  }
 
-    Symbol makeFresh (std::string name) {
-      std::size_t i {0};
-      std::string namee;
-      do {
-	namee = name+std::to_string(i);
-	if (!symbols.count(namee)) {
-	  Symbol b (symb,namee);
-	  symbols.emplace (std::make_pair(namee,b));
-	  return b;
-	}
-	++i;
-      }while(symbols.count(namee));
-      std::unreachable();
-    }
-    
-    std::optional<Symbol>   resolve (std::string s) {
-      
-      auto it = symbols.find(s);
-      if (it != symbols.end())
-	return it->second;
-      else if (parent) {
-	return parent ->resolve(s);
-      }
-      else return std::nullopt;
-    }
-    
-    Symbol symb;
-    std::shared_ptr<Internal> parent;
-    std::unordered_map<std::string,Symbol> symbols;
-    std::unordered_map<std::string,std::shared_ptr<Internal>> frames;
-    
-  };
+  Symbol Frame::createSymbol (Name s) {
+    return Symbol {table.get(),table->makeSymbol (scope,s)};
+  }
+
+  Symbol Frame::createSymbol (const std::string& s) {
+    return createSymbol (intern (s));
+  }
 
-  Symbol Frame::createSymbol (std::string s) {
-    return _internal->makeSymbol (s);
+  Symbol Frame::createFresh (Name prefix) {
+    return Symbol {table.get(),table->makeFresh (scope,prefix)};
   }
 
-  Symbol Frame::createFresh (std::string s) {
-    return _internal->makeFresh (s);
+  Symbol Frame::createFresh (const std::string& s) {
+    return createFresh (intern (s));
   }
+
   Frame Frame::close() {
-    if (!_internal->parent)
+    auto parent = table->scopes[scope].parent;
+    if (parent == SymbolTable::none)
       throw std::runtime_error {"No scope to close to"};
-    return Frame{_internal->parent};
-  }
-  
-  Frame Frame::create (std::string s) {
-    if (!_internal->frames.count(s)) {
-      auto frame_symb = _internal->makeSymbol (s+"__");
-      auto inter_frame = std::make_shared<Internal> (frame_symb,_internal->shared_from_this ());
-      _internal->frames.emplace(s+"__",inter_frame);
-      return Frame{inter_frame};
-    }
-    throw std::runtime_error ("Symbol exists");
+    return Frame{table,parent};
   }
 
-  Frame Frame::open (std::string s) {
-    std::shared_ptr<Internal> _frame{nullptr};
-      auto it  = _internal->frames.find (s+"__");
-      if (it== _internal->frames.end ())
-	throw std::runtime_error ("Cannot find frame");
+  Frame Frame::create (Name s) {
+    return Frame{table,table->makeScope (scope,s)};
+  }
+
+  Frame Frame::create (const std::string& s) {
+    return create (intern (s));
+  }
 
-      _frame = it->second;
-      
-      return _frame;   
+  Frame Frame::renew (Name s) {
+    return Frame{table,table->renewScope (scope,s)};
   }
-  
+
+  Frame Frame::open (Name s) {
+    auto child = table->frames.find (ScopedIdMap::key (scope,s));
+    if (child == SymbolTable::none)
+      throw std::runtime_error ("Cannot find frame");
+    return Frame{table,child};
+  }
+
+  Frame Frame::open (const std::string& s) {
+    return open (intern (s));
+  }
+
+  std::optional<Symbol> Frame::resolve(Name s) const {
+    auto id = table->resolve (scope,s);
+    if (id == SymbolTable::none)
+      return std::nullopt;
+    return Symbol {table.get(),id};
+  }
+
+  std::optional<Symbol> Frame::resolve(Name s, std::uint32_t before) const {
+    auto id = table->resolve (scope,s,before);
+    if (id == SymbolTable::none)
+      return std::nullopt;
+    return Symbol {table.get(),id};
+  }
+
   std::optional<Symbol> Frame::resolve(const std::string& s) const {
-    return _internal->resolve(s);
+    if (auto name = table->interner.lookup (s))
+      return resolve(*name);
+    return std::nullopt;
+  }
+
+  Symbol Frame::owner () const {
+    return Symbol {table.get(),table->scopes[scope].owner};
   }
 
-  
-  Frame::Frame(std::string s) {
-    _internal = std::make_shared<Internal> (Symbol (s),nullptr);
+  Interner& Frame::getInterner () const {
+    return table->interner;
+  }
+
+  std::size_t Frame::symbolCount () const {
+    // Entry 0 is the root frame itself
+    return table->names.size ()-1;
+  }
+
+  std::size_t Frame::maxDepth () const {
+    return table->maxDepth;
+  }
+
+  Frame::Frame(std::string s) : table(std::make_shared<SymbolTable> (s)),scope(0) {
   }
 
   std::generator<Symbol> Frame::getLocalSymbols() const {
-    for (auto [name,symb] : _internal->symbols )
-      co_yield symb;
+    // Index afresh each step: creating scopes while iterating may move the vector
+    for (std::size_t i = 0; i < table->scopes[scope].members.size(); ++i)
+      co_yield Symbol {table.get(),table->scopes[scope].members[i]};
   }
 
   Function::~Function() {}
   Function::Function (Whiley::Frame f, Statement_ptr&& stmt, std::vector<Symbol>&& params,Type retType)  :
-    frame(f),
+    table(f.table.get()),
+    scope(f.scope),
+    returnType(retType),
+    stmt(stmt),
+    parameters(std::move(params)){}
+
+  Function::Function (Whiley::Frame f, std::shared_ptr<BodySource> source, const location_t& loc, std::vector<Symbol>&& params,Type retType)  :
+    table(f.table.get()),
+    scope(f.scope),
     returnType(retType),
-   
-    stmt(std::move(stmt)),
-   parameters(std::move(params)){}
-  
+    stmt(nullptr),
+    source(std::move(source)),
+    body(loc),
+    parameters(std::move(params)){}
+
+  Statement_ptr Function::getStmt() const {
+    if (auto s = stmt.load (std::memory_order_acquire))
+      return s;
+    std::lock_guard lock {source->mutex};
+    // Someone else may have parsed it while we waited
+    if (auto s = stmt.load (std::memory_order_relaxed))
+      return s;
+    // A failed parse leaves declarations behind, so it is not tried again
+    if (failure)
+      std::rethrow_exception (failure);
+    try {
+      auto s = source->parse (Whiley::Frame {table->shared_from_this(),scope},body);
+      stmt.store (s,std::memory_order_release);
+      return s;
+    }
+    catch (...) {
+      failure = std::current_exception ();
+      throw;
+    }
+  }
+
+  Whiley::Frame Function::getFrame() const {
+    getStmt ();
+    return Whiley::Frame {table->shared_from_this(),scope};
+  }
+
 }
@@ -0,0 +1,303 @@
+#ifndef _WHILEY_SYMBOLTABLE__
+#define _WHILEY_SYMBOLTABLE__
+
+#include "whiley/symbol.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Whiley {
+  /**
+   * Open addressing map from (scope,name) keys to dense ids; entries are never removed.
+   * One thread may insert while others find: a slot's key is written after its value,
+   * and a grown table is published whole. Outgrown tables stay until the map dies as a
+   * reader may still be probing one; together they are smaller than the current one.
+   */
+  class ScopedIdMap {
+  public:
+    static constexpr std::uint32_t none = ~std::uint32_t{0};
+
+    static std::uint64_t key (std::uint32_t scope, Name n) {
+      return (static_cast<std::uint64_t> (scope) << 32) | n.id ();
+    }
+
+    std::uint32_t find (std::uint64_t k) const {
+      auto t = current.load (std::memory_order_acquire);
+      if (!t)
+	return none;
+      for (auto i = t->slot (k);; i = (i+1) & t->mask) {
+	auto key = t->slots[i].key.load (std::memory_order_acquire);
+	if (key == k)
+	  return t->slots[i].value.load (std::memory_order_acquire);
+	if (key == empty)
+	  return none;
+      }
+    }
+
+    bool insert (std::uint64_t k, std::uint32_t v) {
+      auto t = current.load (std::memory_order_relaxed);
+      if (!t || (count+1)*4 > (t->mask+1)*3)
+	t = rehash (t ? (t->mask+1)*2 : 64);
+      for (auto i = t->slot (k);; i = (i+1) & t->mask) {
+	auto key = t->slots[i].key.load (std::memory_order_relaxed);
+	if (key == k)
+	  return false;
+	if (key == empty) {
+	  t->slots[i].value.store (v,std::memory_order_relaxed);
+	  t->slots[i].key.store (k,std::memory_order_release);
+	  ++count;
+	  return true;
+	}
+      }
+    }
+
+    /* Binds k to v, rebinding it if it is bound already */
+    void assign (std::uint64_t k, std::uint32_t v) {
+      if (insert (k,v))
+	return;
+      auto t = current.load (std::memory_order_relaxed);
+      for (auto i = t->slot (k);; i = (i+1) & t->mask) {
+	if (t->slots[i].key.load (std::memory_order_relaxed) == k) {
+	  t->slots[i].value.store (v,std::memory_order_release);
+	  return;
+	}
+      }
+    }
+
+  private:
+    // Name ids start at 1, so no (scope,name) key is ever 0
+    static constexpr std::uint64_t empty = 0;
+    struct Slot {
+      std::atomic<std::uint64_t> key{empty};
+      std::atomic<std::uint32_t> value{none};
+    };
+
+    struct Table {
+      explicit Table (std::size_t capacity) : slots(new Slot[capacity]),
+					      mask(capacity-1),
+					      shift(64 - std::countr_zero (capacity)) {}
+
+      std::size_t slot (std::uint64_t k) const {
+	return (k * 0x9E3779B97F4A7C15ull) >> shift;
+      }
+
+      std::unique_ptr<Slot[]> slots;
+      std::size_t mask;
+      int shift;
+    };
+
+    Table* rehash (std::size_t capacity) {
+      auto old = current.load (std::memory_order_relaxed);
+      auto t = tables.emplace_back (std::make_unique<Table> (capacity)).get ();
+      count = 0;
+      if (old) {
+	for (std::size_t i = 0; i <= old->mask; ++i) {
+	  auto k = old->slots[i].key.load (std::memory_order_relaxed);
+	  if (k != empty)
+	    insertNew (*t,k,old->slots[i].value.load (std::memory_order_relaxed));
+	}
+      }
+      current.store (t,std::memory_order_release);
+      return t;
+    }
+
+    /* For a table nobody else sees yet */
+    void insertNew (Table& t, std::uint64_t k, std::uint32_t v) {
+      auto i = t.slot (k);
+      while (t.slots[i].key.load (std::memory_order_relaxed) != empty)
+	i = (i+1) & t.mask;
+      t.slots[i].value.store (v,std::memory_order_relaxed);
+      t.slots[i].key.store (k,std::memory_order_relaxed);
+      ++count;
+    }
+
+    /* Every table made, the current one last */
+    std::vector<std::unique_ptr<Table>> tables;
+    std::atomic<Table*> current{nullptr};
+    std::size_t count{0};
+  };
+
+  /**
+   * Append-only sequence whose elements never move. One thread may append while
+   * others read elements appended before: blocks double in size and their index
+   * is fixed, so nothing a reader follows is ever reallocated.
+   */
+  template<class T>
+  class Column {
+  public:
+    Column () = default;
+    Column (const Column&) = delete;
+    Column& operator= (const Column&) = delete;
+    ~Column () {
+      auto n = count.load (std::memory_order_relaxed);
+      for (std::size_t i = 0; i < n; ++i)
+	std::destroy_at (&(*this)[i]);
+      for (std::size_t b = 0; b < blocks.size () && blocks[b]; ++b)
+	std::allocator<T> ().deallocate (blocks[b],blockSize (b));
+    }
+
+    T& operator[] (std::size_t i) {
+      auto [b,offset] = locate (i);
+      return blocks[b][offset];
+    }
+
+    const T& operator[] (std::size_t i) const {
+      auto [b,offset] = locate (i);
+      return blocks[b][offset];
+    }
+
+    std::size_t size () const {return count.load (std::memory_order_acquire);}
+
+    template<class... Args>
+    T& emplace_back (Args&&... args) {
+      auto n = count.load (std::memory_order_relaxed);
+      auto [b,offset] = locate (n);
+      if (b >= blocks.size ())
+	throw std::length_error ("Column full");
+      if (!blocks[b])
+	blocks[b] = std::allocator<T> ().allocate (blockSize (b));
+      auto elem = std::construct_at (blocks[b]+offset,std::forward<Args>(args)...);
+      count.store (n+1,std::memory_order_release);
+      return *elem;
+    }
+
+    void push_back (T t) {emplace_back (std::move(t));}
+
+  private:
+    /* Block b holds first << b elements */
+    static constexpr std::size_t first = 64;
+
+    static std::size_t blockSize (std::size_t b) {return first << b;}
+
+    static std::pair<std::size_t,std::size_t> locate (std::size_t i) {
+      auto b = static_cast<std::size_t> (std::bit_width (i/first+1)) - 1;
+      return {b,i - first*((std::size_t{1} << b)-1)};
+    }
+
+    // Enough for every 32-bit id
+    std::array<T*,std::numeric_limits<std::uint32_t>::digits> blocks{};
+    std::atomic<std::size_t> count{0};
+  };
+
+  /**
+   * All symbols and scopes of one compilation. Symbols are dense ids into
+   * column storage, whose elements never move, so getUserData references
+   * stay valid while the table grows. Each scope resolves a name with one
+   * probe into a single flat (scope,name) map.
+   * Symbols may be added to a scope that exists while other threads read
+   * symbols and scopes (see Function::getStmt); scopes are only made by
+   * one thread at a time with no readers.
+   */
+  struct SymbolTable : public std::enable_shared_from_this<SymbolTable> {
+    static constexpr std::uint32_t none = ScopedIdMap::none;
+
+    struct Scope {
+      std::uint32_t owner;
+      std::uint32_t parent;
+      std::vector<std::uint32_t> members;
+      std::uint32_t depth;
+    };
+
+    SymbolTable (const std::string& rootName) {
+      auto root = interner.intern (rootName);
+      names.push_back (root);
+      scopeOf.push_back (none);
+      data.emplace_back ();
+      scopes.push_back ({0,none,{},0});
+    }
+
+    std::uint32_t makeSymbol (std::uint32_t scope, Name name) {
+      auto id = static_cast<std::uint32_t> (names.size());
+      if (!bindings.insert (ScopedIdMap::key (scope,name),id))
+	throw std::runtime_error ("Symbol already exists");
+      names.push_back (name);
+      scopeOf.push_back (scope);
+      data.emplace_back ();
+      scopes[scope].members.push_back (id);
+      return id;
+    }
+
+    std::uint32_t makeFresh (std::uint32_t scope, Name prefix) {
+      // Numbering resumes where the last fresh name of this prefix stopped,
+      // so a candidate is only rebuilt when the user took that name already
+      auto& i = freshCounters[ScopedIdMap::key (scope,prefix)];
+      std::string namee {prefix.view()};
+      auto base = namee.size();
+      do {
+	namee.resize (base);
+	namee += std::to_string(i++);
+	auto interned = interner.lookup (namee);
+	if (!interned || bindings.find (ScopedIdMap::key (scope,*interned)) == none) {
+	  return makeSymbol (scope,interner.intern (namee));
+	}
+      }while(true);
+      std::unreachable();
+    }
+
+    /* Child scope of parent for function name, owned by a fresh symbol name__ */
+    std::uint32_t makeScope (std::uint32_t parent, Name name) {
+      auto key = ScopedIdMap::key (parent,name);
+      if (frames.find (key) != none)
+	throw std::runtime_error ("Symbol exists");
+      auto owner = makeSymbol (parent,interner.intern (name.str()+"__"));
+      auto child = static_cast<std::uint32_t> (scopes.size());
+      auto depth = scopes[parent].depth+1;
+      scopes.push_back ({owner,parent,{},depth});
+      maxDepth = std::max (maxDepth,depth);
+      frames.insert (key,child);
+      return child;
+    }
+
+    /* Empty scope taking over from the child scope of parent for function name; the
+       owner stays, the old scope's symbols keep their ids but are no longer found */
+    std::uint32_t renewScope (std::uint32_t parent, Name name) {
+      auto key = ScopedIdMap::key (parent,name);
+      auto old = frames.find (key);
+      if (old == none)
+	throw std::runtime_error ("Cannot find frame");
+      auto child = static_cast<std::uint32_t> (scopes.size());
+      scopes.push_back ({scopes[old].owner,parent,{},scopes[old].depth});
+      frames.assign (key,child);
+      return child;
+    }
+
+    /* Symbols of enclosing scopes only count if their id is below before */
+    std::uint32_t resolve (std::uint32_t scope, Name name, std::uint32_t before = none) const {
+      for (auto s = scope; s != none; s = scopes[s].parent) {
+	auto id = bindings.find (ScopedIdMap::key (s,name));
+	if (id != none && (s == scope || id < before))
+	  return id;
+      }
+      return none;
+    }
+
+    std::ostream& output (std::ostream& os, std::uint32_t id) const {
+      if (scopeOf[id] != none)
+	return output (os,scopes[scopeOf[id]].owner) << "#" << names[id];
+      else
+	return os << names[id];
+    }
+
+    Interner interner;
+    Column<Name> names;
+    Column<std::uint32_t> scopeOf;
+    Column<UserData> data;
+    std::vector<Scope> scopes;
+    ScopedIdMap bindings;
+    ScopedIdMap frames;
+    std::unordered_map<std::uint64_t,std::size_t> freshCounters;
+    std::uint32_t maxDepth{0};
+  };
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "whiley/threadpool.hpp"
+
+#include <utility>
+
+namespace Whiley {
+  ThreadPool::ThreadPool (std::size_t threads) {
+    for (std::size_t i = 1; i < threads; ++i)
+      workers.emplace_back ([this]() {run ();});
+  }
+
+  ThreadPool::~ThreadPool () {
+    {
+      std::lock_guard lock {mutex};
+      stopping = true;
+    }
+    wake.notify_all ();
+    workers.clear ();
+  }
+
+  void ThreadPool::drain (const std::function<void(std::size_t)>& body, std::size_t n) {
+    for (std::size_t i; (i = next.fetch_add (1,std::memory_order_relaxed)) < n;) {
+      try {
+	body (i);
+      }
+      catch (...) {
+	std::lock_guard lock {mutex};
+	if (!error)
+	  error = std::current_exception ();
+      }
+    }
+  }
+
+  void ThreadPool::run () {
+    std::uint64_t seen = 0;
+    std::unique_lock lock {mutex};
+    while (true) {
+      wake.wait (lock,[&]() {return stopping || generation != seen;});
+      if (stopping)
+	return;
+      seen = generation;
+      auto body = job;
+      auto n = jobSize;
+      lock.unlock ();
+      drain (*body,n);
+      lock.lock ();
+      // Every worker checks in once per loop, so none can straggle into the next one
+      if (++finished == workers.size ())
+	done.notify_all ();
+    }
+  }
+
+  void ThreadPool::parallelFor (std::size_t n, const std::function<void(std::size_t)>& body) {
+    if (workers.empty () || n <= 1) {
+      for (std::size_t i = 0; i < n; ++i)
+	body (i);
+      return;
+    }
+
+    std::lock_guard guard {submit};
+    {
+      std::lock_guard lock {mutex};
+      job = &body;
+      jobSize = n;
+      next.store (0,std::memory_order_relaxed);
+      finished = 0;
+      error = nullptr;
+      ++generation;
+    }
+    wake.notify_all ();
+    drain (body,n);
+
+    std::unique_lock lock {mutex};
+    done.wait (lock,[&]() {return finished == workers.size ();});
+    job = nullptr;
+    if (auto e = std::exchange (error,nullptr))
+      std::rethrow_exception (e);
+  }
+}
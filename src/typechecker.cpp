@@ -2,6 +2,8 @@
 #include "whiley/ast.hpp"
 #include "whiley/symbol.hpp"
 #include "whiley/typechecker.hpp"
+#include "whiley/threadpool.hpp"
+#include "whiley/diagnostics.hpp"
 
 #include <unordered_map>
 #include <string>
@@ -11,24 +13,42 @@
 
 namespace Whiley {
   struct TypeChecker::Internal {
-    Internal(Whiley::Frame f) : frame(f) {} 
+    Internal(Whiley::Frame f, const LineTable& lines) : frame(f),lines(lines) {} 
     Whiley::Frame frame;
+    const LineTable& lines;
     Type type {Type::Untyped};
     bool ok;
     Function_ptr func;
     bool hasReturn{false};
   };
 
+  /* Texts are only built from the Diagnostic record, so formatting can wait for a DiagnosticBuffer flush */
   template<class N>
   struct TypeCheckerMessage : Message {
     TypeCheckerMessage (const N& n) : node(n) {}
-    virtual std::string loc_string () const {
+
+    std::string to_string () const override {
+      Diagnostic d;
+      describe (d);
       std::stringstream str;
-      str << "@" << node.getFileLocation ();
+      d.format (str,d);
       return str.str();
     }
+
+    static std::ostream& loc_string (std::ostream& os, const Diagnostic& d) {
+      return os << "@" << d.lines->lookup (d.offset);
+    }
     
+    /* Set by TypeChecker::report before the message is emitted */
+    const LineTable* lines{nullptr};
     
+  protected:
+    void locate (Diagnostic& d, DiagnosticKind kind, Diagnostic::Formatter format) const {
+      d.kind = kind;
+      d.lines = lines;
+      d.offset = node.getLocation ().begin;
+      d.format = format;
+    }
     
   private:
     const N& node;
@@ -37,10 +57,14 @@ namespace Whiley {
     struct NotAFunction : public TypeCheckerMessage<Node>{
     NotAFunction (const Node& n,Whiley::Symbol name) : TypeCheckerMessage(n),name(name) {}
     
-    std::string to_string () const override {
-      std::stringstream str;
-      str << loc_string ()<< ": '" << name.getFullName() << " is not a function"; 
-      return str.str();
+    bool describe (Diagnostic& d) const override {
+      locate (d,DiagnosticKind::NotAFunction,&format);
+      d.symbol = name;
+      return true;
+    }
+
+    static void format (std::ostream& str, const Diagnostic& d) {
+      loc_string (str,d)<< ": '" << d.symbol->getFullName() << " is not a function"; 
     }
 
       Whiley::Symbol name;
@@ -54,42 +78,143 @@ namespace Whiley {
    struct MissingReturn : public TypeCheckerMessage<Node>{
     MissingReturn (const Node& n) : TypeCheckerMessage(n) {}
     
-    std::string to_string () const override {
-      std::stringstream str;
-      str << loc_string ()<< ": '" << "missing return statement"; 
-      return str.str();
+    bool describe (Diagnostic& d) const override {
+      locate (d,DiagnosticKind::MissingReturn,&format);
+      return true;
+    }
+
+    static void format (std::ostream& str, const Diagnostic& d) {
+      loc_string (str,d)<< ": '" << "missing return statement"; 
     }
   };
   
   TypeChecker::~TypeChecker () {}
 
+  namespace {
+    /* Thrown by report once the sink is full; CheckProgram gives up */
+    struct Cutoff {};
+  }
+
+  template<class M>
+  void TypeChecker::report (M&& msg) {
+    msg.lines = &_internal->lines;
+    messaging << msg;
+    if (messaging.full ())
+      throw Cutoff {};
+  }
+
+  void TypeChecker::setJobs (std::size_t jobs) {
+    if (jobs > 1)
+      pool = std::make_unique<ThreadPool> (jobs);
+    else
+      pool = nullptr;
+  }
+
+  bool TypeChecker::CheckFunction (const Symbol& s, const Function_ptr& func) {
+    Stats::Timer timer {stats,"typecheck.function",s.getName ().view ()};
+    _internal->func = func;
+    _internal->frame = _internal->frame.open (s.getName());
+    _internal->hasReturn = false;
+    bool ok = CheckStatement(*func->getStmt());
+    _internal->frame = _internal->frame.close();
+    _internal->func = nullptr;
+    if (!_internal->hasReturn) {
+      report (MissingReturn {*func->getStmt()});
+      ok = false;
+    }
+    return ok;
+  }
+  
   bool TypeChecker::CheckProgram (Program& prgm) {
-    _internal = std::make_unique<Internal> (prgm.getFrame());
+    Stats::Timer timer {stats,"typecheck"};
+    if (messaging.full ())
+      return false;
+    try {
+      return CheckAll (prgm);
+    }
+    catch (Cutoff&) {
+      return false;
+    }
+  }
+
+  bool TypeChecker::CheckFunction (Program& prgm, const Symbol& func) {
+    if (messaging.full ())
+      return false;
+    auto& data = func.getUserData ();
+    if (!std::holds_alternative<Function_ptr> (data))
+      throw std::runtime_error ("Not a function");
+    _internal = std::make_unique<Internal> (prgm.getFrame(),prgm.getLineTable ());
+    try {
+      return CheckFunction (func,std::get<Function_ptr> (data));
+    }
+    catch (Cutoff&) {
+      return false;
+    }
+  }
+
+  bool TypeChecker::CheckMain (Program& prgm) {
+    if (messaging.full ())
+      return false;
+    _internal = std::make_unique<Internal> (prgm.getFrame(),prgm.getLineTable ());
+    try {
+      return CheckStatement (prgm.getStmt());
+    }
+    catch (Cutoff&) {
+      return false;
+    }
+  }
+
+  bool TypeChecker::CheckAll (Program& prgm) {
+    _internal = std::make_unique<Internal> (prgm.getFrame(),prgm.getLineTable ());
     auto oldframe = _internal->frame;
-    bool ok = true;
+    std::vector<std::pair<Symbol,Function_ptr>> funcs;
     for (auto s : oldframe.getLocalSymbols() ) {
       if (std::holds_alternative<Whiley::Function_ptr> (s.getUserData())) {
-	auto func = std::get<Whiley::Function_ptr> (s.getUserData());
-	_internal->func = func;
-	_internal->frame = _internal->frame.open (s.getName());
-	_internal->hasReturn = false;
-	ok = ok && CheckStatement(*func->getStmt());
-	_internal->frame = _internal->frame.close();
-	_internal->func = nullptr;
-	if (!_internal->hasReturn) {
-	  messaging << MissingReturn {*func->getStmt()};
-	  ok = false;
-	}
+	funcs.emplace_back (s,std::get<Whiley::Function_ptr> (s.getUserData()));
+      }
+      else if (pool && std::holds_alternative<Whiley::Expression_ptr> (s.getUserData())) {
+	// Constants are shared between bodies; type them up front so tasks only read them
+	BufferMessageSystem discard;
+	TypeChecker constants {discard};
+	constants._internal = std::make_unique<Internal> (oldframe,prgm.getLineTable ());
+	(void)constants.CheckExpression (*std::get<Whiley::Expression_ptr> (s.getUserData()));
+      }
+    }
+
+    bool ok = true;
+    if (pool && funcs.size () > 1) {
+      std::vector<DiagnosticBuffer> buffers (funcs.size ());
+      std::vector<char> results (funcs.size ());
+      pool->parallelFor (funcs.size (),[&](std::size_t i) {
+	TypeChecker task {buffers[i]};
+	task.stats = stats;
+	task._internal = std::make_unique<Internal> (oldframe,prgm.getLineTable ());
+	results[i] = task.CheckFunction (funcs[i].first,funcs[i].second);
+      });
+      for (std::size_t i = 0; i < funcs.size (); ++i) {
+	buffers[i].flush (messaging);
+	ok = results[i] && ok;
       }
+      // Bodies were checked in full; only the messages up to the cutoff are kept
+      if (messaging.full ())
+	throw Cutoff {};
+    }
+    else {
+      for (auto& [s,func] : funcs)
+	ok = CheckFunction (s,func) && ok;
     }
-    return ok && CheckStatement(prgm.getStmt());
+    if (stats)
+      stats->add ("functions",funcs.size ());
+    return CheckStatement(prgm.getStmt()) && ok;
   }
 
   
   
   Type TypeChecker::CheckExpression (Expression& e) {
     e.accept(*this);
-    e.setType (_internal->type);
+    // Shared nodes (constants) are only read once typed, keeping parallel checks race free
+    if (e.getType () != _internal->type)
+      e.setType (_internal->type);
     return e.getType ();
   }
 
@@ -128,10 +253,15 @@ namespace Whiley {
 		  Type t2,
 		  const Node& n) : TypeCheckerMessage(n),t1(t1),t2(t2) {}
     
-    std::string to_string () const override {
-      std::stringstream str;
-      str << loc_string ()<< ": '" << "Type mismatch between " << t1 << " and " << t2; 
-      return str.str();
+    bool describe (Diagnostic& d) const override {
+      locate (d,DiagnosticKind::TypeMismatch,&format);
+      d.first = t1;
+      d.second = t2;
+      return true;
+    }
+
+    static void format (std::ostream& str, const Diagnostic& d) {
+      loc_string (str,d)<< ": '" << "Type mismatch between " << d.first << " and " << d.second; 
     }
     
   private:
@@ -143,10 +273,13 @@ namespace Whiley {
   struct InconsistentNumberofParameters : public TypeCheckerMessage<Node>{
     InconsistentNumberofParameters (const Node& n) : TypeCheckerMessage(n) {}
     
-    std::string to_string () const override {
-      std::stringstream str;
-      str << loc_string ()<< ": '" << "Inconsistent number of parameters (formal vs actual)"; 
-      return str.str();
+    bool describe (Diagnostic& d) const override {
+      locate (d,DiagnosticKind::InconsistentNumberofParameters,&format);
+      return true;
+    }
+
+    static void format (std::ostream& str, const Diagnostic& d) {
+      loc_string (str,d)<< ": '" << "Inconsistent number of parameters (formal vs actual)"; 
     }
     
 
@@ -156,10 +289,14 @@ namespace Whiley {
     struct NotAVariable : public TypeCheckerMessage<Node>{
     NotAVariable (const Node& n,Whiley::Symbol name) : TypeCheckerMessage(n),name(name) {}
     
-    std::string to_string () const override {
-      std::stringstream str;
-      str << loc_string ()<< ": '" << name.getFullName() << " is not a variable"; 
-      return str.str();
+    bool describe (Diagnostic& d) const override {
+      locate (d,DiagnosticKind::NotAVariable,&format);
+      d.symbol = name;
+      return true;
+    }
+
+    static void format (std::ostream& str, const Diagnostic& d) {
+      loc_string (str,d)<< ": '" << d.symbol->getFullName() << " is not a variable"; 
     }
 
       Whiley::Symbol name;
@@ -168,10 +305,13 @@ namespace Whiley {
   struct ReturnStatementNotInFunction : public TypeCheckerMessage<Node>{
     ReturnStatementNotInFunction (const Node& n) : TypeCheckerMessage(n) {}
     
-    std::string to_string () const override {
-      std::stringstream str;
-      str << loc_string ()<< ": '" << "Return statement not inside a function"; 
-      return str.str();
+    bool describe (Diagnostic& d) const override {
+      locate (d,DiagnosticKind::ReturnStatementNotInFunction,&format);
+      return true;
+    }
+
+    static void format (std::ostream& str, const Diagnostic& d) {
+      loc_string (str,d)<< ": '" << "Return statement not inside a function"; 
     }
    
   };
@@ -180,7 +320,7 @@ namespace Whiley {
   void TypeChecker::visitDerefExpression (const DerefExpression& expr)  {
     auto leftType =  CheckExpression (expr.getMem ());
     if (leftType != Type::Pointer) {
-      messaging << TypeMismatch (leftType,Type::Pointer,expr);
+      report (TypeMismatch {leftType,Type::Pointer,expr});
       _internal->type = Type::Untyped;
     }
     else
@@ -207,12 +347,12 @@ namespace Whiley {
       _internal->type = Type::Untyped;
     else if (expr.getOp () == BinOps::LShl) {
       if (isSigned(rightType)) {
-	messaging << TypeMismatch (rightType,Type::UI64,expr);
+	report (TypeMismatch {rightType,Type::UI64,expr});
 	_internal->type = Type::Untyped;
       }
       else if (bytesize (leftType) != bytesize (rightType)) {
 	  _internal->type = Type::Untyped;
-	  messaging << TypeMismatch (rightType,leftType,expr);
+	  report (TypeMismatch {rightType,leftType,expr});
 	}
       else
 	_internal->type = leftType;
@@ -220,7 +360,7 @@ namespace Whiley {
     }
     else if (leftType  == Type::Pointer  && expr.getOp () == BinOps::Add) {
       if (rightType != Type::UI64) {
-	messaging << TypeMismatch (rightType,Type::UI64,expr);
+	report (TypeMismatch {rightType,Type::UI64,expr});
 	_internal->type = Type::Untyped;
       }
       else
@@ -231,24 +371,28 @@ namespace Whiley {
       _internal->type = leftType;
     }
     else {
-      messaging << TypeMismatch (leftType,rightType,expr);
+      report (TypeMismatch {leftType,rightType,expr});
       _internal->type = Type::Untyped;
     }
     
   }
 
   struct VariableNotDeclared : public TypeCheckerMessage<Node>{
-    VariableNotDeclared (std::string name,
+    VariableNotDeclared (Name name,
 			 const Node& n) : TypeCheckerMessage(n),name(name) {}
 
-    std::string to_string () const override {
-      std::stringstream str;
-      str << loc_string ()<< ": '" << name <<"' not declared"; 
-      return str.str();
+    bool describe (Diagnostic& d) const override {
+      locate (d,DiagnosticKind::VariableNotDeclared,&format);
+      d.name = name;
+      return true;
+    }
+
+    static void format (std::ostream& str, const Diagnostic& d) {
+      loc_string (str,d)<< ": '" << d.name <<"' not declared"; 
     }
     
   private:
-    std::string name; 
+    Name name; 
   };
 
   
@@ -259,11 +403,11 @@ namespace Whiley {
       auto symb_type = symbType(symb.value());
       _internal->ok = symb_type == val;
       if (!_internal->ok)
-	messaging << TypeMismatch (symb_type,val,ass);
+	report (TypeMismatch {symb_type,val,ass});
       
     }
     else {
-      messaging << VariableNotDeclared (ass.getAssignName(),ass);
+      report (VariableNotDeclared {ass.getAssignName(),ass});
       _internal->ok = false;
     }
   }
@@ -274,10 +418,10 @@ namespace Whiley {
       auto symb_type = symbType(symb.value());
       _internal->ok = isInteger (symb_type);
       if (!_internal->ok)
-	messaging << TypeMismatch (symb_type,Type::UI8,ass);
+	report (TypeMismatch {symb_type,Type::UI8,ass});
     }
     else {
-      messaging << VariableNotDeclared (ass.getIncrementee(),ass);
+      report (VariableNotDeclared {ass.getIncrementee(),ass});
       _internal->ok = false;
     }
   }
@@ -289,18 +433,18 @@ namespace Whiley {
       auto symb_type = symbType(symb.value());
       if (symb_type != Type::Pointer)
 	{
-	  messaging << TypeMismatch (symb_type,Type::Pointer,ass);
+	  report (TypeMismatch {symb_type,Type::Pointer,ass});
 	  _internal->ok = false;
 	}
       if (val != Type::UI64) {
-	  messaging << TypeMismatch (val,Type::UI64,ass);
+	  report (TypeMismatch {val,Type::UI64,ass});
 	  _internal->ok = false;
 	
       }
       
     }
     else {
-      messaging << VariableNotDeclared (ass.getAssignName(),ass);
+      report (VariableNotDeclared {ass.getAssignName(),ass});
       _internal->ok = false;
     }
   }
@@ -309,7 +453,7 @@ namespace Whiley {
     _internal->hasReturn = false;
     auto val = CheckExpression (ass.getExpression());
     if (val != Type::Pointer) {
-      messaging << TypeMismatch (val,Type::UI64,ass);
+      report (TypeMismatch {val,Type::UI64,ass});
       _internal->ok = false;
       
       }
@@ -321,7 +465,7 @@ namespace Whiley {
     auto val = CheckExpression (ass.getExpression());
     _internal->ok = val!=Type::Untyped;
     if (!_internal->ok) {
-      messaging << TypeMismatch (val,Type::SI8,ass);
+      report (TypeMismatch {val,Type::SI8,ass});
     
     }
   }
@@ -331,7 +475,7 @@ namespace Whiley {
     auto val = CheckExpression (ass.getExpression());
     _internal->ok = val!=Type::Untyped;
     if (!_internal->ok) {
-      messaging << TypeMismatch (val,Type::SI8,ass);
+      report (TypeMismatch {val,Type::SI8,ass});
     }
   }
   
@@ -340,7 +484,7 @@ namespace Whiley {
     auto val = CheckExpression (iff.getCondition());
     bool ok = val != Type::Untyped;
     if (!ok) {
-      messaging << TypeMismatch (val,Type::SI8,iff.getCondition());
+      report (TypeMismatch {val,Type::SI8,iff.getCondition()});
     
     }
     bool left_ok =  CheckStatement (iff.getIfBody ());
@@ -360,18 +504,21 @@ namespace Whiley {
     auto val = CheckExpression (ww.getCondition());
     bool ok = val != Type::Untyped;
     if (!ok) {
-      messaging << TypeMismatch (val,Type::SI8,ww.getCondition());
+      report (TypeMismatch {val,Type::SI8,ww.getCondition()});
       
     }
     _internal->ok = ok && CheckStatement (ww.getBody ());
     _internal->hasReturn = false;
   }
-  void TypeChecker::visitSequenceStatement (const SequenceStatement& seq)  {
-    bool ok = CheckStatement (seq.getFirst ());
-    bool leftRet = _internal->hasReturn;
-    bool sec_ok =   CheckStatement (seq.getSecond ());
-    _internal->hasReturn = _internal->hasReturn || leftRet;
-    _internal->ok = ok && sec_ok;
+  void TypeChecker::visitBlockStatement (const BlockStatement& block)  {
+    bool ok = true;
+    bool hasRet = false;
+    for (auto s : block.getStatements ()) {
+      ok = CheckStatement (*s) && ok;
+      hasRet = hasRet || _internal->hasReturn;
+    }
+    _internal->hasReturn = hasRet;
+    _internal->ok = ok;
     
   }
 
@@ -391,7 +538,7 @@ namespace Whiley {
     auto loc = CheckExpression(ma.getMemLoc ());
     auto expr = CheckExpression(ma.getExpression ());
     if (loc != Type::Pointer) {
-      messaging << TypeMismatch (loc,Type::Pointer,ma.getMemLoc());
+      report (TypeMismatch {loc,Type::Pointer,ma.getMemLoc()});
       _internal->ok = false; 
     }
     _internal->ok = _internal->ok && (expr!=Type::Untyped);
@@ -401,12 +548,13 @@ namespace Whiley {
   void TypeChecker::visitReturnStatement (const ReturnStatement& r) {
     _internal->hasReturn = true;
     if (_internal->func == nullptr) {
-      messaging << ReturnStatementNotInFunction (r);
+      report (ReturnStatementNotInFunction {r});
       _internal->ok = false;
+      return;
     }
     auto ll = CheckExpression (r.getExpr());
     if (ll != _internal->func->returns()) {
-      messaging << TypeMismatch (ll,_internal->func->returns(),r);
+      report (TypeMismatch {ll,_internal->func->returns(),r});
       _internal->ok = false;
     }
   }
@@ -421,7 +569,7 @@ namespace Whiley {
     }
   
     if (!std::holds_alternative<Whiley::Function_ptr> (func_symb.value().getUserData ())) {
-      messaging << NotAFunction (r,func_symb.value());
+      report (NotAFunction {r,func_symb.value()});
       _internal->ok = false;
       return;
     }
@@ -429,7 +577,7 @@ namespace Whiley {
     
     
   auto func_ptrs = std::get<Whiley::Function_ptr> (func_symb.value().getUserData ());
-  if (r.assignname ()!="") {
+  if (r.assignname ()) {
     auto assign_name = _internal->frame.resolve(r.assignname());
     if (!assign_name)   {
       _internal->ok = false;
@@ -443,20 +591,20 @@ namespace Whiley {
     auto assignType = std::visit (Whiley::overloaded {
 	[](const Whiley::VarDecl& dec) {return dec.type;},
 	  [](const Whiley::ParamDecl& dec) {return dec.type;},
-	  [this,&r,&assign_name](auto& )->Whiley::Type { _internal->ok = false; messaging << NotAVariable (r,assign_name.value()); return Type::Untyped;
+	  [this,&r,&assign_name](auto& )->Whiley::Type { _internal->ok = false; report (NotAVariable {r,assign_name.value()}); return Type::Untyped;
 	  }
 	  },
       assign_name.value().getUserData()
       );
     
     if (assignType != func_ptrs->returns()) {
-      messaging << TypeMismatch (assignType,func_ptrs->returns(),r);
+      report (TypeMismatch {assignType,func_ptrs->returns(),r});
       _internal->ok = false;
     }
   }
   
   if (func_ptrs->getParams().size() != r.parameters().size()) {
-    messaging << InconsistentNumberofParameters(r);
+    report (InconsistentNumberofParameters {r});
     
     _internal->ok = false;
     return;
@@ -470,7 +618,7 @@ namespace Whiley {
     auto formal_param = symbType (*it);
     if (actual_param != formal_param)  {
       _internal->ok = false;
-      messaging << TypeMismatch (actual_param,formal_param,**pit);
+      report (TypeMismatch {actual_param,formal_param,**pit});
       
     }
   }
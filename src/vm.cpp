@@ -0,0 +1,1113 @@
+#include "whiley/vm.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__GNUC__) && !defined(WHILEY_VM_NO_THREADED)
+#define WHILEY_VM_THREADED
+#endif
+
+/*
+ * The instructions in Op order, U for those that run the same at every
+ * type and T for those with a handler per integer type
+ */
+#define WHILEY_VM_OPS(U,T) \
+  U (Mov) T (Add) T (Sub) T (Mul) T (Div) T (Mod) U (Xor) U (Or) U (And) T (Shl) \
+  U (Eq) U (NEq) T (Lt) T (LEq) T (Gt) T (GEq) U (Not) T (Cast) T (Load) T (Store) T (Update) \
+  U (Alloc) U (Free) T (Havoc) U (GetGlobal) U (SetGlobal) U (Jump) U (JumpIf) U (JumpIfNot) \
+  U (JumpEq) U (JumpNEq) T (JumpLt) T (JumpLEq) T (JumpGt) T (JumpGEq) T (IncJumpLt) T (IncJumpLEq) T (IncJumpNEq) \
+  U (Assume) U (Choose) U (Call) U (Return) U (Halt) U (Fail) U (Block)
+
+/* The integer types in Type order */
+#define WHILEY_VM_TYPES(X,name,...) \
+  X (name,UI8,__VA_ARGS__) X (name,SI8,__VA_ARGS__) X (name,UI16,__VA_ARGS__) X (name,SI16,__VA_ARGS__) \
+  X (name,UI32,__VA_ARGS__) X (name,SI32,__VA_ARGS__) X (name,UI64,__VA_ARGS__) X (name,SI64,__VA_ARGS__)
+
+namespace Whiley {
+  namespace VM {
+    namespace {
+      using IR::none;
+
+#define WHILEY_HANDLER(name) H_##name,
+#define WHILEY_HANDLER_AT(name,t,...) H_##name##_##t,
+#define WHILEY_HANDLERS(name) WHILEY_VM_TYPES (WHILEY_HANDLER_AT,name)
+      /* What the machine dispatches on: an instruction specialised to its type */
+      enum Handler : std::uint16_t {
+	WHILEY_VM_OPS (WHILEY_HANDLER,WHILEY_HANDLERS)
+	Handlers
+      };
+#undef WHILEY_HANDLER
+#undef WHILEY_HANDLER_AT
+#undef WHILEY_HANDLERS
+
+#define WHILEY_UNTYPED(name) {H_##name,false},
+#define WHILEY_TYPED(name) {H_##name##_UI8,true},
+      constexpr std::pair<Handler,bool> handlers[] = {WHILEY_VM_OPS (WHILEY_UNTYPED,WHILEY_TYPED)};
+#undef WHILEY_UNTYPED
+#undef WHILEY_TYPED
+      static_assert (std::size (handlers) == std::to_underlying (Op::Block)+1);
+
+      /* Pointers and untyped values run as ui64, which leaves all 64 bits alone */
+      std::uint16_t handler (Op op, Type t) {
+	auto [first,typed] = handlers[std::to_underlying (op)];
+	if (!typed)
+	  return first;
+	return first+(isInteger (t) ? std::to_underlying (t) : std::to_underlying (Type::UI64))-std::to_underlying (Type::UI8);
+      }
+
+      Op opFor (BinOps op) {
+	switch (op) {
+	case BinOps::Add: return Op::Add;
+	case BinOps::Sub: return Op::Sub;
+	case BinOps::Div: return Op::Div;
+	case BinOps::Mul: return Op::Mul;
+	case BinOps::LEq: return Op::LEq;
+	case BinOps::GEq: return Op::GEq;
+	case BinOps::Lt: return Op::Lt;
+	case BinOps::Gt: return Op::Gt;
+	case BinOps::Eq: return Op::Eq;
+	case BinOps::NEq: return Op::NEq;
+	case BinOps::Mod: return Op::Mod;
+	case BinOps::Xor: return Op::Xor;
+	case BinOps::Or: return Op::Or;
+	case BinOps::And: return Op::And;
+	case BinOps::LShl: return Op::Shl;
+	}
+	std::unreachable ();
+      }
+
+      /* The compare-and-branch jumping when a comparison with op holds, if there is one */
+      std::optional<Op> jumpFor (BinOps op) {
+	switch (op) {
+	case BinOps::Eq: return Op::JumpEq;
+	case BinOps::NEq: return Op::JumpNEq;
+	case BinOps::Lt: return Op::JumpLt;
+	case BinOps::LEq: return Op::JumpLEq;
+	case BinOps::Gt: return Op::JumpGt;
+	case BinOps::GEq: return Op::JumpGEq;
+	default: return std::nullopt;
+	}
+      }
+
+      /* The compare-and-branch taken exactly when op is not */
+      Op inverse (Op op) {
+	switch (op) {
+	case Op::JumpEq: return Op::JumpNEq;
+	case Op::JumpNEq: return Op::JumpEq;
+	case Op::JumpLt: return Op::JumpGEq;
+	case Op::JumpLEq: return Op::JumpGt;
+	case Op::JumpGt: return Op::JumpLEq;
+	case Op::JumpGEq: return Op::JumpLt;
+	default: std::unreachable ();
+	}
+      }
+
+      /* The compare-and-branch that increments its left operand first, if there is one */
+      std::optional<Op> incrementing (Op op) {
+	switch (op) {
+	case Op::JumpLt: return Op::IncJumpLt;
+	case Op::JumpLEq: return Op::IncJumpLEq;
+	case Op::JumpNEq: return Op::IncJumpNEq;
+	default: return std::nullopt;
+	}
+      }
+
+      /* Whether exactly one of x and y holds, as for the edges of an if, a while or an assert */
+      bool complementary (const IR::CFA& cfa, IR::expr_t x, IR::expr_t y) {
+	using IR::ExprKind;
+	if (cfa.exprKind (x) == ExprKind::Not && cfa.lhs (x) == y)
+	  return true;
+	if (cfa.exprKind (y) == ExprKind::Not && cfa.lhs (y) == x)
+	  return true;
+	if (cfa.exprKind (x) != ExprKind::Binary || cfa.exprKind (y) != ExprKind::Binary
+	    || cfa.type (x) != cfa.type (y) || cfa.lhs (x) != cfa.lhs (y) || cfa.rhs (x) != cfa.rhs (y))
+	  return false;
+	auto opposite = [](BinOps a, BinOps b) {
+	  return (a == BinOps::LEq && b == BinOps::Gt) || (a == BinOps::GEq && b == BinOps::Lt)
+	    || (a == BinOps::Eq && b == BinOps::NEq);
+	};
+	return opposite (cfa.op (x),cfa.op (y)) || opposite (cfa.op (y),cfa.op (x));
+      }
+
+      class Assembler {
+      public:
+	Assembler (const IR::CFA& cfa, Bytecode& bc) : cfa(cfa),bc(bc),placed(cfa.locations (),none),owned(cfa.functions ().size ()+1),
+						       memo(cfa.expressions (),0),stamps(cfa.expressions (),0),folded(cfa.expressions (),0),
+						       constant(cfa.expressions (),false),slots(cfa.expressions (),none),
+						       seen(cfa.expressions (),0),position(cfa.locations ()),visited(cfa.expressions (),0) {
+	  for (IR::loc_t l = 0; l < cfa.locations (); ++l) {
+	    position[l] = static_cast<std::uint32_t> (owned[cfa.owner (l)+1].size ());
+	    owned[cfa.owner (l)+1].push_back (l);
+	  }
+	  // Operands have smaller ids than the expressions built from them. The
+	  // kernels are the ones the machine runs, so folding cannot change a result
+	  using IR::ExprKind;
+	  for (IR::expr_t x = 0; x < cfa.expressions (); ++x) {
+	    auto t = cfa.type (x);
+	    switch (cfa.exprKind (x)) {
+	    case ExprKind::Constant:
+	      constant[x] = true;
+	      folded[x] = Kernels::wrapper (t) (static_cast<std::uint64_t> (cfa.value (x)));
+	      break;
+	    case ExprKind::Binary:
+	      if (constant[cfa.lhs (x)] && constant[cfa.rhs (x)])
+		if (auto v = Kernels::kernel (cfa.op (x),t) (folded[cfa.lhs (x)],folded[cfa.rhs (x)])) {
+		  constant[x] = true;
+		  folded[x] = *v;
+		}
+	      break;
+	    case ExprKind::Not:
+	    case ExprKind::Cast:
+	      if (constant[cfa.lhs (x)]) {
+		constant[x] = true;
+		folded[x] = cfa.exprKind (x) == ExprKind::Not ? !folded[cfa.lhs (x)] : Kernels::wrapper (t) (folded[cfa.lhs (x)]);
+	      }
+	      break;
+	    default:
+	      break;
+	    }
+	  }
+	}
+
+	/**
+	 * Lays out what start reaches for the main statement (owner none) or
+	 * a function, whose registers [first,first+count) begin the frame
+	 */
+	Bytecode::Function frame (IR::loc_t start, IR::func_t owner, IR::reg_t first, std::uint32_t count) {
+	  Bytecode::Function res {};
+	  res.entry = pc ();
+	  inMain = owner == none;
+	  res.firstConstant = firstConstant = static_cast<std::uint32_t> (bc.constants.size ());
+	  base = first;
+	  registers = count;
+	  ++frames;
+	  values.clear ();
+	  for (auto l : owned[owner+1])
+	    for (auto e : cfa.successors (l))
+	      operands (e,[&](IR::expr_t x) {pool (x);});
+	  fixed = count+static_cast<std::uint32_t> (bc.constants.size ())-firstConstant;
+	  size = fixed;
+	  pending.push_back (start);
+	  while (!pending.empty ()) {
+	    auto l = pending.back ();
+	    pending.pop_back ();
+	    if (placed[l] == none)
+	      chain (l);
+	  }
+	  res.frameSize = size;
+	  res.constants = fixed-count;
+	  return res;
+	}
+
+	/**
+	 * Lists the locals of f that some path from its entry reads before it
+	 * writes them, as count and slots in operands(), and returns where.
+	 * Only these need zeroing when f is entered.
+	 */
+	std::uint32_t zeroed (IR::func_t f) {
+	  auto& func = cfa.functions ()[f];
+	  auto& locs = owned[f+1];
+	  auto mine = [&](IR::reg_t r) {return r != none && r >= func.firstRegister && r-func.firstRegister < func.registers;};
+	  // The registers written on every path to a location, a bit each; all of them until it is reached
+	  std::size_t words = (func.registers+63)/64;
+	  std::vector<std::uint64_t> written (locs.size ()*words,~std::uint64_t{0}), out (words);
+	  std::vector<bool> reached (locs.size ());
+	  auto row = [&](IR::loc_t l) {return written.begin ()+position[l]*words;};
+	  auto bit = [&](IR::reg_t r) {return std::uint64_t{1} << (r-func.firstRegister) % 64;};
+	  auto has = [&](IR::loc_t l, IR::reg_t r) {return (row (l)[(r-func.firstRegister)/64] & bit (r)) != 0;};
+	  std::fill_n (row (func.entry),words,0);
+	  for (std::uint32_t p = 0; p < func.params; ++p)
+	    row (func.entry)[p/64] |= bit (func.firstRegister+p);
+	  reached[position[func.entry]] = true;
+	  std::vector<IR::loc_t> work {func.entry};
+	  while (!work.empty ()) {
+	    auto l = work.back ();
+	    work.pop_back ();
+	    for (auto e : cfa.successors (l)) {
+	      std::copy_n (row (l),words,out.begin ());
+	      auto k = cfa.edgeKind (e);
+	      if ((k == IR::EdgeKind::Assign || k == IR::EdgeKind::Havoc || k == IR::EdgeKind::Alloc || k == IR::EdgeKind::Call) && mine (cfa.a (e)))
+		out[(cfa.a (e)-func.firstRegister)/64] |= bit (cfa.a (e));
+	      auto t = cfa.target (e);
+	      bool changed = !reached[position[t]];
+	      reached[position[t]] = true;
+	      auto in = row (t);
+	      for (std::size_t w = 0; w < words; ++w) {
+		changed |= (in[w] & ~out[w]) != 0;
+		in[w] &= out[w];
+	      }
+	      if (changed)
+		work.push_back (t);
+	    }
+	  }
+
+	  std::vector<bool> unwritten (func.registers);
+	  for (auto l : locs)
+	    if (reached[position[l]])
+	      for (auto e : cfa.successors (l)) {
+		++walks;
+		operands (e,[&](IR::expr_t x) {
+		  reads (x,[&](IR::reg_t r) {
+		    if (mine (r) && !has (l,r))
+		      unwritten[r-func.firstRegister] = true;
+		  });
+		});
+	      }
+	  auto list = static_cast<std::uint32_t> (bc.operands.size ());
+	  bc.operands.push_back (0);
+	  for (std::uint32_t r = func.params; r < func.registers; ++r)
+	    if (unwritten[r]) {
+	      ++bc.operands[list];
+	      bc.operands.push_back (r);
+	    }
+	  return list;
+	}
+
+	/* Fills in the jumps to locations placed after them */
+	void patch () {
+	  for (auto [i,l] : jumps)
+	    bc.code[i].a = placed[l];
+	  for (auto [i,l] : tables)
+	    bc.operands[i] = placed[l];
+	  // A callee's frame follows the main statement's, and every other frame at the size of the largest
+	  std::uint32_t largest = 0;
+	  for (auto& f : bc.functions)
+	    largest = std::max (largest,f.frameSize);
+	  for (auto [i,inMain] : arguments)
+	    bc.code[i].a += (inMain ? bc.main.frameSize : largest)-outgoing;
+	}
+
+      private:
+	std::uint32_t pc () const {
+	  return static_cast<std::uint32_t> (bc.code.size ());
+	}
+
+	void emit (Op op, Type t, std::uint32_t a, std::uint32_t b = none, std::uint32_t c = none) {
+	  if (bc.code.size () >= none)
+	    throw std::runtime_error ("Program too large for the VM");
+	  bc.code.push_back ({op,static_cast<std::uint8_t> (t),handler (op,t),a,b,c});
+	  bc.sources.push_back (at);
+	}
+
+	void jump (Op op, IR::loc_t l, std::uint32_t cond = none) {
+	  if (placed[l] == none) {
+	    jumps.emplace_back (pc (),l);
+	    pending.push_back (l);
+	  }
+	  emit (op,Type::Untyped,placed[l],cond);
+	}
+
+	/* Follows fall-through edges from l until it reaches placed code or a stop */
+	void chain (IR::loc_t l) {
+	  for (;;) {
+	    placed[l] = pc ();
+	    at = cfa.sourceLocation (l);
+	    auto out = cfa.successors (l);
+	    IR::loc_t next = none;
+	    if (out.empty ()) {
+	      switch (cfa.locationKind (l)) {
+	      case IR::LocationKind::Final: emit (Op::Halt,Type::Untyped,none); break;
+	      case IR::LocationKind::Error: emit (Op::Fail,Type::Untyped,none); break;
+	      default: emit (Op::Block,Type::Untyped,none); break;
+	      }
+	      return;
+	    }
+	    if (out.size () == 1) {
+	      auto e = out.front ();
+	      if (!edge (e))
+		return;
+	      next = cfa.target (e);
+	    }
+	    else if (out.size () == 2 && cfa.edgeKind (out[0]) == IR::EdgeKind::Assume && cfa.edgeKind (out[1]) == IR::EdgeKind::Assume
+		     && complementary (cfa,cfa.b (out[0]),cfa.b (out[1]))) {
+	      // Fall through to code not laid out yet, and jump to failed assertions
+	      auto ahead = [&](IR::edge_t e) {
+		return placed[cfa.target (e)] == none && cfa.locationKind (cfa.target (e)) != IR::LocationKind::Error;
+	      };
+	      auto taken = out[0], other = out[1];
+	      if (!ahead (taken) && ahead (other))
+		std::swap (taken,other);
+	      branch (l,other,taken);
+	      next = cfa.target (taken);
+	    }
+	    else {
+	      // A choose; edges other than skips run in stubs before their targets
+	      auto table = static_cast<std::uint32_t> (bc.operands.size ());
+	      bc.operands.resize (table+out.size (),none);
+	      emit (Op::Choose,Type::Untyped,none,table,static_cast<std::uint32_t> (out.size ()));
+	      for (std::size_t i = 0; i < out.size (); ++i) {
+		auto e = out[i];
+		if (cfa.edgeKind (e) != IR::EdgeKind::Skip) {
+		  bc.operands[table+i] = pc ();
+		  if (edge (e))
+		    jump (Op::Jump,cfa.target (e));
+		}
+		else {
+		  tables.emplace_back (table+i,cfa.target (e));
+		  pending.push_back (cfa.target (e));
+		}
+	      }
+	      return;
+	    }
+	    if (placed[next] != none) {
+	      latch (l,next);
+	      return;
+	    }
+	    l = next;
+	  }
+	}
+
+	/*
+	 * Leaves from along other when its condition holds and falls through
+	 * to taken otherwise, comparing and branching in one instruction where
+	 * the condition is a comparison. Remembers such tests that begin a
+	 * location, as they may head loops.
+	 */
+	void branch (IR::loc_t from, IR::edge_t other, IR::edge_t taken) {
+	  using IR::ExprKind;
+	  auto l = cfa.target (other);
+	  auto cond = cfa.b (other);
+	  begin ();
+	  std::optional<Op> fused;
+	  if (cfa.exprKind (cond) == ExprKind::Binary && !constant[cond])
+	    fused = jumpFor (cfa.op (cond));
+	  if (fused) {
+	    auto x = eval (cfa.lhs (cond));
+	    auto y = eval (cfa.rhs (cond));
+	    if (placed[l] == none) {
+	      jumps.emplace_back (pc (),l);
+	      pending.push_back (l);
+	    }
+	    if (placed[from] == pc ())
+	      headers.emplace (pc (),std::pair {l,cfa.target (taken)});
+	    emit (*fused,cfa.type (cfa.lhs (cond)),placed[l],x,y);
+	  }
+	  else if (cfa.exprKind (cond) == ExprKind::Not && !constant[cond])
+	    jump (Op::JumpIf,l,eval (cfa.lhs (cond)));
+	  else
+	    jump (Op::JumpIfNot,l,eval (cfa.b (taken)));
+	}
+
+	/*
+	 * Jumps from to l, which is placed. Where l starts with a
+	 * compare-and-branch out of a loop, the test is repeated here instead
+	 * so that the loop takes one branch per iteration, merged with an
+	 * increment of the counter by from's edge where there is one.
+	 */
+	void latch (IR::loc_t from, IR::loc_t l) {
+	  auto h = placed[l];
+	  auto it = headers.find (h);
+	  if (it == headers.end () || placed[it->second.second] == none) {
+	    jump (Op::Jump,l);
+	    return;
+	  }
+	  auto [exit,body] = it->second;
+	  auto test = bc.code[h];
+	  auto op = inverse (test.op);
+	  auto inc = incrementing (op);
+	  if (inc && pc () > placed[from] && bc.code.back ().op == Op::Add && bc.code.back ().t == test.t
+	      && bc.code.back ().a == test.b && bc.code.back ().b == test.b && one (bc.code.back ().c)) {
+	    bc.code.pop_back ();
+	    bc.sources.pop_back ();
+	    op = *inc;
+	  }
+	  emit (op,test.type (),placed[body],test.b,test.c);
+	  jump (Op::Jump,exit);
+	}
+
+	/* Whether slot s is a constant 1 of the current frame */
+	bool one (std::uint32_t s) const {
+	  return s >= registers && s < fixed && bc.constants[firstConstant+s-registers] == 1;
+	}
+
+	/* The code of e; false if it leaves the frame */
+	bool edge (IR::edge_t e) {
+	  using IR::EdgeKind;
+	  begin ();
+	  switch (cfa.edgeKind (e)) {
+	  case EdgeKind::Skip:
+	    break;
+	  case EdgeKind::Assign:
+	    assign (cfa.a (e),cfa.b (e));
+	    break;
+	  case EdgeKind::Havoc:
+	    write (cfa.a (e),[&](std::uint32_t d) {emit (Op::Havoc,cfa.registerType (cfa.a (e)),d);});
+	    break;
+	  case EdgeKind::Assume:
+	    emit (Op::Assume,Type::Untyped,none,eval (cfa.b (e)));
+	    break;
+	  case EdgeKind::Store: {
+	    using IR::ExprKind;
+	    auto x = cfa.c (e);
+	    auto p = eval (cfa.b (e));
+	    // Updates in place, as # p = $ p as t $ op v, load, compute and store in one
+	    if (cfa.exprKind (x) == ExprKind::Binary && !constant[x] && cfa.exprKind (cfa.lhs (x)) == ExprKind::Load
+		&& cfa.lhs (cfa.lhs (x)) == cfa.b (e) && cfa.type (cfa.lhs (x)) == cfa.type (x)
+		&& (constant[cfa.rhs (x)] || cfa.exprKind (cfa.rhs (x)) == ExprKind::Register)) {
+	      auto v = eval (cfa.rhs (x));
+	      emit (Op::Update,cfa.type (x),std::to_underlying (cfa.op (x)),p,v);
+	      break;
+	    }
+	    auto v = eval (x);
+	    emit (Op::Store,cfa.type (x),none,p,v);
+	    break;
+	  }
+	  case EdgeKind::Alloc: {
+	    auto n = eval (cfa.b (e));
+	    write (cfa.a (e),[&](std::uint32_t d) {emit (Op::Alloc,Type::Pointer,d,n);});
+	    break;
+	  }
+	  case EdgeKind::Free:
+	    emit (Op::Free,Type::Untyped,none,eval (cfa.b (e)));
+	    break;
+	  case EdgeKind::Call: {
+	    // Straight into the parameters of the callee's frame
+	    auto args = cfa.arguments ().begin ()+cfa.c (e);
+	    for (std::uint32_t i = 1; i <= *args; ++i) {
+	      eval (args[i],outgoing+i-1);
+	      arguments.emplace_back (pc ()-1,inMain);
+	    }
+	    if (cfa.a (e) == none)
+	      emit (Op::Call,Type::Untyped,none,cfa.b (e));
+	    else
+	      write (cfa.a (e),[&](std::uint32_t d) {emit (Op::Call,Type::Untyped,d,cfa.b (e));});
+	    break;
+	  }
+	  case EdgeKind::Return:
+	    emit (Op::Return,Type::Untyped,none,eval (cfa.b (e)));
+	    return false;
+	  }
+	  return true;
+	}
+
+	/* Calls f on the expressions e evaluates */
+	template<class F>
+	void operands (IR::edge_t e, F f) {
+	  using IR::EdgeKind;
+	  switch (cfa.edgeKind (e)) {
+	  case EdgeKind::Assign: case EdgeKind::Assume: case EdgeKind::Alloc: case EdgeKind::Free: case EdgeKind::Return:
+	    f (cfa.b (e));
+	    break;
+	  case EdgeKind::Store:
+	    f (cfa.b (e));
+	    f (cfa.c (e));
+	    break;
+	  case EdgeKind::Call: {
+	    auto args = cfa.arguments ().begin ()+cfa.c (e);
+	    for (std::uint32_t i = 1; i <= *args; ++i)
+	      f (args[i]);
+	    break;
+	  }
+	  default:
+	    break;
+	  }
+	}
+
+	/* Calls f on the registers x reads, each expression once per walk */
+	template<class F>
+	void reads (IR::expr_t x, F f) {
+	  if (visited[x] == walks)
+	    return;
+	  visited[x] = walks;
+	  switch (cfa.exprKind (x)) {
+	  case IR::ExprKind::Register:
+	    f (cfa.lhs (x));
+	    break;
+	  case IR::ExprKind::Binary:
+	    reads (cfa.rhs (x),f);
+	    [[fallthrough]];
+	  case IR::ExprKind::Not:
+	  case IR::ExprKind::Cast:
+	  case IR::ExprKind::Load:
+	    reads (cfa.lhs (x),f);
+	    break;
+	  default:
+	    break;
+	  }
+	}
+
+	/* Gives the outermost constants within x slots in the current frame */
+	void pool (IR::expr_t x) {
+	  if (seen[x] == frames)
+	    return;
+	  seen[x] = frames;
+	  if (constant[x]) {
+	    auto [it,added] = values.try_emplace (folded[x],registers+static_cast<std::uint32_t> (bc.constants.size ())-firstConstant);
+	    if (added)
+	      bc.constants.push_back (folded[x]);
+	    slots[x] = it->second;
+	    return;
+	  }
+	  switch (cfa.exprKind (x)) {
+	  case IR::ExprKind::Binary:
+	    pool (cfa.rhs (x));
+	    [[fallthrough]];
+	  case IR::ExprKind::Not:
+	  case IR::ExprKind::Cast:
+	  case IR::ExprKind::Load:
+	    pool (cfa.lhs (x));
+	    break;
+	  default:
+	    break;
+	  }
+	}
+
+	void begin () {
+	  ++epoch;
+	  temps = fixed;
+	}
+
+	std::uint32_t temp () {
+	  size = std::max (size,++temps);
+	  return temps-1;
+	}
+
+	bool local (IR::reg_t r) const {
+	  return r >= base && r-base < registers;
+	}
+
+	/* Has produce write register r: in place if it is in the frame, else through a temporary */
+	template<class F>
+	void write (IR::reg_t r, F produce) {
+	  if (local (r))
+	    produce (r-base);
+	  else {
+	    auto t = temp ();
+	    produce (t);
+	    emit (Op::SetGlobal,Type::Untyped,r,t);
+	  }
+	}
+
+	void assign (IR::reg_t r, IR::expr_t x) {
+	  if (local (r))
+	    eval (x,r-base);
+	  else
+	    emit (Op::SetGlobal,Type::Untyped,r,eval (x));
+	}
+
+	/* The slot holding x; common subexpressions of an edge are computed once */
+	std::uint32_t eval (IR::expr_t x, std::uint32_t dest = none) {
+	  using IR::ExprKind;
+	  if (dest == none && stamps[x] == epoch)
+	    return memo[x];
+	  if (constant[x]) {
+	    if (dest != none)
+	      emit (Op::Mov,cfa.type (x),dest,slots[x]);
+	    return dest != none ? dest : slots[x];
+	  }
+	  auto target = [&] {return dest != none ? dest : temp ();};
+	  std::uint32_t res = none;
+	  auto t = cfa.type (x);
+	  switch (cfa.exprKind (x)) {
+	  case ExprKind::Register: {
+	    auto r = cfa.lhs (x);
+	    if (local (r)) {
+	      if (dest == none || dest == r-base)
+		return r-base;
+	      emit (Op::Mov,t,dest,r-base);
+	      return dest;
+	    }
+	    res = target ();
+	    emit (Op::GetGlobal,t,res,r);
+	    break;
+	  }
+	  case ExprKind::Constant:
+	    std::unreachable ();
+	  case ExprKind::Binary: {
+	    auto l = eval (cfa.lhs (x));
+	    auto r = eval (cfa.rhs (x));
+	    res = target ();
+	    emit (opFor (cfa.op (x)),t,res,l,r);
+	    break;
+	  }
+	  case ExprKind::Not:
+	  case ExprKind::Cast:
+	  case ExprKind::Load: {
+	    auto v = eval (cfa.lhs (x));
+	    res = target ();
+	    auto op = cfa.exprKind (x) == ExprKind::Not ? Op::Not : cfa.exprKind (x) == ExprKind::Cast ? Op::Cast : Op::Load;
+	    emit (op,t,res,v);
+	    break;
+	  }
+	  }
+	  if (dest == none) {
+	    memo[x] = res;
+	    stamps[x] = epoch;
+	  }
+	  return res;
+	}
+
+	const IR::CFA& cfa;
+	Bytecode& bc;
+	std::vector<std::uint32_t> placed;
+	std::vector<IR::loc_t> pending;
+	/* Instructions and table entries waiting for the address of a location */
+	std::vector<std::pair<std::uint32_t,IR::loc_t>> jumps;
+	std::vector<std::pair<std::uint32_t,IR::loc_t>> tables;
+	/* Instructions computing an argument, whose destination is outgoing plus its index
+	   until patch knows where the callee's frame starts, and whether main makes the call */
+	static constexpr std::uint32_t outgoing = std::uint32_t{1} << 31;
+	std::vector<std::pair<std::uint32_t,bool>> arguments;
+	bool inMain{false};
+	/* Compare-and-branch instructions beginning a location, with where they exit to and where they fall through to */
+	std::unordered_map<std::uint32_t,std::pair<IR::loc_t,IR::loc_t>> headers;
+	/* Locations by owner+1 */
+	std::vector<std::vector<IR::loc_t>> owned;
+	std::vector<std::uint32_t> memo;
+	std::vector<std::uint32_t> stamps;
+	std::uint32_t epoch{0};
+	std::vector<std::uint64_t> folded;
+	std::vector<bool> constant;
+	/* The slot of a constant in the current frame */
+	std::vector<std::uint32_t> slots;
+	std::vector<std::uint32_t> seen;
+	std::uint32_t frames{0};
+	/* Index of each location among those of its owner */
+	std::vector<std::uint32_t> position;
+	std::vector<std::uint32_t> visited;
+	std::uint32_t walks{0};
+	std::uint32_t firstConstant{0};
+	std::unordered_map<std::uint64_t,std::uint32_t> values;
+	IR::reg_t base{0};
+	std::uint32_t registers{0};
+	/* Slots before the temporaries */
+	std::uint32_t fixed{0};
+	std::uint32_t temps{0};
+	std::uint32_t size{0};
+	location_t at{};
+      };
+    }
+
+    Bytecode assemble (const IR::CFA& cfa) {
+      Bytecode bc;
+      Assembler as (cfa,bc);
+      bc.main = as.frame (cfa.initial (),none,0,cfa.programRegisters ());
+      bc.main.locals = cfa.programRegisters ();
+      bc.main.zeroed = none;
+      for (IR::func_t f = 0; f < cfa.functions ().size (); ++f) {
+	auto& func = cfa.functions ()[f];
+	auto code = as.frame (func.entry,f,func.firstRegister,func.registers);
+	code.params = func.params;
+	code.locals = func.registers-func.params;
+	code.zeroed = as.zeroed (f);
+	bc.functions.push_back (code);
+      }
+      as.patch ();
+      for (IR::reg_t r = 0; r < cfa.programRegisters (); ++r)
+	bc.globals.push_back (cfa.registerType (r));
+      return bc;
+    }
+
+    static const char* name (Op op) {
+      static const char* names[] = {"mov","add","sub","mul","div","mod","xor","or","and","shl","eq","neq","lt","leq","gt","geq",
+				    "not","cast","load","store","update","alloc","free","havoc","getglobal","setglobal","jump","jumpif","jumpifnot",
+				    "jumpeq","jumpneq","jumplt","jumpleq","jumpgt","jumpgeq","incjumplt","incjumpleq","incjumpneq",
+				    "assume","choose","call","return","halt","fail","block"};
+      static_assert (std::size (names) == std::to_underlying (Op::Block)+1);
+      return names[std::to_underlying (op)];
+    }
+
+    std::ostream& operator<< (std::ostream& os, const Bytecode& bc) {
+      auto frame = [&](const Bytecode::Function& f) {
+	os << " entry " << f.entry << " frame " << f.frameSize << " params " << f.params << " locals " << f.locals;
+	if (f.zeroed != none) {
+	  os << " zeroed";
+	  for (std::uint32_t k = 1; k <= bc.operands[f.zeroed]; ++k)
+	    os << " " << bc.operands[f.zeroed+k];
+	}
+	os << " constants";
+	for (std::uint32_t k = 0; k < f.constants; ++k)
+	  os << " " << static_cast<std::int64_t> (bc.constants[f.firstConstant+k]);
+	os << "\n";
+      };
+      os << "main";
+      frame (bc.main);
+      for (std::size_t f = 0; f < bc.functions.size (); ++f) {
+	os << "f" << f;
+	frame (bc.functions[f]);
+      }
+      for (std::size_t pc = 0; pc < bc.code.size (); ++pc) {
+	auto& i = bc.code[pc];
+	os << pc << ": " << name (i.op);
+	if (i.type () != Type::Untyped)
+	  os << "." << i.type ();
+	for (auto v : {i.a,i.b,i.c})
+	  if (v != none)
+	    os << " " << v;
+	if (i.op == Op::Choose) {
+	  os << " ->";
+	  for (std::uint32_t k = 0; k < i.c; ++k)
+	    os << " " << bc.operands[i.b+k];
+	}
+	os << "\n";
+      }
+      return os;
+    }
+
+    Machine::Machine (const Bytecode& bc) : bc(bc) {
+      for (auto& f : bc.functions)
+	largest = std::max (largest,f.frameSize);
+      // The main statement writes the arguments of its calls into the frame after its own
+      stack.resize (std::max<std::size_t> (bc.main.frameSize+largest,1));
+    }
+
+    void Machine::reset () {
+      // Frames of functions are filled in as they are entered
+      std::fill_n (stack.begin (),bc.main.frameSize,0);
+    }
+
+    bool Machine::threadedDispatch () {
+#if defined(WHILEY_VM_THREADED)
+      return true;
+#else
+      return false;
+#endif
+    }
+
+    RunResult Machine::run (Nondeterminism& choices) {
+#if defined(WHILEY_VM_THREADED)
+      if (dispatch == Dispatch::Threaded)
+	return execute<true> (choices);
+#endif
+      return execute<false> (choices);
+    }
+
+    /*
+     * Every instruction ends by dispatching the next one itself: through
+     * the switch, or straight to its label, which gives each instruction
+     * an indirect jump of its own for the branch predictor to learn.
+     * Instructions whose meaning depends on the type are written once and
+     * instantiated for each integer type T.
+     */
+#if defined(WHILEY_VM_THREADED)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define WHILEY_OP(name) case H_##name: op_##name:
+#define WHILEY_OP_AT(name,t) case H_##name##_##t: op_##name##_##t:
+#define WHILEY_NEXT do {if constexpr (threaded) goto *targets[ip->handler]; else goto dispatch;} while (0)
+#else
+#define WHILEY_OP(name) case H_##name:
+#define WHILEY_OP_AT(name,t) case H_##name##_##t:
+#define WHILEY_NEXT goto dispatch
+#endif
+/* To instruction a if taken, which counts as a step */
+#define WHILEY_BRANCH(taken) \
+  do { \
+    if (!(taken)) \
+      ++ip; \
+    else if (ip = code+ip->a; ++steps > limit) \
+      return stop (ip,Outcome::OutOfSteps); \
+    WHILEY_NEXT; \
+  } while (0)
+#define WHILEY_AT(name,t,...) WHILEY_OP_AT (name,t) {[[maybe_unused]] constexpr Type T = Type::t; __VA_ARGS__}
+#define WHILEY_TYPED(name,...) WHILEY_VM_TYPES (WHILEY_AT,name,__VA_ARGS__)
+
+    template<bool threaded>
+    RunResult Machine::execute (Nondeterminism& choices) {
+      memory.clear ();
+      auto code = bc.code.data ();
+      auto ops = bc.operands.data ();
+      auto consts = bc.constants.data ();
+      auto functions = bc.functions.data ();
+      auto regs = stack.data ();
+      std::copy_n (consts+bc.main.firstConstant,bc.main.constants,regs+bc.main.locals);
+      auto ip = code;
+      std::uint64_t steps = 0, limit = stepLimit;
+      // Frames are kept between runs; only running out of them checks the depth
+      auto fp = frames.data (), frameEnd = fp+std::min<std::size_t> (frames.size (),depthLimit);
+      // Where the next call's frame goes
+      auto top = regs+bc.main.frameSize;
+      // Neither captures ip or steps, which keeps them in registers
+      auto stop = [this,code](const Instr* at, Outcome o) {return RunResult {o,bc.sources[at-code]};};
+#if defined(WHILEY_VM_THREADED)
+#define WHILEY_LABEL(name) &&op_##name,
+#define WHILEY_LABEL_AT(name,t,...) &&op_##name##_##t,
+#define WHILEY_LABELS(name) WHILEY_VM_TYPES (WHILEY_LABEL_AT,name)
+      static void* const targets[] = {WHILEY_VM_OPS (WHILEY_LABEL,WHILEY_LABELS)};
+#undef WHILEY_LABEL
+#undef WHILEY_LABEL_AT
+#undef WHILEY_LABELS
+      static_assert (std::size (targets) == Handlers);
+#endif
+
+    [[maybe_unused]] dispatch:
+      switch (ip->handler) {
+	WHILEY_OP (Mov) {
+	  regs[ip->a] = regs[ip->b];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_TYPED (Add,
+	  regs[ip->a] = *Kernels::apply<BinOps::Add,T> (regs[ip->b],regs[ip->c]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (Sub,
+	  regs[ip->a] = *Kernels::apply<BinOps::Sub,T> (regs[ip->b],regs[ip->c]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (Mul,
+	  regs[ip->a] = *Kernels::apply<BinOps::Mul,T> (regs[ip->b],regs[ip->c]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (Div,
+	  auto res = Kernels::apply<BinOps::Div,T> (regs[ip->b],regs[ip->c]);
+	  if (!res)
+	    return stop (ip,Outcome::DivisionByZero);
+	  regs[ip->a] = *res;
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (Mod,
+	  auto res = Kernels::apply<BinOps::Mod,T> (regs[ip->b],regs[ip->c]);
+	  if (!res)
+	    return stop (ip,Outcome::DivisionByZero);
+	  regs[ip->a] = *res;
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_OP (Xor) {
+	  regs[ip->a] = regs[ip->b] ^ regs[ip->c];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (Or) {
+	  regs[ip->a] = regs[ip->b] | regs[ip->c];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (And) {
+	  regs[ip->a] = regs[ip->b] & regs[ip->c];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_TYPED (Shl,
+	  regs[ip->a] = *Kernels::apply<BinOps::LShl,T> (regs[ip->b],regs[ip->c]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_OP (Eq) {
+	  regs[ip->a] = regs[ip->b] == regs[ip->c];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (NEq) {
+	  regs[ip->a] = regs[ip->b] != regs[ip->c];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_TYPED (Lt,
+	  regs[ip->a] = *Kernels::apply<BinOps::Lt,T> (regs[ip->b],regs[ip->c]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (LEq,
+	  regs[ip->a] = *Kernels::apply<BinOps::LEq,T> (regs[ip->b],regs[ip->c]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (Gt,
+	  regs[ip->a] = *Kernels::apply<BinOps::Gt,T> (regs[ip->b],regs[ip->c]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (GEq,
+	  regs[ip->a] = *Kernels::apply<BinOps::GEq,T> (regs[ip->b],regs[ip->c]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_OP (Not) {
+	  regs[ip->a] = !regs[ip->b];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_TYPED (Cast,
+	  regs[ip->a] = Kernels::wrap<T> (regs[ip->b]);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (Load,
+	  if (!memory.load<T> (regs[ip->b],regs[ip->a]))
+	    return stop (ip,Outcome::InvalidAccess);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (Store,
+	  if (!memory.store<T> (regs[ip->b],regs[ip->c]))
+	    return stop (ip,Outcome::InvalidAccess);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_TYPED (Update,
+	  std::uint64_t old;
+	  if (!memory.load<T> (regs[ip->b],old))
+	    return stop (ip,Outcome::InvalidAccess);
+	  auto res = Kernels::row<T>[ip->a] (old,regs[ip->c]);
+	  if (!res)
+	    return stop (ip,Outcome::DivisionByZero);
+	  memory.store<T> (regs[ip->b],*res);
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_OP (Alloc) {
+	  auto p = memory.allocate (regs[ip->b]);
+	  if (!p)
+	    return stop (ip,Outcome::OutOfMemory);
+	  regs[ip->a] = p;
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (Free) {
+	  if (!memory.release (regs[ip->b]))
+	    return stop (ip,Outcome::InvalidAccess);
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_TYPED (Havoc,
+	  regs[ip->a] = Kernels::wrap<T> (choices.value (ip->type ()));
+	  ++ip;
+	  WHILEY_NEXT;
+	)
+	WHILEY_OP (GetGlobal) {
+	  regs[ip->a] = stack[ip->b];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (SetGlobal) {
+	  stack[ip->a] = regs[ip->b];
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (Jump) {
+	  WHILEY_BRANCH (true);
+	}
+	WHILEY_OP (JumpIf) {
+	  WHILEY_BRANCH (regs[ip->b]);
+	}
+	WHILEY_OP (JumpIfNot) {
+	  WHILEY_BRANCH (!regs[ip->b]);
+	}
+	WHILEY_OP (JumpEq) {
+	  WHILEY_BRANCH (regs[ip->b] == regs[ip->c]);
+	}
+	WHILEY_OP (JumpNEq) {
+	  WHILEY_BRANCH (regs[ip->b] != regs[ip->c]);
+	}
+	WHILEY_TYPED (JumpLt,
+	  WHILEY_BRANCH (Kernels::less<T> (regs[ip->b],regs[ip->c]));
+	)
+	WHILEY_TYPED (JumpLEq,
+	  WHILEY_BRANCH (!Kernels::less<T> (regs[ip->c],regs[ip->b]));
+	)
+	WHILEY_TYPED (JumpGt,
+	  WHILEY_BRANCH (Kernels::less<T> (regs[ip->c],regs[ip->b]));
+	)
+	WHILEY_TYPED (JumpGEq,
+	  WHILEY_BRANCH (!Kernels::less<T> (regs[ip->b],regs[ip->c]));
+	)
+	WHILEY_TYPED (IncJumpLt,
+	  auto& r = regs[ip->b];
+	  r = Kernels::wrap<T> (r+1);
+	  WHILEY_BRANCH (Kernels::less<T> (r,regs[ip->c]));
+	)
+	WHILEY_TYPED (IncJumpLEq,
+	  auto& r = regs[ip->b];
+	  r = Kernels::wrap<T> (r+1);
+	  WHILEY_BRANCH (!Kernels::less<T> (regs[ip->c],r));
+	)
+	WHILEY_TYPED (IncJumpNEq,
+	  auto& r = regs[ip->b];
+	  r = Kernels::wrap<T> (r+1);
+	  WHILEY_BRANCH (r != regs[ip->c]);
+	)
+	WHILEY_OP (Assume) {
+	  if (!regs[ip->b])
+	    return stop (ip,Outcome::Blocked);
+	  ++ip;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (Choose) {
+	  if (++steps > limit)
+	    return stop (ip,Outcome::OutOfSteps);
+	  ip = code+ops[ip->b+choices.choose (ip->c)];
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (Call) {
+	  if (fp == frameEnd) [[unlikely]] {
+	    std::size_t depth = fp-frames.data ();
+	    if (depth >= depthLimit)
+	      return stop (ip,Outcome::StackOverflow);
+	    frames.resize (std::min<std::size_t> (std::max<std::size_t> (2*depth,16),depthLimit));
+	    fp = frames.data ()+depth;
+	    frameEnd = frames.data ()+frames.size ();
+	    // Room for the largest frame at every depth there is a Frame for, so calls need not check
+	    auto old = stack.data ();
+	    stack.resize (std::max (stack.size (),bc.main.frameSize+(frames.size ()+1)*largest));
+	    for (auto r = frames.data (); r != fp; ++r)
+	      r->regs = stack.data ()+(r->regs-old);
+	    regs = stack.data ()+(regs-old);
+	    top = stack.data ()+(top-old);
+	  }
+	  if (++steps > limit)
+	    return stop (ip,Outcome::OutOfSteps);
+	  auto& f = functions[ip->b];
+	  auto callee = top;
+	  auto zeroed = ops+f.zeroed;
+	  for (std::uint32_t k = 0; k < zeroed[0]; ++k)
+	    callee[zeroed[k+1]] = 0;
+	  // Constants are never written, so they stay until another function runs at this depth
+	  if (fp->constants != ip->b) [[unlikely]] {
+	    std::copy_n (consts+f.firstConstant,f.constants,callee+f.params+f.locals);
+	    fp->constants = ip->b;
+	  }
+	  fp->regs = regs;
+	  fp->ret = ip+1;
+	  fp->dest = ip->a;
+	  ++fp;
+	  regs = callee;
+	  top = callee+largest;
+	  ip = code+f.entry;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (Return) {
+	  auto v = regs[ip->b];
+	  auto& f = *--fp;
+	  top = regs;
+	  regs = f.regs;
+	  ip = f.ret;
+	  if (f.dest != none)
+	    regs[f.dest] = v;
+	  WHILEY_NEXT;
+	}
+	WHILEY_OP (Halt) {
+	  return {};
+	}
+	WHILEY_OP (Fail) {
+	  return stop (ip,Outcome::AssertionFailed);
+	}
+	WHILEY_OP (Block) {
+	  return stop (ip,Outcome::Blocked);
+	}
+      }
+      std::unreachable ();
+    }
+
+#undef WHILEY_OP
+#undef WHILEY_OP_AT
+#undef WHILEY_NEXT
+#undef WHILEY_BRANCH
+#undef WHILEY_AT
+#undef WHILEY_TYPED
+#if defined(WHILEY_VM_THREADED)
+#pragma GCC diagnostic pop
+#endif
+#undef WHILEY_VM_OPS
+#undef WHILEY_VM_TYPES
+  }
+}
@@ -1,30 +1,145 @@
 #include "whiley/parser.hpp"
 #include "scanner.h"
 #include "parser.hh"
+#include "rdparser.h"
 #include "whiley/ast.hpp"
 #include "whiley/messaging.hpp"
+#include "whiley/source.hpp"
 
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <stdexcept>
+#include <string>
 
 namespace Whiley {
-  ParseResult  WParser::parse( std::istream& iss ) {
+  namespace {
+    /* Keeps the source of a lazy parse to parse its function bodies when they are asked for */
+    class DeferredBodies : public BodySource {
+    public:
+      DeferredBodies (SourceBuffer&& buffer, const TypeFlags& flags) : buffer(std::move(buffer)),
+								       text(this->buffer.view ()),
+								       flags(flags) {}
+      DeferredBodies (std::span<const char> source, const TypeFlags& flags) : copy(source.begin (),source.end ()),
+									       text(copy),
+									       flags(flags) {}
+
+      std::span<const char> source () const {return text;}
+      /* Lines of the whole source, for messages */
+      void setLines (const LineTable& l) {lines = l;}
+
+      Statement_ptr parse (Frame func, const location_t& loc) override {
+	// Syntax errors are thrown, anything else the scanner says goes with them
+	struct : MessageSystem {
+	  MessageSystem& operator<< (const Message& m) override {
+	    auto line = m.to_string ();
+	    while (!line.empty () && line.back () == '\n')
+	      line.pop_back ();
+	    text += (text.empty () ? "" : "\n") + line;
+	    return *this;
+	  }
+	  std::string text;
+	} messages;
+	// The lazy parse has recorded the body's lines already
+	LineTable scanned;
+	ASTBuilder builder {func,std::move(arena),std::move(lines)};
+	Scanner scanner {text.subspan (loc.begin,loc.end-loc.begin),builder.getInterner (),scanned,messages,flags};
+	RDParser parser {scanner,builder,messages,loc.begin};
+	int res;
+	try {
+	  res = parser.parseBody ();
+	}
+	catch (...) {
+	  // The arena holds the bodies parsed before
+	  builder.release (arena,lines);
+	  throw;
+	}
+	builder.release (arena,lines);
+	if (res)
+	  throw std::runtime_error (messages.text);
+	return parser.getMain ();
+      }
+
+    private:
+      SourceBuffer buffer;
+      std::string copy;
+      std::span<const char> text;
+      TypeFlags flags;
+      Arena arena;
+      LineTable lines;
+    };
+  }
+
+  static void collect (Stats& stats, const Scanner& scanner, const ASTBuilder& builder, const Program& prgm) {
+    stats.addTime ("lex",scanner.lexingTime ());
+    stats.add ("tokens",scanner.tokenCount ());
+    std::size_t nodes = 0;
+    auto& counts = builder.getNodeCounts ();
+    for (std::size_t i = 0; i < counts.size (); ++i) {
+      if (counts[i])
+	stats.add (std::string{"nodes."}+nodeKindNames[i],counts[i]);
+      nodes += counts[i];
+    }
+    stats.add ("nodes",nodes);
+    stats.add ("symbols",prgm.getFrame ().symbolCount ());
+    stats.max ("frame_depth",prgm.getFrame ().maxDepth ());
+    stats.add ("arena_bytes",prgm.getArena ().bytesAllocated ());
+  }
+
+  // Lexing, parsing and AST building are interleaved by the grammar actions,
+  // so "parse" covers all three and "lex" is the scanner's share of it
+  static ParseResult run (Scanner& scanner, ASTBuilder& builder, MessageSystem& messages, Stats* stats, bool recursiveDescent,
+			  const std::shared_ptr<DeferredBodies>& bodies = nullptr) {
+    Stats::Timer timer {stats,"parse"};
+    scanner.setTimed (stats);
+    bool res;
+    Statement_ptr main = nullptr;
+    if (recursiveDescent || bodies) {
+      RDParser parser{scanner,builder, messages};
+      if (bodies)
+	parser.deferBodies (bodies);
+      res = parser.parse ();
+      main = parser.getMain ();
+    }
+    else {
+      Parser parser{scanner,builder, messages};
+      res = parser.parse ();
+    }
+    auto prgm = main ? builder.get (main) : builder.get ();
+    if (bodies)
+      bodies->setLines (prgm.getLineTable ());
+    if (stats)
+      collect (*stats,scanner,builder,prgm);
+    return ParseResult{std::move(prgm),!res};
+  }
+
+  static ParseResult lazily (std::shared_ptr<DeferredBodies> bodies, const TypeFlags& flags, MessageSystem& messages, Stats* stats) {
+    ASTBuilder builder;
+    Scanner scanner {bodies->source (),builder.getInterner (),builder.getLineTable (),messages,flags};
+    return run (scanner,builder,messages,stats,true,bodies);
+  }
+  
+  ParseResult  WParser::parse( std::istream& iss, MessageSystem& messages ) const {
+    if (lazyBodies)
+      return lazily (std::make_shared<DeferredBodies> (SourceBuffer::fromStream (iss),flags),flags,messages,stats);
+    ASTBuilder builder;
+    Scanner scanner {&iss,builder.getInterner (),builder.getLineTable (),messages,flags};
+    return run (scanner,builder,messages,stats,recursiveDescent);
+  }
+  
+  ParseResult  WParser::parse( std::span<const char> source, MessageSystem& messages ) const {
+    // The bodies are parsed later from a copy, as source may be gone by then
+    if (lazyBodies)
+      return lazily (std::make_shared<DeferredBodies> (source,flags),flags,messages,stats);
     ASTBuilder builder;
-    Scanner scanner {&iss,flags};
-    
-    Parser parser{scanner,builder, STDMessageSystem::get()};
-    
-    bool res = parser.parse ();
-    return ParseResult{builder.get (),!res};
-    
+    Scanner scanner {source,builder.getInterner (),builder.getLineTable (),messages,flags};
+    return run (scanner,builder,messages,stats,recursiveDescent);
   }
   
-  ParseResult WParser::parse(const std::string& s ) {
-    std::ifstream ifs;
-    
-    ifs.open (s, std::ifstream::in);
-    return parse (ifs);
+  ParseResult WParser::parse(const std::string& s, MessageSystem& messages ) const {
+    auto source = SourceBuffer::fromFile (s);
+    if (lazyBodies)
+      return lazily (std::make_shared<DeferredBodies> (std::move(source),flags),flags,messages,stats);
+    return parse (source.view (),messages);
   }
   
   
@@ -0,0 +1,106 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/compiler.hpp"
+#include "whiley/interpreter.hpp"
+#include "whiley/batch.hpp"
+
+#include <iostream>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Runs a program with params and outputs on a table of random rows as a
+ * batch, on one thread and on several, and checks each row against the
+ * interpreter run on its own with the same choices.
+ *
+ *   whiley_tbatch [rows]
+ */
+
+namespace {
+  const std::string program =
+    "param si64 n;\n"
+    "param ui8 k;\n"
+    "output si64 sum;\n"
+    "output ui8 h;\n"
+    "si64 i;\n"
+    "fn tri (si64 m) -> si64 {\n"
+    "  si64 r;\n"
+    "  if (m <= 0) { return 0; } else { skip; }\n"
+    "  r = tri (m - 1);\n"
+    "  return m + r;\n"
+    "}\n"
+    "h = k;\n"
+    "while (i < n % 100) { sum = sum + i * i; h = h * (31 as ui8) + k; i++; }\n"
+    "assert sum != 285;\n"
+    "choose { :: { h = h + (1 as ui8); } :: { skip; } }\n"
+    "i = tri (n % 50);\n"
+    "sum = sum + i / (k as si64);\n";
+}
+
+int main (int argc, char** argv) {
+  std::size_t rows = argc > 1 ? std::stoul (argv[1]) : 5000;
+  Whiley::WParser parser;
+  auto prgm = parser.parse (std::span<const char> (program.data (),program.size ())).get ();
+  Whiley::BufferMessageSystem discard;
+  if (!Whiley::TypeChecker {discard}.CheckProgram (prgm)) {
+    std::cerr << "ill-typed" << std::endl;
+    return 1;
+  }
+  auto cfa = Whiley::Compiler{}.Compile (prgm);
+  auto bc = Whiley::VM::assemble (cfa);
+  Whiley::VM::Batch batch (prgm,cfa,bc);
+  batch.setSeed (7);
+
+  auto& params = batch.parameters ();
+  auto& outs = batch.outputs ();
+  if (params.size () != 2 || outs.size () != 2) {
+    std::cerr << params.size () << " params and " << outs.size () << " outputs" << std::endl;
+    return 1;
+  }
+  std::vector<std::vector<std::uint64_t>> in (params.size (),std::vector<std::uint64_t> (rows));
+  Whiley::RandomChoices random (1);
+  for (std::size_t i = 0; i < params.size (); ++i)
+    for (auto& v : in[i])
+      v = Whiley::normalize (params[i].type,random.value (params[i].type) % 300);
+  std::vector<const std::uint64_t*> columns;
+  for (auto& c : in)
+    columns.push_back (c.data ());
+
+  Whiley::Interpreter interpreter (prgm);
+  int failures = 0;
+  std::map<Whiley::Outcome,std::size_t> outcomes;
+  for (std::size_t jobs : {1,4}) {
+    std::vector<std::vector<std::uint64_t>> out (outs.size (),std::vector<std::uint64_t> (rows));
+    std::vector<std::uint64_t*> targets;
+    for (auto& c : out)
+      targets.push_back (c.data ());
+    std::vector<Whiley::RunResult> results (rows);
+    batch.setJobs (jobs);
+    batch.run (rows,columns,targets,results);
+
+    for (std::size_t row = 0; row < rows; ++row) {
+      interpreter.reset ();
+      for (std::size_t i = 0; i < params.size (); ++i)
+	interpreter.set (params[i].symbol,in[i][row]);
+      Whiley::RandomChoices choices (7+row);
+      auto expected = interpreter.run (choices);
+      if (jobs == 1)
+	++outcomes[expected.outcome];
+      if (expected.outcome != results[row].outcome) {
+	std::cerr << jobs << " jobs, row " << row << ": interpreter " << expected.outcome << ", batch " << results[row].outcome << std::endl;
+	++failures;
+      }
+      for (std::size_t j = 0; j < outs.size (); ++j)
+	if (interpreter.get (outs[j].symbol) != out[j][row]) {
+	  std::cerr << jobs << " jobs, row " << row << ": " << outs[j].symbol.getFullName () << " is "
+		    << interpreter.get (outs[j].symbol) << ", batch " << out[j][row] << std::endl;
+	  ++failures;
+	}
+    }
+  }
+  for (auto [o,n] : outcomes)
+    std::cout << o << ": " << n << std::endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+#include "whiley/cache.hpp"
+#include "whiley/image.hpp"
+
+#include "common.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Uses a compilation cache in a fresh directory: a miss stores the
+ * program and the next lookup hits with an equal program; once the
+ * entries outgrow the limit the least recently used one goes, also when
+ * recency comes from the modification times of a reopened directory;
+ * missing and corrupt entries are misses and only corrupt ones are
+ * removed.
+ *
+ *   whiley_tcache [directory]
+ */
+
+namespace {
+  namespace fs = std::filesystem;
+
+  std::string program (std::size_t n) {
+    std::stringstream str;
+    str << "si64 x;\n";
+    for (std::size_t i = 0; i <= n; ++i)
+      str << "x = x + " << i << ";\n";
+    return str.str ();
+  }
+
+  std::span<const char> text (const std::string& s) {
+    return {s.data (),s.size ()};
+  }
+}
+
+int main (int argc, char** argv) {
+  fs::path dir = argc > 1 ? argv[1] : fs::temp_directory_path () / "whiley_tcache";
+  fs::remove_all (dir);
+
+  int failures = 0;
+  auto expect = [&](bool ok, const char* what) {
+    if (!ok) {
+      std::cerr << "failed: " << what << std::endl;
+      ++failures;
+    }
+  };
+
+  Whiley::WParser parser;
+  WhileyTest::Collect messages;
+  std::vector<std::string> sources {program (1),program (2),program (3)};
+  std::vector<Whiley::CacheKey> keys;
+  std::vector<std::string> files;
+  std::vector<std::uint64_t> sizes;
+  for (auto& s : sources) {
+    keys.push_back (Whiley::CompilationCache::key (text (s),parser.getFlags ()));
+    files.push_back (keys.back ().hex ()+".wimg");
+  }
+
+  {
+    Whiley::CompilationCache cache {dir};
+    auto first = cache.compile (parser,text (sources[0]),messages);
+    auto c = cache.counters ();
+    expect (first && c.misses == 1 && c.hits == 0 && c.stores == 1 && c.entries == 1,"miss then store");
+    auto second = cache.compile (parser,text (sources[0]),messages);
+    c = cache.counters ();
+    expect (second && c.misses == 1 && c.hits == 1 && c.stores == 1,"hit");
+    expect (first && second && WhileyTest::dump (*first) == WhileyTest::dump (*second),"cached program");
+
+    for (std::size_t i = 1; i < sources.size (); ++i)
+      cache.compile (parser,text (sources[i]),messages);
+    for (auto& f : files)
+      sizes.push_back (fs::file_size (dir / f));
+    c = cache.counters ();
+    expect (c.entries == 3 && c.bytes == sizes[0]+sizes[1]+sizes[2] && c.evictions == 0,"three entries");
+  }
+
+  // Any two entries fit, all three do not
+  auto limit = sizes[0]+sizes[1]+sizes[2]-1;
+  {
+    fs::remove_all (dir);
+    Whiley::CompilationCache cache {dir,limit};
+    cache.compile (parser,text (sources[0]),messages);
+    cache.compile (parser,text (sources[1]),messages);
+    expect (cache.find (keys[0]).has_value (),"find first");
+    cache.compile (parser,text (sources[2]),messages);
+    auto c = cache.counters ();
+    expect (c.evictions == 1 && c.entries == 2 && c.bytes == sizes[0]+sizes[2],"one eviction");
+    expect (fs::exists (dir / files[0]) && !fs::exists (dir / files[1]) && fs::exists (dir / files[2]),"least recently used evicted");
+  }
+
+  {
+    fs::remove_all (dir);
+    {
+      Whiley::CompilationCache cache {dir};
+      for (auto& s : sources)
+	cache.compile (parser,text (s),messages);
+      // Stored a minute apart, oldest first, then the oldest used again
+      auto now = fs::file_time_type::clock::now ();
+      for (std::size_t i = 0; i < files.size (); ++i)
+	fs::last_write_time (dir / files[i],now-std::chrono::minutes (3-i));
+      expect (cache.find (keys[0]).has_value (),"find oldest");
+    }
+    Whiley::CompilationCache reopened {dir,limit};
+    auto c = reopened.counters ();
+    expect (c.evictions == 1 && c.entries == 2,"eviction on reopening");
+    expect (fs::exists (dir / files[0]) && !fs::exists (dir / files[1]) && fs::exists (dir / files[2]),"recency kept over reopening");
+  }
+
+  {
+    fs::remove_all (dir);
+    Whiley::CompilationCache cache {dir};
+    for (auto& s : sources)
+      cache.compile (parser,text (s),messages);
+    cache.resetCounters ();
+    fs::remove (dir / files[0]);
+    std::ofstream {dir / files[1]} << "not an image";
+    expect (!cache.find (keys[0]) && !cache.find (keys[1]),"missing and corrupt entries miss");
+    auto c = cache.counters ();
+    expect (c.misses == 2 && c.hits == 0 && c.entries == 1 && c.bytes == sizes[2],"missing and corrupt entries forgotten");
+    expect (!fs::exists (dir / files[1]),"corrupt entry removed");
+    expect (cache.load (keys[2]).has_value (),"intact entry loads");
+  }
+
+  fs::remove_all (dir);
+  std::cout << sizes[0] << ", " << sizes[1] << ", " << sizes[2] << " bytes" << std::endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/compiler.hpp"
+#include "whiley/flat.hpp"
+
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <span>
+#include <sstream>
+#include <string>
+
+/*
+ * Compiles a type checked program from stdin to its CFA and checks the
+ * graph: the edges listed for a location leave or enter it, each
+ * expression is the only one of its shape, and every statement left the
+ * edges it lowers to. A lazily parsed copy must compile to the same CFA.
+ *
+ *   whiley_tcfa < program.w
+ */
+
+namespace {
+  std::string print (const Whiley::IR::CFA& cfa) {
+    std::stringstream str;
+    str << cfa;
+    return str.str ();
+  }
+}
+
+int main () {
+  using namespace Whiley::IR;
+  std::string source {std::istreambuf_iterator<char> (std::cin),std::istreambuf_iterator<char> ()};
+  std::span<const char> text {source.data (),source.size ()};
+  Whiley::WParser parser;
+  auto parsed = parser.parse (text);
+  if (!parsed)
+    return 1;
+  auto prgm = parsed.get ();
+  Whiley::BufferMessageSystem discard;
+  Whiley::TypeChecker checker {discard};
+  if (!checker.CheckProgram (prgm)) {
+    std::cout << "ill-typed" << std::endl;
+    return 0;
+  }
+  auto cfa = Whiley::Compiler{}.Compile (prgm);
+
+  int failures = 0;
+  auto expect = [&](bool ok, const char* what) {
+    if (!ok) {
+      std::cerr << "mismatch: " << what << std::endl;
+      ++failures;
+    }
+  };
+
+  std::size_t out = 0, in = 0;
+  std::map<EdgeKind,std::size_t> edges;
+  std::size_t errors = 0;
+  for (loc_t l = 0; l < cfa.locations (); ++l) {
+    for (auto e : cfa.successors (l)) {
+      expect (cfa.source (e) == l,"successor leaves its location");
+      ++edges[cfa.edgeKind (e)];
+      ++out;
+    }
+    for (auto e : cfa.predecessors (l)) {
+      expect (cfa.target (e) == l,"predecessor enters its location");
+      ++in;
+    }
+    errors += cfa.locationKind (l) == LocationKind::Error;
+  }
+  expect (out == cfa.edges () && in == cfa.edges (),"every edge listed once");
+
+  auto expressions = cfa.expressions ();
+  for (expr_t x = 0; x < expressions; ++x) {
+    expr_t again = none;
+    switch (cfa.exprKind (x)) {
+    case ExprKind::Register: again = cfa.reg (cfa.lhs (x)); break;
+    case ExprKind::Constant: again = cfa.constant (cfa.value (x),cfa.type (x)); break;
+    case ExprKind::Binary: again = cfa.binary (cfa.op (x),cfa.type (x),cfa.lhs (x),cfa.rhs (x)); break;
+    case ExprKind::Not: again = cfa.negate (cfa.lhs (x)); break;
+    case ExprKind::Load: again = cfa.load (cfa.type (x),cfa.lhs (x)); break;
+    case ExprKind::Cast: again = cfa.cast (cfa.type (x),cfa.lhs (x)); break;
+    }
+    expect (again == x,"expressions hash-consed");
+  }
+  expect (cfa.expressions () == expressions,"no expression built twice");
+
+  std::map<Whiley::StmtKind,std::size_t> stmts;
+  auto flat = Whiley::flatten (prgm);
+  flat.forEachStatement ([&](Whiley::stmt_t, Whiley::StmtKind k) {++stmts[k];});
+  using Whiley::StmtKind;
+  expect (edges[EdgeKind::Assign] == stmts[StmtKind::Assign]+stmts[StmtKind::IncrementDecrement],"assignments");
+  expect (edges[EdgeKind::Call] == stmts[StmtKind::Call],"calls");
+  expect (edges[EdgeKind::Return] == stmts[StmtKind::Return],"returns");
+  expect (edges[EdgeKind::Store] == stmts[StmtKind::MemAssign],"stores");
+  expect (edges[EdgeKind::Alloc] == stmts[StmtKind::Alloc],"allocations");
+  expect (edges[EdgeKind::Free] == stmts[StmtKind::Free],"frees");
+  expect (errors == stmts[StmtKind::Assert],"one error location per assertion");
+
+  Whiley::WParser lazy;
+  lazy.useLazyBodies ();
+  auto deferred = lazy.parse (text).get ();
+  Whiley::TypeChecker {discard}.CheckProgram (deferred);
+  expect (print (Whiley::Compiler{}.Compile (deferred)) == print (Whiley::Compiler{}.Compile (prgm)),"lazily parsed program");
+
+  std::cout << cfa.locations () << " locations, " << cfa.edges () << " edges, " << cfa.expressions () << " expressions" << std::endl;
+  return failures ? 1 : 0;
+}
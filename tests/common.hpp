@@ -0,0 +1,40 @@
+#ifndef _WHILEY_TESTS_COMMON__
+#define _WHILEY_TESTS_COMMON__
+
+#include "whiley/ast.hpp"
+#include "whiley/flat.hpp"
+#include "whiley/messaging.hpp"
+
+#include <sstream>
+#include <string>
+
+/*
+ * Fixtures shared by the tests that compare two ways of producing a
+ * Program.
+ */
+namespace WhileyTest {
+  /* Keeps every message as text, so runs can be compared */
+  class Collect : public Whiley::MessageSystem {
+  public:
+    Whiley::MessageSystem& operator<< (const Whiley::Message& m) override {
+      text += m.to_string ();
+      text += "\n";
+      return *this;
+    }
+    std::string text;
+  };
+
+  /* Everything two equal programs agree on: printed form, flat form with types and every location, line table */
+  inline std::string dump (const Whiley::Program& prgm) {
+    std::stringstream str;
+    auto flat = Whiley::flatten (prgm);
+    str << prgm << "\n" << flat;
+    flat.forEachExpression ([&](Whiley::expr_t e, Whiley::ExprKind) {str << flat.exprLocation (e) << " ";});
+    flat.forEachStatement ([&](Whiley::stmt_t s, Whiley::StmtKind) {str << flat.stmtLocation (s) << " ";});
+    for (auto l : prgm.getLineTable ().lineStarts ())
+      str << "l" << l << " ";
+    return str.str ();
+  }
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/messaging.hpp"
+
+#include "common.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Runs hundreds of parses and type checks concurrently through one shared
+ * WParser and compares each with the result of a serial run. Build with
+ * WHILEY_TSAN=ON to have ThreadSanitizer check the library as well.
+ */
+
+namespace {
+  std::string program (std::size_t n) {
+    std::stringstream str;
+    str << "si64 x;\nsi64 y;\nconst k = " << n << ";\n";
+    str << "fn inc (si64 a) -> si64 {\n  si64 r;\n  r = a + k;\n  return r;\n}\n";
+    str << "x = 0;\n";
+    for (std::size_t i = 0; i < n; ++i) {
+      str << "y = inc[x] * " << i << ";\n";
+      str << "while (x < y) { x = x + 1; }\n";
+      str << "choose { :: { x = y; } :: { if (x == " << i << ") { skip; } else { y = x - 1; } } }\n";
+    }
+    return str.str ();
+  }
+
+  /* Everything a parse reports, so serial and concurrent runs can be compared */
+  std::string run (const Whiley::WParser& parser, const std::string& source) {
+    WhileyTest::Collect messages;
+    std::stringstream out;
+    auto res = parser.parse (std::span<const char> (source.data (),source.size ()),messages);
+    out << (res ? "parsed\n" : "failed\n");
+    if (res) {
+      auto prgm = res.get ();
+      out << (Whiley::TypeChecker {messages}.CheckProgram (prgm) ? "checked\n" : "ill-typed\n");
+      out << prgm << "\n";
+    }
+    return out.str () + messages.text;
+  }
+}
+
+int main () {
+  std::vector<std::string> sources;
+  for (std::size_t n = 1; n <= 24; ++n)
+    sources.push_back (program (n));
+  // Syntax errors, unexpected characters and type errors report through the per-parse messages
+  sources.push_back ("si64 x;\nx = ;\n");
+  sources.push_back ("si64 x;\nx = 1 @ 2;\n");
+  sources.push_back ("si64 x;\nui8 y;\nx = y;\n");
+
+  Whiley::WParser parser;
+  std::vector<std::string> expected;
+  for (auto& s : sources)
+    expected.push_back (run (parser,s));
+
+  const std::size_t parses = 400;
+  const std::size_t threads = std::max (8u,std::thread::hardware_concurrency ());
+  std::atomic<std::size_t> next {0};
+  std::atomic<std::size_t> mismatches {0};
+  {
+    std::vector<std::jthread> workers;
+    for (std::size_t t = 0; t < threads; ++t)
+      workers.emplace_back ([&]() {
+	for (auto i = next++; i < parses; i = next++) {
+	  auto k = i % sources.size ();
+	  if (run (parser,sources[k]) != expected[k])
+	    ++mismatches;
+	}
+      });
+  }
+
+  std::cout << parses << " parses on " << threads << " threads, " << mismatches << " mismatches" << std::endl;
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/flat.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/*
+ * Flattens a checked program using every kind of statement and
+ * expression and compares the printed flat form with the expected one,
+ * then checks that storage is in post-order: every operand, child and
+ * argument comes before its user.
+ *
+ *   whiley_tflat
+ */
+
+namespace {
+  const std::string source =
+    "si64 x;\n"
+    "ptr p;\n"
+    "si8 c;\n"
+    "fn g (si64 a) -> si64 {\n"
+    "  return a;\n"
+    "}\n"
+    "c = ?;\n"
+    "p = alloc (8 as ui64);\n"
+    "# p = x;\n"
+    "x = $ p as si64 $ + (c as si64);\n"
+    "if (x == ??si64) { assert x > 2; } else { assume x != 4; }\n"
+    "choose {\n"
+    "  :: { skip; }\n"
+    "  :: { while (x < 3) { x++; } }\n"
+    "}\n"
+    "g (x);\n"
+    "x = g[x];\n"
+    "free p;\n";
+
+  const std::string expected =
+    "e0 : si64 = a\n"
+    "e1 : si8 = ?si8\n"
+    "e2 : si64 = 8\n"
+    "e3 : ui64 = cast ui64 e2\n"
+    "e4 : ptr = p\n"
+    "e5 : si64 = x\n"
+    "e6 : ptr = p\n"
+    "e7 : si64 = load si64 e6\n"
+    "e8 : si8 = c\n"
+    "e9 : si64 = cast si64 e8\n"
+    "e10 : si64 = add e7 e9\n"
+    "e11 : si64 = x\n"
+    "e12 : si64 = ?si64\n"
+    "e13 : si64 = eq e11 e12\n"
+    "e14 : si64 = x\n"
+    "e15 : si64 = 2\n"
+    "e16 : si64 = gt e14 e15\n"
+    "e17 : si64 = x\n"
+    "e18 : si64 = 4\n"
+    "e19 : si64 = neq e17 e18\n"
+    "e20 : si64 = x\n"
+    "e21 : si64 = 3\n"
+    "e22 : si64 = lt e20 e21\n"
+    "e23 : si64 = x\n"
+    "e24 : si64 = x\n"
+    "e25 : si64 = £0\n"
+    "e26 : ptr = p\n"
+    "s0 return e0\n"
+    "s1 assign c e1\n"
+    "s2 alloc p e3\n"
+    "s3 store e4 e5\n"
+    "s4 assign x e10\n"
+    "s5 assert e16\n"
+    "s6 assume e19\n"
+    "s7 if e13 s5 s6\n"
+    "s8 incr x\n"
+    "s9 while e22 s8\n"
+    "s10 skip\n"
+    "s11 choose s9 s10\n"
+    "s12 call g e23\n"
+    "s13 £0 = call g e24\n"
+    "s14 assign x e25\n"
+    "s15 free e26\n"
+    "s16 block s1 s2 s3 s4 s7 s11 s12 s13 s14 s15\n"
+    "fn g s0\n"
+    "main s16\n";
+}
+
+int main () {
+  Whiley::WParser parser;
+  auto parsed = parser.parse (std::span<const char> (source.data (),source.size ()));
+  if (!parsed)
+    return 1;
+  auto prgm = parsed.get ();
+  if (!Whiley::TypeChecker {}.CheckProgram (prgm)) {
+    std::cerr << "program does not check" << std::endl;
+    return 1;
+  }
+
+  int failures = 0;
+  auto flat = Whiley::flatten (prgm);
+  std::stringstream str;
+  str << flat;
+  if (str.str () != expected) {
+    std::cerr << "flat form differs:\n" << str.str () << std::endl;
+    ++failures;
+  }
+
+  auto before = [&](std::uint32_t operand, std::size_t user, const char* what) {
+    if (operand >= user) {
+      std::cerr << what << " " << user << " uses " << operand << std::endl;
+      ++failures;
+    }
+  };
+  flat.forEachExpression ([&](Whiley::expr_t e, Whiley::ExprKind k) {
+    if (k == Whiley::ExprKind::Binary)
+      before (flat.rhs (e),e,"expression");
+    if (k == Whiley::ExprKind::Binary || k == Whiley::ExprKind::Deref || k == Whiley::ExprKind::Cast)
+      before (flat.lhs (e),e,"expression");
+  });
+  flat.forEachStatement ([&](Whiley::stmt_t s, Whiley::StmtKind k) {
+    switch (k) {
+    case Whiley::StmtKind::If:
+      before (flat.c (s),s,"statement");
+      [[fallthrough]];
+    case Whiley::StmtKind::While:
+      before (flat.a (s),s,"statement");
+      break;
+    case Whiley::StmtKind::Block:
+    case Whiley::StmtKind::Choose:
+      for (std::uint32_t i = 0; i < flat.c (s); ++i)
+	before (flat.children ()[flat.a (s)+i],s,"statement");
+      break;
+    default:
+      break;
+    }
+  });
+  if (flat.main ()+1 != flat.statements ()) {
+    std::cerr << "main is not the last statement" << std::endl;
+    ++failures;
+  }
+
+  std::cout << flat.expressions () << " expressions, " << flat.statements () << " statements" << std::endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/image.hpp"
+#include "whiley/flat.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Parses and checks a program from stdin, writes its image, opens it again
+ * and compares the loaded Program with the original: printed form, the
+ * flat form (which includes every expression's type) and a second image.
+ * Then gives each function the global scope or another function's
+ * scope, which load() must reject rather than build a Frame that
+ * contains the function itself, and round-trips a built program with a
+ * decrement, which no parser produces.
+ *
+ *   whiley_timage [image path] < program.w
+ */
+
+namespace {
+  template<class T>
+  std::string print (const T& t) {
+    std::stringstream str;
+    str << t;
+    return str.str ();
+  }
+
+  /* image with the scope of function f replaced */
+  std::string rescope (const std::string& image, const Whiley::ProgramImage::FunctionRecord& f, std::uint32_t scope) {
+    std::string record (reinterpret_cast<const char*> (&f),sizeof (f));
+    auto at = image.find (record);
+    if (at == std::string::npos)
+      throw std::logic_error ("function record not found");
+    auto patched = image;
+    std::memcpy (patched.data ()+at+offsetof (Whiley::ProgramImage::FunctionRecord,scope),&scope,sizeof (scope));
+    return patched;
+  }
+
+  /* si64 x; x--; x++; */
+  Whiley::Program counter () {
+    Whiley::ASTBuilder builder;
+    auto x = builder.getInterner ().intern ("x");
+    builder.DeclareStmt (x,Whiley::Type::SI64,false,false,{});
+    std::vector<Whiley::Statement_ptr> stmts;
+    stmts.push_back (builder.makeDecrement (x,{}));
+    stmts.push_back (builder.makeIncrement (x,{}));
+    return builder.get (builder.makeBlock (std::move(stmts),{}));
+  }
+
+  bool loads (const std::string& bytes) {
+    std::istringstream is {bytes};
+    try {
+      Whiley::ProgramImage::read (is).load ();
+      return true;
+    }
+    catch (const std::runtime_error&) {
+      return false;
+    }
+  }
+}
+
+int main (int argc, char** argv) {
+  std::string path = argc > 1 ? argv[1] : (std::filesystem::temp_directory_path () / "whiley_timage.wimg").string ();
+  Whiley::WParser parser;
+  auto parseres = parser.parse (std::cin);
+  if (!parseres)
+    return 1;
+  auto prgm = parseres.get ();
+  bool checked = Whiley::TypeChecker{}.CheckProgram (prgm);
+
+  Whiley::ProgramImage::write (prgm,path);
+  auto image = Whiley::ProgramImage::open (path);
+  auto loaded = image.load ();
+
+  std::stringstream first, second;
+  Whiley::ProgramImage::write (prgm,first);
+  Whiley::ProgramImage::write (loaded,second);
+
+  int failures = 0;
+  auto expect = [&](bool ok, const char* what) {
+    if (!ok) {
+      std::cerr << "mismatch: " << what << std::endl;
+      ++failures;
+    }
+  };
+  expect (print (prgm) == print (loaded),"program");
+  expect (print (Whiley::flatten (prgm)) == print (Whiley::flatten (loaded)),"flat program");
+  expect (first.str () == second.str (),"image of the loaded program");
+  expect (checked == Whiley::TypeChecker{}.CheckProgram (loaded),"type check");
+
+  auto bytes = first.str ();
+  auto funcs = image.functions ();
+  for (std::size_t i = 0; i < funcs.size (); ++i) {
+    expect (!loads (rescope (bytes,funcs[i],0)),"function in the global scope rejected");
+    if (funcs.size () > 1)
+      expect (!loads (rescope (bytes,funcs[i],funcs[(i+1) % funcs.size ()].scope)),"shared function scope rejected");
+  }
+  auto built = counter ();
+  std::stringstream decremented;
+  Whiley::ProgramImage::write (built,decremented);
+  auto reloaded = Whiley::ProgramImage::read (decremented).load ();
+  expect (print (built) == print (reloaded),"program with a decrement");
+  expect (print (Whiley::flatten (reloaded)).find ("decr x") != std::string::npos,"decrement kept");
+  expect (print (Whiley::flatten (built)) == print (Whiley::flatten (reloaded)),"flat program with a decrement");
+
+  std::cout << image.bytes () << " bytes, " << image.expressions () << " expressions, "
+	    << image.statements () << " statements, " << image.symbols ().size () << " symbols"
+	    << (image.isMapped () ? ", mapped" : "") << std::endl;
+  std::filesystem::remove (path);
+  return failures ? 1 : 0;
+}
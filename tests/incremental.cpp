@@ -0,0 +1,134 @@
+#include "whiley/incremental.hpp"
+
+#include "common.hpp"
+
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Edits a built-in program, whose functions call each other, and then
+ * one read from stdin. Each edit is made and undone again: a statement
+ * and a line break after every semicolon, and in every function a
+ * changed parameter type, a parameter fewer or more, a changed return
+ * type and a syntax error. In the built-in program a call expression
+ * also names an undeclared function and then a variable, which must fail
+ * rather than throw. After every update the incrementally maintained
+ * Program must equal one parsed and checked from scratch: printed form,
+ * flat form with types and every node's location, line table and result.
+ *
+ *   whiley_tincremental < program.w
+ */
+
+namespace {
+  const std::string calls =
+    "si64 x;\n"
+    "fn add (si64 a, si64 b) -> si64 {\n"
+    "  return a + b;\n"
+    "}\n"
+    "fn twice (si64 v) -> si64 {\n"
+    "  si64 r;\n"
+    "  r = add[v, v];\n"
+    "  add (r, 1);\n"
+    "  return r;\n"
+    "}\n"
+    "fn quad (si64 v) -> si64 {\n"
+    "  return twice[twice[v]];\n"
+    "}\n"
+    "x = add[x, 2];\n"
+    "x = quad[x];\n";
+
+  std::string dump (const Whiley::IncrementalProgram& inc) {
+    if (!inc.parsed ())
+      return "unparsed";
+    return WhileyTest::dump (inc.program ());
+  }
+
+  const char* other (std::string_view type) {
+    return type == "si64" ? "ui8" : "si64";
+  }
+
+  /* The source with each function's signature or body edited in turn */
+  std::vector<std::string> signatureEdits (const std::string& source) {
+    std::vector<std::string> res;
+    for (auto fn = source.find ("fn "); fn != std::string::npos; fn = source.find ("\nfn ",fn+1)) {
+      auto open = source.find ('(',fn), close = source.find (')',fn);
+      auto arrow = source.find ("->",close), body = source.find ('{',close);
+      if (close == std::string::npos || arrow > body || body == std::string::npos)
+	break;
+      auto params = source.substr (open+1,close-open-1);
+      auto edit = [&](std::size_t at, std::size_t n, std::string by) {
+	auto s = source;
+	res.push_back (s.replace (at,n,by));
+      };
+      auto typeAt = params.find_first_not_of (' ');
+      if (typeAt != std::string::npos) {
+	auto type = params.substr (typeAt,params.find (' ',typeAt)-typeAt);
+	edit (open+1+typeAt,type.size (),other (type));
+	auto comma = params.rfind (',');
+	edit (comma == std::string::npos ? open+1 : open+1+comma,comma == std::string::npos ? params.size () : params.size ()-comma,"");
+	edit (close,0,", si64 extra");
+      }
+      else
+	edit (close,0,"si64 extra");
+      auto ret = source.find_first_not_of (' ',arrow+2);
+      auto type = source.substr (ret,source.find_first_of (" {",ret)-ret);
+      edit (ret,type.size (),other (type));
+      edit (body+1,0," x = ;");
+    }
+    return res;
+  }
+}
+
+int main () {
+  std::string input {std::istreambuf_iterator<char> (std::cin),std::istreambuf_iterator<char> ()};
+  Whiley::BufferMessageSystem discard;
+  int failures = 0;
+  std::size_t updates = 0, incremental = 0, callers = 0;
+
+  for (auto& source : {calls,input}) {
+    Whiley::IncrementalProgram inc;
+    if (!inc.update (source,discard).full)
+      return 1;
+
+    auto check = [&](const std::string& text) {
+      auto res = inc.update (text,discard);
+      Whiley::IncrementalProgram fresh;
+      auto expected = fresh.update (text,discard);
+      ++updates;
+      incremental += !res.full;
+      callers += !res.full && res.rechecked > 1;
+      if (dump (inc) != dump (fresh) || res.ok != expected.ok) {
+	std::cerr << "mismatch after update " << updates << (res.full ? " (full)" : "") << ":\n" << text << std::endl;
+	++failures;
+      }
+      return res.ok;
+    };
+
+    for (auto at = source.find (';'); at != std::string::npos; at = source.find (';',at+1)) {
+      for (auto insert : {" skip;","\n"}) {
+	auto edited = source;
+	edited.insert (at+1,insert);
+	check (edited);
+	check (source);
+      }
+    }
+    for (auto& edited : signatureEdits (source)) {
+      check (edited);
+      check (source);
+    }
+    if (source == calls)
+      for (auto callee : {"ad","x"}) {
+	auto edited = source;
+	if (check (edited.replace (edited.rfind ("add["),3,callee))) {
+	  std::cerr << "call of " << callee << " accepted" << std::endl;
+	  ++failures;
+	}
+	check (source);
+      }
+  }
+  std::cout << updates << " updates, " << incremental << " incremental, " << callers << " rechecking callers" << std::endl;
+  return failures ? 1 : 0;
+}
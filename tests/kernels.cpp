@@ -0,0 +1,119 @@
+#include "whiley/kernels.hpp"
+#include "whiley/runtime.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Checks the arithmetic kernels of every operator at every type against
+ * a plain reference written with masks, on the edge values of each type,
+ * going through the lookup by run-time type; a few cases are checked as
+ * the compiler evaluates them.
+ *
+ *   whiley_tkernels
+ */
+
+namespace {
+  using Whiley::BinOps;
+  using Whiley::Type;
+
+  static_assert (Whiley::Kernels::wrap<Type::SI8> (0x80) == ~std::uint64_t{0x7F});
+  static_assert (Whiley::Kernels::wrap<Type::UI16> (~std::uint64_t{0}) == 0xFFFF);
+  static_assert (*Whiley::Kernels::apply<BinOps::Div,Type::SI8> (~std::uint64_t{0x7F},~std::uint64_t{0}) == ~std::uint64_t{0x7F});
+  static_assert (!Whiley::Kernels::apply<BinOps::Mod,Type::UI32> (1,0));
+  static_assert (*Whiley::Kernels::apply<BinOps::LShl,Type::UI8> (0x81,1) == 2);
+  static_assert (*Whiley::Kernels::apply<BinOps::Lt,Type::SI64> (~std::uint64_t{0},0) == 1);
+
+  std::uint64_t extend (Type t, std::uint64_t v) {
+    auto bits = 8*Whiley::storeSize (t);
+    if (bits == 64)
+      return v;
+    auto mask = (std::uint64_t{1} << bits)-1;
+    v &= mask;
+    if (Whiley::isSigned (t) && (v >> (bits-1)) & 1)
+      v |= ~mask;
+    return v;
+  }
+
+  std::optional<std::uint64_t> reference (BinOps op, Type t, std::uint64_t a, std::uint64_t b) {
+    auto sa = static_cast<std::int64_t> (a), sb = static_cast<std::int64_t> (b);
+    bool sign = Whiley::isSigned (t);
+    auto lt = [&](std::uint64_t x, std::uint64_t y) {
+      return sign ? static_cast<std::int64_t> (x) < static_cast<std::int64_t> (y) : x < y;
+    };
+    switch (op) {
+    case BinOps::Add: return extend (t,a+b);
+    case BinOps::Sub: return extend (t,a-b);
+    case BinOps::Mul: return extend (t,a*b);
+    case BinOps::Div:
+      if (!b)
+	return std::nullopt;
+      if (!sign)
+	return a/b;
+      return extend (t,sb == -1 ? 0-a : static_cast<std::uint64_t> (sa/sb));
+    case BinOps::Mod:
+      if (!b)
+	return std::nullopt;
+      if (!sign)
+	return a%b;
+      return sb == -1 ? 0 : static_cast<std::uint64_t> (sa%sb);
+    case BinOps::Xor: return a^b;
+    case BinOps::Or: return a|b;
+    case BinOps::And: return a&b;
+    case BinOps::LShl: return b < 64 ? extend (t,a << b) : 0;
+    case BinOps::LEq: return !lt (b,a);
+    case BinOps::GEq: return !lt (a,b);
+    case BinOps::Lt: return lt (a,b);
+    case BinOps::Gt: return lt (b,a);
+    case BinOps::Eq: return a == b;
+    case BinOps::NEq: return a != b;
+    }
+    return std::nullopt;
+  }
+}
+
+int main () {
+  const Type types[] = {Type::UI8,Type::SI8,Type::UI16,Type::SI16,Type::UI32,Type::SI32,Type::UI64,Type::SI64,Type::Pointer};
+  int failures = 0;
+  std::size_t checked = 0;
+  for (auto t : types) {
+    auto bits = 8*Whiley::storeSize (t);
+    std::vector<std::uint64_t> values {0,1,2,3,7,8,31,63,64,65,~std::uint64_t{0},~std::uint64_t{1}};
+    for (auto shift : {bits-1,bits-2,bits/2}) {
+      values.push_back (std::uint64_t{1} << shift);
+      values.push_back ((std::uint64_t{1} << shift)-1);
+      values.push_back ((std::uint64_t{1} << shift)+1);
+    }
+    for (auto& v : values)
+      v = extend (t,v);
+    for (auto v : values)
+      if (Whiley::normalize (t,v) != v) {
+	std::cerr << t << ": " << v << " is not normalized" << std::endl;
+	++failures;
+      }
+    for (std::size_t o = 0; o < Whiley::Kernels::operators; ++o) {
+      auto op = static_cast<BinOps> (o);
+      // LShl shifts by an unsigned value of the same width
+      auto rt = op == BinOps::LShl && Whiley::isSigned (t) ? static_cast<Type> (std::to_underlying (t)-1) : t;
+      for (auto a : values)
+	for (auto b : values) {
+	  b = extend (rt,b);
+	  auto expected = reference (op,t,a,b);
+	  auto actual = Whiley::evaluate (op,t,a,b);
+	  ++checked;
+	  if (expected != actual) {
+	    std::cerr << t << " op " << o << " on " << a << ", " << b << ": expected "
+		      << (expected ? std::to_string (*expected) : "trap") << ", got "
+		      << (actual ? std::to_string (*actual) : "trap") << std::endl;
+	    ++failures;
+	  }
+	}
+    }
+  }
+  std::cout << checked << " checked" << std::endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Parses a program from stdin with and without lazy bodies. Listing the
+ * signatures must leave every body unparsed; parsing them from several
+ * threads at once, each in its own order, and checking a lazily parsed
+ * program in parallel must give what the full parse gives: printed form,
+ * flat form with every location, line table and messages.
+ *
+ *   whiley_tlazy < program.w
+ */
+
+namespace {
+  std::string check (Whiley::Program& prgm) {
+    WhileyTest::Collect messages;
+    Whiley::TypeChecker checker {messages};
+    checker.setJobs (4);
+    auto ok = checker.CheckProgram (prgm);
+    return (ok ? "checked\n" : "ill-typed\n") + messages.text;
+  }
+}
+
+int main () {
+  std::string source {std::istreambuf_iterator<char> (std::cin),std::istreambuf_iterator<char> ()};
+  Whiley::WParser full;
+  full.useRecursiveDescent ();
+  Whiley::WParser lazy;
+  lazy.useLazyBodies ();
+
+  std::span<const char> text {source.data (),source.size ()};
+  auto parsed = full.parse (text);
+  if (!parsed)
+    return 1;
+  auto expected = parsed.get ();
+  auto expectedDump = WhileyTest::dump (expected);
+  auto expectedCheck = check (expected);
+  auto checkedDump = WhileyTest::dump (expected);
+
+  int failures = 0;
+  auto expect = [&](bool ok, const char* what) {
+    if (!ok) {
+      std::cerr << "mismatch: " << what << std::endl;
+      ++failures;
+    }
+  };
+
+  auto lazyParsed = lazy.parse (text);
+  if (!lazyParsed) {
+    std::cerr << "lazy parse failed" << std::endl;
+    return 1;
+  }
+  auto prgm = lazyParsed.get ();
+  std::vector<Whiley::Function_ptr> funcs;
+  std::size_t params = 0;
+  for (auto f : prgm.getFunctions ()) {
+    funcs.push_back (f.getFunction ());
+    params += funcs.back ()->getParams ().size ();
+  }
+  expect (std::none_of (funcs.begin (),funcs.end (),[](auto& f) {return f->isParsed ();}),"bodies left unparsed");
+
+  {
+    std::vector<std::jthread> workers;
+    for (std::size_t t = 0; t < 8; ++t)
+      workers.emplace_back ([&,t]() {
+	for (std::size_t i = 0; i < funcs.size (); ++i)
+	  funcs[(i*(t+1)+t) % funcs.size ()]->getStmt ();
+      });
+  }
+  expect (std::all_of (funcs.begin (),funcs.end (),[](auto& f) {return f->isParsed ();}),"bodies parsed");
+  expect (WhileyTest::dump (prgm) == expectedDump,"program");
+
+  auto unparsed = lazy.parse (text).get ();
+  expect (check (unparsed) == expectedCheck,"parallel check");
+  expect (WhileyTest::dump (unparsed) == checkedDump,"program after check");
+
+  std::cout << funcs.size () << " functions, " << params << " parameters" << std::endl;
+  return failures ? 1 : 0;
+}
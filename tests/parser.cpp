@@ -3,9 +3,12 @@
 #include "whiley/typechecker.hpp"
 
 #include <iostream>
+#include <string_view>
 
-int main () {
+int main (int argc, char** argv) {
   Whiley::WParser parser;
+  if (argc > 1 && std::string_view {argv[1]} == "--rd")
+    parser.useRecursiveDescent ();
   if (auto parseres = parser.parse (std::cin)) {
     auto prgm = parseres.get();
   
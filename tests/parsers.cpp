@@ -0,0 +1,132 @@
+#include "whiley/parser.hpp"
+
+#include "common.hpp"
+#include "../bench/generate.hpp"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Parses generated programs, and mutations of them, with both the Bison
+ * and the recursive-descent parser. Whether the parse succeeds, the
+ * messages and, for a parsed program, its printed form, flat form,
+ * locations and line table must be the same. Mutations delete, repeat
+ * and insert bytes and tokens, so most of them are syntax errors.
+ *
+ *   whiley_tparsers [mutations [seed]]
+ */
+
+namespace {
+  /* Every statement, expression and literal form */
+  const std::string constructs =
+    "si64 x;\n"
+    "ptr p;\n"
+    "ui8 c;\n"
+    "const k = 0x1F + 0b101 - 007;\n"
+    "fn g (si64 a, ui8 b) -> si64 {\n"
+    "  si64 r;\n"
+    "  r = a << 2 % 3 ^ 1 | 4 & 5;\n"
+    "  while (r >= 0) { r = r - 1; }\n"
+    "  for (r = 0; r < 3; ++r) { skip; }\n"
+    "  return r;\n"
+    "}\n"
+    "c = 'a';\n"
+    "p = alloc (8 as ui64);\n"
+    "# p = x;\n"
+    "x = $ p as si64 $ + (c as si64) * -12 / k;\n"
+    "if (x == ??si64) { assert x > 2; } else { assume x != 4; }\n"
+    "choose {\n"
+    "  :: { skip; }\n"
+    "  :: { if (x <= 3) { x++; } }\n"
+    "}\n"
+    "g (x, c);\n"
+    "x = g[x, c];\n"
+    "free p;\n";
+
+  const char* fragments[] = {";","{","}","(",")","[","]",",","::","->","=","==","<","<<","$","#","?","??",
+			     "as","fn","if","else","while","for","++","choose","skip","return","const","alloc","free",
+			     "x","0","0x","'","si64","ptr"," ","\n","\t","@"};
+
+  std::string run (bool recursiveDescent, const std::string& source) {
+    Whiley::WParser parser;
+    parser.useRecursiveDescent (recursiveDescent);
+    WhileyTest::Collect messages;
+    std::stringstream out;
+    try {
+      auto res = parser.parse (std::span<const char> (source.data (),source.size ()),messages);
+      out << (res ? "parsed\n" : "failed\n");
+      if (res)
+	out << WhileyTest::dump (res.get ());
+    }
+    catch (const std::exception& e) {
+      out << "threw " << e.what () << "\n";
+    }
+    return out.str () + messages.text;
+  }
+
+  std::string mutate (std::string s, std::mt19937_64& rng) {
+    auto at = [&](std::size_t n) {return std::uniform_int_distribution<std::size_t> {0,n} (rng);};
+    for (auto edits = 1+at (2); edits--; ) {
+      auto pos = at (s.size ());
+      switch (at (3)) {
+      case 0:
+	s.erase (pos,1+at (7));
+	break;
+      case 1: {
+	auto len = at (std::min<std::size_t> (s.size ()-pos,24));
+	s.insert (pos,s.substr (pos,len));
+	break;
+      }
+      case 2:
+	if (pos < s.size ())
+	  s[pos] = static_cast<char> (at (127));
+	break;
+      default:
+	s.insert (pos,fragments[at (std::size (fragments)-1)]);
+	break;
+      }
+    }
+    return s;
+  }
+}
+
+int main (int argc, char** argv) {
+  std::size_t mutations = argc > 1 ? std::strtoull (argv[1],nullptr,10) : 4000;
+  std::mt19937_64 rng {argc > 2 ? std::strtoull (argv[2],nullptr,10) : 13};
+
+  std::vector<std::string> seeds {constructs};
+  for (auto shape : WhileyBench::shapes)
+    for (std::size_t n : {1,3,8})
+      seeds.push_back (WhileyBench::generate (shape,n));
+
+  int failures = 0;
+  std::size_t parsed = 0;
+  auto compare = [&](const std::string& source) {
+    auto bison = run (false,source);
+    auto rd = run (true,source);
+    parsed += bison.starts_with ("parsed");
+    if (bison != rd) {
+      std::cerr << "parsers differ on:\n" << source << "\n-- bison --\n" << bison << "\n-- recursive descent --\n" << rd << std::endl;
+      ++failures;
+    }
+    return bison;
+  };
+
+  // The seeds themselves must parse, or the mutations would only test error paths
+  for (auto& s : seeds)
+    if (!compare (s).starts_with ("parsed")) {
+      std::cerr << "seed does not parse:\n" << s << std::endl;
+      ++failures;
+    }
+  for (std::size_t i = 0; i < mutations && failures < 10; ++i)
+    compare (mutate (seeds[i % seeds.size ()],rng));
+
+  std::cout << seeds.size ()+mutations << " inputs, " << parsed << " parsed" << std::endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/compiler.hpp"
+#include "whiley/interpreter.hpp"
+#include "whiley/vm.hpp"
+
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Runs a type checked program from stdin on the AST interpreter and on
+ * the bytecode VM, under each dispatch, from the same random globals and
+ * with the same choices, and checks they stop the same way with the same
+ * globals.
+ * Runs that either side cuts short for taking too many steps are not
+ * compared. A built-in program goes first, whose function reads a local
+ * before writing it, so the local has to be zeroed on every call.
+ *
+ *   whiley_tvm [runs] < program.w
+ */
+
+namespace {
+  const std::string stale =
+    "si64 x;\n"
+    "fn f (si64 a) -> si64 {\n"
+    "  si64 r;\n"
+    "  r = r + a;\n"
+    "  return r;\n"
+    "}\n"
+    "x = f[1];\n"
+    "x = f[x];\n";
+
+  /* Failures comparing the runs of source; 1 if it does not parse */
+  int compare (const std::string& source, std::size_t runs) {
+    Whiley::WParser parser;
+    auto parsed = parser.parse (std::span<const char> (source.data (),source.size ()));
+    if (!parsed)
+      return 1;
+    auto prgm = parsed.get ();
+    Whiley::BufferMessageSystem discard;
+    if (!Whiley::TypeChecker {discard}.CheckProgram (prgm)) {
+      std::cout << "ill-typed" << std::endl;
+      return 0;
+    }
+    auto cfa = Whiley::Compiler{}.Compile (prgm);
+    auto bc = Whiley::VM::assemble (cfa);
+
+    Whiley::Interpreter interpreter (prgm);
+    interpreter.setStepLimit (10000);
+    std::pair<Whiley::VM::Dispatch,const char*> dispatches[] = {{Whiley::VM::Dispatch::Switch,"switch"},{Whiley::VM::Dispatch::Threaded,"threaded"}};
+    std::vector<Whiley::VM::Machine> machines (std::size (dispatches),Whiley::VM::Machine (bc));
+    for (std::size_t m = 0; m < machines.size (); ++m) {
+      machines[m].setDispatch (dispatches[m].first);
+      machines[m].setStepLimit (10000);
+    }
+
+    int failures = 0;
+    std::map<Whiley::Outcome,std::size_t> outcomes;
+    for (std::size_t run = 0; run < runs; ++run) {
+      Whiley::RandomChoices globals (run), left (~run);
+      interpreter.reset ();
+      for (auto& machine : machines)
+	machine.reset ();
+      for (Whiley::IR::reg_t r = 0; r < cfa.programRegisters (); ++r)
+	if (auto& s = cfa.registerSymbol (r)) {
+	  auto v = globals.value (cfa.registerType (r));
+	  interpreter.set (*s,v);
+	  for (auto& machine : machines)
+	    machine.set (r,v);
+	}
+
+      auto expected = interpreter.run (left);
+      bool counted = false;
+      for (std::size_t m = 0; m < machines.size (); ++m) {
+	auto& machine = machines[m];
+	auto vm = dispatches[m].second;
+	Whiley::RandomChoices right (~run);
+	auto actual = machine.run (right);
+	if (expected.outcome == Whiley::Outcome::OutOfSteps || actual.outcome == Whiley::Outcome::OutOfSteps) {
+	  if (!std::exchange (counted,true))
+	    ++outcomes[Whiley::Outcome::OutOfSteps];
+	  continue;
+	}
+	if (!std::exchange (counted,true))
+	  ++outcomes[expected.outcome];
+	if (expected.outcome != actual.outcome) {
+	  std::cerr << "run " << run << ": interpreter " << expected.outcome << ", " << vm << " " << actual.outcome << std::endl;
+	  ++failures;
+	  continue;
+	}
+	if (expected.outcome == Whiley::Outcome::AssertionFailed
+	    && (expected.where.begin != actual.where.begin || expected.where.end != actual.where.end)) {
+	  std::cerr << "run " << run << ": assertion at " << expected.where << ", " << vm << " at " << actual.where << std::endl;
+	  ++failures;
+	}
+	for (Whiley::IR::reg_t r = 0; r < cfa.programRegisters (); ++r)
+	  if (auto& s = cfa.registerSymbol (r); s && interpreter.get (*s) != machine.get (r)) {
+	    std::cerr << "run " << run << ": " << s->getFullName () << " is " << interpreter.get (*s) << ", " << vm << " " << machine.get (r) << std::endl;
+	    ++failures;
+	  }
+      }
+    }
+
+    for (auto [o,n] : outcomes)
+      std::cout << o << ": " << n << std::endl;
+    return failures;
+  }
+}
+
+int main (int argc, char** argv) {
+  std::size_t runs = argc > 1 ? std::stoul (argv[1]) : 32;
+  std::string input {std::istreambuf_iterator<char> (std::cin),std::istreambuf_iterator<char> ()};
+  int failures = 0;
+  for (auto& source : {stale,input})
+    failures += compare (source,runs);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+#include "whiley/parser.hpp"
+#include "whiley/typechecker.hpp"
+#include "whiley/diagnostics.hpp"
+#include "whiley/cache.hpp"
+#include "whiley/source.hpp"
+#include "whiley/threadpool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <sstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ * Parses and type checks many Whiley programs in one process:
+ *
+ *   whileyc [-j N | --jobs N] [--max-errors N] [--cache DIR] [--rd] [-q] path...
+ *
+ * Directories are searched recursively for .w and .whiley files. Files are
+ * checked concurrently, each with its own WParser and TypeChecker, and
+ * reported in the order given. Checking a file stops after --max-errors
+ * messages. With --cache, programs that checked before are loaded from
+ * their image in DIR instead. The exit status is 1 if any file failed.
+ */
+
+namespace {
+  enum class Status {
+    Ok,
+    SyntaxError,
+    TypeError,
+    Error
+  };
+
+  const char* statusName (Status s) {
+    static const char* names[] = {"ok","syntax error","type error","error"};
+    return names[static_cast<int> (s)];
+  }
+
+  struct Result {
+    Status status{Status::Ok};
+    std::size_t bytes{0};
+    double ms{0};
+    bool cached{false};
+    /* Diagnostics of this file only */
+    std::string messages;
+  };
+
+  struct Options {
+    std::size_t jobs = std::max (1u,std::thread::hardware_concurrency ());
+    std::size_t maxErrors = Whiley::DiagnosticBuffer::unlimited;
+    bool recursiveDescent = false;
+    bool quiet = false;
+    std::optional<std::filesystem::path> cacheDir;
+    std::vector<std::filesystem::path> files;
+  };
+
+  bool isSource (const std::filesystem::path& p) {
+    return p.extension () == ".w" || p.extension () == ".whiley";
+  }
+
+  void collect (const std::filesystem::path& p, std::vector<std::filesystem::path>& files) {
+    if (!std::filesystem::is_directory (p)) {
+      files.push_back (p);
+      return;
+    }
+    std::vector<std::filesystem::path> found;
+    for (auto& entry : std::filesystem::recursive_directory_iterator (p))
+      if (entry.is_regular_file () && isSource (entry.path ()))
+	found.push_back (entry.path ());
+    // Directory order is unspecified; sort for stable output
+    std::sort (found.begin (),found.end ());
+    files.insert (files.end (),found.begin (),found.end ());
+  }
+
+  void check (const Options& opts, Whiley::CompilationCache* cache, const std::filesystem::path& file, Result& res) {
+    auto start = std::chrono::steady_clock::now ();
+    Whiley::DiagnosticBuffer messages {opts.maxErrors};
+    // Records refer into the program, so it must outlive their formatting
+    std::optional<Whiley::Program> prgm;
+    try {
+      auto source = Whiley::SourceBuffer::fromFile (file.string ());
+      res.bytes = source.length ();
+      Whiley::WParser parser {messages};
+      parser.useRecursiveDescent (opts.recursiveDescent);
+      Whiley::CacheKey key;
+      if (cache) {
+	key = cache->key (source.view (),parser.getFlags ());
+	res.cached = (prgm = cache->load (key)).has_value ();
+      }
+      if (!res.cached) {
+	auto parsed = parser.parse (source.view ());
+	if (!parsed)
+	  res.status = Status::SyntaxError;
+	else {
+	  prgm.emplace (parsed.get ());
+	  if (!Whiley::TypeChecker {messages}.CheckProgram (*prgm))
+	    res.status = Status::TypeError;
+	  else if (cache) {
+	    try {
+	      cache->store (key,*prgm);
+	    }
+	    catch (std::exception&) {
+	      // The file checked; failing to cache it only costs time next run
+	    }
+	  }
+	}
+      }
+    }
+    catch (std::exception& e) {
+      res.status = Status::Error;
+      messages << Whiley::StringMessage {e.what ()};
+    }
+    std::stringstream text;
+    messages.flush (text);
+    res.messages = text.str ();
+    res.ms = std::chrono::duration<double,std::milli> (std::chrono::steady_clock::now ()-start).count ();
+  }
+
+  int usage () {
+    std::cerr << "usage: whileyc [-j N | --jobs N] [--max-errors N] [--cache DIR] [--rd] [-q] path..." << std::endl;
+    return 2;
+  }
+}
+
+int main (int argc, char** argv) {
+  Options opts;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg {argv[i]};
+      if (arg == "-j" || arg == "--jobs") {
+	if (++i == argc)
+	  return usage ();
+	opts.jobs = std::max (1l,std::strtol (argv[i],nullptr,10));
+      }
+      else if (arg.starts_with ("--jobs="))
+	opts.jobs = std::max (1l,std::strtol (argv[i]+7,nullptr,10));
+      else if (arg == "--max-errors") {
+	if (++i == argc)
+	  return usage ();
+	opts.maxErrors = std::strtoul (argv[i],nullptr,10);
+      }
+      else if (arg == "--cache") {
+	if (++i == argc)
+	  return usage ();
+	opts.cacheDir = argv[i];
+      }
+      else if (arg == "--rd")
+	opts.recursiveDescent = true;
+      else if (arg == "-q" || arg == "--quiet")
+	opts.quiet = true;
+      else if (arg.starts_with ("-"))
+	return usage ();
+      else
+	collect (argv[i],opts.files);
+    }
+  }
+  catch (std::filesystem::filesystem_error& e) {
+    std::cerr << e.what () << std::endl;
+    return 2;
+  }
+  if (opts.files.empty ())
+    return usage ();
+
+  std::optional<Whiley::CompilationCache> cache;
+  try {
+    if (opts.cacheDir)
+      cache.emplace (*opts.cacheDir);
+  }
+  catch (std::filesystem::filesystem_error& e) {
+    std::cerr << e.what () << std::endl;
+    return 2;
+  }
+
+  std::vector<Result> results (opts.files.size ());
+  auto start = std::chrono::steady_clock::now ();
+  Whiley::ThreadPool pool {opts.jobs};
+  pool.parallelFor (opts.files.size (),[&](std::size_t i) {
+    check (opts,cache ? &*cache : nullptr,opts.files[i],results[i]);
+  });
+  double wall = std::chrono::duration<double,std::milli> (std::chrono::steady_clock::now ()-start).count ();
+
+  std::size_t failed = 0, bytes = 0;
+  for (std::size_t i = 0; i < results.size (); ++i) {
+    auto& res = results[i];
+    bytes += res.bytes;
+    if (res.status != Status::Ok)
+      ++failed;
+    if (res.status != Status::Ok || !opts.quiet) {
+      std::cout << opts.files[i].string () << ": " << statusName (res.status) << " (" << res.ms << " ms"
+		<< (res.cached ? ", cached" : "") << ")\n"
+		<< res.messages;
+    }
+  }
+  std::cout << opts.files.size () << " files, " << failed << " failed, "
+	    << bytes << " bytes in " << wall << " ms on " << pool.size () << " threads ("
+	    << opts.files.size () * 1e3 / wall << " files/s, "
+	    << bytes / wall / 1e3 << " MB/s)" << std::endl;
+  if (cache) {
+    auto c = cache->counters ();
+    std::cout << "cache: " << c.hits << " hits, " << c.misses << " misses, " << c.stores << " stored, "
+	      << c.evictions << " evicted, " << c.entries << " entries, " << c.bytes << " bytes" << std::endl;
+  }
+  return failed ? 1 : 0;
+}